@@ -5,6 +5,7 @@
 
 char *plugin_directories[PLUGINSD_MAX_DIRECTORIES] = { NULL };
 struct plugind *pluginsd_root = NULL;
+netdata_mutex_t pluginsd_root_mutex = NETDATA_MUTEX_INITIALIZER;
 
 inline int pluginsd_space(char c) {
     switch(c) {
@@ -375,9 +376,11 @@ void *pluginsd_main(void *ptr)
                         config_get(cd->id, "command options", def));
 
                     // link it
+                    netdata_mutex_lock(&pluginsd_root_mutex);
                     if (likely(pluginsd_root))
                         cd->next = pluginsd_root;
                     pluginsd_root = cd;
+                    netdata_mutex_unlock(&pluginsd_root_mutex);
 
                     // it is not currently running
                     cd->obsolete = 1;
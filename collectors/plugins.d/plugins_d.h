@@ -66,11 +66,20 @@ struct plugind {
 
     time_t started_t;
     uint32_t version;
+
+    HISTOGRAM update_latency;           // the time between BEGIN and END of chart updates
+    HISTOGRAM done_latency;             // the time spent processing END (rrdset_done())
+    HISTOGRAM update_latency_charted;   // the last snapshots of the above, kept by the netdata charts
+    HISTOGRAM done_latency_charted;
+
     struct plugind *next;
 };
 
 extern struct plugind *pluginsd_root;
 
+// taken by the threads other than pluginsd_main walking pluginsd_root
+extern netdata_mutex_t pluginsd_root_mutex;
+
 extern void *pluginsd_main(void *ptr);
 
 extern size_t pluginsd_process(RRDHOST *host, struct plugind *cd, FILE *fp, int trust_durations);
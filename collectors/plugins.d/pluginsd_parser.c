@@ -233,6 +233,7 @@ PARSER_RC pluginsd_begin(char **words, void *user, PLUGINSD_ACTION  *plugins_act
         goto disable;
     }
     ((PARSER_USER_OBJECT *)user)->st = st;
+    ((PARSER_USER_OBJECT *)user)->begin_ut = now_monotonic_usec();
 
     usec_t microseconds = 0;
     if (microseconds_txt && *microseconds_txt)
@@ -265,10 +266,20 @@ PARSER_RC pluginsd_end(char **words, void *user, PLUGINSD_ACTION  *plugins_actio
 
     ((PARSER_USER_OBJECT *) user)->st = NULL;
     ((PARSER_USER_OBJECT *) user)->count++;
+
+    struct plugind *cd = ((PARSER_USER_OBJECT *) user)->cd;
+    usec_t end_ut = now_monotonic_usec();
+    if (likely(cd))
+        histogram_add(&cd->update_latency, end_ut - ((PARSER_USER_OBJECT *) user)->begin_ut);
+
+    PARSER_RC rc = PARSER_RC_OK;
     if (plugins_action->end_action) {
-        return plugins_action->end_action(user, st);
+        rc = plugins_action->end_action(user, st);
+
+        if (likely(cd))
+            histogram_add(&cd->done_latency, now_monotonic_usec() - end_ut);
     }
-    return PARSER_RC_OK;
+    return rc;
 }
 
 PARSER_RC pluginsd_chart(char **words, void *user, PLUGINSD_ACTION  *plugins_action)
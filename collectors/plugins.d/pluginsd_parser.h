@@ -15,6 +15,7 @@ typedef struct parser_user_object {
     int trust_durations;
     struct label *new_labels;
     size_t count;
+    usec_t begin_ut;  // when the last BEGIN was received
     int enabled;
     uint8_t st_exists;
     uint8_t host_exists;
@@ -379,6 +379,10 @@ static inline STATSD_METRIC *statsd_metric_index_find(STATSD_INDEX *index, const
     return (STATSD_METRIC *)STATSD_AVL_SEARCH(&index->index, (avl_t *)&tmp);
 }
 
+static inline size_t statsd_metric_memory_size(STATSD_METRIC *m) {
+    return sizeof(STATSD_METRIC) + strlen(m->name) + 1 + (m->histogram.ext ? sizeof(STATSD_METRIC_HISTOGRAM_EXTENSIONS) : 0);
+}
+
 static inline STATSD_METRIC *statsd_find_or_add_metric(STATSD_INDEX *index, const char *name, STATSD_METRIC_TYPE type) {
     debug(D_STATSD, "searching for metric '%s' under '%s'", name, index->name);
 
@@ -406,6 +410,8 @@ static inline STATSD_METRIC *statsd_find_or_add_metric(STATSD_INDEX *index, cons
             m = n;
         }
         else {
+            memory_accounting_alloc(MEMORY_ACCOUNTING_STATSD, statsd_metric_memory_size(m));
+
             STATSD_FIRST_PTR_MUTEX_LOCK(index);
             index->metrics++;
             m->next = index->first;
@@ -552,6 +558,7 @@ static inline void statsd_process_histogram_or_timer(STATSD_METRIC *m, const cha
                 netdata_mutex_lock(&m->histogram.ext->mutex);
                 m->histogram.ext->size += statsd.histogram_increase_step;
                 m->histogram.ext->values = reallocz(m->histogram.ext->values, sizeof(LONG_DOUBLE) * m->histogram.ext->size);
+                memory_accounting_resize(MEMORY_ACCOUNTING_STATSD, sizeof(LONG_DOUBLE) * statsd.histogram_increase_step);
                 netdata_mutex_unlock(&m->histogram.ext->mutex);
             }
 
@@ -790,6 +797,7 @@ static void *statsd_add_callback(POLLINFO *pi, short int *events, void *data) {
     struct statsd_tcp *t = (struct statsd_tcp *)callocz(sizeof(struct statsd_tcp) + STATSD_TCP_BUFFER_SIZE, 1);
     t->type = STATSD_SOCKET_DATA_TYPE_TCP;
     t->size = STATSD_TCP_BUFFER_SIZE - 1;
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STATSD, sizeof(struct statsd_tcp) + STATSD_TCP_BUFFER_SIZE);
     statsd.tcp_socket_connects++;
     statsd.tcp_socket_connected++;
 
@@ -813,6 +821,7 @@ static void statsd_del_callback(POLLINFO *pi) {
         else
             error("STATSD: internal error: received socket data type is %d, but expected %d", (int)t->type, (int)STATSD_SOCKET_DATA_TYPE_TCP);
 
+        memory_accounting_free(MEMORY_ACCOUNTING_STATSD, sizeof(struct statsd_tcp) + STATSD_TCP_BUFFER_SIZE);
         freez(t);
     }
 }
@@ -967,12 +976,23 @@ static void statsd_timer_callback(void *timer_data) {
 // --------------------------------------------------------------------------------------------------------------------
 // statsd child thread to collect metrics from network
 
+static inline size_t statsd_udp_memory_size(struct statsd_udp *d) {
+#ifdef HAVE_RECVMMSG
+    return sizeof(struct statsd_udp) + d->size * (sizeof(struct iovec) + sizeof(struct mmsghdr) + STATSD_UDP_BUFFER_SIZE);
+#else
+    (void)d;
+    return sizeof(struct statsd_udp);
+#endif
+}
+
 void statsd_collector_thread_cleanup(void *data) {
     struct statsd_udp *d = data;
     *d->running = 0;
 
     info("cleaning up...");
 
+    memory_accounting_free(MEMORY_ACCOUNTING_STATSD, statsd_udp_memory_size(d));
+
 #ifdef HAVE_RECVMMSG
     size_t i;
     for (i = 0; i < d->size; i++)
@@ -1011,6 +1031,8 @@ void *statsd_collector_thread(void *ptr) {
     }
 #endif
 
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STATSD, statsd_udp_memory_size(d));
+
     poll_events(&statsd.sockets
             , statsd_add_callback
             , statsd_del_callback
@@ -51,7 +51,15 @@ static inline void global_statistics_unlock(void) {
 #endif
 
 
+static __thread uint64_t rrdr_thread_db_points_read = 0;
+
+uint64_t rrdr_query_thread_points_read(void) {
+    return rrdr_thread_db_points_read;
+}
+
 void rrdr_query_completed(uint64_t db_points_read, uint64_t result_points_generated) {
+    rrdr_thread_db_points_read += db_points_read;
+
 #if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
     __atomic_fetch_add(&global_statistics.rrdr_queries_made, 1, __ATOMIC_SEQ_CST);
     __atomic_fetch_add(&global_statistics.rrdr_db_points_read, db_points_read, __ATOMIC_SEQ_CST);
@@ -124,6 +132,23 @@ uint64_t web_client_connected(void) {
     return id;
 }
 
+// the id of a web client that is not a connection of its own
+uint64_t web_client_request_id(void) {
+#if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
+    return __atomic_fetch_add(&global_statistics.web_client_count, 1, __ATOMIC_SEQ_CST);
+#else
+    if (web_server_is_multithreaded)
+        global_statistics_lock();
+
+    uint64_t id = global_statistics.web_client_count++;
+
+    if (web_server_is_multithreaded)
+        global_statistics_unlock();
+
+    return id;
+#endif
+}
+
 void web_client_disconnected(void) {
 #if defined(HAVE_C___ATOMIC) && !defined(NETDATA_NO_ATOMIC_INSTRUCTIONS)
     __atomic_fetch_sub(&global_statistics.connected_clients, 1, __ATOMIC_SEQ_CST);
@@ -172,6 +197,463 @@ static inline void global_statistics_copy(struct global_statistics *gs, uint8_t
 #endif
 }
 
+struct latency_chart {
+    const char *id;
+    const char *title;
+    long priority;
+
+    HISTOGRAM *histogram;
+    HISTOGRAM last;
+
+    RRDSET *st;
+    RRDDIM *rd_p50;
+    RRDDIM *rd_p95;
+    RRDDIM *rd_p99;
+};
+
+static void latency_chart_update(struct latency_chart *lc) {
+    HISTOGRAM interval;
+
+    if (unlikely(!lc->st)) {
+        lc->st = rrdset_create_localhost(
+                "netdata"
+                , lc->id
+                , NULL
+                , "collection"
+                , NULL
+                , lc->title
+                , "milliseconds"
+                , "netdata"
+                , "stats"
+                , lc->priority
+                , localhost->rrd_update_every
+                , RRDSET_TYPE_LINE
+        );
+
+        lc->rd_p50 = rrddim_add(lc->st, "p50", NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+        lc->rd_p95 = rrddim_add(lc->st, "p95", NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+        lc->rd_p99 = rrddim_add(lc->st, "p99", NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+    }
+    else
+        rrdset_next(lc->st);
+
+    histogram_interval(lc->histogram, &lc->last, &interval);
+
+    rrddim_set_by_pointer(lc->st, lc->rd_p50, (collected_number)histogram_percentile(&interval, 50.0));
+    rrddim_set_by_pointer(lc->st, lc->rd_p95, (collected_number)histogram_percentile(&interval, 95.0));
+    rrddim_set_by_pointer(lc->st, lc->rd_p99, (collected_number)histogram_percentile(&interval, 99.0));
+    rrdset_done(lc->st);
+}
+
+static void plugins_latency_chart_update(RRDSET **st, const char *id, const char *title, long priority, int done) {
+    struct plugind *cd;
+    HISTOGRAM interval;
+
+    if (unlikely(!*st)) {
+        *st = rrdset_create_localhost(
+                "netdata"
+                , id
+                , NULL
+                , "collection"
+                , NULL
+                , title
+                , "milliseconds"
+                , "netdata"
+                , "stats"
+                , priority
+                , localhost->rrd_update_every
+                , RRDSET_TYPE_LINE
+        );
+    }
+    else
+        rrdset_next(*st);
+
+    // plugind structures are never freed, only marked obsolete and reused
+    netdata_mutex_lock(&pluginsd_root_mutex);
+    for (cd = pluginsd_root; cd; cd = cd->next) {
+        if (!cd->enabled || cd->obsolete)
+            continue;
+
+        RRDDIM *rd = rrddim_find(*st, cd->id);
+        if (unlikely(!rd))
+            rd = rrddim_add(*st, cd->id, NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+
+        if (done)
+            histogram_interval(&cd->done_latency, &cd->done_latency_charted, &interval);
+        else
+            histogram_interval(&cd->update_latency, &cd->update_latency_charted, &interval);
+
+        rrddim_set_by_pointer(*st, rd, (collected_number)histogram_percentile(&interval, 95.0));
+    }
+    netdata_mutex_unlock(&pluginsd_root_mutex);
+
+    rrdset_done(*st);
+}
+
+static void collection_latency_charts(void) {
+    static RRDSET_LATENCY all;
+    static struct latency_chart charts[] = {
+            { .id = "rrdset_done_latency", .title = "Netdata charts processing time per update (all charts)", .priority = 130520, .histogram = &all.done },
+            { .id = "rrdset_store_latency", .title = "Netdata charts time spent storing metrics per update (all charts)", .priority = 130521, .histogram = &all.store },
+            { .id = "rrdset_collection_jitter", .title = "Netdata charts collection interval deviation from update every (all charts)", .priority = 130522, .histogram = &all.jitter },
+            { .id = NULL }
+    };
+    static RRDSET *st_plugins_update = NULL, *st_plugins_done = NULL;
+    struct latency_chart *lc;
+
+    if (rrdset_latency_collection) {
+        rrdset_latency_all_get(&all);
+        for (lc = charts; lc->id; lc++)
+            latency_chart_update(lc);
+    }
+
+    plugins_latency_chart_update(&st_plugins_update, "plugins_update_latency", "Netdata external plugins time from BEGIN to END per chart update (95th percentile)", 130523, 0);
+    plugins_latency_chart_update(&st_plugins_done, "plugins_done_latency", "Netdata external plugins chart processing time per update (95th percentile)", 130524, 1);
+}
+
+#ifdef ENABLE_COMPRESSION
+static void streaming_compression_dimensions(RRDSET *st_ratio, RRDSET *st_cpu, const char *id, size_t plain_bytes, size_t wire_bytes, usec_t usec) {
+    RRDDIM *rd = rrddim_find(st_ratio, id);
+    if (unlikely(!rd))
+        rd = rrddim_add(st_ratio, id, NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+
+    // plain text bytes per byte on the wire, since the connection was established
+    if (wire_bytes)
+        rrddim_set_by_pointer(st_ratio, rd, (collected_number)(plain_bytes * 1000 / wire_bytes));
+
+    rd = rrddim_find(st_cpu, id);
+    if (unlikely(!rd))
+        rd = rrddim_add(st_cpu, id, NULL, 1, 1000, RRD_ALGORITHM_INCREMENTAL);
+
+    rrddim_set_by_pointer(st_cpu, rd, (collected_number)usec);
+}
+
+static void streaming_compression_charts(void) {
+    static RRDSET *st_ratio = NULL, *st_cpu = NULL;
+    char id[RRD_ID_LENGTH_MAX + 1];
+    RRDHOST *host;
+
+    if (unlikely(!st_ratio)) {
+        st_ratio = rrdset_create_localhost(
+                "netdata"
+                , "streaming_compression_ratio"
+                , NULL
+                , "streaming"
+                , NULL
+                , "Netdata streaming compression ratio per connection"
+                , "ratio"
+                , "netdata"
+                , "stats"
+                , 130550
+                , localhost->rrd_update_every
+                , RRDSET_TYPE_LINE
+        );
+
+        st_cpu = rrdset_create_localhost(
+                "netdata"
+                , "streaming_compression_cpu"
+                , NULL
+                , "streaming"
+                , NULL
+                , "Netdata streaming compression CPU time per connection"
+                , "milliseconds/s"
+                , "netdata"
+                , "stats"
+                , 130551
+                , localhost->rrd_update_every
+                , RRDSET_TYPE_STACKED
+        );
+    }
+    else {
+        rrdset_next(st_ratio);
+        rrdset_next(st_cpu);
+    }
+
+    rrd_rdlock();
+    rrdhost_foreach_read(host) {
+        if (host->sender) {
+            netdata_mutex_lock(&host->sender->mutex);
+            struct compressor_state c = host->sender->compressor;
+            netdata_mutex_unlock(&host->sender->mutex);
+
+            if (c.active && host->rrdpush_sender_connected) {
+                snprintfz(id, RRD_ID_LENGTH_MAX, "%s_sent", host->hostname);
+                streaming_compression_dimensions(st_ratio, st_cpu, id, c.bytes_in, c.bytes_out, c.usec);
+            }
+        }
+
+        netdata_mutex_lock(&host->receiver_lock);
+        if (host->receiver && host->receiver->decompressor.stream) {
+            struct decompressor_state *d = &host->receiver->decompressor;
+            snprintfz(id, RRD_ID_LENGTH_MAX, "%s_received", host->hostname);
+            streaming_compression_dimensions(st_ratio, st_cpu, id, d->bytes_out, d->bytes_in, d->usec);
+        }
+        netdata_mutex_unlock(&host->receiver_lock);
+    }
+    rrd_unlock();
+
+    rrdset_done(st_ratio);
+    rrdset_done(st_cpu);
+}
+#endif
+
+static RRDSET *streaming_receiver_chart(const char *id, const char *title, const char *units, long priority) {
+    return rrdset_create_localhost(
+            "netdata"
+            , id
+            , NULL
+            , "streaming"
+            , NULL
+            , title
+            , units
+            , "netdata"
+            , "stats"
+            , priority
+            , localhost->rrd_update_every
+            , RRDSET_TYPE_STACKED
+    );
+}
+
+// a dimension per child, by its machine guid, since many children may have the same hostname
+static void streaming_receiver_dimension(RRDSET *st, RRDHOST *host, collected_number value, collected_number divisor) {
+    RRDDIM *rd = rrddim_find(st, host->machine_guid);
+    if (unlikely(!rd))
+        rd = rrddim_add(st, host->machine_guid, host->hostname, 1, divisor, RRD_ALGORITHM_INCREMENTAL);
+    else {
+        if (unlikely(rrddim_flag_check(rd, RRDDIM_FLAG_OBSOLETE)))
+            rrddim_isnot_obsolete(st, rd);
+
+        if (unlikely(strcmp(rd->name, host->hostname)))
+            rrddim_set_name(st, rd, host->hostname);
+    }
+
+    rrddim_set_by_pointer(st, rd, value);
+}
+
+// the children that are not connected any more, their dimensions are removed after [global].cleanup obsolete charts after seconds
+static void streaming_receiver_obsolete(RRDSET *st) {
+    RRDDIM *rd;
+
+    rrdset_rdlock(st);
+    rrddim_foreach_read(rd, st) {
+        if (!rd->updated && !rrddim_flag_check(rd, RRDDIM_FLAG_OBSOLETE) && !rrddim_flag_check(rd, RRDDIM_FLAG_ARCHIVED))
+            rrddim_is_obsolete(st, rd);
+    }
+    rrdset_unlock(st);
+}
+
+// what each child sends and the time it is throttled by its budget, including its previous connections
+static void streaming_receiver_charts(void) {
+    static RRDSET *st_charts = NULL, *st_samples = NULL, *st_bytes = NULL, *st_throttled = NULL;
+    RRDHOST *host;
+    int receivers = 0;
+
+    rrd_rdlock();
+    rrdhost_foreach_read(host) {
+        if (host->receiver) {
+            receivers = 1;
+            break;
+        }
+    }
+    rrd_unlock();
+
+    if (!receivers && !st_charts)
+        return;
+
+    if (unlikely(!st_charts)) {
+        st_charts = streaming_receiver_chart("streaming_receiver_charts_created", "Netdata charts created per child", "charts/s", 130552);
+        st_samples = streaming_receiver_chart("streaming_receiver_samples", "Netdata values received per child", "values/s", 130553);
+        st_bytes = streaming_receiver_chart("streaming_receiver_bytes", "Netdata stream received per child", "KiB/s", 130554);
+        st_throttled = streaming_receiver_chart("streaming_receiver_throttled", "Netdata children throttled by their budget", "milliseconds/s", 130555);
+    }
+    else {
+        rrdset_next(st_charts);
+        rrdset_next(st_samples);
+        rrdset_next(st_bytes);
+        rrdset_next(st_throttled);
+    }
+
+    rrd_rdlock();
+    rrdhost_foreach_read(host) {
+        netdata_mutex_lock(&host->receiver_lock);
+        if (host->receiver) {
+            struct receiver_budget *b = &host->receiver->budget;
+            streaming_receiver_dimension(st_charts, host, (collected_number)(host->receivers_charts_created + b->charts_created), 1);
+            streaming_receiver_dimension(st_samples, host, (collected_number)(host->receivers_samples + b->samples), 1);
+            streaming_receiver_dimension(st_bytes, host, (collected_number)(host->receivers_bytes + b->bytes), 1024);
+            streaming_receiver_dimension(st_throttled, host, (collected_number)(host->receivers_throttled_usec + b->throttled_usec), 1000);
+        }
+        netdata_mutex_unlock(&host->receiver_lock);
+    }
+    rrd_unlock();
+
+    streaming_receiver_obsolete(st_charts);
+    streaming_receiver_obsolete(st_samples);
+    streaming_receiver_obsolete(st_bytes);
+    streaming_receiver_obsolete(st_throttled);
+
+    rrdset_done(st_charts);
+    rrdset_done(st_samples);
+    rrdset_done(st_bytes);
+    rrdset_done(st_throttled);
+}
+
+static RRDSET *web_executor_chart(const char *id, const char *title, const char *units, long priority, RRDSET_TYPE type) {
+    return rrdset_create_localhost(
+            "netdata"
+            , id
+            , NULL
+            , "web"
+            , NULL
+            , title
+            , units
+            , "netdata"
+            , "stats"
+            , priority
+            , localhost->rrd_update_every
+            , type
+    );
+}
+
+static RRDDIM *web_executor_dimension(RRDSET *st, const char *id, collected_number divisor, RRD_ALGORITHM algorithm) {
+    RRDDIM *rd = rrddim_find(st, id);
+    if (unlikely(!rd))
+        rd = rrddim_add(st, id, NULL, 1, divisor, algorithm);
+
+    return rd;
+}
+
+// the queries run by the query executor, the time they wait and the time they run, per endpoint
+static void web_executor_charts(void) {
+    static RRDSET *st_queue = NULL, *st_queries = NULL, *st_wait = NULL, *st_run = NULL;
+    static RRDDIM *rd_queued = NULL, *rd_running = NULL, *rd_rejected = NULL;
+    WEB_EXECUTOR_STATISTICS stats;
+    WEB_EXECUTOR_ENDPOINT *ep;
+    HISTOGRAM interval;
+
+    web_executor_get_statistics(&stats);
+    if (!stats.threads)
+        return;
+
+    if (unlikely(!st_queue)) {
+        st_queue = web_executor_chart("web_executor_queue", "Netdata query executor queue", "queries", 130556, RRDSET_TYPE_LINE);
+        rd_queued = rrddim_add(st_queue, "queued", NULL, 1, 1, RRD_ALGORITHM_ABSOLUTE);
+        rd_running = rrddim_add(st_queue, "running", NULL, 1, 1, RRD_ALGORITHM_ABSOLUTE);
+
+        st_queries = web_executor_chart("web_executor_queries", "Netdata query executor completed queries", "queries/s", 130557, RRDSET_TYPE_STACKED);
+        rd_rejected = rrddim_add(st_queries, "rejected", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+
+        st_wait = web_executor_chart("web_executor_wait", "Netdata query executor time in the queue (95th percentile)", "milliseconds", 130558, RRDSET_TYPE_LINE);
+        st_run = web_executor_chart("web_executor_run", "Netdata query executor time running (95th percentile)", "milliseconds", 130559, RRDSET_TYPE_LINE);
+    }
+    else {
+        rrdset_next(st_queue);
+        rrdset_next(st_queries);
+        rrdset_next(st_wait);
+        rrdset_next(st_run);
+    }
+
+    rrddim_set_by_pointer(st_queue, rd_queued, (collected_number)stats.queued);
+    rrddim_set_by_pointer(st_queue, rd_running, (collected_number)stats.running);
+    rrddim_set_by_pointer(st_queries, rd_rejected, (collected_number)stats.rejected);
+
+    // the endpoints are added at startup and never freed
+    for (ep = web_executor_endpoints(); ep; ep = ep->next) {
+        rrddim_set_by_pointer(st_queries, web_executor_dimension(st_queries, ep->name, 1, RRD_ALGORITHM_INCREMENTAL), (collected_number)ep->completed);
+
+        histogram_interval(&ep->wait, &ep->wait_charted, &interval);
+        rrddim_set_by_pointer(st_wait, web_executor_dimension(st_wait, ep->name, 1000, RRD_ALGORITHM_ABSOLUTE), (collected_number)histogram_percentile(&interval, 95.0));
+
+        histogram_interval(&ep->run, &ep->run_charted, &interval);
+        rrddim_set_by_pointer(st_run, web_executor_dimension(st_run, ep->name, 1000, RRD_ALGORITHM_ABSOLUTE), (collected_number)histogram_percentile(&interval, 95.0));
+    }
+
+    rrdset_done(st_queue);
+    rrdset_done(st_queries);
+    rrdset_done(st_wait);
+    rrdset_done(st_run);
+}
+
+// the buffers given by the web buffers pool, and the memory it retains
+static void web_buffer_pool_charts(void) {
+    static RRDSET *st_buffers = NULL, *st_memory = NULL;
+    static RRDDIM *rd_hits = NULL, *rd_misses = NULL, *rd_returned = NULL, *rd_dropped = NULL, *rd_trimmed = NULL, *rd_bytes = NULL;
+    WEB_BUFFER_POOL_STATISTICS stats;
+
+    web_buffer_pool_get_statistics(&stats);
+
+    if (unlikely(!st_buffers)) {
+        st_buffers = web_executor_chart("web_buffers_pool", "Netdata web buffers pool", "buffers/s", 130560, RRDSET_TYPE_LINE);
+        rd_hits = rrddim_add(st_buffers, "hits", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+        rd_misses = rrddim_add(st_buffers, "misses", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+        rd_returned = rrddim_add(st_buffers, "returned", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+        rd_dropped = rrddim_add(st_buffers, "dropped", NULL, -1, 1, RRD_ALGORITHM_INCREMENTAL);
+        rd_trimmed = rrddim_add(st_buffers, "trimmed", NULL, -1, 1, RRD_ALGORITHM_INCREMENTAL);
+
+        st_memory = web_executor_chart("web_buffers_pool_memory", "Netdata web buffers pool retained memory", "KiB", 130561, RRDSET_TYPE_AREA);
+        rd_bytes = rrddim_add(st_memory, "retained", NULL, 1, 1024, RRD_ALGORITHM_ABSOLUTE);
+    }
+    else {
+        rrdset_next(st_buffers);
+        rrdset_next(st_memory);
+    }
+
+    rrddim_set_by_pointer(st_buffers, rd_hits, (collected_number)stats.hits);
+    rrddim_set_by_pointer(st_buffers, rd_misses, (collected_number)stats.misses);
+    rrddim_set_by_pointer(st_buffers, rd_returned, (collected_number)stats.returned);
+    rrddim_set_by_pointer(st_buffers, rd_dropped, (collected_number)stats.dropped);
+    rrddim_set_by_pointer(st_buffers, rd_trimmed, (collected_number)stats.trimmed);
+    rrddim_set_by_pointer(st_memory, rd_bytes, (collected_number)stats.bytes);
+
+    rrdset_done(st_buffers);
+    rrdset_done(st_memory);
+}
+
+// the requests of every API endpoint, their response time, the size of their responses and the db points they read
+static void web_api_charts(void) {
+    static RRDSET *st_requests = NULL, *st_latency = NULL, *st_bytes = NULL, *st_sent = NULL, *st_points = NULL;
+    WEB_API_ENDPOINT *ep;
+    HISTOGRAM interval;
+
+    if (!web_client_api_v1_endpoints())
+        return;
+
+    if (unlikely(!st_requests)) {
+        st_requests = web_executor_chart("web_api_requests", "Netdata API requests", "requests/s", 130562, RRDSET_TYPE_STACKED);
+        st_latency = web_executor_chart("web_api_latency", "Netdata API response time (95th percentile)", "milliseconds", 130563, RRDSET_TYPE_LINE);
+        st_bytes = web_executor_chart("web_api_bytes", "Netdata API responses size", "KiB/s", 130564, RRDSET_TYPE_STACKED);
+        st_sent = web_executor_chart("web_api_sent", "Netdata API responses size after compression", "KiB/s", 130565, RRDSET_TYPE_STACKED);
+        st_points = web_executor_chart("web_api_points", "Netdata API db points read", "points/s", 130566, RRDSET_TYPE_STACKED);
+    }
+    else {
+        rrdset_next(st_requests);
+        rrdset_next(st_latency);
+        rrdset_next(st_bytes);
+        rrdset_next(st_sent);
+        rrdset_next(st_points);
+    }
+
+    // the endpoints are charted after their first request
+    for (ep = web_client_api_v1_endpoints(); ep; ep = ep->next) {
+        if (!__atomic_load_n(&ep->latency.count, __ATOMIC_RELAXED))
+            continue;
+
+        histogram_interval(&ep->latency, &ep->latency_charted, &interval);
+
+        rrddim_set_by_pointer(st_requests, web_executor_dimension(st_requests, ep->name, 1, RRD_ALGORITHM_INCREMENTAL), (collected_number)ep->latency_charted.count);
+        rrddim_set_by_pointer(st_latency, web_executor_dimension(st_latency, ep->name, 1000, RRD_ALGORITHM_ABSOLUTE), (collected_number)histogram_percentile(&interval, 95.0));
+        rrddim_set_by_pointer(st_bytes, web_executor_dimension(st_bytes, ep->name, 1024, RRD_ALGORITHM_INCREMENTAL), (collected_number)__atomic_load_n(&ep->bytes.sum, __ATOMIC_RELAXED));
+        rrddim_set_by_pointer(st_sent, web_executor_dimension(st_sent, ep->name, 1024, RRD_ALGORITHM_INCREMENTAL), (collected_number)__atomic_load_n(&ep->sent.sum, __ATOMIC_RELAXED));
+        rrddim_set_by_pointer(st_points, web_executor_dimension(st_points, ep->name, 1, RRD_ALGORITHM_INCREMENTAL), (collected_number)__atomic_load_n(&ep->points.sum, __ATOMIC_RELAXED));
+    }
+
+    rrdset_done(st_requests);
+    rrdset_done(st_latency);
+    rrdset_done(st_bytes);
+    rrdset_done(st_sent);
+    rrdset_done(st_points);
+}
+
 void global_statistics_charts(void) {
     static unsigned long long old_web_requests = 0,
                               old_web_usec = 0,
@@ -517,6 +999,115 @@ void global_statistics_charts(void) {
 
     // ----------------------------------------------------------------
 
+    collection_latency_charts();
+
+    // ----------------------------------------------------------------
+
+    {
+        static RRDSET *st_logs = NULL;
+        static RRDDIM *rd_queued = NULL, *rd_dropped = NULL, *rd_waits = NULL, *rd_oversized = NULL;
+
+        LOG_ASYNC_STATISTICS log_stats;
+        log_async_get_statistics(&log_stats);
+
+        if (unlikely(!st_logs)) {
+            st_logs = rrdset_create_localhost(
+                    "netdata"
+                    , "logs"
+                    , NULL
+                    , "logs"
+                    , NULL
+                    , "Netdata asynchronous logging"
+                    , "lines/s"
+                    , "netdata"
+                    , "stats"
+                    , 130530
+                    , localhost->rrd_update_every
+                    , RRDSET_TYPE_LINE
+            );
+
+            rd_queued = rrddim_add(st_logs, "queued", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+            rd_dropped = rrddim_add(st_logs, "dropped", NULL, -1, 1, RRD_ALGORITHM_INCREMENTAL);
+            rd_waits = rrddim_add(st_logs, "waits", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+            rd_oversized = rrddim_add(st_logs, "oversized", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+        }
+        else
+            rrdset_next(st_logs);
+
+        rrddim_set_by_pointer(st_logs, rd_queued, (collected_number)log_stats.queued);
+        rrddim_set_by_pointer(st_logs, rd_dropped, (collected_number)log_stats.dropped);
+        rrddim_set_by_pointer(st_logs, rd_waits, (collected_number)log_stats.waits);
+        rrddim_set_by_pointer(st_logs, rd_oversized, (collected_number)log_stats.oversized);
+        rrdset_done(st_logs);
+    }
+
+    // ----------------------------------------------------------------
+
+    {
+        static RRDSET *st_memory = NULL;
+        static RRDDIM *rd_subsystems[MEMORY_ACCOUNTING_SUBSYSTEMS] = { NULL };
+#ifdef ENABLE_DBENGINE
+        static RRDDIM *rd_dbengine = NULL;
+#endif
+
+        MEMORY_ACCOUNTING_STATISTICS memory_stats[MEMORY_ACCOUNTING_SUBSYSTEMS];
+        memory_accounting_get(memory_stats);
+
+        if (unlikely(!st_memory)) {
+            st_memory = rrdset_create_localhost(
+                    "netdata"
+                    , "memory_subsystems"
+                    , NULL
+                    , "memory"
+                    , NULL
+                    , "Netdata memory per subsystem"
+                    , "MiB"
+                    , "netdata"
+                    , "stats"
+                    , 130540
+                    , localhost->rrd_update_every
+                    , RRDSET_TYPE_STACKED
+            );
+
+            size_t i;
+            for (i = 0; i < MEMORY_ACCOUNTING_SUBSYSTEMS; i++)
+                rd_subsystems[i] = rrddim_add(st_memory, memory_accounting_subsystem_name(i), NULL, 1, 1048576, RRD_ALGORITHM_ABSOLUTE);
+
+#ifdef ENABLE_DBENGINE
+            rd_dbengine = rrddim_add(st_memory, "dbengine", NULL, 1, 1048576, RRD_ALGORITHM_ABSOLUTE);
+#endif
+        }
+        else
+            rrdset_next(st_memory);
+
+        size_t i;
+        for (i = 0; i < MEMORY_ACCOUNTING_SUBSYSTEMS; i++)
+            rrddim_set_by_pointer(st_memory, rd_subsystems[i], (collected_number)memory_stats[i].bytes);
+
+#ifdef ENABLE_DBENGINE
+        SLAB_STATISTICS descr_stats, page_stats;
+        pg_cache_get_allocator_statistics(&descr_stats, &page_stats);
+        rrddim_set_by_pointer(st_memory, rd_dbengine,
+                              (collected_number)(descr_stats.chunks * descr_stats.chunk_size + page_stats.chunks * page_stats.chunk_size));
+#endif
+
+        rrdset_done(st_memory);
+    }
+
+    // ----------------------------------------------------------------
+
+#ifdef ENABLE_COMPRESSION
+    streaming_compression_charts();
+#endif
+
+    streaming_receiver_charts();
+
+    web_executor_charts();
+    web_buffer_pool_charts();
+    web_api_charts();
+
+    // ----------------------------------------------------------------
+
 #ifdef ENABLE_DBENGINE
     RRDHOST *host;
     unsigned long long stats_array[RRDENG_NR_STATS] = {0};
@@ -928,6 +1519,50 @@ void global_statistics_charts(void) {
             rrddim_set_by_pointer(st_ram_usage, rd_metadata, metadata);
             rrdset_done(st_ram_usage);
         }
+
+        // ----------------------------------------------------------------
+
+        {
+            static RRDSET *st_slab = NULL;
+            static RRDDIM *rd_descr_allocated = NULL;
+            static RRDDIM *rd_descr_used = NULL;
+            static RRDDIM *rd_pages_allocated = NULL;
+            static RRDDIM *rd_pages_used = NULL;
+
+            SLAB_STATISTICS descr_stats, page_stats;
+
+            if (unlikely(!st_slab)) {
+                st_slab = rrdset_create_localhost(
+                "netdata"
+                , "dbengine_slab_memory"
+                , NULL
+                , "dbengine"
+                , NULL
+                , "Netdata DB engine page allocators"
+                , "MiB"
+                , "netdata"
+                , "stats"
+                , 130511
+                , localhost->rrd_update_every
+                , RRDSET_TYPE_LINE
+                );
+
+                rd_descr_allocated = rrddim_add(st_slab, "descriptors_allocated", "descriptors allocated", 1, 1048576, RRD_ALGORITHM_ABSOLUTE);
+                rd_descr_used = rrddim_add(st_slab, "descriptors_used", "descriptors used", 1, 1048576, RRD_ALGORITHM_ABSOLUTE);
+                rd_pages_allocated = rrddim_add(st_slab, "pages_allocated", "pages allocated", 1, 1048576, RRD_ALGORITHM_ABSOLUTE);
+                rd_pages_used = rrddim_add(st_slab, "pages_used", "pages used", 1, 1048576, RRD_ALGORITHM_ABSOLUTE);
+            }
+            else
+                rrdset_next(st_slab);
+
+            pg_cache_get_allocator_statistics(&descr_stats, &page_stats);
+
+            rrddim_set_by_pointer(st_slab, rd_descr_allocated, (collected_number)(descr_stats.chunks * descr_stats.chunk_size));
+            rrddim_set_by_pointer(st_slab, rd_descr_used, (collected_number)(descr_stats.elements_used * descr_stats.element_size));
+            rrddim_set_by_pointer(st_slab, rd_pages_allocated, (collected_number)(page_stats.chunks * page_stats.chunk_size));
+            rrddim_set_by_pointer(st_slab, rd_pages_used, (collected_number)(page_stats.elements_used * page_stats.element_size));
+            rrdset_done(st_slab);
+        }
     }
 #endif
 
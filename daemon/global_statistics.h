@@ -21,6 +21,9 @@ extern void *global_statistics_main(void *ptr);
 
 extern void rrdr_query_completed(uint64_t db_points_read, uint64_t result_points_generated);
 
+// the db points read by the queries of the calling thread, since it started
+extern uint64_t rrdr_query_thread_points_read(void);
+
 extern void finished_web_request_statistics(uint64_t dt,
                                      uint64_t bytes_received,
                                      uint64_t bytes_sent,
@@ -28,6 +31,7 @@ extern void finished_web_request_statistics(uint64_t dt,
                                      uint64_t compressed_content_size);
 
 extern uint64_t web_client_connected(void);
+extern uint64_t web_client_request_id(void);
 extern void web_client_disconnected(void);
 extern void global_statistics_charts(void);
 
@@ -71,6 +71,7 @@ void netdata_cleanup_and_exit(int ret) {
 #endif
     info("EXIT: all done - netdata is now exiting - bye bye...");
     (void) unlink(agent_incomplete_shutdown_file);
+    log_async_stop();
     exit(ret);
 }
 
@@ -214,6 +215,36 @@ void web_server_config_options(void)
         error("Invalid compression level %d. Valid levels are 1 (fastest) to 9 (best ratio). Proceeding with level 9 (best compression).", web_gzip_level);
         web_gzip_level = 9;
     }
+
+#ifdef ENABLE_ZSTD
+    web_enable_zstd = config_get_boolean(CONFIG_SECTION_WEB, "enable zstd compression", web_enable_zstd);
+
+    web_zstd_level = (int)config_get_number(CONFIG_SECTION_WEB, "zstd compression level", web_zstd_level);
+    if(web_zstd_level < 1) {
+        error("Invalid zstd compression level %d. Valid levels are 1 (fastest) to 19 (best ratio). Proceeding with level 1 (fastest compression).", web_zstd_level);
+        web_zstd_level = 1;
+    }
+    else if(web_zstd_level > 19) {
+        error("Invalid zstd compression level %d. Valid levels are 1 (fastest) to 19 (best ratio). Proceeding with level 19 (best compression).", web_zstd_level);
+        web_zstd_level = 19;
+    }
+#endif /* ENABLE_ZSTD */
+
+#ifdef ENABLE_BROTLI
+    web_enable_brotli = config_get_boolean(CONFIG_SECTION_WEB, "enable brotli compression", web_enable_brotli);
+
+    web_brotli_level = (int)config_get_number(CONFIG_SECTION_WEB, "brotli compression level", web_brotli_level);
+    if(web_brotli_level < BROTLI_MIN_QUALITY) {
+        error("Invalid brotli compression level %d. Valid levels are 0 (fastest) to 11 (best ratio). Proceeding with level 0 (fastest compression).", web_brotli_level);
+        web_brotli_level = BROTLI_MIN_QUALITY;
+    }
+    else if(web_brotli_level > BROTLI_MAX_QUALITY) {
+        error("Invalid brotli compression level %d. Valid levels are 0 (fastest) to 11 (best ratio). Proceeding with level 11 (best compression).", web_brotli_level);
+        web_brotli_level = BROTLI_MAX_QUALITY;
+    }
+#endif /* ENABLE_BROTLI */
+
+    web_compression_adaptive = config_get_boolean(CONFIG_SECTION_WEB, "adapt compression level to cpu load", web_compression_adaptive);
 #endif /* NETDATA_WITH_ZLIB */
 }
 
@@ -360,6 +391,10 @@ int help(int exitcode) {
             "  -W stacksize=N           Set the stacksize (in bytes).\n\n"
             "  -W debug_flags=N         Set runtime tracing to debug.log.\n\n"
             "  -W unittest              Run internal unittests and exit.\n\n"
+            "  -W slabtest=A,B,C        Run the allocator churn benchmark for A seconds\n"
+            "                           (default 86400) with B threads (default 4),\n"
+            "                           with the slab allocator when C is 1, or with\n"
+            "                           the system allocator when C is 0, and exit.\n\n"
 #ifdef ENABLE_DBENGINE
             "  -W createdataset=N       Create a DB engine dataset of N seconds and exit.\n\n"
             "  -W stresstest=A,B,C,D,E,F\n"
@@ -566,6 +601,18 @@ static void get_netdata_configured_variables() {
         error("Invalid multidb disk space %d given. Defaulting to %d.", default_multidb_disk_quota_mb, default_rrdeng_disk_quota_mb);
         default_multidb_disk_quota_mb = default_rrdeng_disk_quota_mb;
     }
+
+    // ------------------------------------------------------------------------
+    // get Database Engine page compression and read path
+
+    rrdeng_compress_pages = (uint8_t)config_get_boolean(CONFIG_SECTION_GLOBAL, "dbengine page compression", rrdeng_compress_pages);
+    rrdeng_mmap_reads = (uint8_t)config_get_boolean(CONFIG_SECTION_GLOBAL, "dbengine mmap page reads", rrdeng_mmap_reads);
+#ifndef ENVIRONMENT64
+    if(rrdeng_mmap_reads) {
+        error("dbengine mmap page reads are only supported on 64-bit systems. Disabling them.");
+        rrdeng_mmap_reads = 0;
+    }
+#endif
 #else
     if (default_rrd_memory_mode == RRD_MEMORY_MODE_DBENGINE) {
        error_report("RRD_MEMORY_MODE_DBENGINE is not supported in this platform. The agent will use memory mode ram instead.");
@@ -797,6 +844,7 @@ int main(int argc, char **argv) {
                         char* stacksize_string = "stacksize=";
                         char* debug_flags_string = "debug_flags=";
                         char* claim_string = "claim";
+                        char* slabtest_string = "slabtest=";
 #ifdef ENABLE_DBENGINE
                         char* createdataset_string = "createdataset=";
                         char* stresstest_string = "stresstest=";
@@ -825,6 +873,20 @@ int main(int argc, char **argv) {
                             fprintf(stderr, "\n\nALL TESTS PASSED\n\n");
                             return 0;
                         }
+                        else if(strncmp(optarg, slabtest_string, strlen(slabtest_string)) == 0) {
+                            char *endptr;
+                            unsigned test_duration_sec = 0, test_threads = 0, use_slab = 1;
+
+                            optarg += strlen(slabtest_string);
+                            test_duration_sec = (unsigned)strtoul(optarg, &endptr, 0);
+                            if (',' == *endptr)
+                                test_threads = (unsigned)strtoul(endptr + 1, &endptr, 0);
+                            if (',' == *endptr)
+                                use_slab = (unsigned)strtoul(endptr + 1, &endptr, 0);
+
+                            slab_churn_test(test_duration_sec, test_threads, use_slab ? 1 : 0);
+                            return 0;
+                        }
 #ifdef ENABLE_DBENGINE
                         else if(strncmp(optarg, createdataset_string, strlen(createdataset_string)) == 0) {
                             optarg += strlen(createdataset_string);
@@ -1211,6 +1273,10 @@ int main(int argc, char **argv) {
 
     netdata_threads_init_after_fork((size_t)config_get_number(CONFIG_SECTION_GLOBAL, "pthread stack size", (long)default_stacksize));
 
+    // write the logs from a dedicated thread
+    if(config_get_boolean(CONFIG_SECTION_GLOBAL, "asynchronous logging", CONFIG_BOOLEAN_YES))
+        log_async_start();
+
     // initialize internal registry
     registry_init();
     // fork the spawn server
@@ -249,9 +249,10 @@ void signals_handle(void) {
 
                             case NETDATA_SIGNAL_REOPEN_LOGS:
                                 error_log_limit_unlimited();
-                                info("SIGNAL: Received %s. Reopening all log files...", name);
+                                info("SIGNAL: Received %s. Reopening all log files and reloading the web files...", name);
                                 error_log_limit_reset();
                                 execute_command(CMD_REOPEN_LOGS, NULL, NULL);
+                                web_file_cache_invalidate();
                                 break;
 
                             case NETDATA_SIGNAL_EXIT_CLEANLY:
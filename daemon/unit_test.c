@@ -1475,6 +1475,174 @@ int unit_test(long delay, long shift)
     return ret;
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// slab allocator churn benchmark
+//
+// Emulates the allocation pattern of the database engine: page descriptors and 4KiB pages are
+// replaced at random, while the working set grows and shrinks every few minutes like charts
+// that appear and become obsolete. Run it once with the system allocator and once with the
+// slab, for the same duration, to compare their RSS and allocation rates.
+
+#define SLAB_CHURN_DESCR_SIZE 96
+#define SLAB_CHURN_PAGE_SIZE 4096
+#define SLAB_CHURN_WORKING_SET 65536
+#define SLAB_CHURN_PHASE_SECONDS 600
+
+struct slab_churn_thread {
+    netdata_thread_t thread;
+    int use_slab;
+    SLAB *descr_slab;
+    SLAB *page_slab;
+    uint64_t seed;
+    volatile size_t allocations;
+    volatile int stop;
+};
+
+static inline uint64_t slab_churn_random(uint64_t *seed) {
+    uint64_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *seed = x;
+}
+
+static size_t slab_churn_rss(void) {
+    unsigned long size = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if(!fp) return 0;
+
+    if(fscanf(fp, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+
+    fclose(fp);
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void *slab_churn_worker(void *ptr) {
+    struct slab_churn_thread *t = ptr;
+    void **descrs = callocz(SLAB_CHURN_WORKING_SET, sizeof(void *));
+    void **pages = callocz(SLAB_CHURN_WORKING_SET, sizeof(void *));
+    size_t i;
+
+    while(!t->stop) {
+        // the working set shrinks to 10% and grows back to 100% every phase
+        time_t now = now_monotonic_sec();
+        size_t phase = (size_t)(now / SLAB_CHURN_PHASE_SECONDS);
+        size_t active = (phase % 2) ? SLAB_CHURN_WORKING_SET / 10 : SLAB_CHURN_WORKING_SET;
+
+        for(i = 0; i < 10000 ; i++) {
+            size_t slot = (size_t)(slab_churn_random(&t->seed) % SLAB_CHURN_WORKING_SET);
+            int keep = slot < active;
+
+            if(t->use_slab) {
+                if(descrs[slot]) { slab_freez(t->descr_slab, descrs[slot]); descrs[slot] = NULL; }
+                if(pages[slot]) { slab_freez(t->page_slab, pages[slot]); pages[slot] = NULL; }
+                if(keep) {
+                    descrs[slot] = slab_mallocz(t->descr_slab);
+                    pages[slot] = slab_mallocz(t->page_slab);
+                    memset(pages[slot], 0, 64);
+                }
+            }
+            else {
+                freez(descrs[slot]); descrs[slot] = NULL;
+                freez(pages[slot]); pages[slot] = NULL;
+                if(keep) {
+                    descrs[slot] = mallocz(SLAB_CHURN_DESCR_SIZE);
+                    pages[slot] = mallocz(SLAB_CHURN_PAGE_SIZE);
+                    memset(pages[slot], 0, 64);
+                }
+            }
+
+            if(keep)
+                __atomic_add_fetch(&t->allocations, 2, __ATOMIC_RELAXED);
+        }
+    }
+
+    for(i = 0; i < SLAB_CHURN_WORKING_SET ; i++) {
+        if(t->use_slab) {
+            slab_freez(t->descr_slab, descrs[i]);
+            slab_freez(t->page_slab, pages[i]);
+        }
+        else {
+            freez(descrs[i]);
+            freez(pages[i]);
+        }
+    }
+
+    freez(descrs);
+    freez(pages);
+    return NULL;
+}
+
+void slab_churn_test(unsigned seconds, unsigned threads, int use_slab) {
+    SLAB *descr_slab = NULL, *page_slab = NULL;
+    struct slab_churn_thread *t;
+    size_t last_allocations = 0;
+    time_t started_t, last_t;
+    unsigned i;
+
+    if(!seconds) seconds = 86400;
+    if(!threads) threads = 4;
+
+    if(use_slab) {
+        descr_slab = slab_create("churn descr", SLAB_CHURN_DESCR_SIZE, 64 * 1024);
+        page_slab = slab_create("churn pages", SLAB_CHURN_PAGE_SIZE, 1024 * 1024);
+    }
+
+    fprintf(stderr, "Running the %s churn benchmark for %u seconds with %u threads, RSS at start %zu KiB\n",
+            use_slab ? "slab" : "malloc", seconds, threads, slab_churn_rss() / 1024);
+
+    t = callocz(threads, sizeof(struct slab_churn_thread));
+    for(i = 0; i < threads ; i++) {
+        t[i].use_slab = use_slab;
+        t[i].descr_slab = descr_slab;
+        t[i].page_slab = page_slab;
+        t[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+        netdata_thread_create(&t[i].thread, "SLABCHURN", NETDATA_THREAD_OPTION_JOINABLE | NETDATA_THREAD_OPTION_DONT_LOG, slab_churn_worker, &t[i]);
+    }
+
+    started_t = last_t = now_monotonic_sec();
+    while(now_monotonic_sec() - started_t < (time_t)seconds) {
+        sleep(60);
+
+        size_t allocations = 0;
+        for(i = 0; i < threads ; i++)
+            allocations += __atomic_load_n(&t[i].allocations, __ATOMIC_RELAXED);
+
+        time_t now = now_monotonic_sec();
+        fprintf(stderr, "%s: %ld seconds, RSS %zu KiB, %zu allocations/s",
+                use_slab ? "slab" : "malloc", (long)(now - started_t), slab_churn_rss() / 1024,
+                (allocations - last_allocations) / (size_t)MAX(now - last_t, 1));
+
+        if(use_slab) {
+            SLAB_STATISTICS ds, ps;
+            slab_get_statistics(descr_slab, &ds);
+            slab_get_statistics(page_slab, &ps);
+            fprintf(stderr, ", slab chunks %zu KiB, lock taken on %0.2f%% of allocations",
+                    (ds.chunks * ds.chunk_size + ps.chunks * ps.chunk_size) / 1024,
+                    (ds.allocations + ps.allocations) ? (double)(ds.cache_misses + ps.cache_misses) * 100.0 / (double)(ds.allocations + ps.allocations) : 0.0);
+        }
+        fprintf(stderr, "\n");
+
+        last_allocations = allocations;
+        last_t = now;
+    }
+
+    for(i = 0; i < threads ; i++)
+        t[i].stop = 1;
+
+    for(i = 0; i < threads ; i++)
+        netdata_thread_join(t[i].thread, NULL);
+
+    fprintf(stderr, "%s: finished, RSS after freeing everything %zu KiB\n", use_slab ? "slab" : "malloc", slab_churn_rss() / 1024);
+
+    freez(t);
+    if(use_slab) {
+        slab_destroy(descr_slab);
+        slab_destroy(page_slab);
+    }
+}
+
 #ifdef ENABLE_DBENGINE
 static inline void rrddim_set_by_pointer_fake_time(RRDDIM *rd, collected_number value, time_t now)
 {
@@ -43,6 +43,8 @@ static void datafile_init(struct rrdengine_datafile *datafile, struct rrdengine_
     datafile->fileno = fileno;
     datafile->file = (uv_file)0;
     datafile->pos = 0;
+    datafile->map = NULL;
+    datafile->map_size = 0;
     datafile->extents.first = datafile->extents.last = NULL; /* will be populated by journalfile */
     datafile->journalfile = NULL;
     datafile->next = NULL;
@@ -55,6 +57,64 @@ void generate_datafilepath(struct rrdengine_datafile *datafile, char *str, size_
                     datafile->ctx->dbfiles_path, datafile->tier, datafile->fileno);
 }
 
+/*
+ * Returns a pointer to the extent inside the read-only mapping of the datafile, or NULL when the caller must fall back
+ * to regular I/O. The whole maximum datafile size is mapped once, so that the pointers given out stay valid while the
+ * datafile grows. The kernel page cache does the caching and the eviction of the mapped data.
+ */
+void *datafile_map_extent(struct rrdengine_datafile *datafile, uint64_t pos, unsigned size_bytes)
+{
+#ifdef ENVIRONMENT64
+    struct rrdengine_instance *ctx = datafile->ctx;
+
+    /* never touch the mapping past the end of the file, it would raise SIGBUS */
+    if (unlikely(pos + size_bytes > datafile->pos))
+        return NULL;
+
+    if (unlikely(NULL == datafile->map)) {
+        uv_os_fd_t fd = uv_get_osfhandle(datafile->file);
+        uint64_t map_size = MAX(DATAFILE_MAP_SIZE, datafile->pos);
+        void *map;
+
+        map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == map) {
+            char path[RRDENG_PATH_MAX];
+
+            generate_datafilepath(datafile, path, sizeof(path));
+            error("Cannot mmap() datafile %s, falling back to regular reads: %s", path, strerror(errno));
+            ++ctx->stats.fs_errors;
+            rrd_stat_atomic_add(&global_fs_errors, 1);
+            return NULL;
+        }
+        (void)madvise(map, map_size, MADV_RANDOM);
+        datafile->map = map;
+        datafile->map_size = map_size;
+    }
+
+    if (unlikely(pos + size_bytes > datafile->map_size))
+        return NULL;
+
+    return (uint8_t *)datafile->map + pos;
+#else
+    UNUSED(datafile);
+    UNUSED(pos);
+    UNUSED(size_bytes);
+    return NULL;
+#endif
+}
+
+/* The caller must make sure there are no pages in the page cache pointing inside the mapping */
+void datafile_unmap(struct rrdengine_datafile *datafile)
+{
+    if (NULL == datafile->map)
+        return;
+
+    if (munmap(datafile->map, datafile->map_size))
+        error("munmap() of datafile %u-%u failed: %s", datafile->tier, datafile->fileno, strerror(errno));
+    datafile->map = NULL;
+    datafile->map_size = 0;
+}
+
 int close_data_file(struct rrdengine_datafile *datafile)
 {
     struct rrdengine_instance *ctx = datafile->ctx;
@@ -64,6 +124,8 @@ int close_data_file(struct rrdengine_datafile *datafile)
 
     generate_datafilepath(datafile, path, sizeof(path));
 
+    datafile_unmap(datafile);
+
     ret = uv_fs_close(NULL, &req, datafile->file, NULL);
     if (ret < 0) {
         error("uv_fs_close(%s): %s", path, uv_strerror(ret));
@@ -106,6 +168,8 @@ int destroy_data_file(struct rrdengine_datafile *datafile)
 
     generate_datafilepath(datafile, path, sizeof(path));
 
+    datafile_unmap(datafile);
+
     ret = uv_fs_ftruncate(NULL, &req, datafile->file, 0, NULL);
     if (ret < 0) {
         error("uv_fs_ftruncate(%s): %s", path, uv_strerror(ret));
@@ -20,6 +20,9 @@ struct rrdengine_instance;
 
 #define DATAFILE_IDEAL_IO_SIZE (1048576U)
 
+/* datafiles can grow beyond their target size by one extent, leave room for it in the mapping */
+#define DATAFILE_MAP_SIZE   (MAX_DATAFILE_SIZE + 2 * DATAFILE_IDEAL_IO_SIZE)
+
 struct extent_info {
     uint64_t offset;
     uint32_t size;
@@ -41,6 +44,8 @@ struct rrdengine_datafile {
     unsigned fileno;
     uv_file file;
     uint64_t pos;
+    void *map; /* read-only mapping of the datafile, only used by the event loop when dbengine mmap reads are enabled */
+    uint64_t map_size;
     struct rrdengine_instance *ctx;
     struct rrdengine_df_extents extents;
     struct rrdengine_journalfile *journalfile;
@@ -56,6 +61,8 @@ extern void df_extent_insert(struct extent_info *extent);
 extern void datafile_list_insert(struct rrdengine_instance *ctx, struct rrdengine_datafile *datafile);
 extern void datafile_list_delete(struct rrdengine_instance *ctx, struct rrdengine_datafile *datafile);
 extern void generate_datafilepath(struct rrdengine_datafile *datafile, char *str, size_t maxlen);
+extern void *datafile_map_extent(struct rrdengine_datafile *datafile, uint64_t pos, unsigned size_bytes);
+extern void datafile_unmap(struct rrdengine_datafile *datafile);
 extern int close_data_file(struct rrdengine_datafile *datafile);
 extern int unlink_data_file(struct rrdengine_datafile *datafile);
 extern int destroy_data_file(struct rrdengine_datafile *datafile);
@@ -6,6 +6,33 @@
 /* Forward declarations */
 static int pg_cache_try_evict_one_page_unsafe(struct rrdengine_instance *ctx);
 
+/* shared by all database engine instances */
+static SLAB *pg_cache_page_descr_slab = NULL;
+static SLAB *pg_cache_page_slab = NULL;
+
+/* Called once for all database engine instances */
+void pg_cache_init_allocators(void)
+{
+    pg_cache_page_descr_slab = slab_create("dbengine page descr", sizeof(struct rrdeng_page_descr), 64 * 1024);
+    pg_cache_page_slab = slab_create("dbengine pages", RRDENG_BLOCK_SIZE, 1024 * 1024);
+}
+
+void pg_cache_get_allocator_statistics(SLAB_STATISTICS *page_descr_stats, SLAB_STATISTICS *page_stats)
+{
+    slab_get_statistics(pg_cache_page_descr_slab, page_descr_stats);
+    slab_get_statistics(pg_cache_page_slab, page_stats);
+}
+
+void *dbengine_page_alloc(void)
+{
+    return slab_mallocz(pg_cache_page_slab);
+}
+
+void dbengine_page_free(void *page)
+{
+    slab_freez(pg_cache_page_slab, page);
+}
+
 /* always inserts into tail */
 static inline void pg_cache_replaceQ_insert_unsafe(struct rrdengine_instance *ctx,
                                                    struct rrdeng_page_descr *descr)
@@ -81,7 +108,7 @@ struct rrdeng_page_descr *pg_cache_create_descr(void)
 {
     struct rrdeng_page_descr *descr;
 
-    descr = mallocz(sizeof(*descr));
+    descr = slab_mallocz(pg_cache_page_descr_slab);
     descr->page_length = 0;
     descr->start_time = INVALID_TIME;
     descr->end_time = INVALID_TIME;
@@ -93,6 +120,21 @@ struct rrdeng_page_descr *pg_cache_create_descr(void)
     return descr;
 }
 
+/* Releases the memory of a populated page, unless it points inside a datafile mapping */
+static inline void pg_cache_free_page_unsafe(struct page_cache_descr *pg_cache_descr)
+{
+    if (pg_cache_descr->flags & RRD_PAGE_MAPPED)
+        pg_cache_descr->flags &= ~RRD_PAGE_MAPPED;
+    else
+        dbengine_page_free(pg_cache_descr->page);
+    pg_cache_descr->page = NULL;
+}
+
+void pg_cache_destroy_descr(struct rrdeng_page_descr *descr)
+{
+    slab_freez(pg_cache_page_descr_slab, descr);
+}
+
 /* The caller must hold page descriptor lock. */
 void pg_cache_wake_up_waiters_unsafe(struct rrdeng_page_descr *descr)
 {
@@ -356,8 +398,7 @@ static void pg_cache_evict_unsafe(struct rrdengine_instance *ctx, struct rrdeng_
 {
     struct page_cache_descr *pg_cache_descr = descr->pg_cache_descr;
 
-    freez(pg_cache_descr->page);
-    pg_cache_descr->page = NULL;
+    pg_cache_free_page_unsafe(pg_cache_descr);
     pg_cache_descr->flags &= ~RRD_PAGE_POPULATED;
     pg_cache_release_pages_unsafe(ctx, 1);
     ++ctx->stats.pg_cache_evictions;
@@ -497,7 +538,7 @@ uint8_t pg_cache_punch_hole(struct rrdengine_instance *ctx, struct rrdeng_page_d
         (void)sleep_usec(1000); /* 1 msec */
     }
 destroy:
-    freez(descr);
+    pg_cache_destroy_descr(descr);
     pg_cache_update_metric_times(page_index);
 
     return can_delete_metric;
@@ -1222,13 +1263,14 @@ void free_page_cache(struct rrdengine_instance *ctx)
                 /* Check rrdenglocking.c */
                 pg_cache_descr = descr->pg_cache_descr;
                 if (pg_cache_descr->flags & RRD_PAGE_POPULATED) {
-                    freez(pg_cache_descr->page);
-                    bytes_freed += RRDENG_BLOCK_SIZE;
+                    if (!(pg_cache_descr->flags & RRD_PAGE_MAPPED))
+                        bytes_freed += RRDENG_BLOCK_SIZE;
+                    pg_cache_free_page_unsafe(pg_cache_descr);
                 }
                 rrdeng_destroy_pg_cache_descr(ctx, pg_cache_descr);
                 bytes_freed += sizeof(*pg_cache_descr);
             }
-            freez(descr);
+            pg_cache_destroy_descr(descr);
             bytes_freed += sizeof(*descr);
 
             PValue = JudyLNext(page_index->JudyL_array, &Index, PJE0);
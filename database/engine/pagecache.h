@@ -18,6 +18,7 @@ struct rrdeng_page_descr;
 #define RRD_PAGE_READ_PENDING   (1LU << 2)
 #define RRD_PAGE_WRITE_PENDING  (1LU << 3)
 #define RRD_PAGE_POPULATED      (1LU << 4)
+#define RRD_PAGE_MAPPED         (1LU << 5) /* the page points inside a datafile mapping, it must not be freed */
 
 struct page_cache_descr {
     struct rrdeng_page_descr *descr; /* parent descriptor */
@@ -159,7 +160,12 @@ extern void pg_cache_replaceQ_delete(struct rrdengine_instance *ctx,
                                      struct rrdeng_page_descr *descr);
 extern void pg_cache_replaceQ_set_hot(struct rrdengine_instance *ctx,
                                       struct rrdeng_page_descr *descr);
+extern void pg_cache_init_allocators(void);
+extern void pg_cache_get_allocator_statistics(SLAB_STATISTICS *page_descr_stats, SLAB_STATISTICS *page_stats);
+extern void *dbengine_page_alloc(void);
+extern void dbengine_page_free(void *page);
 extern struct rrdeng_page_descr *pg_cache_create_descr(void);
+extern void pg_cache_destroy_descr(struct rrdeng_page_descr *descr);
 extern int pg_cache_try_get_unsafe(struct rrdeng_page_descr *descr, int exclusive_access);
 extern void pg_cache_put_unsafe(struct rrdeng_page_descr *descr);
 extern void pg_cache_put(struct rrdengine_instance *ctx, struct rrdeng_page_descr *descr);
@@ -176,7 +176,7 @@ void read_cached_extent_cb(struct rrdengine_worker_config* wc, unsigned idx, str
     struct extent_info *extent = xt_io_descr->descr_array[0]->extent;
 
     for (i = 0 ; i < xt_io_descr->descr_count; ++i) {
-        page = mallocz(RRDENG_BLOCK_SIZE);
+        page = dbengine_page_alloc();
         descr = xt_io_descr->descr_array[i];
         for (j = 0, page_offset = 0 ; j < extent->number_of_pages ; ++j) {
             /* care, we don't hold the descriptor mutex */
@@ -211,40 +211,31 @@ void read_cached_extent_cb(struct rrdengine_worker_config* wc, unsigned idx, str
     freez(xt_io_descr);
 }
 
-void read_extent_cb(uv_fs_t* req)
+/*
+ * Checks the CRC32 of an extent that has been read from disk or that resides in the mapping of the datafile and
+ * decompresses its payload. It does not touch the state of the event loop, so that it can run in the libuv
+ * threadpool: for mapped extents this is where the kernel faults the extent in from disk.
+ */
+static void read_extent_check(struct extent_io_descriptor *xt_io_descr)
 {
-    struct rrdengine_worker_config* wc = req->loop->data;
-    struct rrdengine_instance *ctx = wc->ctx;
-    struct extent_io_descriptor *xt_io_descr;
-    struct rrdeng_page_descr *descr;
-    struct page_cache_descr *pg_cache_descr;
     int ret;
-    unsigned i, j, count;
-    void *page, *uncompressed_buf = NULL;
-    uint32_t payload_length, payload_offset, page_offset, uncompressed_payload_length = 0;
-    uint8_t have_read_error = 0;
+    unsigned i, count;
+    uint32_t payload_length, payload_offset, uncompressed_payload_length = 0;
     /* persistent structures */
     struct rrdeng_df_extent_header *header;
     struct rrdeng_df_extent_trailer *trailer;
     uLong crc;
 
-    xt_io_descr = req->data;
     header = xt_io_descr->buf;
     payload_length = header->payload_length;
     count = header->number_of_pages;
     payload_offset = sizeof(*header) + sizeof(header->descr[0]) * count;
     trailer = xt_io_descr->buf + xt_io_descr->bytes - sizeof(*trailer);
+    xt_io_descr->uncompressed_buf = NULL;
 
-    if (req->result < 0) {
-        struct rrdengine_datafile *datafile = xt_io_descr->descr_array[0]->extent->datafile;
+    if (xt_io_descr->have_read_error)
+        return;
 
-        ++ctx->stats.io_errors;
-        rrd_stat_atomic_add(&global_io_errors, 1);
-        have_read_error = 1;
-        error("%s: uv_fs_read - %s - extent at offset %"PRIu64"(%u) in datafile %u-%u.", __func__,
-              uv_strerror((int)req->result), xt_io_descr->pos, xt_io_descr->bytes, datafile->tier, datafile->fileno);
-        goto after_crc_check;
-    }
     crc = crc32(0L, Z_NULL, 0);
     crc = crc32(crc, xt_io_descr->buf, xt_io_descr->bytes - sizeof(*trailer));
     ret = crc32cmp(trailer->checksum, crc);
@@ -258,27 +249,59 @@ void read_extent_cb(uv_fs_t* req)
     if (unlikely(ret)) {
         struct rrdengine_datafile *datafile = xt_io_descr->descr_array[0]->extent->datafile;
 
-        ++ctx->stats.io_errors;
-        rrd_stat_atomic_add(&global_io_errors, 1);
-        have_read_error = 1;
+        xt_io_descr->have_read_error = 1;
+        xt_io_descr->crc_failed = 1;
         error("%s: Extent at offset %"PRIu64"(%u) was read from datafile %u-%u. CRC32 check: FAILED", __func__,
               xt_io_descr->pos, xt_io_descr->bytes, datafile->tier, datafile->fileno);
+        return;
     }
 
-after_crc_check:
-    if (!have_read_error && RRD_NO_COMPRESSION != header->compression_algorithm) {
-        uncompressed_payload_length = 0;
+    if (RRD_NO_COMPRESSION != header->compression_algorithm) {
         for (i = 0 ; i < count ; ++i) {
             uncompressed_payload_length += header->descr[i].page_length;
         }
-        uncompressed_buf = mallocz(uncompressed_payload_length);
-        ret = LZ4_decompress_safe(xt_io_descr->buf + payload_offset, uncompressed_buf,
+        xt_io_descr->uncompressed_buf = mallocz(uncompressed_payload_length);
+        ret = LZ4_decompress_safe(xt_io_descr->buf + payload_offset, xt_io_descr->uncompressed_buf,
                                   payload_length, uncompressed_payload_length);
-        ctx->stats.before_decompress_bytes += payload_length;
-        ctx->stats.after_decompress_bytes += ret;
+        xt_io_descr->decompressed_bytes = ret;
         debug(D_RRDENGINE, "LZ4 decompressed %u bytes to %d bytes.", payload_length, ret);
         /* care, we don't hold the descriptor mutex */
     }
+}
+
+/*
+ * Populates the page cache with the pages of an extent checked by read_extent_check(). It runs in the event loop.
+ * When the extent is mapped and uncompressed the pages point directly inside the mapping.
+ */
+static void read_extent_populate_pages(struct rrdengine_worker_config* wc, struct extent_io_descriptor *xt_io_descr)
+{
+    struct rrdengine_instance *ctx = wc->ctx;
+    struct rrdeng_page_descr *descr;
+    struct page_cache_descr *pg_cache_descr;
+    unsigned i, j, count;
+    void *page, *uncompressed_buf = xt_io_descr->uncompressed_buf;
+    uint32_t payload_length, payload_offset, page_offset, uncompressed_payload_length = 0;
+    unsigned long page_flags;
+    uint8_t have_read_error = xt_io_descr->have_read_error;
+    /* persistent structures */
+    struct rrdeng_df_extent_header *header;
+
+    header = xt_io_descr->buf;
+    payload_length = header->payload_length;
+    count = header->number_of_pages;
+    payload_offset = sizeof(*header) + sizeof(header->descr[0]) * count;
+
+    if (unlikely(xt_io_descr->crc_failed)) {
+        ++ctx->stats.io_errors;
+        rrd_stat_atomic_add(&global_io_errors, 1);
+    }
+    if (!have_read_error && RRD_NO_COMPRESSION != header->compression_algorithm) {
+        for (i = 0 ; i < count ; ++i) {
+            uncompressed_payload_length += header->descr[i].page_length;
+        }
+        ctx->stats.before_decompress_bytes += payload_length;
+        ctx->stats.after_decompress_bytes += xt_io_descr->decompressed_bytes;
+    }
     {
         uint8_t xt_is_cached = 0;
         unsigned xt_idx;
@@ -331,21 +354,29 @@ void read_extent_cb(uv_fs_t* req)
                 continue; /* Failed to reserve a suitable page */
             is_prefetched_page = 1;
         }
-        page = mallocz(RRDENG_BLOCK_SIZE);
+        page_flags = RRD_PAGE_POPULATED;
 
         /* care, we don't hold the descriptor mutex */
-        if (have_read_error) {
-            /* Applications should make sure NULL values match 0 as does SN_EMPTY_SLOT */
-            memset(page, 0, descr->page_length);
-        } else if (RRD_NO_COMPRESSION == header->compression_algorithm) {
-            (void) memcpy(page, xt_io_descr->buf + payload_offset + page_offset, descr->page_length);
+        if (!have_read_error && xt_io_descr->buf_is_mapped &&
+            RRD_NO_COMPRESSION == header->compression_algorithm) {
+            /* zero-copy, the page is shared with the kernel page cache */
+            page = xt_io_descr->buf + payload_offset + page_offset;
+            page_flags |= RRD_PAGE_MAPPED;
         } else {
-            (void) memcpy(page, uncompressed_buf + page_offset, descr->page_length);
+            page = dbengine_page_alloc();
+            if (have_read_error) {
+                /* Applications should make sure NULL values match 0 as does SN_EMPTY_SLOT */
+                memset(page, 0, descr->page_length);
+            } else if (RRD_NO_COMPRESSION == header->compression_algorithm) {
+                (void) memcpy(page, xt_io_descr->buf + payload_offset + page_offset, descr->page_length);
+            } else {
+                (void) memcpy(page, uncompressed_buf + page_offset, descr->page_length);
+            }
         }
         rrdeng_page_descr_mutex_lock(ctx, descr);
         pg_cache_descr = descr->pg_cache_descr;
         pg_cache_descr->page = page;
-        pg_cache_descr->flags |= RRD_PAGE_POPULATED;
+        pg_cache_descr->flags |= page_flags;
         pg_cache_descr->flags &= ~RRD_PAGE_READ_PENDING;
         rrdeng_page_descr_mutex_unlock(ctx, descr);
         pg_cache_replaceQ_insert(ctx, descr);
@@ -356,11 +387,50 @@ void read_extent_cb(uv_fs_t* req)
             pg_cache_wake_up_waiters(ctx, descr);
         }
     }
-    if (!have_read_error && RRD_NO_COMPRESSION != header->compression_algorithm) {
-        freez(uncompressed_buf);
-    }
+    freez(uncompressed_buf);
+    xt_io_descr->uncompressed_buf = NULL;
     if (xt_io_descr->completion)
         complete(xt_io_descr->completion);
+}
+
+/* runs in the libuv threadpool, the kernel reads the mapped extent from disk while it is checked */
+static void read_mapped_extent_work(uv_work_t *req)
+{
+    read_extent_check(req->data);
+}
+
+static void read_mapped_extent_after_work(uv_work_t *req, int status)
+{
+    struct rrdengine_worker_config* wc = req->loop->data;
+    struct extent_io_descriptor *xt_io_descr = req->data;
+
+    UNUSED(status);
+
+    read_extent_populate_pages(wc, xt_io_descr);
+    freez(xt_io_descr);
+}
+
+void read_extent_cb(uv_fs_t* req)
+{
+    struct rrdengine_worker_config* wc = req->loop->data;
+    struct rrdengine_instance *ctx = wc->ctx;
+    struct extent_io_descriptor *xt_io_descr;
+    uint8_t have_read_error = 0;
+
+    xt_io_descr = req->data;
+    if (req->result < 0) {
+        struct rrdengine_datafile *datafile = xt_io_descr->descr_array[0]->extent->datafile;
+
+        ++ctx->stats.io_errors;
+        rrd_stat_atomic_add(&global_io_errors, 1);
+        have_read_error = 1;
+        error("%s: uv_fs_read - %s - extent at offset %"PRIu64"(%u) in datafile %u-%u.", __func__,
+              uv_strerror((int)req->result), xt_io_descr->pos, xt_io_descr->bytes, datafile->tier, datafile->fileno);
+    }
+    xt_io_descr->have_read_error = have_read_error;
+    read_extent_check(xt_io_descr);
+    read_extent_populate_pages(wc, xt_io_descr);
+
     uv_fs_req_cleanup(req);
     free(xt_io_descr->buf);
     freez(xt_io_descr);
@@ -405,6 +475,22 @@ static void do_read_extent(struct rrdengine_worker_config* wc,
     /* xt_io_descr->descr_commit_idx_array[0] */
     xt_io_descr->release_descr = release_descr;
 
+    if (rrdeng_mmap_reads) {
+        xt_io_descr->buf = datafile_map_extent(datafile, pos, size_bytes);
+        if (likely(NULL != xt_io_descr->buf)) {
+            /*
+             * The extent is read by the page faults of the CRC32 check, in the libuv threadpool, so that the
+             * event loop is not blocked on disk. The pages are populated back in the event loop.
+             */
+            xt_io_descr->buf_is_mapped = 1;
+            xt_io_descr->work.data = xt_io_descr;
+            ret = uv_queue_work(wc->loop, &xt_io_descr->work, read_mapped_extent_work, read_mapped_extent_after_work);
+            fatal_assert(0 == ret);
+            ctx->stats.pg_cache_backfills += count;
+            return;
+        }
+    }
+
     xt_is_cached = !lookup_in_xt_cache(wc, extent, &xt_idx);
     if (xt_is_cached) {
         xt_cache_replaceQ_set_hot(wc, &wc->xt_cache.extent_array[xt_idx]);
@@ -555,6 +641,8 @@ static void invalidate_oldest_committed(void *arg)
 
     } while (nr_committed_pages >= pg_cache_committed_hard_limit(ctx));
 out:
+    /* this thread is not a netdata thread, return the elements it cached to the slabs */
+    slab_thread_cache_release();
     wc->cleanup_thread_invalidating_dirty_pages = 1;
     /* wake up event loop */
     fatal_assert(0 == uv_async_send(&wc->async));
@@ -896,6 +984,8 @@ static void delete_old_data(void *arg)
         next = extent->next;
         freez(extent);
     }
+    /* this thread is not a netdata thread, return the elements it cached to the slabs */
+    slab_thread_cache_release();
     wc->cleanup_thread_deleting_files = 1;
     /* wake up event loop */
     fatal_assert(0 == uv_async_send(&wc->async));
@@ -1264,6 +1354,8 @@ void rrdeng_worker(void* arg)
     fatal_assert(0 == uv_loop_close(loop));
     freez(loop);
 
+    /* the event loop thread is not a netdata thread, return the elements it cached to the slabs */
+    slab_thread_cache_release();
     return;
 
 error_after_timer_init:
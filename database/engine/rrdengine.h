@@ -90,6 +90,12 @@ struct extent_io_descriptor {
     struct completion *completion;
     unsigned descr_count;
     int release_descr;
+    uint8_t buf_is_mapped; /* buf points inside the mapping of the datafile */
+    uv_work_t work; /* mapped extents are checked and decompressed in the libuv threadpool */
+    uint8_t have_read_error;
+    uint8_t crc_failed;
+    void *uncompressed_buf;
+    int decompressed_bytes;
     struct rrdeng_page_descr *descr_array[MAX_PAGES_PER_EXTENT];
     Word_t descr_commit_idx_array[MAX_PAGES_PER_EXTENT];
     struct extent_io_descriptor *next; /* multiple requests to be served by the same cached extent */
@@ -9,6 +9,8 @@ int default_rrdeng_disk_quota_mb = 256;
 int default_multidb_disk_quota_mb = 256;
 /* Default behaviour is to unblock data collection if the page cache is full of dirty pages by dropping metrics */
 uint8_t rrdeng_drop_metrics_under_page_cache_pressure = 1;
+uint8_t rrdeng_compress_pages = 1;
+uint8_t rrdeng_mmap_reads = 0;
 
 static inline struct rrdengine_instance *get_rrdeng_ctx_from_host(RRDHOST *host)
 {
@@ -202,9 +204,9 @@ void rrdeng_store_metric_flush_current_page(RRDDIM *rd)
             /* handle->prev_descr = descr;*/
         }
     } else {
-        freez(descr->pg_cache_descr->page);
+        dbengine_page_free(descr->pg_cache_descr->page);
         rrdeng_destroy_pg_cache_descr(ctx, descr->pg_cache_descr);
-        freez(descr);
+        pg_cache_destroy_descr(descr);
     }
     handle->descr = NULL;
 }
@@ -724,7 +726,7 @@ void *rrdeng_create_page(struct rrdengine_instance *ctx, uuid_t *id, struct rrde
 
     descr = pg_cache_create_descr();
     descr->id = id; /* TODO: add page type: metric, log, something? */
-    page = mallocz(RRDENG_BLOCK_SIZE); /*TODO: add page size */
+    page = dbengine_page_alloc(); /*TODO: add page size */
     rrdeng_page_descr_mutex_lock(ctx, descr);
     pg_cache_descr = descr->pg_cache_descr;
     pg_cache_descr->page = page;
@@ -883,6 +885,13 @@ void rrdeng_put_page(struct rrdengine_instance *ctx, void *handle)
     pg_cache_put(ctx, (struct rrdeng_page_descr *)handle);
 }
 
+/* Allocators shared by all database engine instances */
+static void rrdeng_init_global(void)
+{
+    rrdeng_init_locking();
+    pg_cache_init_allocators();
+}
+
 /*
  * Returns 0 on success, negative on error
  */
@@ -892,6 +901,9 @@ int rrdeng_init(RRDHOST *host, struct rrdengine_instance **ctxp, char *dbfiles_p
     struct rrdengine_instance *ctx;
     int error;
     uint32_t max_open_files;
+    static uv_once_t rrdeng_global_once = UV_ONCE_INIT;
+
+    uv_once(&rrdeng_global_once, rrdeng_init_global);
 
     max_open_files = rlimit_nofile.rlim_cur / 4;
 
@@ -913,7 +925,7 @@ int rrdeng_init(RRDHOST *host, struct rrdengine_instance **ctxp, char *dbfiles_p
     } else {
         *ctxp = ctx = callocz(1, sizeof(*ctx));
     }
-    ctx->global_compress_alg = RRD_LZ4;
+    ctx->global_compress_alg = rrdeng_compress_pages ? RRD_LZ4 : RRD_NO_COMPRESSION;
     if (page_cache_mb < RRDENG_MIN_PAGE_CACHE_SIZE_MB)
         page_cache_mb = RRDENG_MIN_PAGE_CACHE_SIZE_MB;
     ctx->max_cache_pages = page_cache_mb * (1048576LU / RRDENG_BLOCK_SIZE);
@@ -1,11 +1,19 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "rrdengine.h"
 
+static SLAB *pg_cache_descr_slab = NULL;
+
+/* Called once for all database engine instances */
+void rrdeng_init_locking(void)
+{
+    pg_cache_descr_slab = slab_create("dbengine cache descr", sizeof(struct page_cache_descr), 64 * 1024);
+}
+
 struct page_cache_descr *rrdeng_create_pg_cache_descr(struct rrdengine_instance *ctx)
 {
     struct page_cache_descr *pg_cache_descr;
 
-    pg_cache_descr = mallocz(sizeof(*pg_cache_descr));
+    pg_cache_descr = slab_mallocz(pg_cache_descr_slab);
     rrd_stat_atomic_add(&ctx->stats.page_cache_descriptors, 1);
     pg_cache_descr->page = NULL;
     pg_cache_descr->flags = 0;
@@ -22,7 +30,7 @@ void rrdeng_destroy_pg_cache_descr(struct rrdengine_instance *ctx, struct page_c
 {
     uv_cond_destroy(&pg_cache_descr->cond);
     uv_mutex_destroy(&pg_cache_descr->mutex);
-    freez(pg_cache_descr);
+    slab_freez(pg_cache_descr_slab, pg_cache_descr);
     rrd_stat_atomic_add(&ctx->stats.page_cache_descriptors, -1);
 }
 
@@ -64,6 +64,8 @@ extern int default_rrd_update_every;
 extern int default_rrd_history_entries;
 extern int gap_when_lost_iterations_above;
 extern time_t rrdset_free_obsolete_time;
+extern int rrdset_latency_collection;
+extern int rrdset_latency_histograms;
 
 #define RRD_ID_LENGTH_MAX 200
 
@@ -390,6 +392,9 @@ struct rrddim_volatile {
         // run this to store each metric into the database
         void (*store_metric)(RRDDIM *rd, usec_t point_in_time, storage_number number);
 
+        // run this to close what has been stored so far, before storing a metric after a gap
+        void (*flush)(RRDDIM *rd);
+
         // an finalization function to run after collection is over
         // returns 1 if it's safe to delete the dimension
         int (*finalize)(RRDDIM *rd);
@@ -415,15 +420,47 @@ struct rrddim_volatile {
         // get the timestamp of the first entry of this metric
         time_t (*oldest_time)(RRDDIM *rd);
     } query_ops;
+
+    uint32_t upstream_slot;             // the slot of this dimension in the compact streaming protocol
+    collected_number upstream_last_value; // the last value streamed with the compact protocol
+    time_t replay_next_t;               // the next point expected from replication, 0 = a new page starts
 };
 
 // ----------------------------------------------------------------------------
 // volatile state per chart
+// ----------------------------------------------------------------------------
+// data collection latency of charts, maintained by rrdset_done()
+
+typedef struct rrdset_latency {
+    HISTOGRAM done;                                 // the duration of rrdset_done()
+    HISTOGRAM store;                                // the time spent storing metrics in the db
+    HISTOGRAM jitter;                               // the difference between the collection interval and update_every
+} RRDSET_LATENCY;
+
+// the latency of all the charts of all hosts, summed from the histograms of the threads calling rrdset_done()
+extern void rrdset_latency_all_get(RRDSET_LATENCY *dst);
+
+// the /api/v1/data queries of a chart, when per chart api statistics are enabled
+typedef struct rrdset_queries {
+    HISTOGRAM duration;                             // usec running the query
+    HISTOGRAM bytes;                                // the size of the response
+    HISTOGRAM points;                               // the db points read
+} RRDSET_QUERIES;
+
 struct rrdset_volatile {
     char *old_title;
     char *old_context;
     struct label *new_labels;
     struct label_index labels;
+    RRDSET_LATENCY *latency;                        // per chart latency, when rrdset_latency_histograms is enabled
+    RRDSET_QUERIES *queries;                        // per chart queries, allocated by the first query when web_api_chart_statistics is enabled
+    uint32_t upstream_slot;                         // the slot of this chart in the compact streaming protocol, 0 = not sent yet
+
+    uint8_t replication;                            // sender: the REPLICATION_* state of this chart on the connection
+    time_t replication_after;                       // sender: the last point replicated to the parent
+    uint8_t replay_started;                         // receiver: the child has started sending the missing points
+    time_t replay_after;                            // receiver: the points before this are already in the db
+    struct stream_aggregate_member *aggregate_member; // receiver: the aggregate this chart is a member of
 };
 
 // ----------------------------------------------------------------------------
@@ -820,6 +857,12 @@ struct rrdhost {
     struct receiver_state *receiver;
     netdata_mutex_t receiver_lock;
 
+    // the budget counters of the receivers detached from this host, so that its statistics survive reconnections
+    size_t receivers_charts_created;
+    size_t receivers_samples;
+    size_t receivers_bytes;
+    usec_t receivers_throttled_usec;
+
     // ------------------------------------------------------------------------
     // health monitoring options
 
@@ -1085,6 +1128,9 @@ extern void rrdset_done(RRDSET *st);
 extern void rrdset_is_obsolete(RRDSET *st);
 extern void rrdset_isnot_obsolete(RRDSET *st);
 
+// forget the last collected and stored values, the next collection starts the chart again
+extern void rrdset_reset(RRDSET *st);
+
 // checks if the RRDSET should be offered to viewers
 #define rrdset_is_available_for_viewers(st) (rrdset_flag_check(st, RRDSET_FLAG_ENABLED) && !rrdset_flag_check(st, RRDSET_FLAG_HIDDEN) && !rrdset_flag_check(st, RRDSET_FLAG_OBSOLETE) && !rrdset_flag_check(st, RRDSET_FLAG_ARCHIVED) && (st)->dimensions && (st)->rrd_memory_mode != RRD_MEMORY_MODE_NONE)
 #define rrdset_is_available_for_exporting_and_alarms(st) (rrdset_flag_check(st, RRDSET_FLAG_ENABLED) && !rrdset_flag_check(st, RRDSET_FLAG_OBSOLETE) && !rrdset_flag_check(st, RRDSET_FLAG_ARCHIVED) && (st)->dimensions)
@@ -1320,7 +1366,6 @@ extern void rrdfamily_free(RRDHOST *host, RRDFAMILY *rc);
 extern RRDSET *rrdset_index_del_name(RRDHOST *host, RRDSET *st);
 
 extern void rrdset_free(RRDSET *st);
-extern void rrdset_reset(RRDSET *st);
 extern void rrdset_save(RRDSET *st);
 #define rrdset_delete(st) rrdset_delete_custom(st, 0)
 extern void rrdset_delete_custom(RRDSET *st, int db_rotated);
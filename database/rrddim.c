@@ -126,6 +126,9 @@ static void rrddim_collect_store_metric(RRDDIM *rd, usec_t point_in_time, storag
 
     rd->values[rd->rrdset->current_entry] = number;
 }
+static void rrddim_collect_flush(RRDDIM *rd) {
+    (void)rd;
+}
 static int rrddim_collect_finalize(RRDDIM *rd) {
     (void)rd;
 
@@ -387,12 +390,17 @@ RRDDIM *rrddim_add_custom(RRDSET *st, const char *id, const char *name, collecte
     rd->last_collected_time.tv_usec = 0;
     rd->rrdset = st;
     rd->state = mallocz(sizeof(*rd->state));
+    rd->state->upstream_slot = 0;
+    rd->state->upstream_last_value = 0;
+    rd->state->replay_next_t = 0;
+    memory_accounting_alloc(MEMORY_ACCOUNTING_DIMENSIONS, rd->memsize + sizeof(*rd->state));
     (void) find_dimension_uuid(st, rd, &(rd->state->metric_uuid));
     if(memory_mode == RRD_MEMORY_MODE_DBENGINE) {
 #ifdef ENABLE_DBENGINE
         rrdeng_metric_init(rd);
         rd->state->collect_ops.init = rrdeng_store_metric_init;
         rd->state->collect_ops.store_metric = rrdeng_store_metric_next;
+        rd->state->collect_ops.flush = rrdeng_store_metric_flush_current_page;
         rd->state->collect_ops.finalize = rrdeng_store_metric_finalize;
         rd->state->query_ops.init = rrdeng_load_metric_init;
         rd->state->query_ops.next_metric = rrdeng_load_metric_next;
@@ -404,6 +412,7 @@ RRDDIM *rrddim_add_custom(RRDSET *st, const char *id, const char *name, collecte
     } else {
         rd->state->collect_ops.init         = rrddim_collect_init;
         rd->state->collect_ops.store_metric = rrddim_collect_store_metric;
+        rd->state->collect_ops.flush        = rrddim_collect_flush;
         rd->state->collect_ops.finalize     = rrddim_collect_finalize;
         rd->state->query_ops.init           = rrddim_query_init;
         rd->state->query_ops.next_metric    = rrddim_query_next_metric;
@@ -497,6 +506,8 @@ void rrddim_free_custom(RRDSET *st, RRDDIM *rd, int db_rotated)
 
     // free(rd->annotations);
 
+    memory_accounting_free(MEMORY_ACCOUNTING_DIMENSIONS, rd->memsize + sizeof(*rd->state));
+
     RRD_MEMORY_MODE rrd_memory_mode = rd->rrd_memory_mode;
     switch(rrd_memory_mode) {
         case RRD_MEMORY_MODE_SAVE:
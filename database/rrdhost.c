@@ -8,6 +8,8 @@ size_t rrd_hosts_available = 0;
 netdata_rwlock_t rrd_rwlock = NETDATA_RWLOCK_INITIALIZER;
 
 time_t rrdset_free_obsolete_time = 3600;
+int rrdset_latency_collection = 0;
+int rrdset_latency_histograms = 0;
 time_t rrdhost_free_orphan_time = 3600;
 
 // ----------------------------------------------------------------------------
@@ -654,6 +656,11 @@ int rrd_init(char *hostname, struct rrdhost_system_info *system_info) {
     if (gap_when_lost_iterations_above < 1)
         gap_when_lost_iterations_above = 1;
 
+    rrdset_latency_collection = config_get_boolean(CONFIG_SECTION_GLOBAL, "collection latency histograms", rrdset_latency_collection);
+    rrdset_latency_histograms = config_get_boolean(CONFIG_SECTION_GLOBAL, "per chart collection latency histograms", rrdset_latency_histograms);
+    if (rrdset_latency_histograms)
+        rrdset_latency_collection = 1;
+
     if (unlikely(sql_init_database())) {
         if (default_rrd_memory_mode == RRD_MEMORY_MODE_DBENGINE)
             fatal("Failed to initialize SQLite");
@@ -800,14 +807,21 @@ void rrdhost_free(RRDHOST *host) {
     // ------------------------------------------------------------------------
     // clean up streaming
     rrdpush_sender_thread_stop(host); // stop a possibly running thread
+    memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, host->sender->memory_accounted);
+#ifdef ENABLE_COMPRESSION
+    compressor_destroy(&host->sender->compressor);
+#endif
     cbuffer_free(host->sender->buffer);
-    buffer_free(host->sender->build);
+    buffer_free(host->sender->replication_build);
+    sender_spill_destroy(&host->sender->spill);
+    sender_fanout_destroy(host->sender);
     freez(host->sender);
     host->sender = NULL;
     if (netdata_exit) {
         netdata_mutex_lock(&host->receiver_lock);
         if (host->receiver) {
-            if (!host->receiver->exited)
+            // the receivers of the pool are marked exited by their pool thread
+            if (!host->receiver->exited && !host->receiver->pool)
                 netdata_thread_cancel(host->receiver->thread);
             netdata_mutex_unlock(&host->receiver_lock);
             struct receiver_state *rpt = host->receiver;
@@ -4,6 +4,85 @@
 #include "rrd.h"
 #include <sched.h>
 
+// ----------------------------------------------------------------------------
+// the collection latency of all charts
+//
+// Every thread calling rrdset_done() records into its own slot, so that the
+// collectors and the streaming receivers do not contend on the same cache
+// lines. The slots of exited threads are reused by new threads, keeping their
+// values, so the sum of all the slots is cumulative.
+
+struct rrdset_latency_slot {
+    RRDSET_LATENCY latency;
+    int used;
+    struct rrdset_latency_slot *next;
+};
+
+static netdata_mutex_t rrdset_latency_slots_mutex = NETDATA_MUTEX_INITIALIZER;
+static struct rrdset_latency_slot *rrdset_latency_slots = NULL;
+static pthread_key_t rrdset_latency_slot_key;
+static pthread_once_t rrdset_latency_slot_key_once = PTHREAD_ONCE_INIT;
+static __thread struct rrdset_latency_slot *rrdset_latency_thread_slot = NULL;
+
+// called when a thread that has a slot exits
+static void rrdset_latency_slot_release(void *ptr) {
+    struct rrdset_latency_slot *slot = ptr;
+
+    netdata_mutex_lock(&rrdset_latency_slots_mutex);
+    slot->used = 0;
+    netdata_mutex_unlock(&rrdset_latency_slots_mutex);
+}
+
+static void rrdset_latency_slot_key_create(void) {
+    if(pthread_key_create(&rrdset_latency_slot_key, rrdset_latency_slot_release) != 0)
+        fatal("Cannot create the thread key of the collection latency histograms");
+}
+
+static inline RRDSET_LATENCY *rrdset_latency_thread(void) {
+    struct rrdset_latency_slot *slot = rrdset_latency_thread_slot;
+    if(likely(slot))
+        return &slot->latency;
+
+    pthread_once(&rrdset_latency_slot_key_once, rrdset_latency_slot_key_create);
+
+    netdata_mutex_lock(&rrdset_latency_slots_mutex);
+    for(slot = rrdset_latency_slots; slot && slot->used ; slot = slot->next) ;
+    if(!slot) {
+        slot = callocz(1, sizeof(struct rrdset_latency_slot));
+        slot->next = rrdset_latency_slots;
+        rrdset_latency_slots = slot;
+    }
+    slot->used = 1;
+    netdata_mutex_unlock(&rrdset_latency_slots_mutex);
+
+    pthread_setspecific(rrdset_latency_slot_key, slot);
+    rrdset_latency_thread_slot = slot;
+    return &slot->latency;
+}
+
+void rrdset_latency_all_get(RRDSET_LATENCY *dst) {
+    struct rrdset_latency_slot *slot;
+    HISTOGRAM h;
+
+    memset(dst, 0, sizeof(RRDSET_LATENCY));
+
+    netdata_mutex_lock(&rrdset_latency_slots_mutex);
+    for(slot = rrdset_latency_slots; slot ; slot = slot->next) {
+        histogram_snapshot(&h, &slot->latency.done);
+        histogram_merge(&dst->done, &h);
+        histogram_snapshot(&h, &slot->latency.store);
+        histogram_merge(&dst->store, &h);
+        histogram_snapshot(&h, &slot->latency.jitter);
+        histogram_merge(&dst->jitter, &h);
+    }
+    netdata_mutex_unlock(&rrdset_latency_slots_mutex);
+}
+
+// the memory of a chart, excluding its dimensions
+static inline size_t rrdset_memory_size(RRDSET *st) {
+    return st->memsize + sizeof(*st->state) + (st->state->latency ? sizeof(RRDSET_LATENCY) : 0);
+}
+
 void __rrdset_check_rdlock(RRDSET *st, const char *file, const char *function, const unsigned long line) {
     debug(D_RRD_CALLS, "Checking read lock on chart '%s'", st->id);
 
@@ -379,6 +458,8 @@ void rrdset_free(RRDSET *st) {
     netdata_rwlock_destroy(&st->rrdset_rwlock);
     netdata_rwlock_destroy(&st->state->labels.labels_rwlock);
 
+    memory_accounting_free(MEMORY_ACCOUNTING_CHARTS, rrdset_memory_size(st));
+
     // free directly allocated members
     freez(st->config_section);
     freez(st->plugin_name);
@@ -386,6 +467,13 @@ void rrdset_free(RRDSET *st) {
     freez(st->state->old_title);
     freez(st->state->old_context);
     free_label_list(st->state->labels.head);
+    freez(st->state->latency);
+    if(st->state->queries) {
+        memory_accounting_free(MEMORY_ACCOUNTING_CHARTS, sizeof(RRDSET_QUERIES));
+        freez(st->state->queries);
+    }
+    if(st->state->aggregate_member)
+        stream_aggregate_chart_free(st);
     freez(st->state);
     freez(st->chart_uuid);
 
@@ -840,6 +928,9 @@ RRDSET *rrdset_create_custom(
     st->type       = config_get(st->config_section, "type", type);
 
     st->state = callocz(1, sizeof(*st->state));
+    if(rrdset_latency_histograms)
+        st->state->latency = callocz(1, sizeof(RRDSET_LATENCY));
+    memory_accounting_alloc(MEMORY_ACCOUNTING_CHARTS, rrdset_memory_size(st));
     st->family     = config_get(st->config_section, "family", family?family:st->type);
     json_fix_string(st->family);
 
@@ -1376,8 +1467,25 @@ void rrdset_done(RRDSET *st) {
             next_store_ut = 0,      // the timestamp in microseconds, of the next entry to store in the db
             update_every_ut = st->update_every * USEC_PER_SEC; // st->update_every in microseconds
 
+    // the collection latency histograms of this thread and of this chart, when enabled
+    RRDSET_LATENCY *latency_all = rrdset_latency_collection ? rrdset_latency_thread() : NULL;
+    RRDSET_LATENCY *latency = st->state->latency;
+
+    usec_t
+            done_started_ut = unlikely(latency_all) ? now_monotonic_usec() : 0,
+            store_started_ut = 0,
+            store_ut = 0;
+
     netdata_thread_disable_cancelability();
 
+    if(unlikely(latency_all && st->counter_done)) {
+        // how far from update_every this collection happened
+        usec_t jitter = (st->usec_since_last_update > update_every_ut) ? st->usec_since_last_update - update_every_ut : update_every_ut - st->usec_since_last_update;
+        histogram_add_single_writer(&latency_all->jitter, jitter);
+        if(unlikely(latency))
+            histogram_add(&latency->jitter, jitter);
+    }
+
     // a read lock is OK here
     rrdset_rdlock(st);
 
@@ -1775,6 +1883,9 @@ void rrdset_done(RRDSET *st) {
     }
 #endif
 
+    if(unlikely(latency_all))
+        store_started_ut = now_monotonic_usec();
+
     rrdset_done_interpolate(st
             , update_every_ut
             , last_stored_ut
@@ -1785,6 +1896,13 @@ void rrdset_done(RRDSET *st) {
             , storage_flags
     );
 
+    if(unlikely(latency_all)) {
+        store_ut = now_monotonic_usec() - store_started_ut;
+        histogram_add_single_writer(&latency_all->store, store_ut);
+        if(unlikely(latency))
+            histogram_add(&latency->store, store_ut);
+    }
+
 after_second_database_work:
     st->last_collected_total  = st->collected_total;
 
@@ -1918,6 +2036,13 @@ void rrdset_done(RRDSET *st) {
 
     rrdset_unlock(st);
 
+    if(unlikely(latency_all)) {
+        usec_t done_ut = now_monotonic_usec() - done_started_ut;
+        histogram_add_single_writer(&latency_all->done, done_ut);
+        if(unlikely(latency))
+            histogram_add(&latency->done, done_ut);
+    }
+
     netdata_thread_enable_cancelability();
 }
 
@@ -895,26 +895,81 @@ void rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts(
     EXPORTING_OPTIONS exporting_options,
     PROMETHEUS_OUTPUT_OPTIONS output_options)
 {
-    if (unlikely(!prometheus_exporter_instance || !prometheus_exporter_instance->config.initialized))
-        return;
-
-    prometheus_exporter_instance->before = now_realtime_sec();
+    time_t after, before;
 
     // we start at the point we had stopped before
-    prometheus_exporter_instance->after = prometheus_preparation(
-        prometheus_exporter_instance,
-        host,
-        wb,
-        exporting_options,
-        server,
-        prometheus_exporter_instance->before,
-        output_options);
+    if (!rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts_begin(
+            host, wb, server, exporting_options, output_options, &after, &before))
+        return;
 
     rrd_rdlock();
     rrdhost_foreach_read(host)
     {
-        rrd_stats_api_v1_charts_allmetrics_prometheus(
-            prometheus_exporter_instance, host, wb, prefix, exporting_options, 1, output_options);
+        rrd_stats_api_v1_charts_allmetrics_prometheus_next_host(
+            host, wb, prefix, exporting_options, output_options, after, before);
     }
     rrd_unlock();
 }
+
+/**
+ * Start writing the metrics of all hosts to a buffer, in parts. The metrics of each host
+ * are written by rrd_stats_api_v1_charts_allmetrics_prometheus_next_host().
+ *
+ * @param host a data collecting host.
+ * @param wb the buffer to write to.
+ * @param server the name of a Prometheus server.
+ * @param exporting_options options to configure what data is exported.
+ * @param output_options options to configure the format of the output.
+ * @param after returns the start of the time range of the metrics.
+ * @param before returns the end of the time range of the metrics.
+ * @return Returns 0 when the prometheus exporter is not initialized, 1 otherwise.
+ */
+int rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts_begin(
+    RRDHOST *host,
+    BUFFER *wb,
+    const char *server,
+    EXPORTING_OPTIONS exporting_options,
+    PROMETHEUS_OUTPUT_OPTIONS output_options,
+    time_t *after,
+    time_t *before)
+{
+    if (unlikely(!prometheus_exporter_instance || !prometheus_exporter_instance->config.initialized))
+        return 0;
+
+    *before = now_realtime_sec();
+    *after = prometheus_preparation(
+        prometheus_exporter_instance, host, wb, exporting_options, server, *before, output_options);
+
+    return 1;
+}
+
+/**
+ * Write the metrics of one of all hosts to a buffer.
+ *
+ * @param host a data collecting host.
+ * @param wb the buffer to write to.
+ * @param prefix a prefix for every metric.
+ * @param exporting_options options to configure what data is exported.
+ * @param output_options options to configure the format of the output.
+ * @param after the start of the time range, as returned by rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts_begin().
+ * @param before the end of the time range, as returned by rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts_begin().
+ */
+void rrd_stats_api_v1_charts_allmetrics_prometheus_next_host(
+    RRDHOST *host,
+    BUFFER *wb,
+    const char *prefix,
+    EXPORTING_OPTIONS exporting_options,
+    PROMETHEUS_OUTPUT_OPTIONS output_options,
+    time_t after,
+    time_t before)
+{
+    if (unlikely(!prometheus_exporter_instance || !prometheus_exporter_instance->config.initialized))
+        return;
+
+    // other requests may have used the instance since the previous host
+    prometheus_exporter_instance->after = after;
+    prometheus_exporter_instance->before = before;
+
+    rrd_stats_api_v1_charts_allmetrics_prometheus(
+        prometheus_exporter_instance, host, wb, prefix, exporting_options, 1, output_options);
+}
@@ -28,6 +28,12 @@ extern void rrd_stats_api_v1_charts_allmetrics_prometheus_single_host(
 extern void rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts(
     RRDHOST *host, BUFFER *wb, const char *server, const char *prefix,
     EXPORTING_OPTIONS exporting_options, PROMETHEUS_OUTPUT_OPTIONS output_options);
+extern int rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts_begin(
+    RRDHOST *host, BUFFER *wb, const char *server,
+    EXPORTING_OPTIONS exporting_options, PROMETHEUS_OUTPUT_OPTIONS output_options, time_t *after, time_t *before);
+extern void rrd_stats_api_v1_charts_allmetrics_prometheus_next_host(
+    RRDHOST *host, BUFFER *wb, const char *prefix,
+    EXPORTING_OPTIONS exporting_options, PROMETHEUS_OUTPUT_OPTIONS output_options, time_t after, time_t before);
 
 int can_send_rrdset(struct instance *instance, RRDSET *st);
 size_t prometheus_name_copy(char *d, const char *s, size_t usable);
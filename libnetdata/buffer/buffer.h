@@ -20,6 +20,7 @@ typedef struct web_buffer {
 // options
 #define WB_CONTENT_CACHEABLE            1
 #define WB_CONTENT_NO_CACHEABLE         2
+#define WB_CONTENT_REVALIDATE           4 // with WB_CONTENT_NO_CACHEABLE, clients may keep it, but revalidate it with its ETag
 
 // content-types
 #define CT_APPLICATION_JSON             1
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "../libnetdata.h"
+
+usec_t histogram_bucket_upper_bound(size_t bucket) {
+    if(bucket < HISTOGRAM_SUB_BUCKETS)
+        return (usec_t)bucket + 1;
+
+    size_t msb = (bucket >> HISTOGRAM_SUB_BUCKET_BITS) + HISTOGRAM_SUB_BUCKET_BITS - 1;
+    size_t sub = bucket & (HISTOGRAM_SUB_BUCKETS - 1);
+
+    return (usec_t)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (msb - HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+void histogram_snapshot(HISTOGRAM *dst, HISTOGRAM *src) {
+    size_t i;
+
+    // histogram_add() updates the count last, so it is read first
+    // to avoid getting it ahead of the buckets
+    dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum = __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+
+    for(i = 0; i < HISTOGRAM_BUCKETS ; i++)
+        dst->buckets[i] = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+}
+
+void histogram_subtract(HISTOGRAM *dst, const HISTOGRAM *older) {
+    size_t i;
+
+    dst->count = (dst->count > older->count) ? dst->count - older->count : 0;
+    dst->sum = (dst->sum > older->sum) ? dst->sum - older->sum : 0;
+
+    for(i = 0; i < HISTOGRAM_BUCKETS ; i++)
+        dst->buckets[i] = (dst->buckets[i] > older->buckets[i]) ? dst->buckets[i] - older->buckets[i] : 0;
+}
+
+void histogram_merge(HISTOGRAM *dst, const HISTOGRAM *src) {
+    size_t i;
+
+    dst->count += src->count;
+    dst->sum += src->sum;
+
+    for(i = 0; i < HISTOGRAM_BUCKETS ; i++)
+        dst->buckets[i] += src->buckets[i];
+}
+
+void histogram_interval(HISTOGRAM *h, HISTOGRAM *last, HISTOGRAM *interval) {
+    histogram_snapshot(interval, h);
+
+    HISTOGRAM now = *interval;
+    histogram_subtract(interval, last);
+    *last = now;
+}
+
+usec_t histogram_percentile(const HISTOGRAM *h, double percentile) {
+    if(unlikely(!h->count))
+        return 0;
+
+    uint64_t wanted = (uint64_t)((double)h->count * percentile / 100.0);
+    if(wanted < 1) wanted = 1;
+
+    uint64_t seen = 0;
+    size_t i;
+    for(i = 0; i < HISTOGRAM_BUCKETS ; i++) {
+        seen += h->buckets[i];
+        if(seen >= wanted)
+            return histogram_bucket_upper_bound(i);
+    }
+
+    return histogram_bucket_upper_bound(HISTOGRAM_BUCKETS - 1);
+}
+
+usec_t histogram_average(const HISTOGRAM *h) {
+    if(unlikely(!h->count))
+        return 0;
+
+    return (usec_t)(h->sum / h->count);
+}
+
+void histogram_to_json(const HISTOGRAM *h, BUFFER *wb) {
+    size_t i;
+    int first = 1;
+
+    buffer_sprintf(wb, "{ \"count\": %llu, \"sum\": %llu, \"average\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"buckets\": ["
+                   , (unsigned long long)h->count
+                   , (unsigned long long)h->sum
+                   , histogram_average(h)
+                   , histogram_percentile(h, 50.0)
+                   , histogram_percentile(h, 90.0)
+                   , histogram_percentile(h, 99.0)
+    );
+
+    for(i = 0; i < HISTOGRAM_BUCKETS ; i++) {
+        if(!h->buckets[i]) continue;
+
+        buffer_sprintf(wb, "%s[%llu, %llu]", first ? " " : ", ", histogram_bucket_upper_bound(i), (unsigned long long)h->buckets[i]);
+        first = 0;
+    }
+
+    buffer_strcat(wb, " ] }");
+}
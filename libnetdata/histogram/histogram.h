@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_HISTOGRAM_H
+#define NETDATA_HISTOGRAM_H 1
+
+#include "../libnetdata.h"
+
+// ----------------------------------------------------------------------------
+// log-linear latency histogram
+//
+// Every power of two is split into HISTOGRAM_SUB_BUCKETS linear buckets, so
+// the relative error of any bucket is at most 1 / HISTOGRAM_SUB_BUCKETS.
+// Values are microseconds. Anything above 2^HISTOGRAM_VALUE_BITS is counted
+// in the last bucket. Increments are relaxed atomics, so any number of
+// threads can add values while others take snapshots.
+
+#define HISTOGRAM_SUB_BUCKET_BITS 2
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_VALUE_BITS 27 // about 134 seconds
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS)
+
+typedef struct histogram {
+    uint64_t count;                         // number of values added
+    uint64_t sum;                           // the sum of all values added
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} HISTOGRAM;
+
+static inline size_t histogram_bucket(usec_t value) {
+    if(unlikely(value < HISTOGRAM_SUB_BUCKETS))
+        return (size_t)value;
+
+    if(unlikely(value >= (1ULL << HISTOGRAM_VALUE_BITS)))
+        return HISTOGRAM_BUCKETS - 1;
+
+    size_t msb = (sizeof(unsigned long long) * 8 - 1) - (size_t)__builtin_clzll(value);
+    size_t shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+
+    return ((msb - HISTOGRAM_SUB_BUCKET_BITS + 1) << HISTOGRAM_SUB_BUCKET_BITS)
+           + (size_t)((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static inline void histogram_add(HISTOGRAM *h, usec_t value) {
+    __atomic_add_fetch(&h->buckets[histogram_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, value, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+// for histograms updated by one thread only: no locked instructions, and readers
+// taking snapshots from other threads still see whole counters
+static inline void histogram_add_single_writer(HISTOGRAM *h, usec_t value) {
+    size_t bucket = histogram_bucket(value);
+
+    __atomic_store_n(&h->buckets[bucket], h->buckets[bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+// the first value that does not belong to the bucket
+extern usec_t histogram_bucket_upper_bound(size_t bucket);
+
+// copy a histogram that may be updated concurrently
+extern void histogram_snapshot(HISTOGRAM *dst, HISTOGRAM *src);
+
+// dst = dst - older, to get the values added between two snapshots
+extern void histogram_subtract(HISTOGRAM *dst, const HISTOGRAM *older);
+
+// dst = dst + src, to sum the histograms of many threads
+extern void histogram_merge(HISTOGRAM *dst, const HISTOGRAM *src);
+
+// interval = the values added to h since the last call, last = the current state of h
+extern void histogram_interval(HISTOGRAM *h, HISTOGRAM *last, HISTOGRAM *interval);
+
+// percentile is 0 - 100, the upper bound of the matching bucket is returned
+extern usec_t histogram_percentile(const HISTOGRAM *h, double percentile);
+extern usec_t histogram_average(const HISTOGRAM *h);
+
+// a json object with the count, the sum, a few percentiles and the non-empty buckets
+extern void histogram_to_json(const HISTOGRAM *h, BUFFER *wb);
+
+#endif /* NETDATA_HISTOGRAM_H */
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "../../libnetdata.h"
+#include "../../required_dummies.h"
+#include <setjmp.h>
+#include <cmocka.h>
+
+static void test_bucket_edges(void **state)
+{
+    (void)state;
+
+    // the first buckets have one value each
+    for (usec_t value = 0; value < HISTOGRAM_SUB_BUCKETS; value++) {
+        assert_int_equal(histogram_bucket(value), value);
+        assert_int_equal(histogram_bucket_upper_bound(value), value + 1);
+    }
+
+    // every bucket starts where the previous one ends
+    usec_t lower = 0;
+    for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        usec_t upper = histogram_bucket_upper_bound(bucket);
+        assert_true(upper > lower);
+
+        assert_int_equal(histogram_bucket(lower), bucket);
+        assert_int_equal(histogram_bucket(upper - 1), bucket);
+        if (bucket + 1 < HISTOGRAM_BUCKETS)
+            assert_int_equal(histogram_bucket(upper), bucket + 1);
+
+        // the relative error promised by the header
+        if (bucket >= HISTOGRAM_SUB_BUCKETS)
+            assert_true((upper - lower) * HISTOGRAM_SUB_BUCKETS <= lower);
+
+        lower = upper;
+    }
+
+    // the last bucket ends at the largest value and takes everything above it
+    assert_int_equal(lower, 1ULL << HISTOGRAM_VALUE_BITS);
+    assert_int_equal(histogram_bucket(1ULL << HISTOGRAM_VALUE_BITS), HISTOGRAM_BUCKETS - 1);
+    assert_int_equal(histogram_bucket(~0ULL), HISTOGRAM_BUCKETS - 1);
+}
+
+static void test_percentiles(void **state)
+{
+    (void)state;
+
+    HISTOGRAM h, other, last, interval;
+    memset(&h, 0, sizeof(h));
+    memset(&other, 0, sizeof(other));
+    memset(&last, 0, sizeof(last));
+
+    assert_int_equal(histogram_percentile(&h, 50.0), 0);
+    assert_int_equal(histogram_average(&h), 0);
+
+    for (usec_t value = 1; value <= 100; value++)
+        histogram_add(&h, value);
+
+    assert_int_equal(h.count, 100);
+    assert_int_equal(h.sum, 5050);
+    assert_int_equal(histogram_average(&h), 50);
+
+    // the upper bound of the bucket of the value at the percentile
+    assert_int_equal(histogram_percentile(&h, 0.0), histogram_bucket_upper_bound(histogram_bucket(1)));
+    assert_int_equal(histogram_percentile(&h, 50.0), histogram_bucket_upper_bound(histogram_bucket(50)));
+    assert_int_equal(histogram_percentile(&h, 100.0), histogram_bucket_upper_bound(histogram_bucket(100)));
+
+    histogram_add_single_writer(&other, 1000000);
+    histogram_merge(&h, &other);
+    assert_int_equal(h.count, 101);
+    assert_int_equal(histogram_percentile(&h, 100.0), histogram_bucket_upper_bound(histogram_bucket(1000000)));
+
+    // the interval has only the values added since the previous one
+    histogram_interval(&h, &last, &interval);
+    assert_int_equal(interval.count, 101);
+    histogram_add(&h, 7);
+    histogram_interval(&h, &last, &interval);
+    assert_int_equal(interval.count, 1);
+    assert_int_equal(interval.sum, 7);
+    assert_int_equal(interval.buckets[histogram_bucket(7)], 1);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_bucket_edges),
+        cmocka_unit_test(test_percentiles)
+    };
+
+    return cmocka_run_group_tests_name("histogram", tests, NULL, NULL);
+}
@@ -153,6 +153,14 @@ extern "C" {
 #include <zlib.h>
 #endif
 
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef ENABLE_BROTLI
+#include <brotli/encode.h>
+#endif
+
 #ifdef HAVE_CAPABILITY
 #include <sys/capability.h>
 #endif
@@ -308,6 +316,8 @@ extern char *netdata_configured_host_prefix;
 #include "buffer/buffer.h"
 #include "locks/locks.h"
 #include "circular_buffer/circular_buffer.h"
+#include "slab/slab.h"
+#include "memory_accounting/memory_accounting.h"
 #include "avl/avl.h"
 #include "inlined.h"
 #include "clocks/clocks.h"
@@ -326,6 +336,7 @@ extern char *netdata_configured_host_prefix;
 #endif
 #include "eval/eval.h"
 #include "statistical/statistical.h"
+#include "histogram/histogram.h"
 #include "adaptive_resortable_list/adaptive_resortable_list.h"
 #include "url/url.h"
 #include "json/json.h"
@@ -474,6 +474,337 @@ static inline void log_unlock() {
     netdata_mutex_unlock(&log_mutex);
 }
 
+static netdata_mutex_t access_mutex = NETDATA_MUTEX_INITIALIZER;
+
+// ----------------------------------------------------------------------------
+// asynchronous logging
+//
+// Log lines are formatted in a per-thread staging buffer and copied to a
+// bounded multi-producer / single-consumer ring of fixed size slots. Producers
+// claim slots with a compare-and-swap on the enqueue position, so they never
+// block on each other or on the log files. A dedicated thread drains the ring
+// and writes the lines to the files in batches.
+//
+// When the ring is full, producers wait for the writer for a short time and
+// then drop the line. Lines that do not fit in a slot are written
+// synchronously. Until log_async_start() is called (and in forked children)
+// everything is written synchronously, as before.
+
+#define LOG_ASYNC_QUEUE_SIZE 1024               // slots, must be a power of two
+#define LOG_ASYNC_LINE_MAX 1024                 // bytes per slot
+#define LOG_ASYNC_BATCH_MAX (64 * 1024)         // bytes the writer writes at once
+#define LOG_ASYNC_FULL_RETRIES 10               // times a producer waits for the writer when the ring is full
+#define LOG_ASYNC_FULL_WAIT_UT 100              // microseconds per wait
+#define LOG_ASYNC_IDLE_WAIT_MS 100              // the writer sleeps at most this much when idle
+
+typedef enum log_target {
+    LOG_TARGET_STDERR = 0,
+    LOG_TARGET_ACCESS = 1,
+} LOG_TARGET;
+
+struct log_async_slot {
+    size_t sequence;
+    LOG_TARGET target;
+    size_t len;
+    char line[LOG_ASYNC_LINE_MAX];
+};
+
+static struct log_async_slot *log_async_ring = NULL;
+static size_t log_async_enqueue_pos = 0;
+static size_t log_async_dequeue_pos = 0;
+
+static int log_async_running = 0;
+static int log_async_stopping = 0;
+static int log_async_writer_idle = 0;
+static netdata_thread_t log_async_thread;
+
+static pthread_mutex_t log_async_idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_async_idle_cond = PTHREAD_COND_INITIALIZER;
+
+static LOG_ASYNC_STATISTICS log_async_stats;
+
+static __thread char log_staging[LOG_ASYNC_LINE_MAX];
+
+static inline void log_async_wake_writer(void) {
+    if(__atomic_load_n(&log_async_writer_idle, __ATOMIC_ACQUIRE))
+        pthread_cond_signal(&log_async_idle_cond);
+}
+
+// returns 0 when the line has been queued
+static int log_async_enqueue(LOG_TARGET target, const char *line, size_t len) {
+    size_t retries = 0;
+
+    if(unlikely(len > LOG_ASYNC_LINE_MAX)) {
+        __atomic_add_fetch(&log_async_stats.oversized, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    size_t pos = __atomic_load_n(&log_async_enqueue_pos, __ATOMIC_RELAXED);
+    for(;;) {
+        struct log_async_slot *slot = &log_async_ring[pos & (LOG_ASYNC_QUEUE_SIZE - 1)];
+        size_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if(likely(dif == 0)) {
+            if(__atomic_compare_exchange_n(&log_async_enqueue_pos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->target = target;
+                slot->len = len;
+                memcpy(slot->line, line, len);
+                __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+                __atomic_add_fetch(&log_async_stats.queued, 1, __ATOMIC_RELAXED);
+                log_async_wake_writer();
+                return 0;
+            }
+            // pos has been updated by the failed compare-and-swap
+        }
+        else if(dif < 0) {
+            // the ring is full
+            if(retries++ == LOG_ASYNC_FULL_RETRIES) {
+                __atomic_add_fetch(&log_async_stats.dropped, 1, __ATOMIC_RELAXED);
+                return 0;
+            }
+
+            __atomic_add_fetch(&log_async_stats.waits, 1, __ATOMIC_RELAXED);
+            log_async_wake_writer();
+            sleep_usec(LOG_ASYNC_FULL_WAIT_UT);
+            pos = __atomic_load_n(&log_async_enqueue_pos, __ATOMIC_RELAXED);
+        }
+        else
+            pos = __atomic_load_n(&log_async_enqueue_pos, __ATOMIC_RELAXED);
+    }
+}
+
+static void log_async_write_batch(LOG_TARGET target, const char *batch, size_t len) {
+    if(!len) return;
+
+    if(target == LOG_TARGET_ACCESS) {
+        netdata_mutex_lock(&access_mutex);
+        if(stdaccess) {
+            fwrite(batch, 1, len, stdaccess);
+            fflush(stdaccess);
+        }
+        netdata_mutex_unlock(&access_mutex);
+    }
+    else {
+        log_lock();
+        fwrite(batch, 1, len, stderr);
+        fflush(stderr);
+        log_unlock();
+    }
+
+    __atomic_add_fetch(&log_async_stats.batches, 1, __ATOMIC_RELAXED);
+}
+
+// single consumer - only the writer thread (or log_async_stop() after it has exited) calls this
+static size_t log_async_drain(char *batch) {
+    size_t lines = 0, batch_len = 0;
+    LOG_TARGET batch_target = LOG_TARGET_STDERR;
+
+    for(;;) {
+        size_t pos = log_async_dequeue_pos;
+        struct log_async_slot *slot = &log_async_ring[pos & (LOG_ASYNC_QUEUE_SIZE - 1)];
+
+        if(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+
+        if(batch_len && (slot->target != batch_target || batch_len + slot->len > LOG_ASYNC_BATCH_MAX)) {
+            log_async_write_batch(batch_target, batch, batch_len);
+            batch_len = 0;
+        }
+
+        batch_target = slot->target;
+        memcpy(&batch[batch_len], slot->line, slot->len);
+        batch_len += slot->len;
+
+        __atomic_store_n(&slot->sequence, pos + LOG_ASYNC_QUEUE_SIZE, __ATOMIC_RELEASE);
+        __atomic_store_n(&log_async_dequeue_pos, pos + 1, __ATOMIC_RELEASE);
+        lines++;
+    }
+
+    log_async_write_batch(batch_target, batch, batch_len);
+    return lines;
+}
+
+static void log_async_report_dropped(size_t *reported) {
+    size_t dropped = __atomic_load_n(&log_async_stats.dropped, __ATOMIC_RELAXED);
+    if(likely(dropped == *reported))
+        return;
+
+    char date[LOG_DATE_LENGTH];
+    log_date(date, LOG_DATE_LENGTH);
+
+    log_lock();
+    fprintf(stderr, "%s: %s LOG ASYNC dropped %zu log lines, the log queue was full.\n", date, program_name, dropped - *reported);
+    log_unlock();
+
+    *reported = dropped;
+}
+
+static void *log_async_writer_main(void *ptr) {
+    (void)ptr;
+
+    char *batch = mallocz(LOG_ASYNC_BATCH_MAX);
+    size_t reported_dropped = 0;
+
+    while(!__atomic_load_n(&log_async_stopping, __ATOMIC_ACQUIRE)) {
+        log_async_report_dropped(&reported_dropped);
+
+        if(log_async_drain(batch))
+            continue;
+
+        // nothing to write - wait for the producers
+        // wake ups may be missed, so the wait is limited
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += LOG_ASYNC_IDLE_WAIT_MS * 1000000L;
+        if(ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&log_async_idle_mutex);
+        __atomic_store_n(&log_async_writer_idle, 1, __ATOMIC_RELEASE);
+        if(__atomic_load_n(&log_async_enqueue_pos, __ATOMIC_ACQUIRE) == log_async_dequeue_pos)
+            pthread_cond_timedwait(&log_async_idle_cond, &log_async_idle_mutex, &ts);
+        __atomic_store_n(&log_async_writer_idle, 0, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&log_async_idle_mutex);
+    }
+
+    log_async_drain(batch);
+    log_async_report_dropped(&reported_dropped);
+    freez(batch);
+
+    return NULL;
+}
+
+// a forked child does not have the writer thread
+static void log_async_atfork_child(void) {
+    log_async_running = 0;
+}
+
+void log_async_start(void) {
+    size_t i;
+
+    if(log_async_running)
+        return;
+
+    log_async_ring = mallocz(LOG_ASYNC_QUEUE_SIZE * sizeof(struct log_async_slot));
+    for(i = 0; i < LOG_ASYNC_QUEUE_SIZE ; i++)
+        log_async_ring[i].sequence = i;
+
+    log_async_enqueue_pos = 0;
+    log_async_dequeue_pos = 0;
+    log_async_stopping = 0;
+
+    static int atfork_registered = 0;
+    if(!atfork_registered) {
+        pthread_atfork(NULL, NULL, log_async_atfork_child);
+        atfork_registered = 1;
+    }
+
+    if(netdata_thread_create(&log_async_thread, "LOGGER", NETDATA_THREAD_OPTION_JOINABLE | NETDATA_THREAD_OPTION_DONT_LOG, log_async_writer_main, NULL)) {
+        error("LOG ASYNC: cannot create the log writer thread, logging synchronously.");
+        freez(log_async_ring);
+        log_async_ring = NULL;
+        return;
+    }
+
+    __atomic_store_n(&log_async_running, 1, __ATOMIC_RELEASE);
+}
+
+void log_async_stop(void) {
+    if(!__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE))
+        return;
+
+    // new lines are written synchronously from now on
+    __atomic_store_n(&log_async_running, 0, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&log_async_stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&log_async_idle_cond);
+    netdata_thread_join(log_async_thread, NULL);
+
+    // the ring is not freed, a producer may still be copying a line into it
+}
+
+// wait (for a limited time) until the writer has written everything queued so far
+static void log_async_flush(void) {
+    size_t timeout_ms = 1000;
+
+    if(!__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE) || pthread_equal(netdata_thread_self(), log_async_thread))
+        return;
+
+    size_t pos = __atomic_load_n(&log_async_enqueue_pos, __ATOMIC_ACQUIRE);
+    while(timeout_ms-- && (ssize_t)(pos - __atomic_load_n(&log_async_dequeue_pos, __ATOMIC_ACQUIRE)) > 0) {
+        pthread_cond_signal(&log_async_idle_cond);
+        sleep_usec(1000);
+    }
+}
+
+void log_async_get_statistics(LOG_ASYNC_STATISTICS *stats) {
+    stats->queued = __atomic_load_n(&log_async_stats.queued, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&log_async_stats.dropped, __ATOMIC_RELAXED);
+    stats->waits = __atomic_load_n(&log_async_stats.waits, __ATOMIC_RELAXED);
+    stats->oversized = __atomic_load_n(&log_async_stats.oversized, __ATOMIC_RELAXED);
+    stats->batches = __atomic_load_n(&log_async_stats.batches, __ATOMIC_RELAXED);
+}
+
+// write a complete line (with its newline) to its log file
+static void log_write(LOG_TARGET target, const char *line, size_t len) {
+    if(likely(__atomic_load_n(&log_async_running, __ATOMIC_ACQUIRE)) && !log_async_enqueue(target, line, len))
+        return;
+
+    if(target == LOG_TARGET_ACCESS) {
+        if(web_server_is_multithreaded)
+            netdata_mutex_lock(&access_mutex);
+
+        if(stdaccess)
+            fwrite(line, 1, len, stdaccess);
+
+        if(web_server_is_multithreaded)
+            netdata_mutex_unlock(&access_mutex);
+    }
+    else {
+        log_lock();
+        fwrite(line, 1, len, stderr);
+        log_unlock();
+    }
+}
+
+static inline size_t log_header_length(int printed) {
+    if(unlikely(printed < 0)) return 0;
+    if(unlikely(printed >= LOG_ASYNC_LINE_MAX)) return LOG_ASYNC_LINE_MAX - 1;
+    return (size_t)printed;
+}
+
+// the header of the line has already been printed in log_staging
+static void log_vwrite(LOG_TARGET target, size_t header_len, const char *suffix, const char *fmt, va_list args) {
+    size_t suffix_len = strlen(suffix);
+    va_list args_copy;
+
+    va_copy(args_copy, args);
+
+    int printed = vsnprintf(&log_staging[header_len], LOG_ASYNC_LINE_MAX - header_len, fmt, args);
+    size_t body_len = (printed > 0) ? (size_t)printed : 0;
+    size_t len = header_len + body_len + suffix_len;
+
+    if(likely(len < LOG_ASYNC_LINE_MAX)) {
+        memcpy(&log_staging[header_len + body_len], suffix, suffix_len);
+        log_write(target, log_staging, len);
+    }
+    else {
+        // the line does not fit in the staging buffer
+        char *line = mallocz(len + 1);
+        memcpy(line, log_staging, header_len);
+        vsnprintf(&line[header_len], body_len + 1, fmt, args_copy);
+        memcpy(&line[header_len + body_len], suffix, suffix_len);
+        log_write(target, line, len);
+        freez(line);
+    }
+
+    va_end(args_copy);
+}
+
 static FILE *open_log_file(int fd, FILE *fp, const char *filename, int *enabled_syslog, int is_stdaccess, int *fd_ptr) {
     int f, devnull = 0;
 
@@ -717,17 +1048,13 @@ void info_int( const char *file, const char *function, const unsigned long line,
     char date[LOG_DATE_LENGTH];
     log_date(date, LOG_DATE_LENGTH);
 
-    log_lock();
+    size_t header_len;
+    if(debug_flags) header_len = log_header_length(snprintf(log_staging, LOG_ASYNC_LINE_MAX, "%s: %s INFO  : %s : (%04lu@%-10.10s:%-15.15s): ", date, program_name, netdata_thread_tag(), line, file, function));
+    else            header_len = log_header_length(snprintf(log_staging, LOG_ASYNC_LINE_MAX, "%s: %s INFO  : %s : ", date, program_name, netdata_thread_tag()));
 
     va_start( args, fmt );
-    if(debug_flags) fprintf(stderr, "%s: %s INFO  : %s : (%04lu@%-10.10s:%-15.15s): ", date, program_name, netdata_thread_tag(), line, file, function);
-    else            fprintf(stderr, "%s: %s INFO  : %s : ", date, program_name, netdata_thread_tag());
-    vfprintf( stderr, fmt, args );
+    log_vwrite(LOG_TARGET_STDERR, header_len, "\n", fmt, args);
     va_end( args );
-
-    fputc('\n', stderr);
-
-    log_unlock();
 }
 
 // ----------------------------------------------------------------------------
@@ -773,23 +1100,20 @@ void error_int( const char *prefix, const char *file, const char *function, cons
     char date[LOG_DATE_LENGTH];
     log_date(date, LOG_DATE_LENGTH);
 
-    log_lock();
-
-    va_start( args, fmt );
-    if(debug_flags) fprintf(stderr, "%s: %s %-5.5s : %s : (%04lu@%-10.10s:%-15.15s): ", date, program_name, prefix, netdata_thread_tag(), line, file, function);
-    else            fprintf(stderr, "%s: %s %-5.5s : %s : ", date, program_name, prefix, netdata_thread_tag());
-    vfprintf( stderr, fmt, args );
-    va_end( args );
+    size_t header_len;
+    if(debug_flags) header_len = log_header_length(snprintf(log_staging, LOG_ASYNC_LINE_MAX, "%s: %s %-5.5s : %s : (%04lu@%-10.10s:%-15.15s): ", date, program_name, prefix, netdata_thread_tag(), line, file, function));
+    else            header_len = log_header_length(snprintf(log_staging, LOG_ASYNC_LINE_MAX, "%s: %s %-5.5s : %s : ", date, program_name, prefix, netdata_thread_tag()));
 
+    char suffix[1024 + 50] = "\n";
     if(__errno) {
         char buf[1024];
-        fprintf(stderr, " (errno %d, %s)\n", __errno, strerror_result(strerror_r(__errno, buf, 1023), buf));
+        snprintfz(suffix, sizeof(suffix) - 1, " (errno %d, %s)\n", __errno, strerror_result(strerror_r(__errno, buf, 1023), buf));
         errno = 0;
     }
-    else
-        fputc('\n', stderr);
 
-    log_unlock();
+    va_start( args, fmt );
+    log_vwrite(LOG_TARGET_STDERR, header_len, suffix, fmt, args);
+    va_end( args );
 }
 
 void fatal_int( const char *file, const char *function, const unsigned long line, const char *fmt, ... ) {
@@ -816,6 +1140,9 @@ void fatal_int( const char *file, const char *function, const unsigned long line
     char date[LOG_DATE_LENGTH];
     log_date(date, LOG_DATE_LENGTH);
 
+    // the fatal message is written synchronously, after everything queued before it
+    log_async_flush();
+
     log_lock();
 
     va_start( args, fmt );
@@ -852,21 +1179,13 @@ void log_access( const char *fmt, ... ) {
     }
 
     if(stdaccess) {
-        static netdata_mutex_t access_mutex = NETDATA_MUTEX_INITIALIZER;
-
-        if(web_server_is_multithreaded)
-            netdata_mutex_lock(&access_mutex);
-
         char date[LOG_DATE_LENGTH];
         log_date(date, LOG_DATE_LENGTH);
-        fprintf(stdaccess, "%s: ", date);
+
+        size_t header_len = log_header_length(snprintf(log_staging, LOG_ASYNC_LINE_MAX, "%s: ", date));
 
         va_start( args, fmt );
-        vfprintf( stdaccess, fmt, args );
+        log_vwrite(LOG_TARGET_ACCESS, header_len, "\n", fmt, args);
         va_end( args );
-        fputc('\n', stdaccess);
-
-        if(web_server_is_multithreaded)
-            netdata_mutex_unlock(&access_mutex);
     }
 }
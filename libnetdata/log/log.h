@@ -76,6 +76,19 @@ extern int error_log_limit(int reset);
 extern void open_all_log_files();
 extern void reopen_all_log_files();
 
+typedef struct log_async_statistics {
+    size_t queued;      // lines queued for the writer thread
+    size_t dropped;     // lines dropped because the queue was full
+    size_t waits;       // times a logging thread waited for the writer because the queue was full
+    size_t oversized;   // lines too long for the queue, written synchronously
+    size_t batches;     // writes to the log files made by the writer thread
+} LOG_ASYNC_STATISTICS;
+
+// write error, info and access log lines from a dedicated thread
+extern void log_async_start(void);
+extern void log_async_stop(void);
+extern void log_async_get_statistics(LOG_ASYNC_STATISTICS *stats);
+
 static inline void debug_dummy(void) {}
 
 #define error_log_limit_reset() do { error_log_errors_per_period = error_log_errors_per_period_backup; error_log_limit(1); } while(0)
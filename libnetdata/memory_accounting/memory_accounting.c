@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "../libnetdata.h"
+
+__thread struct memory_accounting_thread *memory_accounting_local = NULL;
+
+static netdata_mutex_t memory_accounting_mutex = NETDATA_MUTEX_INITIALIZER;
+static struct memory_accounting_thread *memory_accounting_threads = NULL;
+static MEMORY_ACCOUNTING_STATISTICS memory_accounting_exited[MEMORY_ACCOUNTING_SUBSYSTEMS];
+
+static const char *memory_accounting_names[MEMORY_ACCOUNTING_SUBSYSTEMS] = {
+        [MEMORY_ACCOUNTING_CHARTS]     = "charts",
+        [MEMORY_ACCOUNTING_DIMENSIONS] = "dimensions",
+        [MEMORY_ACCOUNTING_STREAMING]  = "streaming",
+        [MEMORY_ACCOUNTING_WEB]        = "web",
+        [MEMORY_ACCOUNTING_STATSD]     = "statsd",
+};
+
+const char *memory_accounting_subsystem_name(MEMORY_ACCOUNTING_SUBSYSTEM subsystem) {
+    if(unlikely(subsystem >= MEMORY_ACCOUNTING_SUBSYSTEMS))
+        return "unknown";
+
+    return memory_accounting_names[subsystem];
+}
+
+struct memory_accounting_thread *memory_accounting_thread_register(void) {
+    // calloc() instead of callocz(), fatal() may allocate memory
+    struct memory_accounting_thread *t = calloc(1, sizeof(struct memory_accounting_thread));
+    if(unlikely(!t))
+        fatal("MEMORY ACCOUNTING: cannot allocate the counters of thread %d", gettid());
+
+    netdata_mutex_lock(&memory_accounting_mutex);
+    t->next = memory_accounting_threads;
+    if(memory_accounting_threads) memory_accounting_threads->prev = t;
+    memory_accounting_threads = t;
+    netdata_mutex_unlock(&memory_accounting_mutex);
+
+    memory_accounting_local = t;
+    return t;
+}
+
+void memory_accounting_thread_release(void) {
+    struct memory_accounting_thread *t = memory_accounting_local;
+    size_t i;
+
+    if(!t) return;
+
+    netdata_mutex_lock(&memory_accounting_mutex);
+    for(i = 0; i < MEMORY_ACCOUNTING_SUBSYSTEMS ; i++) {
+        memory_accounting_exited[i].bytes += t->subsystems[i].bytes;
+        memory_accounting_exited[i].objects += t->subsystems[i].objects;
+    }
+
+    if(t->prev) t->prev->next = t->next;
+    if(t->next) t->next->prev = t->prev;
+    if(memory_accounting_threads == t) memory_accounting_threads = t->next;
+    netdata_mutex_unlock(&memory_accounting_mutex);
+
+    memory_accounting_local = NULL;
+    free(t);
+}
+
+void memory_accounting_get(MEMORY_ACCOUNTING_STATISTICS stats[MEMORY_ACCOUNTING_SUBSYSTEMS]) {
+    struct memory_accounting_thread *t;
+    size_t i;
+
+    netdata_mutex_lock(&memory_accounting_mutex);
+
+    for(i = 0; i < MEMORY_ACCOUNTING_SUBSYSTEMS ; i++)
+        stats[i] = memory_accounting_exited[i];
+
+    for(t = memory_accounting_threads; t ; t = t->next) {
+        for(i = 0; i < MEMORY_ACCOUNTING_SUBSYSTEMS ; i++) {
+            stats[i].bytes += __atomic_load_n(&t->subsystems[i].bytes, __ATOMIC_RELAXED);
+            stats[i].objects += __atomic_load_n(&t->subsystems[i].objects, __ATOMIC_RELAXED);
+        }
+    }
+
+    netdata_mutex_unlock(&memory_accounting_mutex);
+}
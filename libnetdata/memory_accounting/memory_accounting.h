@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_MEMORY_ACCOUNTING_H
+#define NETDATA_MEMORY_ACCOUNTING_H 1
+
+#include "../libnetdata.h"
+
+// ----------------------------------------------------------------------------
+// memory accounting per subsystem
+//
+// Every thread updates its own counters, without locks or atomic
+// read-modify-write operations. Readers sum the counters of all threads.
+// Memory allocated by one thread and freed by another is accounted correctly
+// in the sum, although the counters of each thread may become negative.
+
+typedef enum memory_accounting_subsystem {
+    MEMORY_ACCOUNTING_CHARTS = 0,       // RRDSET structures and their round robin databases
+    MEMORY_ACCOUNTING_DIMENSIONS,       // RRDDIM structures and their round robin databases
+    MEMORY_ACCOUNTING_STREAMING,        // senders and receivers
+    MEMORY_ACCOUNTING_WEB,              // web clients and their buffers
+    MEMORY_ACCOUNTING_STATSD,           // statsd metrics and sockets
+
+    // terminator
+    MEMORY_ACCOUNTING_SUBSYSTEMS
+} MEMORY_ACCOUNTING_SUBSYSTEM;
+
+typedef struct memory_accounting_statistics {
+    ssize_t bytes;
+    ssize_t objects;
+} MEMORY_ACCOUNTING_STATISTICS;
+
+struct memory_accounting_thread {
+    MEMORY_ACCOUNTING_STATISTICS subsystems[MEMORY_ACCOUNTING_SUBSYSTEMS];
+    struct memory_accounting_thread *prev;
+    struct memory_accounting_thread *next;
+};
+
+extern __thread struct memory_accounting_thread *memory_accounting_local;
+extern struct memory_accounting_thread *memory_accounting_thread_register(void);
+
+static inline MEMORY_ACCOUNTING_STATISTICS *memory_accounting_counters(MEMORY_ACCOUNTING_SUBSYSTEM subsystem) {
+    struct memory_accounting_thread *t = memory_accounting_local;
+    if(unlikely(!t))
+        t = memory_accounting_thread_register();
+
+    return &t->subsystems[subsystem];
+}
+
+// only this thread writes its counters, a relaxed store is enough for the readers
+static inline void memory_accounting_update(MEMORY_ACCOUNTING_SUBSYSTEM subsystem, ssize_t bytes, ssize_t objects) {
+    MEMORY_ACCOUNTING_STATISTICS *c = memory_accounting_counters(subsystem);
+    __atomic_store_n(&c->bytes, c->bytes + bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->objects, c->objects + objects, __ATOMIC_RELAXED);
+}
+
+#define memory_accounting_alloc(subsystem, bytes) memory_accounting_update(subsystem, (ssize_t)(bytes), 1)
+#define memory_accounting_free(subsystem, bytes) memory_accounting_update(subsystem, -(ssize_t)(bytes), -1)
+#define memory_accounting_resize(subsystem, delta_bytes) memory_accounting_update(subsystem, (ssize_t)(delta_bytes), 0)
+
+extern const char *memory_accounting_subsystem_name(MEMORY_ACCOUNTING_SUBSYSTEM subsystem);
+
+// sum the counters of all threads
+extern void memory_accounting_get(MEMORY_ACCOUNTING_STATISTICS stats[MEMORY_ACCOUNTING_SUBSYSTEMS]);
+
+// move the counters of the calling thread to the totals of the exited threads
+extern void memory_accounting_thread_release(void);
+
+#endif /* NETDATA_MEMORY_ACCOUNTING_H */
@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "../libnetdata.h"
+
+#define SLAB_ELEMENT_ALIGNMENT 8
+#define SLAB_ALIGN(x, a) (((x) + (a) - 1) & ~((size_t)(a) - 1))
+
+struct slab_free_element {
+    struct slab_free_element *next;
+};
+
+struct slab_chunk {
+    struct slab_chunk *prev;
+    struct slab_chunk *next;
+
+    struct slab_free_element *free_list;
+    size_t used;    // elements given out of this chunk (including the ones in thread caches)
+    size_t carved;  // elements initialized so far, the rest are carved lazily
+};
+
+struct slab_thread_cache {
+    struct slab_free_element *free_list;
+    size_t count;
+    size_t generation;
+};
+
+static __thread struct slab_thread_cache slab_thread_caches[SLAB_MAX_INSTANCES];
+
+static netdata_mutex_t slabs_mutex = NETDATA_MUTEX_INITIALIZER;
+static SLAB *slabs[SLAB_MAX_INSTANCES];
+static size_t slabs_generation[SLAB_MAX_INSTANCES];
+static size_t slabs_generation_counter = 0;
+
+static inline size_t round_up_to_power_of_two(size_t x) {
+    size_t p = 1;
+    while(p < x) p <<= 1;
+    return p;
+}
+
+static inline struct slab_chunk *slab_chunk_of(SLAB *slab, void *ptr) {
+    return (struct slab_chunk *)((uintptr_t)ptr & ~((uintptr_t)slab->chunk_size - 1));
+}
+
+// ----------------------------------------------------------------------------
+// chunk lists - the caller must hold the slab lock
+
+static inline void slab_chunk_link_unsafe(struct slab_chunk **head, struct slab_chunk *chunk) {
+    chunk->prev = NULL;
+    chunk->next = *head;
+    if(*head) (*head)->prev = chunk;
+    *head = chunk;
+}
+
+static inline void slab_chunk_unlink_unsafe(struct slab_chunk **head, struct slab_chunk *chunk) {
+    if(chunk->prev) chunk->prev->next = chunk->next;
+    if(chunk->next) chunk->next->prev = chunk->prev;
+    if(*head == chunk) *head = chunk->next;
+    chunk->prev = chunk->next = NULL;
+}
+
+static struct slab_chunk *slab_chunk_create_unsafe(SLAB *slab) {
+    struct slab_chunk *chunk = slab->spare;
+
+    if(chunk)
+        slab->spare = NULL;
+    else {
+        int ret = posix_memalign((void *)&chunk, slab->chunk_size, slab->chunk_size);
+        if(unlikely(ret))
+            fatal("SLAB: '%s' cannot allocate chunk of %zu bytes - posix_memalign:%s", slab->name, slab->chunk_size, strerror(ret));
+
+        slab->stats.chunks++;
+    }
+
+    chunk->free_list = NULL;
+    chunk->used = 0;
+    chunk->carved = 0;
+    slab_chunk_link_unsafe(&slab->partial, chunk);
+
+    return chunk;
+}
+
+static void slab_chunk_release_unsafe(SLAB *slab, struct slab_chunk *chunk) {
+    slab_chunk_unlink_unsafe(&slab->partial, chunk);
+
+    if(!slab->spare) {
+        slab->spare = chunk;
+        return;
+    }
+
+    free(chunk);
+    slab->stats.chunks--;
+}
+
+static inline void *slab_element_get_unsafe(SLAB *slab) {
+    struct slab_chunk *chunk = slab->partial;
+    if(unlikely(!chunk))
+        chunk = slab_chunk_create_unsafe(slab);
+
+    void *ptr;
+    if(chunk->free_list) {
+        ptr = chunk->free_list;
+        chunk->free_list = chunk->free_list->next;
+    }
+    else
+        ptr = (char *)chunk + slab->first_element_offset + chunk->carved++ * slab->element_size;
+
+    if(++chunk->used == slab->elements_per_chunk) {
+        slab_chunk_unlink_unsafe(&slab->partial, chunk);
+        slab_chunk_link_unsafe(&slab->full, chunk);
+    }
+
+    return ptr;
+}
+
+static inline void slab_element_put_unsafe(SLAB *slab, void *ptr) {
+    struct slab_chunk *chunk = slab_chunk_of(slab, ptr);
+    struct slab_free_element *fe = (struct slab_free_element *)ptr;
+
+    if(unlikely(chunk->used == slab->elements_per_chunk)) {
+        slab_chunk_unlink_unsafe(&slab->full, chunk);
+        slab_chunk_link_unsafe(&slab->partial, chunk);
+    }
+
+    fe->next = chunk->free_list;
+    chunk->free_list = fe;
+
+    if(unlikely(--chunk->used == 0))
+        slab_chunk_release_unsafe(slab, chunk);
+}
+
+// ----------------------------------------------------------------------------
+// thread caches
+
+static inline struct slab_thread_cache *slab_thread_cache_get(SLAB *slab) {
+    struct slab_thread_cache *cache = &slab_thread_caches[slab->id];
+
+    // the slab that used to own this id has been destroyed
+    // the elements of the cache have been freed with it
+    if(unlikely(cache->generation != slabs_generation[slab->id])) {
+        cache->free_list = NULL;
+        cache->count = 0;
+        cache->generation = slabs_generation[slab->id];
+    }
+
+    return cache;
+}
+
+static void slab_thread_cache_flush(SLAB *slab, struct slab_thread_cache *cache, size_t keep) {
+    netdata_mutex_lock(&slab->mutex);
+    while(cache->count > keep) {
+        struct slab_free_element *fe = cache->free_list;
+        cache->free_list = fe->next;
+        cache->count--;
+        slab_element_put_unsafe(slab, fe);
+    }
+    netdata_mutex_unlock(&slab->mutex);
+}
+
+void slab_thread_cache_release(void) {
+    size_t id;
+
+    netdata_mutex_lock(&slabs_mutex);
+    for(id = 0; id < SLAB_MAX_INSTANCES ; id++) {
+        struct slab_thread_cache *cache = &slab_thread_caches[id];
+
+        if(cache->count && slabs[id] && cache->generation == slabs_generation[id])
+            slab_thread_cache_flush(slabs[id], cache, 0);
+
+        cache->free_list = NULL;
+        cache->count = 0;
+    }
+    netdata_mutex_unlock(&slabs_mutex);
+}
+
+// ----------------------------------------------------------------------------
+// public API
+
+SLAB *slab_create(const char *name, size_t element_size, size_t chunk_size) {
+    SLAB *slab = callocz(1, sizeof(SLAB));
+
+    strncpyz(slab->name, name, SLAB_NAME_MAX);
+    netdata_mutex_init(&slab->mutex);
+
+    slab->element_size = SLAB_ALIGN(MAX(element_size, sizeof(struct slab_free_element)), SLAB_ELEMENT_ALIGNMENT);
+    slab->first_element_offset = SLAB_ALIGN(sizeof(struct slab_chunk), SLAB_ELEMENT_ALIGNMENT);
+
+    // every chunk should hold at least a few elements
+    chunk_size = MAX(chunk_size, slab->first_element_offset + 8 * slab->element_size);
+    slab->chunk_size = round_up_to_power_of_two(chunk_size);
+    slab->elements_per_chunk = (slab->chunk_size - slab->first_element_offset) / slab->element_size;
+
+    slab->stats.chunk_size = slab->chunk_size;
+    slab->stats.element_size = slab->element_size;
+
+    netdata_mutex_lock(&slabs_mutex);
+    for(slab->id = 0; slab->id < SLAB_MAX_INSTANCES ; slab->id++)
+        if(!slabs[slab->id]) break;
+
+    if(unlikely(slab->id == SLAB_MAX_INSTANCES))
+        fatal("SLAB: cannot create slab '%s', all %d slabs are in use", name, SLAB_MAX_INSTANCES);
+
+    slabs[slab->id] = slab;
+    slabs_generation[slab->id] = ++slabs_generation_counter;
+    netdata_mutex_unlock(&slabs_mutex);
+
+    debug(D_MEMORY, "SLAB: created '%s' with element size %zu, chunk size %zu, %zu elements per chunk",
+          slab->name, slab->element_size, slab->chunk_size, slab->elements_per_chunk);
+
+    return slab;
+}
+
+void slab_destroy(SLAB *slab) {
+    struct slab_chunk *chunk;
+
+    netdata_mutex_lock(&slabs_mutex);
+    slabs[slab->id] = NULL;
+    slabs_generation[slab->id] = ++slabs_generation_counter;
+    netdata_mutex_unlock(&slabs_mutex);
+
+    while((chunk = slab->partial)) {
+        slab_chunk_unlink_unsafe(&slab->partial, chunk);
+        free(chunk);
+    }
+
+    while((chunk = slab->full)) {
+        slab_chunk_unlink_unsafe(&slab->full, chunk);
+        free(chunk);
+    }
+
+    if(slab->spare)
+        free(slab->spare);
+
+    pthread_mutex_destroy(&slab->mutex);
+    freez(slab);
+}
+
+void *slab_mallocz(SLAB *slab) {
+    struct slab_thread_cache *cache = slab_thread_cache_get(slab);
+    void *ptr;
+
+    __atomic_add_fetch(&slab->stats.allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&slab->stats.elements_used, 1, __ATOMIC_RELAXED);
+
+    if(likely(cache->count)) {
+        ptr = cache->free_list;
+        cache->free_list = cache->free_list->next;
+        cache->count--;
+        return ptr;
+    }
+
+    __atomic_add_fetch(&slab->stats.cache_misses, 1, __ATOMIC_RELAXED);
+
+    // refill half of the thread cache while we hold the lock
+    netdata_mutex_lock(&slab->mutex);
+    ptr = slab_element_get_unsafe(slab);
+    while(cache->count < SLAB_THREAD_CACHE_MAX / 2) {
+        struct slab_free_element *fe = slab_element_get_unsafe(slab);
+        fe->next = cache->free_list;
+        cache->free_list = fe;
+        cache->count++;
+    }
+    netdata_mutex_unlock(&slab->mutex);
+
+    return ptr;
+}
+
+void *slab_callocz(SLAB *slab) {
+    void *ptr = slab_mallocz(slab);
+    memset(ptr, 0, slab->element_size);
+    return ptr;
+}
+
+void slab_freez(SLAB *slab, void *ptr) {
+    if(unlikely(!ptr)) return;
+
+    struct slab_thread_cache *cache = slab_thread_cache_get(slab);
+    struct slab_free_element *fe = (struct slab_free_element *)ptr;
+
+    __atomic_add_fetch(&slab->stats.frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&slab->stats.elements_used, 1, __ATOMIC_RELAXED);
+
+    fe->next = cache->free_list;
+    cache->free_list = fe;
+
+    if(unlikely(++cache->count > SLAB_THREAD_CACHE_MAX))
+        slab_thread_cache_flush(slab, cache, SLAB_THREAD_CACHE_MAX / 2);
+}
+
+void slab_get_statistics(SLAB *slab, SLAB_STATISTICS *stats) {
+    netdata_mutex_lock(&slab->mutex);
+    *stats = slab->stats;
+    netdata_mutex_unlock(&slab->mutex);
+
+    stats->allocations = __atomic_load_n(&slab->stats.allocations, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&slab->stats.frees, __ATOMIC_RELAXED);
+    stats->elements_used = __atomic_load_n(&slab->stats.elements_used, __ATOMIC_RELAXED);
+    stats->cache_misses = __atomic_load_n(&slab->stats.cache_misses, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_SLAB_H
+#define NETDATA_SLAB_H 1
+
+#include "../libnetdata.h"
+
+// ----------------------------------------------------------------------------
+// fixed size object allocator
+//
+// Objects are carved out of large chunks that are aligned to their own size,
+// so the chunk of any object is found by masking its address. Every thread
+// keeps a small cache of free objects per slab, so that the common alloc/free
+// path does not take any lock.
+
+#define SLAB_NAME_MAX 23
+#define SLAB_MAX_INSTANCES 16
+#define SLAB_THREAD_CACHE_MAX 64
+
+struct slab_chunk;
+
+typedef struct slab_statistics {
+    size_t chunks;              // number of chunks allocated
+    size_t chunk_size;          // the size of each chunk in bytes
+    size_t element_size;        // the size of each element in bytes (including padding)
+    size_t elements_used;       // elements handed to the callers
+    size_t allocations;         // total slab_mallocz() calls
+    size_t frees;               // total slab_freez() calls
+    size_t cache_misses;        // slab_mallocz() calls that had to take the slab lock
+} SLAB_STATISTICS;
+
+typedef struct slab {
+    char name[SLAB_NAME_MAX + 1];
+
+    size_t id;                  // the index of this slab in the thread caches
+    size_t element_size;
+    size_t chunk_size;
+    size_t elements_per_chunk;
+    size_t first_element_offset;
+
+    netdata_mutex_t mutex;
+    struct slab_chunk *partial; // chunks with free elements
+    struct slab_chunk *full;    // chunks without free elements
+    struct slab_chunk *spare;   // one completely free chunk, kept to avoid thrashing
+
+    SLAB_STATISTICS stats;
+} SLAB;
+
+extern SLAB *slab_create(const char *name, size_t element_size, size_t chunk_size);
+extern void slab_destroy(SLAB *slab);
+
+extern void *slab_mallocz(SLAB *slab) MALLOCLIKE NEVERNULL;
+extern void *slab_callocz(SLAB *slab) MALLOCLIKE NEVERNULL;
+extern void slab_freez(SLAB *slab, void *ptr);
+
+extern void slab_get_statistics(SLAB *slab, SLAB_STATISTICS *stats);
+
+// return the cached elements of the calling thread back to their slabs
+extern void slab_thread_cache_release(void);
+
+#endif /* NETDATA_SLAB_H */
@@ -2,6 +2,10 @@
 
 #include "../libnetdata.h"
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 // --------------------------------------------------------------------------------------------------------------------
 // various library calls
 
@@ -561,6 +565,84 @@ int listen_sockets_setup(LISTEN_SOCKETS *sockets) {
     return (int)sockets->opened;
 }
 
+// Open another listening socket for each TCP socket of src, bound to the same
+// ip and port with SO_REUSEPORT, so that the kernel balances the connections
+// among the sockets of the group, instead of waking up all the threads polling
+// a shared socket. The UNIX and UDP sockets of src are not cloned.
+int listen_sockets_clone_reuseport(LISTEN_SOCKETS *dst, LISTEN_SOCKETS *src) {
+    listen_sockets_init(dst);
+    dst->config = src->config;
+    dst->config_section = src->config_section;
+    dst->default_bind_to = src->default_bind_to;
+    dst->default_port = src->default_port;
+    dst->backlog = src->backlog;
+
+#ifdef SO_REUSEPORT
+    size_t i;
+    for(i = 0; i < src->opened ;i++) {
+        int family = src->fds_families[i];
+        if(src->fds_types[i] != SOCK_STREAM || (family != AF_INET && family != AF_INET6))
+            continue;
+
+        struct sockaddr_storage name;
+        socklen_t len = sizeof(name);
+        if(getsockname(src->fds[i], (struct sockaddr *)&name, &len) != 0) {
+            error("LISTENER: Cannot get the address of listening socket %s.", src->fds_names[i]);
+            dst->failed++;
+            continue;
+        }
+
+        char ip[INET6_ADDRSTRLEN] = "INVALID";
+        uint16_t port;
+        if(family == AF_INET) {
+            struct sockaddr_in *sin = (struct sockaddr_in *)&name;
+            inet_ntop(AF_INET, &sin->sin_addr, ip, sizeof(ip));
+            port = ntohs(sin->sin_port);
+        }
+        else {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&name;
+            inet_ntop(AF_INET6, &sin6->sin6_addr, ip, sizeof(ip));
+            port = ntohs(sin6->sin6_port);
+        }
+
+        int fd = socket(family, SOCK_STREAM, 0);
+        if(fd < 0) {
+            error("LISTENER: socket() for a clone of listening socket %s failed.", src->fds_names[i]);
+            dst->failed++;
+            continue;
+        }
+
+        sock_setreuse(fd, 1);
+        if(sock_setreuse_port(fd, 1) != 0) {
+            close(fd);
+            dst->failed++;
+            continue;
+        }
+        sock_setnonblock(fd);
+        sock_enlarge_in(fd);
+
+        if(family == AF_INET6) {
+            int ipv6only = 1;
+            if(setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (void*)&ipv6only, sizeof(ipv6only)) != 0)
+                error("LISTENER: Cannot set IPV6_V6ONLY on a clone of listening socket %s.", src->fds_names[i]);
+        }
+
+        if(bind(fd, (struct sockaddr *)&name, len) < 0 || listen(fd, src->backlog) < 0) {
+            error("LISTENER: Cannot bind a clone of listening socket %s.", src->fds_names[i]);
+            close(fd);
+            dst->failed++;
+            continue;
+        }
+
+        listen_sockets_add(dst, fd, family, SOCK_STREAM, "tcp", ip, port, src->fds_acl_flags[i]);
+    }
+#else
+    (void)src;
+#endif
+
+    return (int)dst->opened;
+}
+
 
 // --------------------------------------------------------------------------------------------------------------------
 // connect to another host/port
@@ -1147,10 +1229,207 @@ int accept_socket(int fd, int flags, char *client_ip, size_t ipsize, char *clien
 
 // --------------------------------------------------------------------------------------------------------------------
 // poll() based listener
-// this should be the fastest possible listener for up to 100 sockets
-// above 100, an epoll() interface is needed on Linux
+// poll() is the fastest listener for up to 100 sockets, so when epoll() is available the same slots are registered
+// with it, and each wakeup processes only the sockets that have events. The sockets are level triggered, since the
+// callbacks do not always read or write until EAGAIN.
 
 #define POLL_FDS_INCREASE_STEP 10
+#define POLL_EPOLL_MAX_EVENTS 128
+
+// ----------------------------------------------------------------------------
+// the timer wheel of the timeouts of the client sockets
+
+static void poll_timer_add(POLLJOB *p, POLLINFO *pi, time_t t) {
+    size_t bucket = (size_t)t % POLL_TIMER_WHEEL_SIZE;
+
+    pi->timeout_t = t;
+    pi->timer_prev = -1;
+    pi->timer_next = p->timer_wheel[bucket];
+    if(pi->timer_next != -1)
+        p->inf[pi->timer_next].timer_prev = (ssize_t)pi->slot;
+
+    p->timer_wheel[bucket] = (ssize_t)pi->slot;
+}
+
+static void poll_timer_del(POLLJOB *p, POLLINFO *pi) {
+    if(!pi->timeout_t)
+        return;
+
+    if(pi->timer_prev != -1)
+        p->inf[pi->timer_prev].timer_next = pi->timer_next;
+    else
+        p->timer_wheel[(size_t)pi->timeout_t % POLL_TIMER_WHEEL_SIZE] = pi->timer_next;
+
+    if(pi->timer_next != -1)
+        p->inf[pi->timer_next].timer_prev = pi->timer_prev;
+
+    pi->timeout_t = 0;
+    pi->timer_prev = -1;
+    pi->timer_next = -1;
+}
+
+// schedule the next check of the timeouts of a client socket, the first time they may have expired
+static void poll_timeout_schedule(POLLJOB *p, POLLINFO *pi, time_t now) {
+    time_t t = 0;
+
+    if(pi->send_count == 0 && p->complete_request_timeout > 0)
+        t = pi->connected_t + p->complete_request_timeout;
+
+    if(p->idle_timeout > 0) {
+        // the idle timeout starts with the first data received
+        time_t last = now;
+        if(pi->recv_count)
+            last = (pi->last_received_t > pi->last_sent_t) ? pi->last_received_t : pi->last_sent_t;
+
+        if(!t || last + p->idle_timeout < t)
+            t = last + p->idle_timeout;
+    }
+
+    if(!t)
+        return;
+
+    if(t <= now)
+        t = now + 1;
+
+    poll_timer_add(p, pi, t);
+}
+
+static void poll_timeout_check(POLLJOB *p, POLLINFO *pi, time_t now) {
+    if (unlikely(pi->send_count == 0 && p->complete_request_timeout > 0 && (now - pi->connected_t) >= p->complete_request_timeout)) {
+        info("POLLFD: LISTENER: client slot %zu (fd %d) from %s port %s has not sent a complete request in %zu seconds - closing it. "
+              , pi->slot
+              , pi->fd
+              , pi->client_ip ? pi->client_ip : "<undefined-ip>"
+              , pi->client_port ? pi->client_port : "<undefined-port>"
+              , (size_t) p->complete_request_timeout
+        );
+        poll_close_fd(pi);
+    }
+    else if(unlikely(pi->recv_count && p->idle_timeout > 0 && now - ((pi->last_received_t > pi->last_sent_t) ? pi->last_received_t : pi->last_sent_t) >= p->idle_timeout )) {
+        info("POLLFD: LISTENER: client slot %zu (fd %d) from %s port %s is idle for more than %zu seconds - closing it. "
+              , pi->slot
+              , pi->fd
+              , pi->client_ip ? pi->client_ip : "<undefined-ip>"
+              , pi->client_port ? pi->client_port : "<undefined-port>"
+              , (size_t) p->idle_timeout
+        );
+        poll_close_fd(pi);
+    }
+    else
+        poll_timeout_schedule(p, pi, now);
+}
+
+// check the sockets of the buckets of the seconds passed since the last run
+static void poll_timer_run(POLLJOB *p, time_t now) {
+    time_t t = p->timer_wheel_t;
+    if(now - t > POLL_TIMER_WHEEL_SIZE)
+        t = now - POLL_TIMER_WHEEL_SIZE;
+
+    for(t++; t <= now ; t++) {
+        ssize_t slot = p->timer_wheel[(size_t)t % POLL_TIMER_WHEEL_SIZE];
+
+        while(slot != -1) {
+            POLLINFO *pi = &p->inf[slot];
+            slot = pi->timer_next;
+
+            // in the bucket for a later round of the wheel
+            if(pi->timeout_t > now)
+                continue;
+
+            poll_timer_del(p, pi);
+            poll_timeout_check(p, pi, now);
+        }
+    }
+
+    p->timer_wheel_t = now;
+}
+
+// ----------------------------------------------------------------------------
+// epoll()
+
+#ifdef HAVE_SYS_EPOLL_H
+static inline uint32_t poll_events_to_epoll(short int events) {
+    return ((events & POLLIN)  ? EPOLLIN  : 0) |
+           ((events & POLLPRI) ? EPOLLPRI : 0) |
+           ((events & POLLOUT) ? EPOLLOUT : 0);
+}
+
+static inline short int poll_events_from_epoll(uint32_t events) {
+    return (short int)(((events & EPOLLIN)  ? POLLIN  : 0) |
+                       ((events & EPOLLPRI) ? POLLPRI : 0) |
+                       ((events & EPOLLOUT) ? POLLOUT : 0) |
+                       ((events & EPOLLERR) ? POLLERR : 0) |
+                       ((events & EPOLLHUP) ? POLLHUP : 0));
+}
+
+// the slot and the fd, so that the events of a slot closed and reused in the same wakeup are ignored
+static inline uint64_t poll_epoll_data(POLLINFO *pi) {
+    return ((uint64_t)pi->slot << 32) | (uint32_t)pi->fd;
+}
+
+static void poll_epoll_add(POLLJOB *p, POLLINFO *pi) {
+    struct pollfd *pf = &p->fds[pi->slot];
+    struct epoll_event ev = { .events = poll_events_to_epoll(pf->events), .data.u64 = poll_epoll_data(pi) };
+
+    if(likely(epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, pf->fd, &ev) == 0)) {
+        pi->epoll_events = pf->events;
+        return;
+    }
+
+    if(errno != EPERM) {
+        error("POLLFD: cannot add fd %d to epoll()", pf->fd);
+        return;
+    }
+
+    // files are always ready for poll(), but epoll() does not support them
+    if(p->always_ready_used == p->always_ready_size) {
+        p->always_ready_size = p->always_ready_size ? p->always_ready_size * 2 : POLL_FDS_INCREASE_STEP;
+        p->always_ready = reallocz(p->always_ready, p->always_ready_size * sizeof(size_t));
+    }
+
+    p->always_ready[p->always_ready_used++] = pi->slot;
+    pi->flags |= POLLINFO_FLAG_ALWAYS_READY;
+}
+
+static void poll_epoll_del(POLLJOB *p, POLLINFO *pi) {
+    if(unlikely(pi->flags & POLLINFO_FLAG_ALWAYS_READY)) {
+        size_t i;
+        for(i = 0; i < p->always_ready_used ; i++) {
+            if(p->always_ready[i] == pi->slot) {
+                p->always_ready[i] = p->always_ready[--p->always_ready_used];
+                break;
+            }
+        }
+        return;
+    }
+
+    if(epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, pi->fd, NULL) == -1)
+        error("POLLFD: cannot remove fd %d from epoll()", pi->fd);
+
+    pi->epoll_events = 0;
+}
+#endif
+
+/* Apply the events of the slot of pi to epoll(). The callbacks change the events of their own slot, which are
+ * applied after they return, but the events of other slots have to be applied with this.
+ */
+void poll_update_events(POLLINFO *pi) {
+#ifdef HAVE_SYS_EPOLL_H
+    POLLJOB *p = pi->p;
+    struct pollfd *pf = &p->fds[pi->slot];
+
+    if(p->epoll_fd == -1 || pf->fd == -1 || (pi->flags & POLLINFO_FLAG_ALWAYS_READY) || pi->epoll_events == pf->events)
+        return;
+
+    struct epoll_event ev = { .events = poll_events_to_epoll(pf->events), .data.u64 = poll_epoll_data(pi) };
+    if(unlikely(epoll_ctl(p->epoll_fd, EPOLL_CTL_MOD, pf->fd, &ev) == -1))
+        error("POLLFD: cannot modify the events of fd %d in epoll()", pf->fd);
+    else
+        pi->epoll_events = pf->events;
+#else
+    (void)pi;
+#endif
+}
 
 inline POLLINFO *poll_add_fd(POLLJOB *p
                              , int fd
@@ -1205,6 +1484,11 @@ inline POLLINFO *poll_add_fd(POLLJOB *p
             p->inf[i].snd_callback = p->snd_callback;
             p->inf[i].data = NULL;
 
+            p->inf[i].epoll_events = 0;
+            p->inf[i].timeout_t = 0;
+            p->inf[i].timer_prev = -1;
+            p->inf[i].timer_next = -1;
+
             // link them so that the first free will be earlier in the array
             // (we loop decrementing i)
             p->inf[i].next = p->first_free;
@@ -1257,6 +1541,14 @@ inline POLLINFO *poll_add_fd(POLLJOB *p
     if(pi->flags & POLLINFO_FLAG_SERVER_SOCKET) {
         p->min = pi->slot;
     }
+
+#ifdef HAVE_SYS_EPOLL_H
+    if(p->epoll_fd != -1)
+        poll_epoll_add(p, pi);
+#endif
+
+    if((pi->flags & POLLINFO_FLAG_CLIENT_SOCKET) && !(pi->flags & POLLINFO_FLAG_DONT_TIMEOUT))
+        poll_timeout_schedule(p, pi, pi->connected_t);
     netdata_thread_enable_cancelability();
 
     debug(D_POLLFD, "POLLFD: ADD: completed, slots = %zu, used = %zu, min = %zu, max = %zu, next free = %zd", p->slots, p->used, p->min, p->max, p->first_free?(ssize_t)p->first_free->slot:(ssize_t)-1);
@@ -1274,6 +1566,13 @@ inline void poll_close_fd(POLLINFO *pi) {
 
     netdata_thread_disable_cancelability();
 
+    poll_timer_del(p, pi);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if(p->epoll_fd != -1)
+        poll_epoll_del(p, pi);
+#endif
+
     if(pi->flags & POLLINFO_FLAG_CLIENT_SOCKET) {
         pi->del_callback(pi);
 
@@ -1384,6 +1683,12 @@ static void poll_events_cleanup(void *data) {
 
     freez(p->fds);
     freez(p->inf);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if(p->epoll_fd != -1)
+        close(p->epoll_fd);
+#endif
+    freez(p->always_ready);
 }
 
 static void poll_events_process(POLLJOB *p, POLLINFO *pi, struct pollfd *pf, short int revents, time_t now) {
@@ -1416,6 +1721,7 @@ static void poll_events_process(POLLJOB *p, POLLINFO *pi, struct pollfd *pf, sho
             }
             pf = &p->fds[i];
             pi = &p->inf[i];
+            poll_update_events(pi);
 
 #ifdef NETDATA_INTERNAL_CHECKS
             // this is common - it is used for web server file copies
@@ -1499,6 +1805,7 @@ static void poll_events_process(POLLJOB *p, POLLINFO *pi, struct pollfd *pf, sho
 
                     pf->events = 0;
                     pi->rcv_callback(pi, &pf->events);
+                    poll_update_events(pi);
                     break;
                 }
 
@@ -1524,6 +1831,7 @@ static void poll_events_process(POLLJOB *p, POLLINFO *pi, struct pollfd *pf, sho
         }
         pf = &p->fds[i];
         pi = &p->inf[i];
+        poll_update_events(pi);
 
 #ifdef NETDATA_INTERNAL_CHECKS
         // this is common - it is used for streaming
@@ -1592,7 +1900,8 @@ void poll_events(LISTEN_SOCKETS *sockets
 
             .complete_request_timeout = tcp_request_timeout_seconds,
             .idle_timeout = tcp_idle_timeout_seconds,
-            .checks_every = (tcp_idle_timeout_seconds / 3) + 1,
+            .timer_wheel_t = now_boottime_sec(),
+            .epoll_fd = -1,
 
             .access_list = access_list,
             .allow_dns   = allow_dns,
@@ -1608,6 +1917,16 @@ void poll_events(LISTEN_SOCKETS *sockets
     };
 
     size_t i;
+    for(i = 0; i < POLL_TIMER_WHEEL_SIZE ;i++)
+        p.timer_wheel[i] = -1;
+
+#ifdef HAVE_SYS_EPOLL_H
+    p.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(p.epoll_fd == -1)
+        error("POLLFD: cannot create an epoll() instance, falling back to poll()");
+    struct epoll_event epoll_events[POLL_EPOLL_MAX_EVENTS];
+#endif
+
     for(i = 0; i < sockets->opened ;i++) {
 
         POLLINFO *pi = poll_add_fd(&p
@@ -1632,7 +1951,6 @@ void poll_events(LISTEN_SOCKETS *sockets
     int listen_sockets_active = 1;
 
     int timeout_ms = 1000; // in milliseconds
-    time_t last_check = now_boottime_sec();
 
     usec_t timer_usec = timer_milliseconds * USEC_PER_MS;
     usec_t now_usec = 0, next_timer_usec = 0, last_timer_usec = 0;
@@ -1671,13 +1989,59 @@ void poll_events(LISTEN_SOCKETS *sockets
             for (i = 0; i <= p.max; i++) {
                 if(p.inf[i].flags & POLLINFO_FLAG_SERVER_SOCKET && p.inf[i].socktype == SOCK_STREAM) {
                     p.fds[i].events = (short int) ((listen_sockets_active) ? POLLIN : 0);
+                    poll_update_events(&p.inf[i]);
                 }
             }
         }
 
+        time_t now;
+
+#ifdef HAVE_SYS_EPOLL_H
+        if(likely(p.epoll_fd != -1)) {
+            debug(D_POLLFD, "POLLFD: LISTENER: Waiting on %zu sockets with epoll() for %zu ms...", p.used, (size_t)timeout_ms);
+            retval = epoll_wait(p.epoll_fd, epoll_events, POLL_EPOLL_MAX_EVENTS, p.always_ready_used ? 0 : timeout_ms);
+            now = now_boottime_sec();
+
+            if(unlikely(retval == -1)) {
+                if(errno == EINTR)
+                    continue;
+
+                error("POLLFD: LISTENER: epoll_wait() failed while waiting on %zu sockets.", p.used);
+                break;
+            }
+
+            int e;
+            for(e = 0; e < retval ;e++) {
+                size_t slot = (size_t)(epoll_events[e].data.u64 >> 32);
+                int fd = (int)(uint32_t)epoll_events[e].data.u64;
+
+                // the slot may have been closed, or reused, by an earlier event of this wakeup
+                if(unlikely(slot > p.max || p.fds[slot].fd != fd))
+                    continue;
+
+                poll_events_process(&p, &p.inf[slot], &p.fds[slot], poll_events_from_epoll(epoll_events[e].events), now);
+            }
+
+            // files are always ready for what they wait for
+            for(i = p.always_ready_used; i > 0 ;i--) {
+                if(i > p.always_ready_used)
+                    continue;
+
+                size_t slot = p.always_ready[i - 1];
+                short int revents = (short int)(p.fds[slot].events & (POLLIN | POLLOUT));
+                if(revents)
+                    poll_events_process(&p, &p.inf[slot], &p.fds[slot], revents, now);
+            }
+
+            // close the client sockets that timed out
+            poll_timer_run(&p, now);
+            continue;
+        }
+#endif
+
         debug(D_POLLFD, "POLLFD: LISTENER: Waiting on %zu sockets for %zu ms...", p.max + 1, (size_t)timeout_ms);
         retval = poll(p.fds, p.max + 1, timeout_ms);
-        time_t now = now_boottime_sec();
+        now = now_boottime_sec();
 
         if(unlikely(retval == -1)) {
             error("POLLFD: LISTENER: poll() failed while waiting on %zu sockets.", p.max + 1);
@@ -1695,37 +2059,8 @@ void poll_events(LISTEN_SOCKETS *sockets
             }
         }
 
-        if(unlikely(p.checks_every > 0 && now - last_check > p.checks_every)) {
-            last_check = now;
-
-            // security checks
-            for(i = 0; i <= p.max; i++) {
-                POLLINFO *pi = &p.inf[i];
-
-                if(likely(pi->flags & POLLINFO_FLAG_CLIENT_SOCKET)) {
-                    if (unlikely(pi->send_count == 0 && p.complete_request_timeout > 0 && (now - pi->connected_t) >= p.complete_request_timeout)) {
-                        info("POLLFD: LISTENER: client slot %zu (fd %d) from %s port %s has not sent a complete request in %zu seconds - closing it. "
-                              , i
-                              , pi->fd
-                              , pi->client_ip ? pi->client_ip : "<undefined-ip>"
-                              , pi->client_port ? pi->client_port : "<undefined-port>"
-                              , (size_t) p.complete_request_timeout
-                        );
-                        poll_close_fd(pi);
-                    }
-                    else if(unlikely(pi->recv_count && p.idle_timeout > 0 && now - ((pi->last_received_t > pi->last_sent_t) ? pi->last_received_t : pi->last_sent_t) >= p.idle_timeout )) {
-                        info("POLLFD: LISTENER: client slot %zu (fd %d) from %s port %s is idle for more than %zu seconds - closing it. "
-                              , i
-                              , pi->fd
-                              , pi->client_ip ? pi->client_ip : "<undefined-ip>"
-                              , pi->client_port ? pi->client_port : "<undefined-port>"
-                              , (size_t) p.idle_timeout
-                        );
-                        poll_close_fd(pi);
-                    }
-                }
-            }
-        }
+        // close the client sockets that timed out
+        poll_timer_run(&p, now);
     }
 
     netdata_thread_cleanup_pop(1);
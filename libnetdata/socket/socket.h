@@ -53,6 +53,7 @@ extern char *strdup_client_description(int family, const char *protocol, const c
 
 extern int listen_sockets_setup(LISTEN_SOCKETS *sockets);
 extern void listen_sockets_close(LISTEN_SOCKETS *sockets);
+extern int listen_sockets_clone_reuseport(LISTEN_SOCKETS *dst, LISTEN_SOCKETS *src);
 
 extern int connect_to_this(const char *definition, int default_port, struct timeval *timeout);
 extern int connect_to_one_of(const char *destination, int default_port, struct timeval *timeout, size_t *reconnects_counter, char *connected_to, size_t connected_to_size);
@@ -94,10 +95,15 @@ extern int accept4(int sock, struct sockaddr *addr, socklen_t *addrlen, int flag
 
 // ----------------------------------------------------------------------------
 // poll() based listener
+// it uses epoll() when available, with the same callbacks
 
 #define POLLINFO_FLAG_SERVER_SOCKET 0x00000001
 #define POLLINFO_FLAG_CLIENT_SOCKET 0x00000002
 #define POLLINFO_FLAG_DONT_CLOSE    0x00000004
+#define POLLINFO_FLAG_ALWAYS_READY  0x00000008 // internal: epoll() does not support this fd (a file), it is always ready
+#define POLLINFO_FLAG_DONT_TIMEOUT  0x00000010 // a client socket that is not closed when idle (i.e. a notification pipe)
+
+#define POLL_TIMER_WHEEL_SIZE 64    // seconds
 
 typedef struct poll POLLJOB;
 
@@ -121,6 +127,12 @@ typedef struct pollinfo {
 
     uint32_t flags;         // internal flags
 
+    short int epoll_events; // the events registered with epoll()
+
+    time_t timeout_t;       // when the timeouts of the socket are checked next, 0 = not in the timer wheel
+    ssize_t timer_prev;     // the previous and the next slots in the same bucket of the timer wheel, -1 = none
+    ssize_t timer_next;
+
     // callbacks for this socket
     void  (*del_callback)(struct pollinfo *pi);
     int   (*rcv_callback)(struct pollinfo *pi, short int *events);
@@ -146,7 +158,15 @@ struct poll {
 
     time_t complete_request_timeout;
     time_t idle_timeout;
-    time_t checks_every;
+
+    // the timeouts of the client sockets are checked when they may expire, not by scanning all of them
+    ssize_t timer_wheel[POLL_TIMER_WHEEL_SIZE]; // the first slot of each bucket (one per second), -1 = empty
+    time_t timer_wheel_t;                       // the last second the timer wheel has run for
+
+    int epoll_fd;                               // -1 = poll() is used
+    size_t *always_ready;                       // the slots with POLLINFO_FLAG_ALWAYS_READY
+    size_t always_ready_used;
+    size_t always_ready_size;
 
     time_t timer_milliseconds;
     void *timer_data;
@@ -187,6 +207,7 @@ extern POLLINFO *poll_add_fd(POLLJOB *p
                              , void *data
 );
 extern void poll_close_fd(POLLINFO *pi);
+extern void poll_update_events(POLLINFO *pi);
 
 extern void poll_events(LISTEN_SOCKETS *sockets
         , void *(*add_callback)(POLLINFO *pi, short int *events, void *data)
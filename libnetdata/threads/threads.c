@@ -106,6 +106,9 @@ static void thread_cleanup(void *ptr) {
     if(!(netdata_thread->options & NETDATA_THREAD_OPTION_DONT_LOG_CLEANUP))
         info("thread with task id %d finished", gettid());
 
+    slab_thread_cache_release();
+    memory_accounting_thread_release();
+
     freez((void *)netdata_thread->tag);
     netdata_thread->tag = NULL;
 
@@ -0,0 +1,532 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "rrdpush.h"
+
+/*
+ * Aggregates
+ *
+ * A parent or a proxy can keep aggregates of the charts its children stream,
+ * configured in stream.conf:
+ *
+ *   [aggregate:cgroup_cpu]
+ *       context = cgroup.cpu
+ *       group by label = cluster
+ *       method = sum
+ *
+ * The charts of the children with this context become members of the
+ * aggregate when the children define them. Each time a member is updated,
+ * its receiver copies the values it stored to the member. Every update every
+ * seconds, the aggregate thread combines the values of the fresh members of
+ * each group (the children with the same value of the host label) into a
+ * chart of localhost, i.e. aggregate.cgroup_cpu_<cluster>.
+ *
+ * localhost streams these charts upstream like its own, while the members are
+ * not sent upstream (unless send members upstream = yes), so the parents
+ * above store only the aggregates.
+ */
+
+extern struct config stream_config;
+
+#define STREAM_AGGREGATE_SECTION_PREFIX "aggregate:"
+#define STREAM_AGGREGATE_GROUP_RECHECK_SECONDS 10   // how often the label of the host of a member is checked again
+#define STREAM_AGGREGATE_STALE_UPDATES 3            // a member not updated for this many intervals is not aggregated
+
+typedef enum {
+    STREAM_AGGREGATE_SUM,
+    STREAM_AGGREGATE_AVERAGE,
+    STREAM_AGGREGATE_MIN,
+    STREAM_AGGREGATE_MAX
+} STREAM_AGGREGATE_METHOD;
+
+struct stream_aggregate_group {
+    char *value;                        // the value of the label, "all" when the aggregate is not grouped
+    RRDSET *st;                         // the chart of the group on localhost, created on its first update
+    RRDDIM **rd;                        // the dimensions of the chart, by the index of the aggregate
+    size_t rd_size;
+
+    calculated_number *values;          // combined by the aggregate thread
+    size_t *counts;
+    size_t values_size;
+
+    struct stream_aggregate_group *next;
+};
+
+struct stream_aggregate_member {
+    struct stream_aggregate *aggregate;
+    RRDSET *st;                         // NULL when the chart has been freed
+    struct stream_aggregate_group *group;
+    time_t group_checked_t;
+    time_t updated_t;
+    int update_every;
+
+    calculated_number *values;          // by the index of the dimensions of the aggregate, NAN when not stored
+    size_t values_size;
+
+    struct stream_aggregate_member *next;
+};
+
+struct stream_aggregate {
+    char *name;
+    char *context;
+    SIMPLE_PATTERN *hosts;
+    char *label;                        // the host label to group by, NULL for a single group
+    uint32_t label_hash;
+    STREAM_AGGREGATE_METHOD method;
+    int update_every;
+    int send_members;
+    long priority;
+
+    netdata_mutex_t mutex;              // protects everything below
+    char *units;                        // from the first member
+    RRDSET_TYPE chart_type;
+    char **dimensions;                  // the ids of the dimensions of the members
+    size_t dimensions_count;
+    struct stream_aggregate_group *groups;
+    struct stream_aggregate_member *members;
+
+    struct stream_aggregate *next;
+};
+
+static struct stream_aggregate *stream_aggregates = NULL;
+
+static const char *stream_aggregate_method_name(STREAM_AGGREGATE_METHOD method) {
+    switch(method) {
+        case STREAM_AGGREGATE_AVERAGE: return "average";
+        case STREAM_AGGREGATE_MIN: return "min";
+        case STREAM_AGGREGATE_MAX: return "max";
+        default: return "sum";
+    }
+}
+
+static int stream_aggregate_method_id(const char *name, STREAM_AGGREGATE_METHOD *method) {
+    if(!strcmp(name, "sum")) *method = STREAM_AGGREGATE_SUM;
+    else if(!strcmp(name, "average")) *method = STREAM_AGGREGATE_AVERAGE;
+    else if(!strcmp(name, "min")) *method = STREAM_AGGREGATE_MIN;
+    else if(!strcmp(name, "max")) *method = STREAM_AGGREGATE_MAX;
+    else return 1;
+
+    return 0;
+}
+
+void stream_aggregate_init(void) {
+    struct section *section;
+    struct stream_aggregate **last = &stream_aggregates;
+    long priority = 100000;
+    char update_every[20];
+
+    snprintfz(update_every, 19, "%d", default_rrd_update_every);
+
+    appconfig_wrlock(&stream_config);
+    for(section = stream_config.first_section; section; section = section->next) {
+        if(strncmp(section->name, STREAM_AGGREGATE_SECTION_PREFIX, sizeof(STREAM_AGGREGATE_SECTION_PREFIX) - 1) != 0)
+            continue;
+
+        const char *name = &section->name[sizeof(STREAM_AGGREGATE_SECTION_PREFIX) - 1];
+        if(!*name || !appconfig_get_boolean_by_section(section, "enabled", 1))
+            continue;
+
+        char *context = appconfig_get_by_section(section, "context", "");
+        if(!*context) {
+            error("STREAM: aggregate '%s' has no context, ignoring it.", name);
+            continue;
+        }
+
+        STREAM_AGGREGATE_METHOD method;
+        char *method_name = appconfig_get_by_section(section, "method", "sum");
+        if(stream_aggregate_method_id(method_name, &method)) {
+            error("STREAM: aggregate '%s' has an invalid method '%s', ignoring it.", name, method_name);
+            continue;
+        }
+
+        struct stream_aggregate *a = callocz(1, sizeof(*a));
+        a->name = strdupz(name);
+        a->context = strdupz(context);
+        a->hosts = simple_pattern_create(appconfig_get_by_section(section, "hosts", "*"), NULL, SIMPLE_PATTERN_EXACT);
+        a->method = method;
+        a->update_every = (int)str2l(appconfig_get_by_section(section, "update every", update_every));
+        a->send_members = appconfig_get_boolean_by_section(section, "send members upstream", 0);
+        a->priority = priority++;
+        if(a->update_every < 1) a->update_every = 1;
+
+        char *label = appconfig_get_by_section(section, "group by label", "");
+        if(*label) {
+            a->label = strdupz(label);
+            a->label_hash = simple_hash(a->label);
+        }
+
+        netdata_mutex_init(&a->mutex);
+
+        info("STREAM: aggregate '%s' of context '%s' per %s, method %s, every %d seconds.",
+             a->name, a->context, a->label ? a->label : "parent", stream_aggregate_method_name(a->method), a->update_every);
+
+        *last = a;
+        last = &a->next;
+    }
+    appconfig_unlock(&stream_config);
+}
+
+// ----------------------------------------------------------------------------
+// the members, updated by the receivers
+
+static void *stream_aggregate_thread(void *ptr);
+
+// the thread is started with the first member
+static void stream_aggregate_thread_start(void) {
+    static netdata_mutex_t mutex = NETDATA_MUTEX_INITIALIZER;
+    static netdata_thread_t thread;
+    static int started = 0;
+
+    netdata_mutex_lock(&mutex);
+    if(!started) {
+        started = 1;
+        if(netdata_thread_create(&thread, "STREAM_AGGREGATE", NETDATA_THREAD_OPTION_DEFAULT, stream_aggregate_thread, NULL))
+            error("STREAM: cannot start the thread of the aggregates.");
+    }
+    netdata_mutex_unlock(&mutex);
+}
+
+// the caller holds the mutex of the aggregate
+static void stream_aggregate_member_detach(struct stream_aggregate_member *m) {
+    rrdset_flag_clear(m->st, RRDSET_FLAG_UPSTREAM_SEND);
+    rrdset_flag_clear(m->st, RRDSET_FLAG_UPSTREAM_IGNORE);
+    m->st->state->aggregate_member = NULL;
+    m->st = NULL;   // freed by the aggregate thread
+}
+
+/* Called by the receiver when a child defines a chart. The chart becomes a member of the first aggregate of its
+ * context, or stops being one when its context has changed.
+ */
+void stream_aggregate_chart(RRDSET *st) {
+    struct stream_aggregate_member *m = st->state->aggregate_member;
+    struct stream_aggregate *a;
+
+    if(likely(!stream_aggregates))
+        return;
+
+    for(a = stream_aggregates; a ; a = a->next) {
+        if(!strcmp(a->context, st->context) && simple_pattern_matches(a->hosts, st->rrdhost->hostname))
+            break;
+    }
+
+    if(m && m->aggregate == a)
+        return;
+
+    if(m) {
+        netdata_mutex_lock(&m->aggregate->mutex);
+        stream_aggregate_member_detach(m);
+        netdata_mutex_unlock(&m->aggregate->mutex);
+    }
+
+    if(!a)
+        return;
+
+    m = callocz(1, sizeof(*m));
+    m->aggregate = a;
+    m->st = st;
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, sizeof(*m));
+
+    netdata_mutex_lock(&a->mutex);
+    if(!a->units) {
+        a->units = strdupz(st->units);
+        a->chart_type = st->chart_type;
+    }
+    m->next = a->members;
+    a->members = m;
+    st->state->aggregate_member = m;
+
+    // decide again whether it is sent upstream
+    rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_SEND);
+    rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_IGNORE);
+    netdata_mutex_unlock(&a->mutex);
+
+    debug(D_STREAM, "STREAM %s: chart '%s' is a member of aggregate '%s'", st->rrdhost->hostname, st->id, a->name);
+    stream_aggregate_thread_start();
+}
+
+// the members of the aggregates are not sent upstream, unless configured so
+int stream_aggregate_hides(RRDSET *st) {
+    struct stream_aggregate_member *m = st->state->aggregate_member;
+    return m && !m->aggregate->send_members;
+}
+
+// the caller holds the mutex of the aggregate
+static size_t stream_aggregate_dimension_index(struct stream_aggregate *a, const char *id) {
+    size_t i;
+    for(i = 0; i < a->dimensions_count ; i++)
+        if(!strcmp(a->dimensions[i], id))
+            return i;
+
+    a->dimensions = reallocz(a->dimensions, (a->dimensions_count + 1) * sizeof(char *));
+    a->dimensions[a->dimensions_count] = strdupz(id);
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, sizeof(char *) + strlen(id) + 1);
+    return a->dimensions_count++;
+}
+
+// the caller holds the mutex of the aggregate
+static struct stream_aggregate_group *stream_aggregate_group_get(struct stream_aggregate *a, const char *value) {
+    struct stream_aggregate_group *g;
+    for(g = a->groups; g ; g = g->next)
+        if(!strcmp(g->value, value))
+            return g;
+
+    g = callocz(1, sizeof(*g));
+    g->value = strdupz(value);
+    g->next = a->groups;
+    a->groups = g;
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, sizeof(*g) + strlen(value) + 1);
+    return g;
+}
+
+// the caller holds the mutex of the aggregate
+static void stream_aggregate_member_group(struct stream_aggregate_member *m, RRDHOST *host, time_t now) {
+    struct stream_aggregate *a = m->aggregate;
+    char value[CONFIG_MAX_VALUE + 1] = "all";
+
+    if(a->label) {
+        strcpy(value, "unset");
+
+        netdata_rwlock_rdlock(&host->labels.labels_rwlock);
+        struct label *l = label_list_lookup_key(host->labels.head, a->label, a->label_hash);
+        if(l)
+            strncpyz(value, l->value, CONFIG_MAX_VALUE);
+        netdata_rwlock_unlock(&host->labels.labels_rwlock);
+    }
+
+    m->group = stream_aggregate_group_get(a, value);
+    m->group_checked_t = now;
+}
+
+/* Called by the receiver after a member has been updated, to copy the values it stored.
+ */
+void stream_aggregate_collect(RRDSET *st) {
+    struct stream_aggregate_member *m = st->state->aggregate_member;
+    struct stream_aggregate *a = m->aggregate;
+    time_t now = now_realtime_sec();
+    RRDDIM *rd;
+
+    netdata_mutex_lock(&a->mutex);
+
+    if(unlikely(!m->group || now - m->group_checked_t >= STREAM_AGGREGATE_GROUP_RECHECK_SECONDS))
+        stream_aggregate_member_group(m, st->rrdhost, now);
+
+    size_t i;
+    for(i = 0; i < m->values_size ; i++)
+        m->values[i] = NAN;
+
+    rrdset_rdlock(st);
+    rrddim_foreach_read(rd, st) {
+        if(unlikely(rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN | RRDDIM_FLAG_OBSOLETE)))
+            continue;
+
+        size_t index = stream_aggregate_dimension_index(a, rd->id);
+        if(unlikely(index >= m->values_size)) {
+            size_t size = a->dimensions_count;
+            m->values = reallocz(m->values, size * sizeof(calculated_number));
+            for(i = m->values_size; i < size ; i++)
+                m->values[i] = NAN;
+            memory_accounting_resize(MEMORY_ACCOUNTING_STREAMING, (size - m->values_size) * sizeof(calculated_number));
+            m->values_size = size;
+        }
+
+        m->values[index] = rd->last_stored_value;
+    }
+    rrdset_unlock(st);
+
+    m->updated_t = now;
+    m->update_every = st->update_every;
+
+    netdata_mutex_unlock(&a->mutex);
+}
+
+/* Called when the chart of a member is freed.
+ */
+void stream_aggregate_chart_free(RRDSET *st) {
+    struct stream_aggregate_member *m = st->state->aggregate_member;
+    struct stream_aggregate *a = m->aggregate;
+
+    netdata_mutex_lock(&a->mutex);
+    stream_aggregate_member_detach(m);
+    netdata_mutex_unlock(&a->mutex);
+}
+
+// ----------------------------------------------------------------------------
+// the charts of the aggregates, updated by the aggregate thread
+
+static inline void stream_aggregate_add(STREAM_AGGREGATE_METHOD method, calculated_number *total, size_t *count, calculated_number value) {
+    if(!*count)
+        *total = value;
+    else switch(method) {
+        case STREAM_AGGREGATE_MIN:
+            if(value < *total) *total = value;
+            break;
+
+        case STREAM_AGGREGATE_MAX:
+            if(value > *total) *total = value;
+            break;
+
+        default:
+            *total += value;
+            break;
+    }
+
+    (*count)++;
+}
+
+// combine the values of the fresh members into their groups, and free the members of the freed charts
+static void stream_aggregate_combine(struct stream_aggregate *a, time_t now) {
+    struct stream_aggregate_group *g;
+    struct stream_aggregate_member *m, **p;
+    size_t i;
+
+    for(g = a->groups; g ; g = g->next) {
+        if(g->values_size < a->dimensions_count) {
+            size_t size = a->dimensions_count;
+            g->values = reallocz(g->values, size * sizeof(calculated_number));
+            g->counts = reallocz(g->counts, size * sizeof(size_t));
+            memory_accounting_resize(MEMORY_ACCOUNTING_STREAMING, (size - g->values_size) * (sizeof(calculated_number) + sizeof(size_t)));
+            g->values_size = size;
+        }
+
+        for(i = 0; i < g->values_size ; i++) {
+            g->values[i] = 0;
+            g->counts[i] = 0;
+        }
+    }
+
+    for(p = &a->members; (m = *p) ; ) {
+        if(!m->st) {
+            *p = m->next;
+            memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, sizeof(*m) + m->values_size * sizeof(calculated_number));
+            freez(m->values);
+            freez(m);
+            continue;
+        }
+
+        p = &m->next;
+
+        if(!m->group || now - m->updated_t > STREAM_AGGREGATE_STALE_UPDATES * (m->update_every > a->update_every ? m->update_every : a->update_every))
+            continue;
+
+        g = m->group;
+        for(i = 0; i < m->values_size ; i++) {
+            if(isnan(m->values[i]))
+                continue;
+
+            stream_aggregate_add(a->method, &g->values[i], &g->counts[i], m->values[i]);
+        }
+    }
+
+    if(a->method == STREAM_AGGREGATE_AVERAGE) {
+        for(g = a->groups; g ; g = g->next)
+            for(i = 0; i < g->values_size ; i++)
+                if(g->counts[i])
+                    g->values[i] /= (calculated_number)g->counts[i];
+    }
+}
+
+static void stream_aggregate_group_chart(struct stream_aggregate *a, struct stream_aggregate_group *g) {
+    char id[RRD_ID_LENGTH_MAX + 1], context[RRD_ID_LENGTH_MAX + 1], title[RRD_ID_LENGTH_MAX + 1];
+
+    if(a->label) {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "%s_%s", a->name, g->value);
+        snprintfz(title, RRD_ID_LENGTH_MAX, "%s of %s for %s %s", stream_aggregate_method_name(a->method), a->context, a->label, g->value);
+    }
+    else {
+        snprintfz(id, RRD_ID_LENGTH_MAX, "%s", a->name);
+        snprintfz(title, RRD_ID_LENGTH_MAX, "%s of %s of all the children", stream_aggregate_method_name(a->method), a->context);
+    }
+    snprintfz(context, RRD_ID_LENGTH_MAX, "aggregate.%s", a->name);
+
+    g->st = rrdset_create_localhost(
+            "aggregate"
+            , id
+            , NULL
+            , a->name
+            , context
+            , title
+            , a->units ? a->units : ""
+            , "netdata"
+            , "aggregate"
+            , a->priority
+            , a->update_every
+            , a->chart_type
+    );
+
+    if(a->label) {
+        rrdset_add_label_to_new_list(g->st, a->label, g->value, LABEL_SOURCE_AUTO);
+        rrdset_finalize_labels(g->st);
+    }
+}
+
+static void stream_aggregate_update(struct stream_aggregate *a, time_t now) {
+    struct stream_aggregate_group *g;
+    size_t i;
+
+    netdata_mutex_lock(&a->mutex);
+    stream_aggregate_combine(a, now);
+    struct stream_aggregate_group *groups = a->groups;
+    netdata_mutex_unlock(&a->mutex);
+
+    // the receivers may add groups while we update the charts, but only this thread changes their values
+    for(g = groups; g ; g = g->next) {
+        size_t values_size = g->values_size, counted = 0;
+        for(i = 0; i < values_size ; i++)
+            counted += g->counts[i];
+
+        if(!counted && !g->st)
+            continue;
+
+        if(unlikely(!g->st))
+            stream_aggregate_group_chart(a, g);
+        else
+            rrdset_next(g->st);
+
+        if(unlikely(g->rd_size < values_size)) {
+            g->rd = reallocz(g->rd, values_size * sizeof(RRDDIM *));
+            memset(&g->rd[g->rd_size], 0, (values_size - g->rd_size) * sizeof(RRDDIM *));
+            g->rd_size = values_size;
+        }
+
+        for(i = 0; i < values_size ; i++) {
+            if(!g->counts[i])
+                continue;
+
+            if(unlikely(!g->rd[i])) {
+                netdata_mutex_lock(&a->mutex);
+                char *dimension = a->dimensions[i];
+                netdata_mutex_unlock(&a->mutex);
+
+                // the values are fractional, i.e. percentages
+                g->rd[i] = rrddim_add(g->st, dimension, NULL, 1, 1000, RRD_ALGORITHM_ABSOLUTE);
+            }
+
+            rrddim_set_by_pointer(g->st, g->rd[i], (collected_number)(g->values[i] * 1000));
+        }
+
+        rrdset_done(g->st);
+    }
+}
+
+static void *stream_aggregate_thread(void *ptr) {
+    UNUSED(ptr);
+    heartbeat_t hb;
+    heartbeat_init(&hb);
+
+    info("STREAM: aggregate thread started (task id %d)", gettid());
+
+    while(!netdata_exit) {
+        heartbeat_next(&hb, USEC_PER_SEC);
+        if(unlikely(netdata_exit))
+            break;
+
+        time_t now = now_realtime_sec();
+        struct stream_aggregate *a;
+        for(a = stream_aggregates; a ; a = a->next) {
+            if(now % a->update_every == 0)
+                stream_aggregate_update(a, now);
+        }
+    }
+
+    info("STREAM: aggregate thread exiting");
+    return NULL;
+}
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "rrdpush.h"
+
+#ifdef ENABLE_COMPRESSION
+
+/*
+ * Compressed streaming
+ *
+ * When both ends negotiate STREAM_CAP_COMPRESSION, everything the child
+ * sends after the handshake is a sequence of messages:
+ *
+ *     [STREAM_COMPRESSION_SIGNATURE] [24-bit big endian size] [LZ4 block]
+ *
+ * Every message carries at most STREAM_COMPRESSION_MSG_MAX bytes of the
+ * plain text protocol. The blocks form a single LZ4 stream per connection,
+ * so each block uses the previous 64KiB as its dictionary - this is what
+ * makes the highly repetitive BEGIN/SET/END lines compress well.
+ *
+ * Both ends keep their history in ring buffers of
+ * 64KiB + 2 * STREAM_COMPRESSION_MSG_MAX bytes, which is enough for LZ4
+ * to find the previous 64KiB where it left it.
+ */
+
+#define STREAM_COMPRESSION_DICT_SIZE (64 * 1024)
+#define STREAM_COMPRESSION_RING_SIZE (STREAM_COMPRESSION_DICT_SIZE + 2 * STREAM_COMPRESSION_MSG_MAX)
+
+// ----------------------------------------------------------------------------
+// sender side
+
+static inline size_t compressor_memory_size(void) {
+    return sizeof(LZ4_stream_t) + STREAM_COMPRESSION_RING_SIZE + STREAM_COMPRESSION_HEADER_SIZE + LZ4_COMPRESSBOUND(STREAM_COMPRESSION_MSG_MAX);
+}
+
+void compressor_reset(struct compressor_state *c, int active) {
+    c->active = active;
+    c->output_len = 0;
+    c->output_sent = 0;
+    c->ring_pos = 0;
+
+    if(!active)
+        return;
+
+    if(!c->stream) {
+        c->stream = LZ4_createStream();
+        if(unlikely(!c->stream))
+            fatal("STREAM: cannot allocate LZ4 compression stream");
+
+        c->ring = mallocz(STREAM_COMPRESSION_RING_SIZE);
+        c->output = mallocz(STREAM_COMPRESSION_HEADER_SIZE + LZ4_COMPRESSBOUND(STREAM_COMPRESSION_MSG_MAX));
+        memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, compressor_memory_size());
+    }
+    else
+        LZ4_resetStream(c->stream);
+}
+
+void compressor_destroy(struct compressor_state *c) {
+    if(c->stream) {
+        LZ4_freeStream(c->stream);
+        freez(c->ring);
+        freez(c->output);
+        memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, compressor_memory_size());
+    }
+
+    memset(c, 0, sizeof(*c));
+}
+
+// compresses up to STREAM_COMPRESSION_MSG_MAX bytes into c->output
+// returns the number of input bytes consumed
+size_t compressor_compress(struct compressor_state *c, const char *data, size_t size) {
+    if(size > STREAM_COMPRESSION_MSG_MAX)
+        size = STREAM_COMPRESSION_MSG_MAX;
+
+    usec_t started_ut = now_monotonic_usec();
+
+    // LZ4 needs the previous blocks where they were compressed,
+    // so copy the input out of the circular buffer of the sender
+    if(c->ring_pos + size > STREAM_COMPRESSION_RING_SIZE - STREAM_COMPRESSION_MSG_MAX)
+        c->ring_pos = 0;
+
+    char *src = &c->ring[c->ring_pos];
+    memcpy(src, data, size);
+
+    int compressed = LZ4_compress_fast_continue(c->stream, src, c->output + STREAM_COMPRESSION_HEADER_SIZE,
+                                                (int)size, LZ4_COMPRESSBOUND(STREAM_COMPRESSION_MSG_MAX), 1);
+    if(unlikely(compressed <= 0))
+        fatal("STREAM: LZ4 failed to compress %zu bytes", size);
+
+    c->ring_pos += size;
+
+    c->output[0] = (char)STREAM_COMPRESSION_SIGNATURE;
+    c->output[1] = (char)((compressed >> 16) & 0xff);
+    c->output[2] = (char)((compressed >> 8) & 0xff);
+    c->output[3] = (char)(compressed & 0xff);
+    c->output_len = (size_t)compressed + STREAM_COMPRESSION_HEADER_SIZE;
+    c->output_sent = 0;
+
+    c->bytes_in += size;
+    c->bytes_out += c->output_len;
+    c->usec += now_monotonic_usec() - started_ut;
+
+    return size;
+}
+
+// ----------------------------------------------------------------------------
+// receiver side
+
+static inline size_t decompressor_memory_size(void) {
+    return sizeof(LZ4_streamDecode_t) + STREAM_COMPRESSION_RING_SIZE + LZ4_COMPRESSBOUND(STREAM_COMPRESSION_MSG_MAX);
+}
+
+void decompressor_init(struct decompressor_state *d) {
+    d->stream = LZ4_createStreamDecode();
+    if(unlikely(!d->stream))
+        fatal("STREAM: cannot allocate LZ4 decompression stream");
+
+    d->ring = mallocz(STREAM_COMPRESSION_RING_SIZE);
+    d->input = mallocz(LZ4_COMPRESSBOUND(STREAM_COMPRESSION_MSG_MAX));
+    d->ring_pos = 0;
+    d->output = NULL;
+    d->output_len = 0;
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, decompressor_memory_size());
+}
+
+void decompressor_destroy(struct decompressor_state *d) {
+    if(d->stream) {
+        LZ4_freeStreamDecode(d->stream);
+        freez(d->ring);
+        freez(d->input);
+        memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, decompressor_memory_size());
+    }
+
+    memset(d, 0, sizeof(*d));
+}
+
+// returns the size of the message the header describes, or 0 if the header is not valid
+size_t decompressor_message_size(const char *header) {
+    const unsigned char *h = (const unsigned char *)header;
+
+    if(unlikely(h[0] != STREAM_COMPRESSION_SIGNATURE))
+        return 0;
+
+    size_t size = ((size_t)h[1] << 16) | ((size_t)h[2] << 8) | (size_t)h[3];
+    if(unlikely(!size || size > (size_t)LZ4_COMPRESSBOUND(STREAM_COMPRESSION_MSG_MAX)))
+        return 0;
+
+    return size;
+}
+
+// decompresses the message in d->input into d->output
+// returns 0 on success
+int decompressor_decompress(struct decompressor_state *d, size_t size) {
+    usec_t started_ut = now_monotonic_usec();
+
+    if(d->ring_pos + STREAM_COMPRESSION_MSG_MAX > STREAM_COMPRESSION_RING_SIZE)
+        d->ring_pos = 0;
+
+    char *dst = &d->ring[d->ring_pos];
+    int decompressed = LZ4_decompress_safe_continue(d->stream, d->input, dst, (int)size, STREAM_COMPRESSION_MSG_MAX);
+    if(unlikely(decompressed < 0))
+        return 1;
+
+    d->ring_pos += (size_t)decompressed;
+    d->output = dst;
+    d->output_len = (size_t)decompressed;
+
+    d->bytes_in += size + STREAM_COMPRESSION_HEADER_SIZE;
+    d->bytes_out += (size_t)decompressed;
+    d->usec += now_monotonic_usec() - started_ut;
+
+    return 0;
+}
+
+#endif // ENABLE_COMPRESSION
@@ -0,0 +1,431 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "rrdpush.h"
+
+/*
+ * Fan-out to more parents
+ *
+ * The groups of parents after the first one in [stream].destination are
+ * served by a thread each. The thread connects to one of the alternatives of
+ * its group, asks for the charts to be defined again for everyone, and then
+ * sends whatever the collectors add to its queue.
+ *
+ * The queues are written by the collectors under the lock of the sender, in
+ * sender_commit(), with the same bytes that go to the first group, so every
+ * chart is formatted once no matter how many parents it is streamed to. Each
+ * destination compresses its own queue, since every connection is a separate
+ * LZ4 stream.
+ */
+
+static inline int sender_fanout_socket_error(struct sender_fanout *f, const char *what) {
+    RRDHOST *host = f->sender->host;
+
+    error("STREAM %s [send to %s]: %s - closing connection - we have sent %zu bytes on this connection.",
+          host->hostname, f->connected_to, what, f->sent_bytes_on_this_connection);
+    return 1;
+}
+
+static void sender_fanout_disconnect(struct sender_fanout *f) {
+    struct sender_state *s = f->sender;
+
+    netdata_mutex_lock(&s->mutex);
+
+    if(f->connected) {
+        f->connected = 0;
+        s->fanouts_connected--;
+        s->host->rrdpush_sender_connected = (s->ready || s->fanouts_connected || s->spill.outage) ? 1 : 0;
+    }
+
+    f->overflow = 0;
+    f->buffer->read = f->buffer->write = 0;
+
+    netdata_mutex_unlock(&s->mutex);
+
+    if(f->fd != -1) {
+        close(f->fd);
+        f->fd = -1;
+    }
+}
+
+// returns 0 when connected
+static int sender_fanout_connect(struct sender_fanout *f) {
+    struct sender_state *s = f->sender;
+    RRDHOST *host = s->host;
+
+    int32_t version;
+    uint32_t capabilities = 0;
+    int fd = rrdpush_sender_connect(
+            host
+#ifdef ENABLE_HTTPS
+            , &f->ssl
+#endif
+            , f->destination
+            , s->default_port
+            , s->timeout
+            , rrdpush_sender_capabilities_offered(s)
+            , &f->reconnects_counter
+            , f->connected_to
+            , sizeof(f->connected_to)
+            , &version
+            , &capabilities
+    );
+
+    if(fd == -1)
+        return 1;
+
+    f->fd = fd;
+
+#ifdef ENABLE_COMPRESSION
+    // every connection is a new compressed stream
+    compressor_reset(&f->compressor, capabilities & STREAM_CAP_COMPRESSION);
+    if(f->compressor.active)
+        info("STREAM %s [send to %s]: compression enabled", host->hostname, f->connected_to);
+#endif
+
+    // the charts are reset holding locks, so the thread cannot be cancelled meanwhile
+    netdata_thread_disable_cancelability();
+    int mismatch = rrdpush_sender_reset_stream(s, f, version, capabilities);
+    netdata_thread_enable_cancelability();
+
+    if(mismatch) {
+        sender_fanout_disconnect(f);
+        return 1;
+    }
+
+    f->last_sent_t = now_monotonic_sec();
+    f->sent_bytes_on_this_connection = 0;
+    host->rrdpush_sender_connected = 1;
+
+    info("STREAM %s [send to %s]: fan-out destination is ready to send metrics.", host->hostname, f->connected_to);
+    return 0;
+}
+
+// sends the next part of the queue - returns 1 when the connection has to be closed
+static int sender_fanout_send(struct sender_fanout *f) {
+    struct sender_state *s = f->sender;
+    struct circular_buffer *cb = f->buffer;
+
+    netdata_thread_disable_cancelability();
+    netdata_mutex_lock(&s->mutex);
+
+    char *chunk;
+    size_t outstanding = cbuffer_next_unsafe(cb, &chunk);
+    int plain = 1;
+
+#ifdef ENABLE_COMPRESSION
+    // the compressed message has to be sent completely before the next one is compressed
+    struct compressor_state *c = &f->compressor;
+    if(c->active) {
+        if(!c->output_len && outstanding)
+            cbuffer_remove_unsafe(cb, compressor_compress(c, chunk, outstanding));
+
+        chunk = c->output + c->output_sent;
+        outstanding = c->output_len - c->output_sent;
+        plain = 0;
+    }
+#endif
+
+    ssize_t ret;
+#ifdef ENABLE_HTTPS
+    if(f->ssl.conn && !f->ssl.flags)
+        ret = SSL_write(f->ssl.conn, chunk, outstanding);
+    else
+#endif
+    if(plain)
+        ret = sender_send_buffer_nolock(cb, f->fd);
+    else
+        ret = send(f->fd, chunk, outstanding, MSG_DONTWAIT);
+
+    int failed = 0;
+    if(likely(ret > 0)) {
+#ifdef ENABLE_COMPRESSION
+        if(c->active) {
+            c->output_sent += ret;
+            if(c->output_sent == c->output_len)
+                c->output_len = c->output_sent = 0;
+        }
+        else
+#endif
+        cbuffer_remove_unsafe(cb, ret);
+
+        f->sent_bytes_on_this_connection += ret;
+        f->sent_bytes += ret;
+        f->last_sent_t = now_monotonic_sec();
+    }
+    else if(ret == -1 && errno != EAGAIN && errno != EINTR && errno != EWOULDBLOCK)
+        failed = 1;
+
+    netdata_mutex_unlock(&s->mutex);
+    netdata_thread_enable_cancelability();
+
+    return failed ? sender_fanout_socket_error(f, "failed to send metrics") : 0;
+}
+
+// the parents do not send commands to fan-out destinations, but the socket has to be drained
+// returns 1 when the connection has to be closed
+static int sender_fanout_read(struct sender_fanout *f) {
+    char buffer[512 + 1];
+    ssize_t ret;
+
+#ifdef ENABLE_HTTPS
+    if(f->ssl.conn && !f->ssl.flags) {
+        ERR_clear_error();
+        ret = SSL_read(f->ssl.conn, buffer, sizeof(buffer) - 1);
+        if(ret <= 0) {
+            int sslerrno = SSL_get_error(f->ssl.conn, (int)ret);
+            if(sslerrno == SSL_ERROR_WANT_READ || sslerrno == SSL_ERROR_WANT_WRITE)
+                return 0;
+
+            return sender_fanout_socket_error(f, "SSL read failed");
+        }
+    }
+    else
+#endif
+    {
+        ret = recv(f->fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+        if(ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return 0;
+
+        if(ret <= 0)
+            return sender_fanout_socket_error(f, (ret == 0) ? "connection closed by far end" : "error during read");
+    }
+
+    buffer[ret] = '\0';
+    debug(D_STREAM, "STREAM %s [send to %s]: fan-out destination sent: %s", f->sender->host->hostname, f->connected_to, buffer);
+    return 0;
+}
+
+static void sender_fanout_thread_cleanup(void *ptr) {
+    struct sender_fanout *f = ptr;
+
+    info("STREAM %s [send to %s]: fan-out thread now exits.", f->sender->host->hostname, f->destination);
+    sender_fanout_disconnect(f);
+}
+
+static void *sender_fanout_thread(void *ptr) {
+    struct sender_fanout *f = ptr;
+    struct sender_state *s = f->sender;
+    RRDHOST *host = s->host;
+
+    info("STREAM %s [send to %s]: fan-out thread created (task id %d)", host->hostname, f->destination, gettid());
+
+    enum {
+        Collector,
+        Socket
+    };
+    struct pollfd fds[2];
+    fds[Collector].fd = f->pipe[PIPE_READ];
+    fds[Collector].events = POLLIN;
+
+    netdata_thread_cleanup_push(sender_fanout_thread_cleanup, f);
+    for(; host->rrdpush_send_enabled && !netdata_exit ;) {
+        netdata_thread_testcancel();
+
+        if(unlikely(f->fd == -1)) {
+            if(sender_fanout_connect(f))
+                sleep_usec(USEC_PER_SEC * s->reconnect_delay);
+            continue;
+        }
+
+        netdata_mutex_lock(&s->mutex);
+        int overflow = f->overflow;
+        size_t outstanding = sender_queue_used(f->buffer);
+#ifdef ENABLE_COMPRESSION
+        if(f->compressor.active)
+            outstanding += f->compressor.output_len - f->compressor.output_sent;
+#endif
+        netdata_mutex_unlock(&s->mutex);
+
+        int failed = 0;
+        if(unlikely(overflow)) {
+            errno = 0;
+            failed = sender_fanout_socket_error(f, "buffer full");
+        }
+        else if(unlikely(now_monotonic_sec() - f->last_sent_t > s->timeout))
+            failed = sender_fanout_socket_error(f, "could not send metrics for too long");
+
+        if(unlikely(failed)) {
+            sender_fanout_disconnect(f);
+            continue;
+        }
+
+        // the labels go to all the parents, whichever thread finds them first
+        rrdpush_send_labels(host);
+
+        fds[Collector].revents = 0;
+        fds[Socket].fd = f->fd;
+        fds[Socket].events = (short)(POLLIN | (outstanding ? POLLOUT : 0));
+        fds[Socket].revents = 0;
+
+        int retval = poll(fds, 2, 1000);
+        if(unlikely(netdata_exit)) break;
+
+        if(retval == 0 || (retval == -1 && (errno == EAGAIN || errno == EINTR)))
+            continue;
+
+        if(unlikely(retval == -1)) {
+            sender_fanout_socket_error(f, "failed to poll()");
+            sender_fanout_disconnect(f);
+            continue;
+        }
+
+        if(fds[Collector].revents & (POLLIN | POLLPRI)) {
+            char buffer[1000 + 1];
+            if(read(f->pipe[PIPE_READ], buffer, 1000) == -1)
+                error("STREAM %s [send to %s]: cannot read from internal pipe.", host->hostname, f->connected_to);
+        }
+
+        if(fds[Socket].revents & POLLIN)
+            failed = sender_fanout_read(f);
+
+        if(!failed && (fds[Socket].revents & POLLOUT))
+            failed = sender_fanout_send(f);
+
+        if(!failed && (fds[Socket].revents & (POLLERR | POLLHUP | POLLNVAL)))
+            failed = sender_fanout_socket_error(f, "the socket reports errors");
+
+        if(failed)
+            sender_fanout_disconnect(f);
+    }
+
+    netdata_thread_cleanup_pop(1);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// the sender side
+
+// parse the groups of [stream].destination - the first one is for the sender thread
+void sender_fanout_init(struct sender_state *s) {
+    // the sender thread has been started again
+    if(s->destination)
+        return;
+
+    RRDHOST *host = s->host;
+    struct sender_fanout **last = &s->fanouts;
+
+    char *groups = strdupz(host->rrdpush_send_destination), *next = groups, *group;
+    while((group = strsep(&next, "|"))) {
+        group = trim(group);
+        if(!group || !*group)
+            continue;
+
+        if(!s->destination) {
+            s->destination = strdupz(group);
+            continue;
+        }
+
+        struct sender_fanout *f = callocz(1, sizeof(struct sender_fanout));
+        f->sender = s;
+        f->destination = strdupz(group);
+        f->fd = -1;
+        f->pipe[PIPE_READ] = f->pipe[PIPE_WRITE] = -1;
+#ifdef ENABLE_HTTPS
+        f->ssl.flags = NETDATA_SSL_START;
+#endif
+        f->buffer = cbuffer_new(1024, s->buffer->max_size);
+
+        if(pipe(f->pipe) == -1) {
+            error("STREAM %s [send to %s]: cannot create the pipe of the fan-out destination - it is disabled.", host->hostname, group);
+            cbuffer_free(f->buffer);
+            freez(f->destination);
+            freez(f);
+            continue;
+        }
+
+        info("STREAM %s [send]: fan-out to '%s' too", host->hostname, f->destination);
+
+        *last = f;
+        last = &f->next;
+    }
+
+    if(!s->destination)
+        s->destination = strdupz("");
+
+    freez(groups);
+}
+
+void sender_fanout_start(struct sender_state *s) {
+    struct sender_fanout *f;
+    for(f = s->fanouts; f ; f = f->next) {
+        if(f->spawned)
+            continue;
+
+        char tag[NETDATA_THREAD_TAG_MAX + 1];
+        snprintfz(tag, NETDATA_THREAD_TAG_MAX, "STREAM_FANOUT[%s]", s->host->hostname);
+
+        if(netdata_thread_create(&f->thread, tag, NETDATA_THREAD_OPTION_JOINABLE, sender_fanout_thread, f))
+            error("STREAM %s [send to %s]: failed to create the fan-out thread.", s->host->hostname, f->destination);
+        else
+            f->spawned = 1;
+    }
+}
+
+void sender_fanout_stop(struct sender_state *s) {
+    struct sender_fanout *f;
+    for(f = s->fanouts; f ; f = f->next) {
+        if(!f->spawned)
+            continue;
+
+        netdata_thread_cancel(f->thread);
+
+        void *result;
+        netdata_thread_join(f->thread, &result);
+        f->spawned = 0;
+    }
+}
+
+void sender_fanout_destroy(struct sender_state *s) {
+    while(s->fanouts) {
+        struct sender_fanout *f = s->fanouts;
+        s->fanouts = f->next;
+
+#ifdef ENABLE_COMPRESSION
+        compressor_destroy(&f->compressor);
+#endif
+#ifdef ENABLE_HTTPS
+        if(f->ssl.conn)
+            SSL_free(f->ssl.conn);
+#endif
+        close(f->pipe[PIPE_READ]);
+        close(f->pipe[PIPE_WRITE]);
+        cbuffer_free(f->buffer);
+        freez(f->destination);
+        freez(f);
+    }
+
+    freez(s->destination);
+    s->destination = NULL;
+}
+
+// queue the data the collectors committed to the connected destinations
+// the caller holds the lock of the sender
+void sender_fanout_add(struct sender_state *s, const char *data, size_t len) {
+    struct sender_fanout *f;
+    for(f = s->fanouts; f ; f = f->next) {
+        if(!f->connected || f->overflow)
+            continue;
+
+        int was_empty = (f->buffer->read == f->buffer->write);
+
+        if(cbuffer_add_unsafe(f->buffer, data, len))
+            f->overflow = 1;
+
+        // wake up the thread, if it is not already sending
+        if(was_empty || f->overflow) {
+            if(write(f->pipe[PIPE_WRITE], " ", 1) == -1)
+                error("STREAM %s [send to %s]: cannot write to internal pipe", s->host->hostname, f->connected_to);
+        }
+    }
+}
+
+// the caller holds the lock of the sender
+size_t sender_fanout_memory_size(struct sender_state *s) {
+    size_t size = 0;
+
+    struct sender_fanout *f;
+    for(f = s->fanouts; f ; f = f->next)
+        size += sizeof(*f) + sizeof(*f->buffer) + f->buffer->size;
+
+    return size;
+}
@@ -4,6 +4,20 @@
 
 extern struct config stream_config;
 
+static void stream_slots_destroy(struct stream_slots *slots) {
+    size_t i, size = slots->charts_size * sizeof(*slots->charts) + slots->payload_size;
+
+    for(i = 0; i < slots->charts_size ; i++) {
+        size += slots->charts[i].dimensions_size * sizeof(*slots->charts[i].dimensions);
+        freez(slots->charts[i].dimensions);
+    }
+
+    freez(slots->charts);
+    freez(slots->payload);
+    memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, size);
+    memset(slots, 0, sizeof(*slots));
+}
+
 void destroy_receiver_state(struct receiver_state *rpt) {
     freez(rpt->key);
     freez(rpt->hostname);
@@ -22,9 +36,44 @@ void destroy_receiver_state(struct receiver_state *rpt) {
         SSL_free(rpt->ssl.conn);
     }
 #endif
+#ifdef ENABLE_COMPRESSION
+    decompressor_destroy(&rpt->decompressor);
+#endif
+    stream_slots_destroy(&rpt->slots);
+    freez(rpt->read_buffer);
+    freez(rpt->cd);
+    memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, sizeof(*rpt) + (size_t)rpt->read_size);
     freez(rpt);
 }
 
+/* Add the budget counters of a receiver to the ones of its host, when it is detached from it.
+ * Called with the receiver_lock of the host.
+ */
+void receiver_budget_detach(RRDHOST *host, struct receiver_state *rpt) {
+    struct receiver_budget *b = &rpt->budget;
+
+    host->receivers_charts_created += b->charts_created;
+    host->receivers_samples += b->samples;
+    host->receivers_bytes += b->bytes;
+    host->receivers_throttled_usec += b->throttled_usec;
+}
+
+/* Detach the receiver from its host, unless a new receiver has replaced it, and free it.
+ */
+void receiver_release(struct receiver_state *rpt) {
+    // Make sure that we detach this receiver and don't kill a freshly arriving one
+    if (!netdata_exit && rpt->host) {
+        netdata_mutex_lock(&rpt->host->receiver_lock);
+        if (rpt->host->receiver == rpt) {
+            receiver_budget_detach(rpt->host, rpt);
+            rpt->host->receiver = NULL;
+        }
+        netdata_mutex_unlock(&rpt->host->receiver_lock);
+    }
+
+    destroy_receiver_state(rpt);
+}
+
 static void rrdpush_receiver_thread_cleanup(void *ptr) {
     static __thread int executed = 0;
     if(!executed) {
@@ -37,31 +86,64 @@ static void rrdpush_receiver_thread_cleanup(void *ptr) {
             return;
         }
 
-        // Make sure that we detach this thread and don't kill a freshly arriving receiver
-        if (!netdata_exit && rpt->host) {
-            netdata_mutex_lock(&rpt->host->receiver_lock);
-            if (rpt->host->receiver == rpt)
-                rpt->host->receiver = NULL;
-            netdata_mutex_unlock(&rpt->host->receiver_lock);
-        }
-
         info("STREAM %s [receive from [%s]:%s]: receive thread ended (task id %d)", rpt->hostname, rpt->client_ip, rpt->client_port, gettid());
-        destroy_receiver_state(rpt);
+        receiver_release(rpt);
     }
 }
 
 #include "collectors/plugins.d/pluginsd_parser.h"
 
+/* Send a command to the child. The child reads the commands as it sends metrics, so when the socket is
+ * non-blocking (the receivers of the pool) we only wait a little for it to have room.
+ */
+static int receiver_send_command(struct receiver_state *rpt, const char *command) {
+    size_t len = strlen(command);
+    int retries = 10;
+    ssize_t ret;
+
+    for (;;) {
+        int again = 0;
+#ifdef ENABLE_HTTPS
+        if (rpt->ssl.conn && !rpt->ssl.flags) {
+            ERR_clear_error();
+            ret = SSL_write(rpt->ssl.conn, command, (int)len);
+            if (ret <= 0) {
+                int sslerrno = SSL_get_error(rpt->ssl.conn, (int)ret);
+                again = (sslerrno == SSL_ERROR_WANT_READ || sslerrno == SSL_ERROR_WANT_WRITE);
+            }
+        }
+        else
+#endif
+        {
+            ret = send(rpt->fd, command, len, 0);
+            again = (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+        }
+
+        if (!again || !retries--)
+            break;
+
+        struct pollfd pfd = { .fd = rpt->fd, .events = POLLOUT };
+        if (poll(&pfd, 1, 100) == -1 && errno != EINTR)
+            break;
+    }
+
+    if (ret != (ssize_t)len) {
+        error("STREAM %s [receive from %s]: failed to send command: %s", rpt->hostname, rpt->client_ip, command);
+        return 1;
+    }
+    return 0;
+}
+
 PARSER_RC streaming_timestamp(char **words, void *user, PLUGINSD_ACTION *plugins_action)
 {
     UNUSED(plugins_action);
     char *remote_time_txt = words[1];
     time_t remote_time = 0;
     RRDHOST *host = ((PARSER_USER_OBJECT *)user)->host;
+    struct receiver_state *rpt = (struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque;
     struct plugind *cd = ((PARSER_USER_OBJECT *)user)->cd;
-    if (cd->version < VERSION_GAP_FILLING ) {
-        error("STREAM %s from %s: Child negotiated version %u but sent TIMESTAMP!", host->hostname, cd->cmd,
-               cd->version);
+    if (!(rpt->capabilities & STREAM_CAP_TIMESTAMPS)) {
+        error("STREAM %s from %s: Child did not negotiate replication or backlog but sent TIMESTAMP!", host->hostname, cd->cmd);
         return PARSER_RC_OK;    // Ignore error and continue stream
     }
     if (remote_time_txt && *remote_time_txt) {
@@ -76,26 +158,259 @@ PARSER_RC streaming_timestamp(char **words, void *user, PLUGINSD_ACTION *plugins
             info("STREAM %s from %s: Checking for gaps... remote=%ld local=%ld..%ld slew=%ld  %ld-sec gap",
                  host->hostname, cd->cmd, remote_time, prev, now, remote_time - now, gap);
         }
-        char message[128];
-        sprintf(message,"REPLICATE %ld %ld\n", remote_time - gap, remote_time);
-        int ret;
-#ifdef ENABLE_HTTPS
-        SSL *conn = host->stream_ssl.conn ;
-        if(conn && !host->stream_ssl.flags) {
-            ret = SSL_write(conn, message, strlen(message));
-        } else {
-            ret = send(host->receiver->fd, message, strlen(message), MSG_DONTWAIT);
-        }
-#else
-        ret = send(host->receiver->fd, message, strlen(message), MSG_DONTWAIT);
-#endif
-        if (ret != (int)strlen(message))
-            error("Failed to send initial timestamp - gaps may appear in charts");
+
+        // the child asks to replicate its charts in its own clock
+        rpt->clock_delta = remote_time - now;
         return PARSER_RC_OK;
     }
     return PARSER_RC_ERROR;
 }
 
+// the difference of the clocks, in whole collection intervals of the chart
+static inline time_t replication_clock_delta(struct receiver_state *rpt, RRDSET *st) {
+    return (rpt->clock_delta / st->update_every) * st->update_every;
+}
+
+/* CHART_DEFINITION_END "<chart id>" <first entry> <last entry>
+ * The child holds the live values of the chart until we reply with REPLICATE "<chart id>" <after>, asking for the
+ * points after <after> in its clock, or 0 when we do not need any.
+ */
+PARSER_RC streaming_chart_definition_end(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    RRDHOST *host = ((PARSER_USER_OBJECT *)user)->host;
+    struct receiver_state *rpt = (struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque;
+
+    if (unlikely(!words[1] || !words[2] || !words[3])) {
+        error("STREAM %s: CHART_DEFINITION_END came without a chart id or its retention.", host->hostname);
+        return PARSER_RC_ERROR;
+    }
+
+    time_t child_first_t = (time_t)str2ull(words[2]);
+    time_t child_last_t = (time_t)str2ull(words[3]);
+    time_t after = 0;
+
+    RRDSET *st = rrdset_find(host, words[1]);
+    if (unlikely(!st)) {
+        error("STREAM %s: CHART_DEFINITION_END for chart '%s', which does not exist.", host->hostname, words[1]);
+    }
+    // only the database engine can store points in the past
+    else if (st->rrd_memory_mode == RRD_MEMORY_MODE_DBENGINE && rpt->seconds_to_replicate > 0 && child_last_t) {
+        time_t delta = replication_clock_delta(rpt, st);
+        time_t wanted = now_realtime_sec() - rpt->seconds_to_replicate;
+        time_t have = rrdset_last_entry_t(st);
+        if (have > wanted)
+            wanted = have;
+
+        after = wanted + delta;
+        if (after < child_first_t - 1)
+            after = child_first_t - 1;
+
+        if (after >= child_last_t)
+            after = 0;
+    }
+
+    if (st) {
+        st->state->replay_started = 0;
+        st->state->replay_after = after ? after - replication_clock_delta(rpt, st) : 0;
+    }
+
+    char command[RRD_ID_LENGTH_MAX + 100];
+    snprintfz(command, sizeof(command) - 1, "REPLICATE \"%s\" %ld\n", words[1], after);
+    if (receiver_send_command(rpt, command))
+        return PARSER_RC_ERROR;
+
+    return PARSER_RC_OK;
+}
+
+/* Keep the replication of all the children below replication_receive_points_per_second, by not reading more from
+ * the children that are ahead of the rate - they stop sending when their buffers fill up.
+ * The threads of the pool serve other children too, so they pause the receiver instead of sleeping.
+ */
+static void replication_receive_throttle(struct receiver_state *rpt, size_t points) {
+    static netdata_mutex_t mutex = NETDATA_MUTEX_INITIALIZER;
+    static struct replication_limiter limiter = { 0 };
+
+    netdata_mutex_lock(&mutex);
+    usec_t ahead_ut = replication_limiter_add(&limiter, points, replication_receive_points_per_second);
+    netdata_mutex_unlock(&mutex);
+
+    if (!ahead_ut)
+        return;
+
+    if (rpt->pool)
+        rpt->paused_until_ut = now_monotonic_usec() + ahead_ut;
+    else
+        sleep_usec(ahead_ut);
+}
+
+static inline usec_t receiver_budget_pay(struct replication_limiter *limiter, size_t *paid, size_t count, size_t per_second) {
+    if (!per_second || count == *paid) {
+        *paid = count;
+        return 0;
+    }
+
+    usec_t ahead_ut = replication_limiter_add(limiter, count - *paid, per_second);
+    *paid = count;
+    return ahead_ut;
+}
+
+/* Keep the child within the charts, the values and the bytes per second of its budget, by not reading more from
+ * it while it is ahead. It is called after parsing what has been read, so a child may go over its budget by one
+ * read, but not for longer.
+ */
+static void receiver_budget_throttle(struct receiver_state *rpt) {
+    struct receiver_budget *b = &rpt->budget;
+    usec_t ahead_ut = 0, ut;
+
+    ut = receiver_budget_pay(&b->charts_limiter, &b->charts_paid, b->charts_created, b->charts_per_second);
+    if (ut > ahead_ut) ahead_ut = ut;
+
+    ut = receiver_budget_pay(&b->samples_limiter, &b->samples_paid, b->samples, b->samples_per_second);
+    if (ut > ahead_ut) ahead_ut = ut;
+
+    ut = receiver_budget_pay(&b->bytes_limiter, &b->bytes_paid, b->bytes, b->bytes_per_second);
+    if (ut > ahead_ut) ahead_ut = ut;
+
+    if (!ahead_ut)
+        return;
+
+    b->throttled_usec += ahead_ut;
+
+    if (rpt->pool) {
+        usec_t until_ut = now_monotonic_usec() + ahead_ut;
+        if (rpt->paused_until_ut < until_ut)
+            rpt->paused_until_ut = until_ut;
+    }
+    else
+        sleep_usec(ahead_ut);
+}
+
+/* REPLAY_BEGIN "<chart id>" <first point> <last point>
+ */
+PARSER_RC streaming_replay_begin(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    RRDHOST *host = ((PARSER_USER_OBJECT *)user)->host;
+    struct receiver_state *rpt = (struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque;
+
+    rpt->replay_st = NULL;
+    rpt->replay_points = 0;
+
+    RRDSET *st = words[1] ? rrdset_find(host, words[1]) : NULL;
+    if (unlikely(!st)) {
+        error("STREAM %s: REPLAY_BEGIN for chart '%s', which does not exist.", host->hostname, words[1] ? words[1] : "");
+        return PARSER_RC_OK;
+    }
+
+    if (unlikely(st->rrd_memory_mode != RRD_MEMORY_MODE_DBENGINE || !st->state->replay_after))
+        return PARSER_RC_OK;
+
+    if (!st->state->replay_started) {
+        // the points stored before the disconnection are in the current pages
+        rrdset_rdlock(st);
+        rrdset_reset(st);
+
+        RRDDIM *rd;
+        rrddim_foreach_read(rd, st)
+            rd->state->replay_next_t = 0;
+
+        rrdset_unlock(st);
+        st->state->replay_started = 1;
+    }
+
+    rpt->replay_st = st;
+    return PARSER_RC_OK;
+}
+
+/* REPLAY_SET "<dimension id>" <time> <storage number>
+ * The points of each dimension come in order. The pages of the database engine have a point every update_every,
+ * so the missing points are stored as empty, or a new page is started when there are too many.
+ */
+#define REPLAY_MAX_EMPTY_POINTS 1024    // the points of a page of the database engine
+PARSER_RC streaming_replay_set(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    struct receiver_state *rpt = (struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque;
+    RRDSET *st = rpt->replay_st;
+
+    if (unlikely(!st))
+        return PARSER_RC_OK;
+
+    if (unlikely(!words[1] || !words[2] || !words[3])) {
+        error("STREAM %s: REPLAY_SET came without a dimension, a time or a value.", rpt->hostname);
+        return PARSER_RC_ERROR;
+    }
+
+    RRDDIM *rd = rrddim_find(st, words[1]);
+    if (unlikely(!rd || rrddim_flag_check(rd, RRDDIM_FLAG_ARCHIVED)))
+        return PARSER_RC_OK;
+
+    time_t update_every = st->update_every;
+    time_t t = (time_t)str2ull(words[2]) - replication_clock_delta(rpt, st);
+    storage_number n = (storage_number)str2ul(words[3]);
+
+    if (unlikely(t <= st->state->replay_after || (rd->state->replay_next_t && t < rd->state->replay_next_t)))
+        return PARSER_RC_OK;
+
+    rrdset_rdlock(st);
+
+    if (rd->state->replay_next_t && t > rd->state->replay_next_t) {
+        time_t missing = (t - rd->state->replay_next_t) / update_every;
+
+        if (missing > REPLAY_MAX_EMPTY_POINTS)
+            rd->state->collect_ops.flush(rd);
+        else {
+            time_t m;
+            for (m = rd->state->replay_next_t; m < t; m += update_every)
+                rd->state->collect_ops.store_metric(rd, (usec_t)m * USEC_PER_SEC, SN_EMPTY_SLOT);
+        }
+    }
+
+    rd->state->collect_ops.store_metric(rd, (usec_t)t * USEC_PER_SEC, n);
+    rd->state->replay_next_t = t + update_every;
+
+    rrdset_unlock(st);
+    rpt->replay_points++;
+
+    return PARSER_RC_OK;
+}
+
+/* REPLAY_END "<chart id>" <last point> <finished>
+ * When the child has finished, the next values of the chart are live.
+ */
+PARSER_RC streaming_replay_end(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    RRDHOST *host = ((PARSER_USER_OBJECT *)user)->host;
+    struct receiver_state *rpt = (struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque;
+
+    if (unlikely(!words[1] || !words[2] || !words[3])) {
+        error("STREAM %s: REPLAY_END came without a chart id, a time or a state.", host->hostname);
+        return PARSER_RC_ERROR;
+    }
+
+    RRDSET *st = rpt->replay_st;
+    rpt->replay_st = NULL;
+
+    if (!st)
+        st = rrdset_find(host, words[1]);
+
+    if (st && str2ul(words[3]) && st->state->replay_started) {
+        // start the live values on new pages, without filling the gap to the last point replicated
+        rrdset_rdlock(st);
+        rrdset_reset(st);
+        rrdset_unlock(st);
+        st->state->replay_started = 0;
+    }
+
+    if (rpt->replay_points)
+        replication_receive_throttle(rpt, rpt->replay_points);
+
+    rpt->replay_points = 0;
+    return PARSER_RC_OK;
+}
+
 #define CLAIMED_ID_MIN_WORDS 3
 PARSER_RC streaming_claimed_id(char **words, void *user, PLUGINSD_ACTION *plugins_action)
 {
@@ -141,16 +456,89 @@ PARSER_RC streaming_claimed_id(char **words, void *user, PLUGINSD_ACTION *plugin
     return PARSER_RC_OK;
 }
 
+#ifdef ENABLE_COMPRESSION
+/* Read exactly size bytes from the blocking socket.
+ */
+static int receiver_read_exactly(struct receiver_state *r, FILE *fp, char *buffer, size_t size) {
+#ifdef ENABLE_HTTPS
+    if (r->ssl.conn && !r->ssl.flags) {
+        size_t done = 0;
+        while (done < size) {
+            ERR_clear_error();
+            int ret = SSL_read(r->ssl.conn, buffer + done, (int)(size - done));
+            if (ret <= 0) {
+                u_long err;
+                char buf[256];
+                while ((err = ERR_get_error()) != 0) {
+                    ERR_error_string_n(err, buf, sizeof(buf));
+                    error("STREAM %s [receive from %s] ssl error: %s", r->hostname, r->client_ip, buf);
+                }
+                return 1;
+            }
+            done += (size_t)ret;
+        }
+        return 0;
+    }
+#endif
+    return (fread(buffer, 1, size, fp) != size);
+}
+
+/* Append the next part of the decompressed stream to the read buffer, reading a new message when the last one
+ * has been consumed.
+ */
+static int receiver_read_compressed(struct receiver_state *r, FILE *fp) {
+    struct decompressor_state *d = &r->decompressor;
+
+    if (r->decompressed_read == d->output_len) {
+        char header[STREAM_COMPRESSION_HEADER_SIZE];
+        if (receiver_read_exactly(r, fp, header, STREAM_COMPRESSION_HEADER_SIZE))
+            return 1;
+
+        size_t size = decompressor_message_size(header);
+        if (unlikely(!size)) {
+            error("STREAM %s [receive from %s]: invalid compressed message header, closing connection.", r->hostname, r->client_ip);
+            return 1;
+        }
+
+        if (receiver_read_exactly(r, fp, d->input, size))
+            return 1;
+
+        if (unlikely(decompressor_decompress(d, size))) {
+            error("STREAM %s [receive from %s]: cannot decompress message of %zu bytes, closing connection.", r->hostname, r->client_ip, size);
+            return 1;
+        }
+
+        r->decompressed_read = 0;
+    }
+
+    size_t available = d->output_len - r->decompressed_read;
+    size_t room = (size_t)(r->read_size - r->read_len - 1);
+    if (available > room)
+        available = room;
+
+    memcpy(r->read_buffer + r->read_len, d->output + r->decompressed_read, available);
+    r->decompressed_read += available;
+    r->read_len += (int)available;
+    r->budget.bytes += available;
+    return 0;
+}
+#endif
+
 /* The receiver socket is blocking, perform a single read into a buffer so that we can reassemble lines for parsing.
  */
 static int receiver_read(struct receiver_state *r, FILE *fp) {
+#ifdef ENABLE_COMPRESSION
+    if (r->decompressor.stream)
+        return receiver_read_compressed(r, fp);
+#endif
 #ifdef ENABLE_HTTPS
     if (r->ssl.conn && !r->ssl.flags) {
         ERR_clear_error();
-        int desired = sizeof(r->read_buffer) - r->read_len - 1;
+        int desired = r->read_size - r->read_len - 1;
         int ret = SSL_read(r->ssl.conn, r->read_buffer + r->read_len, desired);
         if (ret > 0 ) {
             r->read_len += ret;
+            r->budget.bytes += (size_t)ret;
             return 0;
         }
         // Don't treat SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE differently on blocking socket
@@ -163,88 +551,623 @@ static int receiver_read(struct receiver_state *r, FILE *fp) {
         return 1;
     }
 #endif
-    if (!fgets(r->read_buffer, sizeof(r->read_buffer), fp))
+    if (!fgets(r->read_buffer, r->read_size, fp))
         return 1;
     r->read_len = strlen(r->read_buffer);
+    r->budget.bytes += (size_t)r->read_len;
     return 0;
 }
 
 /* Produce a full line if one exists, statefully return where we start next time.
  * When we hit the end of the buffer with a partial line move it to the beginning for the next fill.
  */
-static char *receiver_next_line(struct receiver_state *r, int *pos) {
-    int start = *pos, scan = *pos;
+static char *receiver_next_line(struct receiver_state *r) {
+    int start = r->read_pos, scan = r->read_pos;
     if (scan >= r->read_len) {
         r->read_len = 0;
+        r->read_pos = 0;
         return NULL;
     }
     while (scan < r->read_len && r->read_buffer[scan] != '\n')
         scan++;
     if (scan < r->read_len && r->read_buffer[scan] == '\n') {
-        *pos = scan+1;
+        r->read_pos = scan+1;
         r->read_buffer[scan] = 0;
         return &r->read_buffer[start];
     }
     memmove(r->read_buffer, &r->read_buffer[start], r->read_len - start);
     r->read_len -= start;
+    r->read_pos = 0;
     return NULL;
 }
 
+/* Read the binary payload that follows the current line, first from what is left in the read buffer and then
+ * from the stream. fgets() cannot read binary data, so the plain stream is read directly from the file.
+ */
+static int receiver_read_payload(struct receiver_state *r, FILE *fp, unsigned char *dst, size_t size) {
+    while (size) {
+        if (r->read_pos >= r->read_len) {
+            r->read_pos = 0;
+            r->read_len = 0;
+
+            // the receivers of the pool parse SAMPLES only when the payload is in the buffer
+            if (unlikely(!fp))
+                return 1;
+
+            int plain = 1;
+#ifdef ENABLE_COMPRESSION
+            if (r->decompressor.stream)
+                plain = 0;
+#endif
+#ifdef ENABLE_HTTPS
+            if (r->ssl.conn && !r->ssl.flags)
+                plain = 0;
+#endif
+            if (plain) {
+                r->budget.bytes += size;
+                return (fread(dst, 1, size, fp) != size);
+            }
+
+            if (receiver_read(r, fp))
+                return 1;
+        }
+
+        size_t available = (size_t)(r->read_len - r->read_pos);
+        if (available > size)
+            available = size;
+
+        memcpy(dst, &r->read_buffer[r->read_pos], available);
+        r->read_pos += (int)available;
+        dst += available;
+        size -= available;
+    }
+
+    return 0;
+}
+
+/* Read from the non-blocking socket of a receiver of the pool.
+ * Returns the bytes read, 0 when nothing has arrived and -1 when the connection has to be closed.
+ */
+static ssize_t receiver_recv(struct receiver_state *r, char *buffer, size_t size) {
+    ssize_t ret;
+#ifdef ENABLE_HTTPS
+    if (r->ssl.conn && !r->ssl.flags) {
+        ERR_clear_error();
+        ret = SSL_read(r->ssl.conn, buffer, (int)size);
+        if (ret > 0)
+            return ret;
+
+        int sslerrno = SSL_get_error(r->ssl.conn, (int)ret);
+        if (sslerrno == SSL_ERROR_WANT_READ || sslerrno == SSL_ERROR_WANT_WRITE)
+            return 0;
+
+        u_long err;
+        char buf[256];
+        while ((err = ERR_get_error()) != 0) {
+            ERR_error_string_n(err, buf, sizeof(buf));
+            error("STREAM %s [receive from %s] ssl error: %s", r->hostname, r->client_ip, buf);
+        }
+        return -1;
+    }
+#endif
+    ret = recv(r->fd, buffer, size, MSG_DONTWAIT);
+    if (ret > 0)
+        return ret;
+
+    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 0;
+
+    return -1;
+}
+
+#ifdef ENABLE_COMPRESSION
+/* Like receiver_read_compressed(), but the message is collected in parts, as they arrive.
+ */
+static ssize_t receiver_read_compressed_nonblocking(struct receiver_state *r, size_t room) {
+    struct decompressor_state *d = &r->decompressor;
+
+    while (r->decompressed_read == d->output_len) {
+        ssize_t ret;
+
+        if (r->compressed_read < STREAM_COMPRESSION_HEADER_SIZE) {
+            ret = receiver_recv(r, r->compressed_header + r->compressed_read, STREAM_COMPRESSION_HEADER_SIZE - r->compressed_read);
+            if (ret <= 0)
+                return ret;
+
+            r->compressed_read += (size_t)ret;
+            continue;
+        }
+
+        size_t size = decompressor_message_size(r->compressed_header);
+        if (unlikely(!size)) {
+            error("STREAM %s [receive from %s]: invalid compressed message header, closing connection.", r->hostname, r->client_ip);
+            return -1;
+        }
+
+        size_t have = r->compressed_read - STREAM_COMPRESSION_HEADER_SIZE;
+        if (have < size) {
+            ret = receiver_recv(r, d->input + have, size - have);
+            if (ret <= 0)
+                return ret;
+
+            r->compressed_read += (size_t)ret;
+            continue;
+        }
+
+        if (unlikely(decompressor_decompress(d, size))) {
+            error("STREAM %s [receive from %s]: cannot decompress message of %zu bytes, closing connection.", r->hostname, r->client_ip, size);
+            return -1;
+        }
+
+        r->compressed_read = 0;
+        r->decompressed_read = 0;
+    }
+
+    size_t available = d->output_len - r->decompressed_read;
+    if (available > room)
+        available = room;
+
+    memcpy(r->read_buffer + r->read_len, d->output + r->decompressed_read, available);
+    r->decompressed_read += available;
+    return (ssize_t)available;
+}
+#endif
+
+/* Append what has arrived to the read buffer of a receiver of the pool, growing it when the unparsed part
+ * fills it. Returns the bytes added, 0 when nothing has arrived and -1 when the connection has to be closed.
+ */
+static ssize_t receiver_read_nonblocking(struct receiver_state *r) {
+    if (r->read_pos) {
+        memmove(r->read_buffer, &r->read_buffer[r->read_pos], (size_t)(r->read_len - r->read_pos));
+        r->read_len -= r->read_pos;
+        r->read_pos = 0;
+    }
+
+    size_t room = (size_t)(r->read_size - r->read_len - 1);
+    if (room < RECEIVER_READ_BUFFER_SIZE && r->read_size < RECEIVER_POOL_BUFFER_MAX) {
+        int size = r->read_size * 2;
+        if (size > RECEIVER_POOL_BUFFER_MAX)
+            size = RECEIVER_POOL_BUFFER_MAX;
+
+        memory_accounting_resize(MEMORY_ACCOUNTING_STREAMING, size - r->read_size);
+        r->read_buffer = reallocz(r->read_buffer, (size_t)size);
+        r->read_size = size;
+        room = (size_t)(r->read_size - r->read_len - 1);
+    }
+
+    if (unlikely(!room)) {
+        error("STREAM %s [receive from %s]: received more than %d bytes without a new line, closing connection.", r->hostname, r->client_ip, r->read_size);
+        return -1;
+    }
+
+    ssize_t ret;
+#ifdef ENABLE_COMPRESSION
+    if (r->decompressor.stream)
+        ret = receiver_read_compressed_nonblocking(r, room);
+    else
+#endif
+        ret = receiver_recv(r, r->read_buffer + r->read_len, room);
+
+    if (ret > 0) {
+        r->read_len += (int)ret;
+        r->budget.bytes += (size_t)ret;
+    }
+
+    return ret;
+}
+
+/* Like receiver_next_line(), for the receivers of the pool. A SAMPLES line is not returned before its payload
+ * has arrived too, so that streaming_samples() finds all of it in the buffer.
+ */
+static char *receiver_next_complete_line(struct receiver_state *r) {
+    char *start = &r->read_buffer[r->read_pos];
+    char *newline = memchr(start, '\n', (size_t)(r->read_len - r->read_pos));
+    if (!newline)
+        return NULL;
+
+    if (newline - start > 8 && !strncmp(start, "SAMPLES ", 8)) {
+        size_t size = str2ul(start + 8);
+        size_t available = (size_t)(&r->read_buffer[r->read_len] - newline - 1);
+        if (size <= STREAM_SAMPLES_MAX && size > available)
+            return NULL;
+    }
+
+    *newline = '\0';
+    r->read_pos = (int)(newline - r->read_buffer) + 1;
+    return start;
+}
+
+/* Parse what the child has sent, reading from the non-blocking socket until it has nothing more, or until the
+ * receiver has had its share of the thread: RECEIVER_POOL_READ_BUDGET bytes parsed, counting each chart it
+ * created as RECEIVER_POOL_CHART_COST bytes, since creating a chart costs much more than parsing a value.
+ * Returns 0 when the socket has to be waited for, 1 when the receiver has to be served again without waiting
+ * and -1 when the connection has to be closed.
+ */
+int receiver_receive_available(struct receiver_state *rpt) {
+    size_t received = 0, parsed = 0, work = 0, charts_created = rpt->budget.charts_created;
+
+    for (;;) {
+        char *line;
+        while (!rpt->paused_until_ut && work < RECEIVER_POOL_READ_BUDGET) {
+            int read_pos = rpt->read_pos;
+            if (!(line = receiver_next_complete_line(rpt)))
+                break;
+
+            if (unlikely(netdata_exit || rpt->shutdown || parser_action(rpt->parser, line)))
+                return -1;
+
+            // a SAMPLES line has consumed its payload too
+            parsed += (size_t)(rpt->read_pos - read_pos);
+            work = parsed + (rpt->budget.charts_created - charts_created) * RECEIVER_POOL_CHART_COST;
+        }
+
+        if (unlikely(netdata_exit || rpt->shutdown))
+            return -1;
+
+        receiver_budget_throttle(rpt);
+
+        if (rpt->paused_until_ut || work >= RECEIVER_POOL_READ_BUDGET || received >= RECEIVER_POOL_READ_BUDGET)
+            return 1;
+
+        ssize_t ret = receiver_read_nonblocking(rpt);
+        if (ret <= 0)
+            return (int)ret;
+
+        received += (size_t)ret;
+        rpt->last_msg_t = now_realtime_sec();
+    }
+}
+
+/* CHART_SLOT <chart slot> "<chart id>"
+ * Sent by the child after the CHART command of a chart it will send with SAMPLES.
+ */
+PARSER_RC streaming_chart_slot(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    RRDHOST *host = ((PARSER_USER_OBJECT *)user)->host;
+    struct stream_slots *slots = &((struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque)->slots;
+
+    if (unlikely(!words[1] || !words[2])) {
+        error("STREAM %s: CHART_SLOT came without a slot or a chart id.", host->hostname);
+        return PARSER_RC_ERROR;
+    }
+
+    size_t slot = str2ul(words[1]);
+    // the collectors of the child give the slots concurrently, so a slot may come a little before the definitions
+    // of the charts with lower slots, but not further than that
+    if (unlikely(!slot || slot > STREAM_SLOTS_MAX || slot > slots->charts_defined + STREAM_SLOTS_AHEAD)) {
+        error("STREAM %s: CHART_SLOT %zu of chart '%s' is not valid.", host->hostname, slot, words[2]);
+        return PARSER_RC_ERROR;
+    }
+
+    if (unlikely(slot >= slots->charts_size)) {
+        size_t size = slots->charts_size ? slots->charts_size : 1024;
+        while (size <= slot)
+            size *= 2;
+
+        slots->charts = reallocz(slots->charts, size * sizeof(*slots->charts));
+        memset(&slots->charts[slots->charts_size], 0, (size - slots->charts_size) * sizeof(*slots->charts));
+        memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, (size - slots->charts_size) * sizeof(*slots->charts));
+        slots->charts_size = size;
+    }
+
+    struct stream_slot_chart *sc = &slots->charts[slot];
+    sc->st = rrdset_find(host, words[2]);
+    if (unlikely(!sc->st))
+        error("STREAM %s: CHART_SLOT %zu is for chart '%s', which does not exist.", host->hostname, slot, words[2]);
+
+    // the dimensions follow
+    if (sc->dimensions)
+        memset(sc->dimensions, 0, sc->dimensions_size * sizeof(*sc->dimensions));
+    sc->dimensions_defined = 0;
+
+    return PARSER_RC_OK;
+}
+
+/* DIMENSION_SLOT <chart slot> <dimension slot> "<dimension id>"
+ * Sent by the child after the DIMENSION command of a chart with a slot. The value it sends next is relative to 0.
+ */
+PARSER_RC streaming_dimension_slot(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    RRDHOST *host = ((PARSER_USER_OBJECT *)user)->host;
+    struct stream_slots *slots = &((struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque)->slots;
+
+    if (unlikely(!words[1] || !words[2] || !words[3])) {
+        error("STREAM %s: DIMENSION_SLOT came without a chart slot, a slot or a dimension id.", host->hostname);
+        return PARSER_RC_ERROR;
+    }
+
+    size_t chart_slot = str2ul(words[1]);
+    size_t slot = str2ul(words[2]);
+    if (unlikely(chart_slot >= slots->charts_size || slot >= STREAM_SLOTS_MAX)) {
+        error("STREAM %s: DIMENSION_SLOT %zu %zu of dimension '%s' is not valid.", host->hostname, chart_slot, slot, words[3]);
+        return PARSER_RC_ERROR;
+    }
+
+    struct stream_slot_chart *sc = &slots->charts[chart_slot];
+    if (unlikely(!sc->st))
+        return PARSER_RC_OK;
 
-size_t streaming_parser(struct receiver_state *rpt, struct plugind *cd, FILE *fp) {
-    size_t result;
+    // each slot follows the previous one, or repeats one already given
+    if (unlikely(slot > sc->dimensions_defined)) {
+        error("STREAM %s: DIMENSION_SLOT %zu %zu of dimension '%s' skips slot %zu.", host->hostname, chart_slot, slot, words[3], sc->dimensions_defined);
+        return PARSER_RC_ERROR;
+    }
+    if (slot == sc->dimensions_defined)
+        sc->dimensions_defined++;
+
+    if (unlikely(slot >= sc->dimensions_size)) {
+        size_t size = sc->dimensions_size ? sc->dimensions_size : 8;
+        while (size <= slot)
+            size *= 2;
+
+        sc->dimensions = reallocz(sc->dimensions, size * sizeof(*sc->dimensions));
+        memset(&sc->dimensions[sc->dimensions_size], 0, (size - sc->dimensions_size) * sizeof(*sc->dimensions));
+        memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, (size - sc->dimensions_size) * sizeof(*sc->dimensions));
+        sc->dimensions_size = size;
+    }
+
+    struct stream_slot_dimension *sd = &sc->dimensions[slot];
+    sd->rd = rrddim_find(sc->st, words[3]);
+    sd->last_value = 0;
+    if (unlikely(!sd->rd))
+        error("STREAM %s: DIMENSION_SLOT %zu %zu is for dimension '%s' of chart '%s', which does not exist.",
+              host->hostname, chart_slot, slot, words[3], sc->st->id);
+
+    return PARSER_RC_OK;
+}
+
+/* With STREAM_CAP_BACKLOG, the updates the child queued while we were not connected follow the definitions of its
+ * charts, which resync their clock to ours. So each update is stored at the time it was collected, whenever the
+ * microseconds since the previous one disagree with it by more than an interval. Runs after the begin action.
+ */
+static void streaming_place_update(struct receiver_state *rpt, RRDSET *st, time_t collected_t)
+{
+    if (!(rpt->capabilities & STREAM_CAP_BACKLOG) || collected_t <= 0)
+        return;
+
+    usec_t collected_ut = (usec_t)(collected_t - rpt->clock_delta) * USEC_PER_SEC;
+    usec_t update_every_ut = (usec_t)st->update_every * USEC_PER_SEC;
+
+    if (unlikely(!st->last_collected_time.tv_sec)) {
+        // the first update of the chart, it is not stored, only the start of the next one
+        if (collected_ut <= update_every_ut)
+            return;
+
+        collected_ut -= update_every_ut;
+        st->last_collected_time.tv_sec = (time_t)(collected_ut / USEC_PER_SEC);
+        st->last_collected_time.tv_usec = 0;
+        st->usec_since_last_update = update_every_ut;
+        return;
+    }
+
+    usec_t last_ut = timeval_usec(&st->last_collected_time);
+    usec_t expected_ut = last_ut + st->usec_since_last_update;
+
+    // older than what we have, or where the chart is going anyway
+    if (collected_ut <= last_ut || (collected_ut > expected_ut ? collected_ut - expected_ut : expected_ut - collected_ut) <= update_every_ut)
+        return;
+
+    rrdset_flag_clear(st, RRDSET_FLAG_SYNC_CLOCK);
+    st->usec_since_last_update = collected_ut - last_ut;
+}
+
+/* BEGIN "<chart id>" <microseconds> [<collection time>]
+ * After pluginsd_begin(), which has found the chart and started the update.
+ */
+static PARSER_RC streaming_begin(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    UNUSED(plugins_action);
+    PARSER_USER_OBJECT *u = (PARSER_USER_OBJECT *)user;
+
+    if (words[3] && *words[3] && u->st)
+        streaming_place_update((struct receiver_state *)u->opaque, u->st, (time_t)str2ull(words[3]));
+
+    return PARSER_RC_OK;
+}
+
+/* SAMPLES <bytes>
+ * Followed by a binary frame with the values of one update of a chart, the equivalent of BEGIN, SET and END.
+ */
+PARSER_RC streaming_samples(char **words, void *user, PLUGINSD_ACTION *plugins_action)
+{
+    PARSER_USER_OBJECT *u = (PARSER_USER_OBJECT *)user;
+    struct receiver_state *rpt = (struct receiver_state *)u->opaque;
+    struct stream_slots *slots = &rpt->slots;
+    RRDHOST *host = u->host;
+
+    size_t size = words[1] ? str2ul(words[1]) : 0;
+    if (unlikely(!size || size > STREAM_SAMPLES_MAX)) {
+        error("STREAM %s: SAMPLES of %zu bytes are not valid.", host->hostname, size);
+        return PARSER_RC_ERROR;
+    }
+
+    if (unlikely(size > slots->payload_size)) {
+        memory_accounting_resize(MEMORY_ACCOUNTING_STREAMING, (ssize_t)size - (ssize_t)slots->payload_size);
+        slots->payload = reallocz(slots->payload, size);
+        slots->payload_size = size;
+    }
+
+    if (receiver_read_payload(rpt, (FILE *)u->parser->input, slots->payload, size)) {
+        error("STREAM %s: cannot read SAMPLES of %zu bytes.", host->hostname, size);
+        return PARSER_RC_ERROR;
+    }
+
+    const unsigned char *p = slots->payload, *end = slots->payload + size;
+    uint64_t chart_slot, microseconds, timestamp, slot, delta;
+
+#define STREAM_SAMPLES_DECODE(var) do { \
+        if (unlikely(!stream_samples_next(&p, end, &(var)))) goto corrupted; \
+    } while(0)
+
+    STREAM_SAMPLES_DECODE(chart_slot);
+    STREAM_SAMPLES_DECODE(microseconds);
+    timestamp = 0;
+    if (rpt->capabilities & STREAM_CAP_TIMESTAMPS)
+        STREAM_SAMPLES_DECODE(timestamp);
+
+    if (unlikely(chart_slot >= slots->charts_size || !slots->charts[chart_slot].st)) {
+        error("STREAM %s: SAMPLES for chart slot %llu, which is not known - ignoring them.", host->hostname, (unsigned long long)chart_slot);
+        return PARSER_RC_OK;
+    }
+
+    struct stream_slot_chart *sc = &slots->charts[chart_slot];
+    RRDSET *st = sc->st;
+
+    u->st = st;
+    u->begin_ut = now_monotonic_usec();
+    if (plugins_action->begin_action && plugins_action->begin_action(user, st, (usec_t)microseconds, u->trust_durations) != PARSER_RC_OK)
+        return PARSER_RC_ERROR;
+
+    streaming_place_update(rpt, st, (time_t)timestamp);
+
+    while (p < end) {
+        STREAM_SAMPLES_DECODE(slot);
+        STREAM_SAMPLES_DECODE(delta);
+
+        // DIMENSION_SLOT has already logged the dimensions we do not have
+        if (unlikely(slot >= sc->dimensions_size || !sc->dimensions[slot].rd))
+            continue;
+
+        struct stream_slot_dimension *sd = &sc->dimensions[slot];
+        sd->last_value = (collected_number)((uint64_t)sd->last_value + (uint64_t)stream_zigzag_decode(delta));
+
+        if (plugins_action->set_action)
+            plugins_action->set_action(user, st, sd->rd, sd->last_value);
+    }
+
+#undef STREAM_SAMPLES_DECODE
+
+    return pluginsd_end(words, user, plugins_action);
+
+corrupted:
+    error("STREAM %s: SAMPLES of %zu bytes are corrupted.", host->hostname, size);
+    return PARSER_RC_ERROR;
+}
+
+
+/* The charts and the values of the child are counted for its budget, and its charts are aggregated, around the
+ * actions of plugins.d.
+ */
+static PARSER_RC streaming_chart_action(void *user, char *type, char *id, char *name, char *family, char *context,
+                                        char *title, char *units, char *plugin, char *module, int priority,
+                                        int update_every, RRDSET_TYPE chart_type, char *options)
+{
+    struct receiver_state *rpt = (struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque;
+
+    if (!rrdset_find_bytype(rpt->host, type, id))
+        rpt->budget.charts_created++;
+    rpt->slots.charts_defined++;
+
+    PARSER_RC rc = pluginsd_chart_action(user, type, id, name, family, context, title, units, plugin, module,
+                                         priority, update_every, chart_type, options);
+
+    // the chart may have become a member of an aggregate, or stopped being one
+    RRDSET *st = rrdset_find_bytype(rpt->host, type, id);
+    if (st)
+        stream_aggregate_chart(st);
+
+    return rc;
+}
+
+static PARSER_RC streaming_set_action(void *user, RRDSET *st, RRDDIM *rd, long long int value)
+{
+    ((struct receiver_state *)((PARSER_USER_OBJECT *)user)->opaque)->budget.samples++;
+    return pluginsd_set_action(user, st, rd, value);
+}
+
+static PARSER_RC streaming_end_action(void *user, RRDSET *st)
+{
+    PARSER_RC rc = pluginsd_end_action(user, st);
+
+    if (unlikely(st->state->aggregate_member))
+        stream_aggregate_collect(st);
+
+    return rc;
+}
+
+/* The parser of the stream of a child. The receivers of the pool have no FILE, their lines come from
+ * receiver_receive_available().
+ */
+PARSER *receiver_parser_create(struct receiver_state *rpt, FILE *fp) {
     PARSER_USER_OBJECT *user = callocz(1, sizeof(*user));
-    user->enabled = cd->enabled;
+    user->enabled = rpt->cd->enabled;
     user->host = rpt->host;
     user->opaque = rpt;
-    user->cd = cd;
+    user->cd = rpt->cd;
     user->trust_durations = 0;
 
     PARSER *parser = parser_init(rpt->host, user, fp, PARSER_INPUT_SPLIT);
-    parser_add_keyword(parser, "TIMESTAMP", streaming_timestamp);
-    parser_add_keyword(parser, "CLAIMED_ID", streaming_claimed_id);
 
     if (unlikely(!parser)) {
         error("Failed to initialize parser");
-        cd->serial_failures++;
+        rpt->cd->serial_failures++;
         freez(user);
-        return 0;
+        return NULL;
     }
 
+    parser_add_keyword(parser, PLUGINSD_KEYWORD_BEGIN, streaming_begin);
+    parser_add_keyword(parser, "TIMESTAMP", streaming_timestamp);
+    parser_add_keyword(parser, "CLAIMED_ID", streaming_claimed_id);
+    parser_add_keyword(parser, "CHART_SLOT", streaming_chart_slot);
+    parser_add_keyword(parser, "DIMENSION_SLOT", streaming_dimension_slot);
+    parser_add_keyword(parser, "SAMPLES", streaming_samples);
+    parser_add_keyword(parser, "CHART_DEFINITION_END", streaming_chart_definition_end);
+    parser_add_keyword(parser, "REPLAY_BEGIN", streaming_replay_begin);
+    parser_add_keyword(parser, "REPLAY_SET", streaming_replay_set);
+    parser_add_keyword(parser, "REPLAY_END", streaming_replay_end);
+
     parser->plugins_action->begin_action     = &pluginsd_begin_action;
     parser->plugins_action->flush_action     = &pluginsd_flush_action;
-    parser->plugins_action->end_action       = &pluginsd_end_action;
+    parser->plugins_action->end_action       = &streaming_end_action;
     parser->plugins_action->disable_action   = &pluginsd_disable_action;
     parser->plugins_action->variable_action  = &pluginsd_variable_action;
     parser->plugins_action->dimension_action = &pluginsd_dimension_action;
     parser->plugins_action->label_action     = &pluginsd_label_action;
     parser->plugins_action->overwrite_action = &pluginsd_overwrite_action;
-    parser->plugins_action->chart_action     = &pluginsd_chart_action;
-    parser->plugins_action->set_action       = &pluginsd_set_action;
+    parser->plugins_action->chart_action     = &streaming_chart_action;
+    parser->plugins_action->set_action       = &streaming_set_action;
 
     user->parser = parser;
+    return parser;
+}
+
+// returns the number of updates completed
+size_t receiver_parser_destroy(PARSER *parser) {
+    PARSER_USER_OBJECT *user = (PARSER_USER_OBJECT *)parser->user;
+    size_t result = user->count;
+    freez(user);
+    parser_destroy(parser);
+    return result;
+}
+
+size_t streaming_parser(struct receiver_state *rpt, FILE *fp) {
+    PARSER *parser = receiver_parser_create(rpt, fp);
+    if (unlikely(!parser))
+        return 0;
 
     do {
         if (receiver_read(rpt, fp))
             break;
-        int pos = 0;
+        rpt->read_pos = 0;
         char *line;
-        while ((line = receiver_next_line(rpt, &pos))) {
+        while ((line = receiver_next_line(rpt))) {
             if (unlikely(netdata_exit || rpt->shutdown || parser_action(parser,  line)))
                 goto done;
         }
         rpt->last_msg_t = now_realtime_sec();
+        receiver_budget_throttle(rpt);
     }
     while(!netdata_exit);
 done:
-    result= user->count;
-    freez(user);
-    parser_destroy(parser);
-    return result;
+    return receiver_parser_destroy(parser);
 }
 
-
-static int rrdpush_receive(struct receiver_state *rpt)
+/* Find or create the host of the child and reply to it, it will start sending metrics.
+ * Returns 0 on success, otherwise the socket has been closed.
+ */
+int receiver_connect(struct receiver_state *rpt)
 {
     int history = default_rrd_history_entries;
     RRD_MEMORY_MODE mode = default_rrd_memory_mode;
@@ -275,6 +1198,7 @@ static int rrdpush_receive(struct receiver_state *rpt)
 
     health_enabled = appconfig_get_boolean_ondemand(&stream_config, rpt->key, "health enabled by default", health_enabled);
     health_enabled = appconfig_get_boolean_ondemand(&stream_config, rpt->machine_guid, "health enabled", health_enabled);
+    rpt->health_enabled = health_enabled;
 
     alarms_delay = appconfig_get_number(&stream_config, rpt->key, "default postpone alarms on connect seconds", alarms_delay);
     alarms_delay = appconfig_get_number(&stream_config, rpt->machine_guid, "postpone alarms on connect seconds", alarms_delay);
@@ -291,6 +1215,44 @@ static int rrdpush_receive(struct receiver_state *rpt)
     rrdpush_send_charts_matching = appconfig_get(&stream_config, rpt->key, "default proxy send charts matching", rrdpush_send_charts_matching);
     rrdpush_send_charts_matching = appconfig_get(&stream_config, rpt->machine_guid, "proxy send charts matching", rrdpush_send_charts_matching);
 
+    // every capability the child offers is used when we have it enabled too
+#ifdef ENABLE_COMPRESSION
+    unsigned int compression_enabled = default_compression_enabled;
+    compression_enabled = appconfig_get_boolean(&stream_config, rpt->key, "enable compression", compression_enabled);
+    compression_enabled = appconfig_get_boolean(&stream_config, rpt->machine_guid, "enable compression", compression_enabled);
+    if (!compression_enabled)
+        rpt->capabilities &= ~STREAM_CAP_COMPRESSION;
+#else
+    rpt->capabilities &= ~STREAM_CAP_COMPRESSION;
+#endif
+
+    unsigned int compact_enabled = default_compact_enabled;
+    compact_enabled = appconfig_get_boolean(&stream_config, rpt->key, "enable compact protocol", compact_enabled);
+    compact_enabled = appconfig_get_boolean(&stream_config, rpt->machine_guid, "enable compact protocol", compact_enabled);
+    if (!compact_enabled)
+        rpt->capabilities &= ~STREAM_CAP_COMPACT;
+
+    unsigned int replication_enabled = default_replication_enabled;
+    replication_enabled = appconfig_get_boolean(&stream_config, rpt->key, "enable replication", replication_enabled);
+    replication_enabled = appconfig_get_boolean(&stream_config, rpt->machine_guid, "enable replication", replication_enabled);
+    if (!replication_enabled)
+        rpt->capabilities &= ~STREAM_CAP_REPLICATION;
+
+    // the backlog of the child is stored at the times it was collected, whatever our configuration is
+    rpt->capabilities &= (STREAM_CAP_COMPRESSION | STREAM_CAP_COMPACT | STREAM_CAP_REPLICATION | STREAM_CAP_BACKLOG);
+
+    rpt->seconds_to_replicate = default_seconds_to_replicate;
+    rpt->seconds_to_replicate = (time_t)appconfig_get_number(&stream_config, rpt->key, "seconds to replicate", rpt->seconds_to_replicate);
+    rpt->seconds_to_replicate = (time_t)appconfig_get_number(&stream_config, rpt->machine_guid, "seconds to replicate", rpt->seconds_to_replicate);
+
+    struct receiver_budget *budget = &rpt->budget;
+    budget->charts_per_second = (size_t)appconfig_get_number(&stream_config, rpt->key, "max charts created per second", (long long)receiver_charts_per_second);
+    budget->charts_per_second = (size_t)appconfig_get_number(&stream_config, rpt->machine_guid, "max charts created per second", (long long)budget->charts_per_second);
+    budget->samples_per_second = (size_t)appconfig_get_number(&stream_config, rpt->key, "max samples per second", (long long)receiver_samples_per_second);
+    budget->samples_per_second = (size_t)appconfig_get_number(&stream_config, rpt->machine_guid, "max samples per second", (long long)budget->samples_per_second);
+    budget->bytes_per_second = (size_t)appconfig_get_number(&stream_config, rpt->key, "max bytes per second", (long long)receiver_bytes_per_second);
+    budget->bytes_per_second = (size_t)appconfig_get_number(&stream_config, rpt->machine_guid, "max bytes per second", (long long)budget->bytes_per_second);
+
     (void)appconfig_set_default(&stream_config, rpt->machine_guid, "host tags", (rpt->tags)?rpt->tags:"");
 
     if (strcmp(rpt->machine_guid, localhost->machine_guid) == 0) {
@@ -367,7 +1329,8 @@ static int rrdpush_receive(struct receiver_state *rpt)
 #endif // NETDATA_INTERNAL_CHECKS
 
 
-    struct plugind cd = {
+    struct plugind *cd = rpt->cd = callocz(1, sizeof(*cd));
+    *cd = (struct plugind) {
             .enabled = 1,
             .update_every = default_rrd_update_every,
             .pid = 0,
@@ -380,14 +1343,17 @@ static int rrdpush_receive(struct receiver_state *rpt)
     };
 
     // put the client IP and port into the buffers used by plugins.d
-    snprintfz(cd.id,           CONFIG_MAX_NAME,  "%s:%s", rpt->client_ip, rpt->client_port);
-    snprintfz(cd.filename,     FILENAME_MAX,     "%s:%s", rpt->client_ip, rpt->client_port);
-    snprintfz(cd.fullfilename, FILENAME_MAX,     "%s:%s", rpt->client_ip, rpt->client_port);
-    snprintfz(cd.cmd,          PLUGINSD_CMD_MAX, "%s:%s", rpt->client_ip, rpt->client_port);
+    snprintfz(cd->id,           CONFIG_MAX_NAME,  "%s:%s", rpt->client_ip, rpt->client_port);
+    snprintfz(cd->filename,     FILENAME_MAX,     "%s:%s", rpt->client_ip, rpt->client_port);
+    snprintfz(cd->fullfilename, FILENAME_MAX,     "%s:%s", rpt->client_ip, rpt->client_port);
+    snprintfz(cd->cmd,          PLUGINSD_CMD_MAX, "%s:%s", rpt->client_ip, rpt->client_port);
 
     info("STREAM %s [receive from [%s]:%s]: initializing communication...", rpt->host->hostname, rpt->client_ip, rpt->client_port);
     char initial_response[HTTP_HEADER_SIZE];
-    if (rpt->stream_version > 1) {
+    if (rpt->stream_version >= STREAM_VERSION_CAPABILITIES) {
+        info("STREAM %s [receive from [%s]:%s]: Netdata is using the stream version %u with capabilities 0x%x.", rpt->host->hostname, rpt->client_ip, rpt->client_port, rpt->stream_version, rpt->capabilities);
+        sprintf(initial_response, "%s%u%s%u", START_STREAMING_PROMPT_VN, rpt->stream_version, START_STREAMING_PROMPT_CAPS, rpt->capabilities);
+    } else if (rpt->stream_version > 1) {
         info("STREAM %s [receive from [%s]:%s]: Netdata is using the stream version %u.", rpt->host->hostname, rpt->client_ip, rpt->client_port, rpt->stream_version);
         sprintf(initial_response, "%s%u", START_STREAMING_PROMPT_VN, rpt->stream_version);
     } else if (rpt->stream_version == 1) {
@@ -408,20 +1374,7 @@ static int rrdpush_receive(struct receiver_state *rpt)
         log_stream_connection(rpt->client_ip, rpt->client_port, rpt->key, rpt->host->machine_guid, rpt->host->hostname, "FAILED - CANNOT REPLY");
         error("STREAM %s [receive from [%s]:%s]: cannot send ready command.", rpt->host->hostname, rpt->client_ip, rpt->client_port);
         close(rpt->fd);
-        return 0;
-    }
-
-    // remove the non-blocking flag from the socket
-    if(sock_delnonblock(rpt->fd) < 0)
-        error("STREAM %s [receive from [%s]:%s]: cannot remove the non-blocking flag from socket %d", rpt->host->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
-
-    // convert the socket to a FILE *
-    FILE *fp = fdopen(rpt->fd, "r");
-    if(!fp) {
-        log_stream_connection(rpt->client_ip, rpt->client_port, rpt->key, rpt->host->machine_guid, rpt->host->hostname, "FAILED - SOCKET ERROR");
-        error("STREAM %s [receive from [%s]:%s]: failed to get a FILE for FD %d.", rpt->host->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
-        close(rpt->fd);
-        return 0;
+        return 1;
     }
 
     rrdhost_wrlock(rpt->host);
@@ -452,7 +1405,15 @@ static int rrdpush_receive(struct receiver_state *rpt)
     info("STREAM %s [receive from [%s]:%s]: receiving metrics...", rpt->host->hostname, rpt->client_ip, rpt->client_port);
     log_stream_connection(rpt->client_ip, rpt->client_port, rpt->key, rpt->host->machine_guid, rpt->host->hostname, "CONNECTED");
 
-    cd.version = rpt->stream_version;
+    cd->version = rpt->stream_version;
+
+#ifdef ENABLE_COMPRESSION
+    // everything the child sends after our reply is compressed
+    if (rpt->capabilities & STREAM_CAP_COMPRESSION) {
+        decompressor_init(&rpt->decompressor);
+        info("STREAM %s [receive from [%s]:%s]: compression enabled", rpt->host->hostname, rpt->client_ip, rpt->client_port);
+    }
+#endif
 
 #if defined(ENABLE_ACLK)
     // in case we have cloud connection we inform cloud
@@ -461,8 +1422,13 @@ static int rrdpush_receive(struct receiver_state *rpt)
         aclk_host_state_update(rpt->host, 1);
 #endif
 
-    size_t count = streaming_parser(rpt, &cd, fp);
+    return 0;
+}
 
+/* The child has disconnected, mark its host as orphan and close the socket.
+ */
+void receiver_disconnect(struct receiver_state *rpt, size_t count, FILE *fp)
+{
     log_stream_connection(rpt->client_ip, rpt->client_port, rpt->key, rpt->host->machine_guid, rpt->hostname,
                           "DISCONNECTED");
     error("STREAM %s [receive from [%s]:%s]: disconnected (completed %zu updates).", rpt->hostname, rpt->client_ip,
@@ -483,7 +1449,7 @@ static int rrdpush_receive(struct receiver_state *rpt)
         if (rpt->host->receiver == rpt) {
             rpt->host->senders_disconnected_time = now_realtime_sec();
             rrdhost_flag_set(rpt->host, RRDHOST_FLAG_ORPHAN);
-            if(health_enabled == CONFIG_BOOLEAN_AUTO)
+            if(rpt->health_enabled == CONFIG_BOOLEAN_AUTO)
                 rpt->host->health_enabled = 0;
         }
         rrdhost_unlock(rpt->host);
@@ -495,7 +1461,32 @@ static int rrdpush_receive(struct receiver_state *rpt)
     }
 
     // cleanup
-    fclose(fp);
+    if(fp)
+        fclose(fp);
+    else
+        close(rpt->fd);
+}
+
+static int rrdpush_receive(struct receiver_state *rpt)
+{
+    if(receiver_connect(rpt))
+        return 0;
+
+    // remove the non-blocking flag from the socket
+    if(sock_delnonblock(rpt->fd) < 0)
+        error("STREAM %s [receive from [%s]:%s]: cannot remove the non-blocking flag from socket %d", rpt->host->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+
+    // convert the socket to a FILE *
+    FILE *fp = fdopen(rpt->fd, "r");
+    if(!fp) {
+        log_stream_connection(rpt->client_ip, rpt->client_port, rpt->key, rpt->host->machine_guid, rpt->host->hostname, "FAILED - SOCKET ERROR");
+        error("STREAM %s [receive from [%s]:%s]: failed to get a FILE for FD %d.", rpt->host->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+        receiver_disconnect(rpt, 0, NULL);
+        return 0;
+    }
+
+    size_t count = streaming_parser(rpt, fp);
+    receiver_disconnect(rpt, count, fp);
     return (int)count;
 }
 
@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "rrdpush.h"
+
+/*
+ * Receiver pool
+ *
+ * Instead of a thread per child, [stream].receiver threads threads wait with
+ * epoll() on the sockets of all the children. A new child is assigned to the
+ * thread with the fewest children. A short-lived thread finds or creates its
+ * host and replies to it, since this may block for the send timeout or on the
+ * database, and then hands it to the thread of the pool, which adds its
+ * socket to its epoll set.
+ *
+ * When a socket is readable, the thread reads what has arrived, parses the
+ * complete lines with the same parser the dedicated threads use, and moves
+ * to the next socket. A child is served for up to RECEIVER_POOL_READ_BUDGET
+ * bytes parsed at a time, each chart it creates counting as
+ * RECEIVER_POOL_CHART_COST bytes, so that a child sending a lot (i.e.
+ * replicating, or creating thousands of charts) cannot keep the others
+ * waiting.
+ *
+ * The sockets are level triggered: a receiver paused by the replication
+ * throttling or by its budget is removed from the epoll set until its pause
+ * ends, the others are served again without waiting while they have more to
+ * read.
+ */
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+
+#define RECEIVER_POOL_MAX_EVENTS 64
+#define RECEIVER_POOL_TIMEOUT_MS 1000
+
+struct receiver_pool_thread {
+    size_t id;
+    netdata_thread_t thread;
+    int epoll_fd;
+    int wakeup_pipe[2];                 // written when a new child is added to pending
+
+    netdata_mutex_t mutex;              // protects pending and connections
+    struct receiver_state *pending;     // connected, handed to this thread, not in its epoll set yet
+    size_t connections;                 // the children of this thread, including the connecting and pending ones
+
+    struct receiver_state *receivers;   // the connected children, touched only by the thread itself
+    size_t ready;                       // receivers with pool_ready set, served without waiting for their sockets
+    size_t paused;                      // receivers throttled by replication or their budget
+};
+
+static netdata_mutex_t receiver_pool_mutex = NETDATA_MUTEX_INITIALIZER;
+static struct receiver_pool_thread *receiver_pool = NULL;
+static size_t receiver_pool_size = 0;
+
+// pool_ready is only changed here, so that the thread does not wait for events while it is set on any receiver
+static inline void receiver_pool_set_ready(struct receiver_pool_thread *t, struct receiver_state *rpt, int ready) {
+    if(ready && !rpt->pool_ready)
+        t->ready++;
+    else if(!ready && rpt->pool_ready)
+        t->ready--;
+
+    rpt->pool_ready = ready ? 1 : 0;
+}
+
+// the receiver has been disconnected, or could not connect
+static void receiver_pool_release(struct receiver_pool_thread *t, struct receiver_state *rpt) {
+    netdata_mutex_lock(&t->mutex);
+    t->connections--;
+    netdata_mutex_unlock(&t->mutex);
+
+    // rrdhost_free() will destroy the receivers that are still attached to their hosts
+    if(netdata_exit && rpt->host) {
+        rpt->exited = 1;
+        return;
+    }
+
+    info("STREAM %s [receive from [%s]:%s]: receiver of pool thread %zu ended", rpt->hostname, rpt->client_ip, rpt->client_port, t->id);
+    receiver_release(rpt);
+}
+
+static void receiver_pool_remove(struct receiver_pool_thread *t, struct receiver_state *rpt) {
+    if(epoll_ctl(t->epoll_fd, EPOLL_CTL_DEL, rpt->fd, NULL) == -1)
+        error("STREAM %s [receive from [%s]:%s]: cannot remove socket %d from the receiver pool", rpt->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+
+    struct receiver_state **p;
+    for(p = &t->receivers; *p ; p = &(*p)->pool_next) {
+        if(*p == rpt) {
+            *p = rpt->pool_next;
+            break;
+        }
+    }
+    rpt->pool_next = NULL;
+
+    if(rpt->pool_paused)
+        t->paused--;
+
+    if(rpt->pool_ready)
+        t->ready--;
+
+    size_t count = receiver_parser_destroy(rpt->parser);
+    rpt->parser = NULL;
+
+    receiver_disconnect(rpt, count, NULL);
+    receiver_pool_release(t, rpt);
+}
+
+// adds the children connected by receiver_pool_connect_thread() to the epoll set of this thread
+static void receiver_pool_add_pending(struct receiver_pool_thread *t) {
+    netdata_mutex_lock(&t->mutex);
+    struct receiver_state *pending = t->pending;
+    t->pending = NULL;
+    netdata_mutex_unlock(&t->mutex);
+
+    while(pending) {
+        struct receiver_state *rpt = pending;
+        pending = rpt->pool_next;
+        rpt->pool_next = NULL;
+
+        info("STREAM %s [receive from [%s]:%s]: served by receiver pool thread %zu", rpt->hostname, rpt->client_ip, rpt->client_port, t->id);
+
+        rpt->parser = receiver_parser_create(rpt, NULL);
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = rpt };
+        if(!rpt->parser || epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, rpt->fd, &ev) == -1) {
+            error("STREAM %s [receive from [%s]:%s]: cannot add socket %d to the receiver pool", rpt->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+
+            size_t count = 0;
+            if(rpt->parser) {
+                count = receiver_parser_destroy(rpt->parser);
+                rpt->parser = NULL;
+            }
+
+            receiver_disconnect(rpt, count, NULL);
+            receiver_pool_release(t, rpt);
+            continue;
+        }
+
+        rpt->pool_next = t->receivers;
+        t->receivers = rpt;
+
+        // the child may have sent its first lines already, together with the handshake
+        receiver_pool_set_ready(t, rpt, 1);
+    }
+}
+
+// finds or creates the host of a child and replies to it, outside the threads of the pool
+static void *receiver_pool_connect_thread(void *ptr) {
+    struct receiver_state *rpt = (struct receiver_state *)ptr;
+    struct receiver_pool_thread *t = rpt->pool;
+
+    if(sock_setnonblock(rpt->fd) < 0)
+        error("STREAM %s [receive from [%s]:%s]: cannot set the non-blocking flag on socket %d", rpt->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+
+    if(receiver_connect(rpt)) {
+        receiver_pool_release(t, rpt);
+        return NULL;
+    }
+
+    // the threads of the pool may have exited already
+    if(unlikely(netdata_exit)) {
+        receiver_disconnect(rpt, 0, NULL);
+        receiver_pool_release(t, rpt);
+        return NULL;
+    }
+
+    netdata_mutex_lock(&t->mutex);
+    rpt->pool_next = t->pending;
+    t->pending = rpt;
+    netdata_mutex_unlock(&t->mutex);
+
+    if(write(t->wakeup_pipe[1], "x", 1) != 1)
+        error("STREAM %s [receive from [%s]:%s]: cannot wake up receiver pool thread %zu", rpt->hostname, rpt->client_ip, rpt->client_port, t->id);
+
+    return NULL;
+}
+
+static void receiver_pool_serve(struct receiver_pool_thread *t, struct receiver_state *rpt) {
+    int ret = receiver_receive_available(rpt);
+    if(ret < 0) {
+        receiver_pool_remove(t, rpt);
+        return;
+    }
+
+    if(rpt->paused_until_ut && !rpt->pool_paused) {
+        struct epoll_event ev = { .events = 0, .data.ptr = rpt };
+        if(epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, rpt->fd, &ev) == -1)
+            error("STREAM %s [receive from [%s]:%s]: cannot pause socket %d", rpt->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+
+        rpt->pool_paused = 1;
+        t->paused++;
+    }
+
+    // the budget may have left parsed lines or read bytes that the socket will not report again
+    receiver_pool_set_ready(t, rpt, ret == 1 && !rpt->paused_until_ut);
+}
+
+static void receiver_pool_resume(struct receiver_pool_thread *t, struct receiver_state *rpt) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = rpt };
+    if(epoll_ctl(t->epoll_fd, EPOLL_CTL_MOD, rpt->fd, &ev) == -1)
+        error("STREAM %s [receive from [%s]:%s]: cannot resume socket %d", rpt->hostname, rpt->client_ip, rpt->client_port, rpt->fd);
+
+    rpt->paused_until_ut = 0;
+    rpt->pool_paused = 0;
+    t->paused--;
+    receiver_pool_set_ready(t, rpt, 1);
+}
+
+// the milliseconds to wait for events, 0 when some receivers have more to read
+static int receiver_pool_timeout(struct receiver_pool_thread *t) {
+    if(t->ready)
+        return 0;
+
+    if(!t->paused)
+        return RECEIVER_POOL_TIMEOUT_MS;
+
+    usec_t now_ut = now_monotonic_usec(), wake_ut = now_ut + RECEIVER_POOL_TIMEOUT_MS * USEC_PER_MS;
+    struct receiver_state *rpt;
+    for(rpt = t->receivers; rpt ; rpt = rpt->pool_next)
+        if(rpt->pool_paused && rpt->paused_until_ut < wake_ut)
+            wake_ut = rpt->paused_until_ut;
+
+    return (wake_ut > now_ut) ? (int)((wake_ut - now_ut + USEC_PER_MS - 1) / USEC_PER_MS) : 0;
+}
+
+static void receiver_pool_thread_cleanup(void *ptr) {
+    struct receiver_pool_thread *t = (struct receiver_pool_thread *)ptr;
+    info("STREAM: receiver pool thread %zu exiting", t->id);
+
+    // the receivers still attached to their hosts are destroyed by rrdhost_free()
+    struct receiver_state *rpt;
+    for(rpt = t->receivers; rpt ; rpt = rpt->pool_next)
+        rpt->exited = 1;
+
+    for(rpt = t->pending; rpt ; rpt = rpt->pool_next)
+        rpt->exited = 1;
+}
+
+static void *receiver_pool_thread_main(void *ptr) {
+    netdata_thread_cleanup_push(receiver_pool_thread_cleanup, ptr);
+
+    struct receiver_pool_thread *t = (struct receiver_pool_thread *)ptr;
+    struct epoll_event events[RECEIVER_POOL_MAX_EVENTS];
+
+    info("STREAM: receiver pool thread %zu started (task id %d)", t->id, gettid());
+
+    while(!netdata_exit) {
+        receiver_pool_add_pending(t);
+
+        int n = epoll_wait(t->epoll_fd, events, RECEIVER_POOL_MAX_EVENTS, receiver_pool_timeout(t));
+        if(unlikely(n == -1)) {
+            if(errno != EINTR) {
+                error("STREAM: receiver pool thread %zu: epoll_wait() failed", t->id);
+                sleep_usec(100 * USEC_PER_MS);
+            }
+            continue;
+        }
+
+        if(unlikely(netdata_exit))
+            break;
+
+        int i;
+        for(i = 0; i < n ; i++) {
+            if(events[i].data.ptr == t) {
+                char buf[64];
+                while(read(t->wakeup_pipe[0], buf, sizeof(buf)) > 0) ;
+                continue;
+            }
+
+            struct receiver_state *rpt = (struct receiver_state *)events[i].data.ptr;
+            if(unlikely(rpt->pool_paused)) {
+                // only errors are reported for the paused sockets
+                receiver_pool_remove(t, rpt);
+                continue;
+            }
+
+            if(!rpt->pool_ready)
+                receiver_pool_serve(t, rpt);
+        }
+
+        if(!t->ready && !t->paused)
+            continue;
+
+        // serve again the receivers that had more to read, and the ones that their pause has ended
+        usec_t now_ut = now_monotonic_usec();
+        struct receiver_state *rpt, *next;
+        for(rpt = t->receivers; rpt ; rpt = next) {
+            next = rpt->pool_next;
+
+            if(rpt->pool_paused && now_ut >= rpt->paused_until_ut)
+                receiver_pool_resume(t, rpt);
+
+            if(rpt->pool_ready)
+                receiver_pool_serve(t, rpt);
+        }
+    }
+
+    netdata_thread_cleanup_pop(1);
+    return NULL;
+}
+
+static int receiver_pool_start(void) {
+    size_t i;
+
+    receiver_pool = callocz(receiver_pool_threads, sizeof(*receiver_pool));
+
+    for(i = 0; i < receiver_pool_threads ; i++) {
+        struct receiver_pool_thread *t = &receiver_pool[i];
+        t->id = i;
+        netdata_mutex_init(&t->mutex);
+
+        t->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if(t->epoll_fd == -1) {
+            error("STREAM: cannot create the epoll of receiver pool thread %zu", i);
+            break;
+        }
+
+        if(pipe(t->wakeup_pipe) == -1) {
+            error("STREAM: cannot create the wakeup pipe of receiver pool thread %zu", i);
+            close(t->epoll_fd);
+            break;
+        }
+
+        sock_setnonblock(t->wakeup_pipe[0]);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = t };
+        if(epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->wakeup_pipe[0], &ev) == -1) {
+            error("STREAM: cannot add the wakeup pipe to the epoll of receiver pool thread %zu", i);
+            close(t->wakeup_pipe[0]);
+            close(t->wakeup_pipe[1]);
+            close(t->epoll_fd);
+            break;
+        }
+
+        char tag[NETDATA_THREAD_TAG_MAX + 1];
+        snprintfz(tag, NETDATA_THREAD_TAG_MAX, "STREAM_POOL[%zu]", i);
+        if(netdata_thread_create(&t->thread, tag, NETDATA_THREAD_OPTION_DEFAULT, receiver_pool_thread_main, (void *)t)) {
+            error("STREAM: cannot create receiver pool thread %zu", i);
+            close(t->wakeup_pipe[0]);
+            close(t->wakeup_pipe[1]);
+            close(t->epoll_fd);
+            break;
+        }
+    }
+
+    receiver_pool_size = i;
+    if(!receiver_pool_size) {
+        error("STREAM: cannot start the receiver pool, every child will be served by its own thread.");
+        return 1;
+    }
+
+    info("STREAM: receiver pool started with %zu threads", receiver_pool_size);
+    return 0;
+}
+
+/* Hand a new child to the thread of the pool with the fewest children.
+ * Returns 0 on success, 1 when the pool is not available and the caller has to start a thread for the child.
+ */
+int receiver_pool_add(struct receiver_state *rpt) {
+    static int failed = 0;
+
+    netdata_mutex_lock(&receiver_pool_mutex);
+    if(unlikely(!receiver_pool && !failed))
+        failed = receiver_pool_start();
+    netdata_mutex_unlock(&receiver_pool_mutex);
+
+    if(unlikely(failed))
+        return 1;
+
+    size_t i, connections = 0;
+    struct receiver_pool_thread *t = NULL;
+    for(i = 0; i < receiver_pool_size ; i++) {
+        netdata_mutex_lock(&receiver_pool[i].mutex);
+        if(!t || receiver_pool[i].connections < connections) {
+            t = &receiver_pool[i];
+            connections = t->connections;
+        }
+        netdata_mutex_unlock(&receiver_pool[i].mutex);
+    }
+
+    netdata_mutex_lock(&t->mutex);
+    t->connections++;
+    netdata_mutex_unlock(&t->mutex);
+
+    rpt->pool = t;
+
+    char tag[NETDATA_THREAD_TAG_MAX + 1];
+    snprintfz(tag, NETDATA_THREAD_TAG_MAX, "STREAM_POOL_CONNECT[%zu]", t->id);
+    if(netdata_thread_create(&rpt->thread, tag, NETDATA_THREAD_OPTION_DONT_LOG, receiver_pool_connect_thread, (void *)rpt)) {
+        error("STREAM %s [receive from [%s]:%s]: cannot create the thread to connect it to the receiver pool", rpt->hostname, rpt->client_ip, rpt->client_port);
+
+        netdata_mutex_lock(&t->mutex);
+        t->connections--;
+        netdata_mutex_unlock(&t->mutex);
+
+        rpt->pool = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+#else // !HAVE_SYS_EPOLL_H
+
+int receiver_pool_add(struct receiver_state *rpt) {
+    static int logged = 0;
+    UNUSED(rpt);
+
+    if(!logged) {
+        error("STREAM: the receiver pool needs epoll(), every child will be served by its own thread.");
+        logged = 1;
+    }
+
+    return 1;
+}
+
+#endif // HAVE_SYS_EPOLL_H
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "rrdpush.h"
+
+/*
+ * Replication - the sender side
+ *
+ * After a reconnection, the parent asks with REPLICATE for the points of
+ * each chart it does not have. They are read from the database of the child
+ * and sent in batches of up to replication_batch_points, interleaved with the
+ * live values of the other charts. A batch is built only when the buffer of
+ * the sender is mostly empty, and the points sent per second are limited by
+ * replication_send_points_per_second.
+ */
+
+// REPLICATE "<chart id>" <after>
+void replication_request(struct sender_state *s, char *command) {
+    char *words[PLUGINSD_MAX_WORDS] = { NULL };
+    pluginsd_split_words(command, words, PLUGINSD_MAX_WORDS, NULL, NULL, 0);
+
+    if(unlikely(!words[1] || !words[2])) {
+        error("STREAM %s [send to %s]: received malformed REPLICATE command.", s->host->hostname, s->connected_to);
+        return;
+    }
+
+    RRDSET *st = rrdset_find(s->host, words[1]);
+    if(unlikely(!st)) {
+        error("STREAM %s [send to %s]: cannot replicate chart '%s', it does not exist.", s->host->hostname, s->connected_to, words[1]);
+        return;
+    }
+
+    // the parent asks again every time the definition is sent
+    if(__atomic_load_n(&st->state->replication, __ATOMIC_ACQUIRE) != REPLICATION_WAITING)
+        return;
+
+    time_t after = (time_t)str2ull(words[2]);
+    if(!after) {
+        __atomic_store_n(&st->state->replication, REPLICATION_DONE, __ATOMIC_RELEASE);
+        return;
+    }
+
+    st->state->replication_after = after;
+    __atomic_store_n(&st->state->replication, REPLICATION_RUNNING, __ATOMIC_RELEASE);
+    s->replication_charts++;
+}
+
+// appends the next batch of the chart to wb, returns the number of points in it
+static size_t replication_chart_batch(RRDSET *st, BUFFER *wb) {
+    size_t points = 0, dimensions = 0;
+    time_t update_every = st->update_every;
+    RRDDIM *rd;
+
+    rrdset_rdlock(st);
+
+    rrddim_foreach_read(rd, st)
+        dimensions++;
+
+    time_t first_entry_t = rrdset_first_entry_t_nolock(st);
+    time_t last_entry_t = rrdset_last_entry_t_nolock(st);
+    time_t start = st->state->replication_after + 1;
+    if(start < first_entry_t)
+        start = first_entry_t;
+
+    int finished = 1;
+    if(dimensions && last_entry_t && start <= last_entry_t) {
+        // the slots of the round robin database are aligned to the last entry
+        if(st->rrd_memory_mode != RRD_MEMORY_MODE_DBENGINE)
+            start = last_entry_t - ((last_entry_t - start) / update_every) * update_every;
+
+        size_t batch = replication_batch_points / dimensions;
+        if(batch < 1) batch = 1;
+
+        time_t end = start + (time_t)(batch - 1) * update_every;
+        if(end < last_entry_t)
+            finished = 0;
+        else
+            end = last_entry_t;
+
+        buffer_sprintf(wb, "REPLAY_BEGIN \"%s\" %ld %ld\n", st->id, start, end);
+
+        rrddim_foreach_read(rd, st) {
+            if(unlikely(rrddim_flag_check(rd, RRDDIM_FLAG_ARCHIVED) || !rd->exposed))
+                continue;
+
+            struct rrddim_query_handle handle;
+            time_t now = start, db_now;
+
+            for(rd->state->query_ops.init(rd, &handle, start, end) ; !rd->state->query_ops.is_finished(&handle) ; now = db_now + update_every) {
+                db_now = now; // the round robin database does not set it
+                storage_number n = rd->state->query_ops.next_metric(&handle, &db_now);
+                if(unlikely(db_now > end))
+                    break;
+
+                if(unlikely(db_now < start || !does_storage_number_exist(n)))
+                    continue;
+
+                buffer_sprintf(wb, "REPLAY_SET \"%s\" %ld %u\n", rd->id, db_now, (unsigned int)n);
+                points++;
+            }
+            rd->state->query_ops.finalize(&handle);
+        }
+
+        buffer_sprintf(wb, "REPLAY_END \"%s\" %ld %d\n", st->id, end, finished);
+        st->state->replication_after = end;
+    }
+    else
+        buffer_sprintf(wb, "REPLAY_END \"%s\" %ld 1\n", st->id, st->state->replication_after);
+
+    // the next values are sent live
+    if(finished)
+        __atomic_store_n(&st->state->replication, REPLICATION_DONE, __ATOMIC_RELEASE);
+
+    rrdset_unlock(st);
+    return points;
+}
+
+// sends batches of the charts being replicated while there is room for them
+// returns the number of charts that still need to be replicated
+size_t replication_send(struct sender_state *s) {
+    RRDHOST *host = s->host;
+    size_t running = 0;
+
+    if(!s->replication_build)
+        s->replication_build = buffer_create(1024);
+
+    rrdhost_rdlock(host);
+
+    RRDSET *st;
+    rrdset_foreach_read(st, host) {
+        if(__atomic_load_n(&st->state->replication, __ATOMIC_ACQUIRE) != REPLICATION_RUNNING)
+            continue;
+
+        running++;
+
+        // keep most of the buffer for the live values, and wait for the spill to be sent
+        netdata_mutex_lock(&s->mutex);
+        size_t used = sender_buffer_used(s);
+        size_t spilled = s->spill.bytes;
+        netdata_mutex_unlock(&s->mutex);
+
+        if(used > s->buffer->max_size / 4 || spilled || replication_limiter_exhausted(&s->replication_limiter))
+            continue;
+
+        buffer_flush(s->replication_build);
+        size_t points = replication_chart_batch(st, s->replication_build);
+        replication_limiter_add(&s->replication_limiter, points, replication_send_points_per_second);
+
+        netdata_mutex_lock(&s->mutex);
+        if(cbuffer_add_unsafe(s->buffer, buffer_tostring(s->replication_build), s->replication_build->len))
+            s->overflow = 1;
+        netdata_mutex_unlock(&s->mutex);
+
+        if(__atomic_load_n(&st->state->replication, __ATOMIC_ACQUIRE) == REPLICATION_DONE)
+            running--;
+    }
+
+    rrdhost_unlock(host);
+
+    if(s->replication_charts && !running)
+        info("STREAM %s [send to %s]: replication of %zu charts finished.", host->hostname, s->connected_to, s->replication_charts);
+
+    if(!running)
+        s->replication_charts = 0;
+
+    return running;
+}
@@ -43,6 +43,20 @@ unsigned int default_rrdpush_enabled = 0;
 char *default_rrdpush_destination = NULL;
 char *default_rrdpush_api_key = NULL;
 char *default_rrdpush_send_charts_matching = NULL;
+unsigned int default_compression_enabled = 1;
+unsigned int default_compact_enabled = 1;
+unsigned int default_replication_enabled = 1;
+time_t default_seconds_to_replicate = 86400;
+size_t replication_batch_points = 5000;
+size_t replication_send_points_per_second = 100000;
+size_t replication_receive_points_per_second = 1000000;
+size_t receiver_pool_threads = 0;
+size_t receiver_charts_per_second = 0;
+size_t receiver_samples_per_second = 0;
+size_t receiver_bytes_per_second = 0;
+size_t sender_spill_max_bytes = 0;
+size_t sender_spill_segment_bytes = 16 * 1024 * 1024;
+size_t sender_spill_drain_bytes_per_second = 1024 * 1024;
 #ifdef ENABLE_HTTPS
 int netdata_use_ssl_on_stream = NETDATA_SSL_OPTIONAL;
 char *netdata_ssl_ca_path = NULL;
@@ -73,6 +87,26 @@ int rrdpush_init() {
     default_rrdpush_api_key     = appconfig_get(&stream_config, CONFIG_SECTION_STREAM, "api key", "");
     default_rrdpush_send_charts_matching      = appconfig_get(&stream_config, CONFIG_SECTION_STREAM, "send charts matching", "*");
     rrdhost_free_orphan_time    = config_get_number(CONFIG_SECTION_GLOBAL, "cleanup orphan hosts after seconds", rrdhost_free_orphan_time);
+    receiver_pool_threads       = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "receiver threads", (long long)receiver_pool_threads);
+    receiver_charts_per_second  = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "max charts created per second", (long long)receiver_charts_per_second);
+    receiver_samples_per_second = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "max samples per second", (long long)receiver_samples_per_second);
+    receiver_bytes_per_second   = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "max bytes per second", (long long)receiver_bytes_per_second);
+    sender_spill_max_bytes      = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "disk spill size bytes", (long long)sender_spill_max_bytes);
+    sender_spill_segment_bytes  = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "disk spill segment size bytes", (long long)sender_spill_segment_bytes);
+    sender_spill_drain_bytes_per_second = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "disk spill drain bytes per second", (long long)sender_spill_drain_bytes_per_second);
+    if(sender_spill_segment_bytes < 65536) sender_spill_segment_bytes = 65536;
+#ifdef ENABLE_COMPRESSION
+    default_compression_enabled = (unsigned int)appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "enable compression", default_compression_enabled);
+#endif
+    default_compact_enabled = (unsigned int)appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "enable compact protocol", default_compact_enabled);
+    default_replication_enabled = (unsigned int)appconfig_get_boolean(&stream_config, CONFIG_SECTION_STREAM, "enable replication", default_replication_enabled);
+    default_seconds_to_replicate = (time_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "seconds to replicate", default_seconds_to_replicate);
+    replication_batch_points = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "replication batch points", (long long)replication_batch_points);
+    replication_send_points_per_second = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "replication send points per second", (long long)replication_send_points_per_second);
+    replication_receive_points_per_second = (size_t)appconfig_get_number(&stream_config, CONFIG_SECTION_STREAM, "replication receive points per second", (long long)replication_receive_points_per_second);
+    if(replication_batch_points < 1) replication_batch_points = 1;
+
+    stream_aggregate_init();
 
 
     if(default_rrdpush_enabled && (!default_rrdpush_destination || !*default_rrdpush_destination || !default_rrdpush_api_key || !*default_rrdpush_api_key)) {
@@ -130,7 +164,11 @@ static inline int should_send_chart_matching(RRDSET *st) {
     else if(!rrdset_flag_check(st, RRDSET_FLAG_UPSTREAM_SEND|RRDSET_FLAG_UPSTREAM_IGNORE)) {
         RRDHOST *host = st->rrdhost;
 
-        if(simple_pattern_matches(host->rrdpush_send_charts_matching, st->id) ||
+        if(unlikely(st->state->aggregate_member && stream_aggregate_hides(st))) {
+            rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_SEND);
+            rrdset_flag_set(st, RRDSET_FLAG_UPSTREAM_IGNORE);
+        }
+        else if(simple_pattern_matches(host->rrdpush_send_charts_matching, st->id) ||
             simple_pattern_matches(host->rrdpush_send_charts_matching, st->name)) {
             rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_IGNORE);
             rrdset_flag_set(st, RRDSET_FLAG_UPSTREAM_SEND);
@@ -183,9 +221,19 @@ static inline int need_to_send_chart_definition(RRDSET *st) {
     return 0;
 }
 
+// the maximum size of the SAMPLES frame of a chart
+static inline size_t rrdpush_chart_samples_size(RRDSET *st) {
+    size_t dimensions = 0;
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st)
+        dimensions++;
+
+    return (3 + 2 * dimensions) * STREAM_VARINT_MAX_BYTES;
+}
+
 // Send the current chart definition.
-// Assumes that collector thread has already called sender_start for mutex / buffer state.
-static inline void rrdpush_send_chart_definition_nolock(RRDSET *st) {
+// Assumes that collector thread has already called sender_start for the staging buffer.
+static inline void rrdpush_send_chart_definition_nolock(RRDSET *st, BUFFER *wb) {
     RRDHOST *host = st->rrdhost;
 
     rrdset_flag_set(st, RRDSET_FLAG_UPSTREAM_EXPOSED);
@@ -205,7 +253,7 @@ static inline void rrdpush_send_chart_definition_nolock(RRDSET *st) {
 
     // send the chart
     buffer_sprintf(
-            host->sender->build
+            wb
             , "CHART \"%s\" \"%s\" \"%s\" \"%s\" \"%s\" \"%s\" \"%s\" %ld %d \"%s %s %s %s\" \"%s\" \"%s\"\n"
             , st->id
             , name
@@ -224,11 +272,29 @@ static inline void rrdpush_send_chart_definition_nolock(RRDSET *st) {
             , (st->module_name)?st->module_name:""
     );
 
+    // give the chart a slot, the charts that do not get one are sent with BEGIN/SET/END
+    uint32_t chart_slot = 0;
+    if(host->sender->capabilities & STREAM_CAP_COMPACT) {
+        if(unlikely(rrdpush_chart_samples_size(st) > STREAM_SAMPLES_MAX))
+            st->state->upstream_slot = 0;
+        else if(!st->state->upstream_slot && __atomic_load_n(&host->sender->next_chart_slot, __ATOMIC_RELAXED) < STREAM_SLOTS_MAX) {
+            // the collectors give slots concurrently, only the ones within the limit are used
+            uint32_t slot = __atomic_add_fetch(&host->sender->next_chart_slot, 1, __ATOMIC_RELAXED);
+            if(slot <= STREAM_SLOTS_MAX)
+                st->state->upstream_slot = slot;
+        }
+
+        chart_slot = st->state->upstream_slot;
+        if(chart_slot)
+            buffer_sprintf(wb, "CHART_SLOT %u \"%s\"\n", chart_slot, st->id);
+    }
+
     // send the dimensions
+    uint32_t dimension_slot = 0;
     RRDDIM *rd;
     rrddim_foreach_read(rd, st) {
         buffer_sprintf(
-                host->sender->build
+                wb
                 , "DIMENSION \"%s\" \"%s\" \"%s\" " COLLECTED_NUMBER_FORMAT " " COLLECTED_NUMBER_FORMAT " \"%s %s %s\"\n"
                 , rd->id
                 , rd->name
@@ -239,9 +305,27 @@ static inline void rrdpush_send_chart_definition_nolock(RRDSET *st) {
                 , rrddim_flag_check(rd, RRDDIM_FLAG_HIDDEN)?"hidden":""
                 , rrddim_flag_check(rd, RRDDIM_FLAG_DONT_DETECT_RESETS_OR_OVERFLOWS)?"noreset":""
         );
+
+        if(chart_slot) {
+            rd->state->upstream_slot = dimension_slot++;
+            rd->state->upstream_last_value = 0;
+            buffer_sprintf(wb, "DIMENSION_SLOT %u %u \"%s\"\n", chart_slot, rd->state->upstream_slot, rd->id);
+        }
+
         rd->exposed = 1;
     }
 
+    // ask the parent of the sender thread what it is missing, and hold the live values until we send it
+    // the other parents of the stream get the live values when it has caught up
+    if((host->sender->capabilities & STREAM_CAP_REPLICATION) && st->state->replication == REPLICATION_NONE) {
+        if(host->sender->ready) {
+            __atomic_store_n(&st->state->replication, REPLICATION_WAITING, __ATOMIC_RELEASE);
+            buffer_sprintf(wb, "CHART_DEFINITION_END \"%s\" %ld %ld\n", st->id, rrdset_first_entry_t_nolock(st), rrdset_last_entry_t_nolock(st));
+        }
+        else
+            __atomic_store_n(&st->state->replication, REPLICATION_DONE, __ATOMIC_RELEASE);
+    }
+
     // send the chart local custom variables
     RRDSETVAR *rs;
     for(rs = st->variables; rs ;rs = rs->next) {
@@ -249,7 +333,7 @@ static inline void rrdpush_send_chart_definition_nolock(RRDSET *st) {
             calculated_number *value = (calculated_number *) rs->value;
 
             buffer_sprintf(
-                    host->sender->build
+                    wb
                     , "VARIABLE CHART %s = " CALCULATED_NUMBER_FORMAT "\n"
                     , rs->variable
                     , *value
@@ -260,25 +344,55 @@ static inline void rrdpush_send_chart_definition_nolock(RRDSET *st) {
     st->upstream_resync_time = st->last_collected_time.tv_sec + (remote_clock_resync_iterations * st->update_every);
 }
 
+// sends the current chart dimensions as a SAMPLES binary frame
+static inline void rrdpush_send_chart_samples_nolock(RRDSET *st, struct sender_state *s, BUFFER *wb) {
+    unsigned char *samples = sender_staging_samples(rrdpush_chart_samples_size(st));
+
+    unsigned char *p = samples;
+    p += stream_varint_encode(p, st->state->upstream_slot);
+    p += stream_varint_encode(p, (st->last_collected_time.tv_sec > st->upstream_resync_time)?st->usec_since_last_update:0);
+    if (s->capabilities & STREAM_CAP_TIMESTAMPS)
+        p += stream_varint_encode(p, (uint64_t)st->last_collected_time.tv_sec);
+
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st) {
+        if(rd->updated && rd->exposed) {
+            p += stream_varint_encode(p, rd->state->upstream_slot);
+            p += stream_varint_encode(p, stream_zigzag_encode((int64_t)((uint64_t)rd->collected_value - (uint64_t)rd->state->upstream_last_value)));
+            rd->state->upstream_last_value = rd->collected_value;
+        }
+    }
+
+    size_t len = (size_t)(p - samples);
+    buffer_sprintf(wb, "SAMPLES %zu\n", len);
+    buffer_need_bytes(wb, len);
+    memcpy(&wb->buffer[wb->len], samples, len);
+    wb->len += len;
+}
+
 // sends the current chart dimensions
-static inline void rrdpush_send_chart_metrics_nolock(RRDSET *st, struct sender_state *s) {
-    RRDHOST *host = st->rrdhost;
-    buffer_sprintf(host->sender->build, "BEGIN \"%s\" %llu", st->id, (st->last_collected_time.tv_sec > st->upstream_resync_time)?st->usec_since_last_update:0);
-    if (s->version >= VERSION_GAP_FILLING)
-        buffer_sprintf(host->sender->build, " %ld\n", st->last_collected_time.tv_sec);
+static inline void rrdpush_send_chart_metrics_nolock(RRDSET *st, struct sender_state *s, BUFFER *wb) {
+    if((s->capabilities & STREAM_CAP_COMPACT) && st->state->upstream_slot) {
+        rrdpush_send_chart_samples_nolock(st, s, wb);
+        return;
+    }
+
+    buffer_sprintf(wb, "BEGIN \"%s\" %llu", st->id, (st->last_collected_time.tv_sec > st->upstream_resync_time)?st->usec_since_last_update:0);
+    if (s->capabilities & STREAM_CAP_TIMESTAMPS)
+        buffer_sprintf(wb, " %ld\n", st->last_collected_time.tv_sec);
     else
-        buffer_strcat(host->sender->build, "\n");
+        buffer_strcat(wb, "\n");
 
     RRDDIM *rd;
     rrddim_foreach_read(rd, st) {
         if(rd->updated && rd->exposed)
-            buffer_sprintf(host->sender->build
+            buffer_sprintf(wb
                            , "SET \"%s\" = " COLLECTED_NUMBER_FORMAT "\n"
                            , rd->id
                            , rd->collected_value
         );
     }
-    buffer_strcat(host->sender->build, "END\n");
+    buffer_strcat(wb, "END\n");
 }
 
 static void rrdpush_sender_thread_spawn(RRDHOST *host);
@@ -291,9 +405,10 @@ void rrdset_push_chart_definition_now(RRDSET *st) {
         return;
 
     rrdset_rdlock(st);
-    sender_start(host->sender);
-    rrdpush_send_chart_definition_nolock(st);
-    sender_commit(host->sender);
+    BUFFER *wb = sender_start(host->sender);
+    rrdpush_send_chart_definition_nolock(st, wb);
+    if(unlikely(sender_commit(host->sender, wb)))
+        rrdpush_sender_reset_chart_nolock(st);
     rrdset_unlock(st);
 }
 
@@ -318,18 +433,25 @@ void rrdset_done_push(RRDSET *st) {
         host->rrdpush_sender_error_shown = 0;
     }
 
-    sender_start(host->sender);
+    BUFFER *wb = sender_start(host->sender);
 
     if(need_to_send_chart_definition(st))
-        rrdpush_send_chart_definition_nolock(st);
+        rrdpush_send_chart_definition_nolock(st, wb);
+
+    // the parent gets the values of the chart from replication, until it catches up
+    if(likely(!(host->sender->capabilities & STREAM_CAP_REPLICATION) ||
+              __atomic_load_n(&st->state->replication, __ATOMIC_ACQUIRE) == REPLICATION_DONE))
+        rrdpush_send_chart_metrics_nolock(st, host->sender, wb);
 
-    rrdpush_send_chart_metrics_nolock(st, host->sender);
+    // the sender reconnected while we were formatting, so the chart has to be sent again
+    if(unlikely(sender_commit(host->sender, wb))) {
+        rrdpush_sender_reset_chart_nolock(st);
+        return;
+    }
 
     // signal the sender there are more data
     if(host->rrdpush_sender_pipe[PIPE_WRITE] != -1 && write(host->rrdpush_sender_pipe[PIPE_WRITE], " ", 1) == -1)
         error("STREAM %s [send]: cannot write to internal pipe", host->hostname);
-
-    sender_commit(host->sender);
 }
 
 // labels
@@ -337,13 +459,13 @@ void rrdpush_send_labels(RRDHOST *host) {
     if (!host->labels.head || !(host->labels.labels_flag & LABEL_FLAG_UPDATE_STREAM) || (host->labels.labels_flag & LABEL_FLAG_STOP_STREAM))
         return;
 
-    sender_start(host->sender);
+    BUFFER *wb = sender_start(host->sender);
     rrdhost_rdlock(host);
     netdata_rwlock_rdlock(&host->labels.labels_rwlock);
 
     struct label *label_i = host->labels.head;
     while(label_i) {
-        buffer_sprintf(host->sender->build
+        buffer_sprintf(wb
                 , "LABEL \"%s\" = %d %s\n"
                 , label_i->key
                 , (int)label_i->label_source
@@ -352,12 +474,15 @@ void rrdpush_send_labels(RRDHOST *host) {
         label_i = label_i->next;
     }
 
-    buffer_sprintf(host->sender->build
+    buffer_sprintf(wb
             , "OVERWRITE %s\n", "labels");
 
     netdata_rwlock_unlock(&host->labels.labels_rwlock);
     rrdhost_unlock(host);
-    sender_commit(host->sender);
+
+    // the labels are sent again on the new connection
+    if(unlikely(sender_commit(host->sender, wb)))
+        return;
 
     if(host->rrdpush_sender_pipe[PIPE_WRITE] != -1 && write(host->rrdpush_sender_pipe[PIPE_WRITE], " ", 1) == -1)
         error("STREAM %s [send]: cannot write to internal pipe", host->hostname);
@@ -373,13 +498,13 @@ void rrdpush_claimed_id(RRDHOST *host)
     if(host->sender->version < STREAM_VERSION_CLAIM)
         return;
 
-    sender_start(host->sender);
+    BUFFER *wb = sender_start(host->sender);
     rrdhost_aclk_state_lock(host);
 
-    buffer_sprintf(host->sender->build, "CLAIMED_ID %s %s\n", host->machine_guid, (host->aclk_state.claimed_id ? host->aclk_state.claimed_id : "NULL") );
+    buffer_sprintf(wb, "CLAIMED_ID %s %s\n", host->machine_guid, (host->aclk_state.claimed_id ? host->aclk_state.claimed_id : "NULL") );
 
     rrdhost_aclk_state_unlock(host);
-    sender_commit(host->sender);
+    sender_commit(host->sender, wb);
 
     // signal the sender there are more data
     if(host->rrdpush_sender_pipe[PIPE_WRITE] != -1 && write(host->rrdpush_sender_pipe[PIPE_WRITE], " ", 1) == -1)
@@ -468,6 +593,7 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
     int32_t utc_offset = 0;
     int update_every = default_rrd_update_every;
     uint32_t stream_version = UINT_MAX;
+    uint32_t capabilities = 0;
     char buf[GUID_LEN + 1];
 
     struct rrdhost_system_info *system_info = callocz(1, sizeof(struct rrdhost_system_info));
@@ -504,6 +630,8 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
             tags = value;
         else if(!strcmp(name, "ver"))
             stream_version = MIN((uint32_t) strtoul(value, NULL, 0), STREAMING_PROTOCOL_CURRENT_VERSION);
+        else if(!strcmp(name, "caps"))
+            capabilities = (uint32_t) strtoul(value, NULL, 0);
         else {
             // An old Netdata child does not have a compatible streaming protocol, map to something sane.
             if (!strcmp(name, "NETDATA_SYSTEM_OS_NAME"))
@@ -639,6 +767,7 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
      * lookup to the now-attached structure).
      */
     struct receiver_state *rpt = callocz(1, sizeof(*rpt));
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, sizeof(*rpt));
 
     rrd_rdlock();
     RRDHOST *host = rrdhost_find_by_guid(machine_guid, 0);
@@ -654,6 +783,7 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
             if (age > 30) {
                 host->receiver->shutdown = 1;
                 shutdown(host->receiver->fd, SHUT_RDWR);
+                receiver_budget_detach(host, host->receiver);
                 host->receiver = NULL;      // Thread holds reference to structure
                 info("STREAM %s [receive from [%s]:%s]: multiple connections for same host detected - existing connection is dead (%ld sec), accepting new connection.", host->hostname, w->client_ip, w->client_port, age);
             }
@@ -667,6 +797,7 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
                 // Have not set WEB_CLIENT_FLAG_DONT_CLOSE_SOCKET - caller should clean up
                 buffer_flush(w->response.data);
                 buffer_strcat(w->response.data, "This GUID is already streaming to this server");
+                memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, sizeof(*rpt));
                 freez(rpt);
                 return 409;
             }
@@ -679,6 +810,10 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
 
     rpt->last_msg_t = now_realtime_sec();
 
+    rpt->read_size = (receiver_pool_threads) ? RECEIVER_POOL_BUFFER_SIZE : RECEIVER_READ_BUFFER_SIZE;
+    rpt->read_buffer = mallocz((size_t)rpt->read_size);
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, (size_t)rpt->read_size);
+
     rpt->host              = host;
     rpt->fd                = w->ifd;
     rpt->key               = strdupz(key);
@@ -695,6 +830,7 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
     rpt->update_every      = update_every;
     rpt->system_info       = system_info;
     rpt->stream_version    = stream_version;
+    rpt->capabilities      = (stream_version >= STREAM_VERSION_CAPABILITIES) ? capabilities : 0;
 #ifdef ENABLE_HTTPS
     rpt->ssl.conn          = w->ssl.conn;
     rpt->ssl.flags         = w->ssl.flags;
@@ -716,13 +852,15 @@ int rrdpush_receiver_thread_spawn(struct web_client *w, char *url) {
 
 
 
-    debug(D_SYSTEM, "starting STREAM receive thread.");
+    if(!receiver_pool_threads || receiver_pool_add(rpt)) {
+        debug(D_SYSTEM, "starting STREAM receive thread.");
 
-    char tag[FILENAME_MAX + 1];
-    snprintfz(tag, FILENAME_MAX, "STREAM_RECEIVER[%s,[%s]:%s]", rpt->hostname, w->client_ip, w->client_port);
+        char tag[FILENAME_MAX + 1];
+        snprintfz(tag, FILENAME_MAX, "STREAM_RECEIVER[%s,[%s]:%s]", rpt->hostname, w->client_ip, w->client_port);
 
-    if(netdata_thread_create(&rpt->thread, tag, NETDATA_THREAD_OPTION_DEFAULT, rrdpush_receiver_thread, (void *)rpt))
-        error("Failed to create new STREAM receive thread for client.");
+        if(netdata_thread_create(&rpt->thread, tag, NETDATA_THREAD_OPTION_DEFAULT, rrdpush_receiver_thread, (void *)rpt))
+            error("Failed to create new STREAM receive thread for client.");
+    }
 
     // prevent the caller from closing the streaming socket
     if(web_server_mode == WEB_SERVER_MODE_STATIC_THREADED) {
@@ -8,12 +8,35 @@
 #include "web/server/web_client.h"
 #include "daemon/common.h"
 
+#ifdef ENABLE_COMPRESSION
+#include <lz4.h>
+#endif
+
 #define CONNECTED_TO_SIZE 100
 
-// #define STREAMING_PROTOCOL_CURRENT_VERSION (uint32_t)4       Gap-filling
-#define STREAMING_PROTOCOL_CURRENT_VERSION (uint32_t)3
-#define VERSION_GAP_FILLING 4
 #define STREAM_VERSION_CLAIM 3
+#define STREAM_VERSION_CAPABILITIES 4
+
+#define STREAMING_PROTOCOL_CURRENT_VERSION (uint32_t)(STREAM_VERSION_CAPABILITIES)
+
+// From STREAM_VERSION_CAPABILITIES, the child adds caps=<bits> to its request, with the features it has
+// enabled, and the parent replies with the ones both ends have enabled:
+//
+//     Hit me baby, push them over with the version=4&caps=<bits>
+//
+// Every feature is used when both ends enable it, whatever the others are.
+#define STREAM_CAP_COMPRESSION 0x00000001  // the connection is compressed with LZ4
+#define STREAM_CAP_COMPACT     0x00000002  // chart and dimension slots and SAMPLES frames
+#define STREAM_CAP_REPLICATION 0x00000004  // the collection times and the points the parent misses
+#define STREAM_CAP_BACKLOG     0x00000008  // the collection times and the spill queued while the parent was not connected
+
+// the capabilities that change what the collectors format, so all the parents of a stream have to share them
+#define STREAM_CAP_FORMAT (STREAM_CAP_COMPACT | STREAM_CAP_REPLICATION | STREAM_CAP_BACKLOG)
+
+// the capabilities with which the updates carry the time they were collected at
+#define STREAM_CAP_TIMESTAMPS (STREAM_CAP_REPLICATION | STREAM_CAP_BACKLOG)
+
+#define START_STREAMING_PROMPT_CAPS "&caps="
 
 #define STREAMING_PROTOCOL_VERSION "1.1"
 #define START_STREAMING_PROMPT "Hit me baby, push them over..."
@@ -35,6 +58,245 @@ typedef struct {
     char *kernel_version;
 } stream_encoded_t;
 
+#ifdef ENABLE_COMPRESSION
+#define STREAM_COMPRESSION_MSG_MAX (16 * 1024)      // uncompressed bytes per message
+#define STREAM_COMPRESSION_HEADER_SIZE 4
+#define STREAM_COMPRESSION_SIGNATURE 0xF1
+
+struct compressor_state {
+    int active;                 // compression has been negotiated for this connection
+    LZ4_stream_t *stream;
+    char *ring;                 // the history of the stream, as LZ4 needs it
+    size_t ring_pos;
+    char *output;               // the current message
+    size_t output_len;
+    size_t output_sent;
+
+    // statistics of the connection
+    size_t bytes_in;
+    size_t bytes_out;
+    usec_t usec;
+};
+
+struct decompressor_state {
+    LZ4_streamDecode_t *stream;
+    char *ring;                 // the decompressed history of the stream
+    size_t ring_pos;
+    char *input;                // the compressed message
+    char *output;               // the decompressed message, points into ring
+    size_t output_len;
+
+    // statistics of the connection
+    size_t bytes_in;
+    size_t bytes_out;
+    usec_t usec;
+};
+
+extern void compressor_reset(struct compressor_state *c, int active);
+extern void compressor_destroy(struct compressor_state *c);
+extern size_t compressor_compress(struct compressor_state *c, const char *data, size_t size);
+
+extern void decompressor_init(struct decompressor_state *d);
+extern void decompressor_destroy(struct decompressor_state *d);
+extern size_t decompressor_message_size(const char *header);
+extern int decompressor_decompress(struct decompressor_state *d, size_t size);
+#endif
+
+// ----------------------------------------------------------------------------
+// compact protocol
+//
+// Charts and dimensions get integer slots when their definitions are sent:
+//
+//     CHART_SLOT <chart slot> "<chart id>"
+//     DIMENSION_SLOT <chart slot> <dimension slot> "<dimension id>"
+//
+// and the values of each chart update are sent as a binary frame:
+//
+//     SAMPLES <bytes>\n<payload>
+//
+// where payload is a sequence of varints: the chart slot, the microseconds since the
+// last update (like BEGIN), the timestamp of the collection (with STREAM_CAP_TIMESTAMPS),
+// followed by pairs of dimension slot and zigzag encoded difference from the previous
+// value sent for the dimension on this connection.
+
+#define STREAM_SLOTS_MAX 1000000
+#define STREAM_SLOTS_AHEAD 1024     // how far a chart slot may run ahead of the charts defined on the connection
+#define STREAM_SAMPLES_MAX (1024 * 1024)
+#define STREAM_VARINT_MAX_BYTES 10
+
+static inline size_t stream_varint_encode(unsigned char *dst, uint64_t v) {
+    size_t i = 0;
+    while(v >= 0x80) {
+        dst[i++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    dst[i++] = (unsigned char)v;
+    return i;
+}
+
+// returns the bytes consumed, or 0 if the varint is truncated or too long
+static inline size_t stream_varint_decode(const unsigned char *src, size_t size, uint64_t *v) {
+    uint64_t result = 0;
+    size_t i;
+
+    for(i = 0; i < size && i < STREAM_VARINT_MAX_BYTES ; i++) {
+        result |= (uint64_t)(src[i] & 0x7f) << (7 * i);
+        if(!(src[i] & 0x80)) {
+            *v = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+// decodes the next varint of a frame, returns 0 if the frame ends in the middle of it
+static inline int stream_samples_next(const unsigned char **p, const unsigned char *end, uint64_t *v) {
+    size_t used = stream_varint_decode(*p, (size_t)(end - *p), v);
+    if(unlikely(!used))
+        return 0;
+
+    *p += used;
+    return 1;
+}
+
+static inline uint64_t stream_zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t stream_zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+struct stream_slot_dimension {
+    RRDDIM *rd;
+    collected_number last_value;    // the samples are differences from this
+};
+
+struct stream_slot_chart {
+    RRDSET *st;
+    struct stream_slot_dimension *dimensions;
+    size_t dimensions_size;
+    size_t dimensions_defined;      // the child gives the dimension slots in order, from 0
+};
+
+struct stream_slots {
+    struct stream_slot_chart *charts;
+    size_t charts_size;
+    size_t charts_defined;          // the CHART commands received on this connection
+    unsigned char *payload;         // the binary frame being processed
+    size_t payload_size;
+};
+
+// ----------------------------------------------------------------------------
+// replication
+//
+// With STREAM_CAP_REPLICATION, the child follows the definition of each chart with
+//
+//     CHART_DEFINITION_END "<chart id>" <first entry> <last entry>
+//
+// and holds the live values of the chart until the parent replies with
+//
+//     REPLICATE "<chart id>" <after>
+//
+// The child then sends the points of its database after <after> in batches of
+//
+//     REPLAY_BEGIN "<chart id>" <first point> <last point>
+//     REPLAY_SET "<dimension id>" <time> <storage number>
+//     REPLAY_END "<chart id>" <last point> <finished>
+//
+// and resumes sending the live values of the chart when it has caught up.
+// <after> = 0 means the parent does not need anything.
+
+#define REPLICATION_NONE 0      // the chart definition has not been sent on this connection
+#define REPLICATION_WAITING 1   // waiting for the parent to send REPLICATE
+#define REPLICATION_RUNNING 2   // sending the points the parent does not have
+#define REPLICATION_DONE 3      // sending live values
+
+// a token bucket of points per second
+struct replication_limiter {
+    usec_t next_ut;             // when all the points added so far will have been paid for
+};
+
+// returns the microseconds the caller is ahead of the rate, allowing a burst of 1 second
+static inline usec_t replication_limiter_add(struct replication_limiter *l, size_t points, size_t points_per_second) {
+    if(!points_per_second)
+        return 0;
+
+    usec_t now_ut = now_monotonic_usec();
+    if(l->next_ut < now_ut)
+        l->next_ut = now_ut;
+
+    l->next_ut += points * USEC_PER_SEC / points_per_second;
+    return (l->next_ut > now_ut + USEC_PER_SEC) ? l->next_ut - now_ut - USEC_PER_SEC : 0;
+}
+
+static inline int replication_limiter_exhausted(struct replication_limiter *l) {
+    return l->next_ut > now_monotonic_usec() + USEC_PER_SEC;
+}
+
+// the stream of the current connection that did not fit in the buffer of the sender,
+// or the stream queued while the parent was not connected
+struct sender_spill {
+    RRDHOST *host;
+    char *path;                 // the directory of the segments, NULL when disk spill is disabled
+    int write_fd;
+    int read_fd;
+    size_t write_segment;       // the segment appended to
+    size_t write_offset;
+    size_t read_segment;        // the segment moved back to the buffer, the oldest one
+    size_t read_offset;
+    size_t bytes;               // spilled and not moved back to the buffer yet, in memory and on disk
+    BUFFER *pending;            // appended by the collectors, until the sender thread writes it to disk
+    BUFFER *writing;            // being written to disk by the sender thread, outside the lock
+    size_t disk_bytes;          // on disk and not moved back to the buffer yet - sender thread only
+    unsigned int outage:1;      // the parent is not connected and the collectors queue the stream here
+    unsigned int self_contained:1;  // it starts with the definitions of all the charts, a new connection can send it
+    unsigned int drained:1;     // some of it has been moved to the buffer, so it belongs to that connection
+    unsigned int full:1;        // nothing is queued until the parent connects, there was no room
+    struct replication_limiter drain_limiter;
+};
+
+// ----------------------------------------------------------------------------
+// fan-out
+//
+// [stream].destination can have more than one group of parents, separated by
+// "|". The first group is served by the sender thread, each of the others by a
+// fan-out thread with its own connection, queue and reconnection state. The
+// collectors format every chart once, and the bytes are copied to the queues
+// of all the connected destinations. A full queue restarts the connection of
+// its destination only.
+//
+// All the parents get the same stream, so they have to agree on the version of
+// the protocol and on the capabilities that change its format. Compression is
+// negotiated with each of them. With replication, the parent of the sender
+// thread asks for the points it misses, and the others get the live values
+// after it. While it is not connected, the charts are not held for it.
+
+struct sender_fanout {
+    struct sender_state *sender;
+    char *destination;          // the alternatives of this group, like [stream].destination
+    netdata_thread_t thread;
+    unsigned int spawned:1;
+    int fd;
+    int pipe[2];                // the collectors wake up the thread when its queue gets data
+#ifdef ENABLE_HTTPS
+    struct netdata_ssl ssl;
+#endif
+    char connected_to[CONNECTED_TO_SIZE + 1];
+    size_t reconnects_counter;
+    struct circular_buffer *buffer;
+#ifdef ENABLE_COMPRESSION
+    struct compressor_state compressor;
+#endif
+    unsigned int connected:1;   // the queue gets the stream - under the lock of the sender, like overflow
+    unsigned int overflow:1;
+    time_t last_sent_t;
+    size_t sent_bytes;
+    size_t sent_bytes_on_this_connection;
+    struct sender_fanout *next;
+};
+
 // Thread-local storage
     // Metric transmission: collector threads asynchronously fill the buffer, sender thread uses it.
 
@@ -56,10 +318,75 @@ struct sender_state {
     // the lazy creation of the sender thread - both cases (buffer access and thread creation) are guarded here.
     netdata_mutex_t mutex;
     struct circular_buffer *buffer;
-    BUFFER *build;
+    size_t connection;          // incremented on every connection, to discard what was staged for the previous one
     char read_buffer[512];
     int read_len;
     int32_t version;
+    uint32_t capabilities;      // the STREAM_CAP_FORMAT capabilities of the stream
+    unsigned int release_replication:1; // the parent of the sender thread disconnected, the other parents get the charts without waiting for it
+    size_t memory_accounted;    // the bytes reported to memory accounting for this sender
+#ifdef ENABLE_COMPRESSION
+    struct compressor_state compressor;
+#endif
+    uint32_t next_chart_slot;   // the last chart slot given on this connection, incremented atomically
+    size_t replication_charts;  // the charts sending missing points to the parent
+    struct replication_limiter replication_limiter;
+    BUFFER *replication_build;  // the batch being built, outside the lock of the buffer
+    struct sender_spill spill;  // appended by the collectors, written and read by the sender thread
+    char *destination;          // the first group of parents of [stream].destination
+    int ready;                  // the connection of the sender thread is ready to send metrics
+    struct sender_fanout *fanouts;  // the other groups of parents
+    size_t fanouts_connected;
+};
+
+static inline size_t sender_queue_used(struct circular_buffer *cb) {
+    return (cb->write >= cb->read) ? cb->write - cb->read : cb->size - cb->read + cb->write;
+}
+
+static inline size_t sender_buffer_used(struct sender_state *s) {
+    return sender_queue_used(s->buffer);
+}
+
+// ----------------------------------------------------------------------------
+// receiver pool
+//
+// With [stream].receiver threads > 0 the children are not served by a thread
+// each, but by a few threads waiting with epoll() on all their sockets. The
+// sockets are non-blocking, so the read buffer of each receiver grows to hold
+// the partial line (or the SAMPLES frame) until the rest of it arrives.
+
+#define RECEIVER_READ_BUFFER_SIZE 1024
+#define RECEIVER_POOL_BUFFER_SIZE (16 * 1024)
+#define RECEIVER_POOL_BUFFER_MAX (2 * STREAM_SAMPLES_MAX)
+#define RECEIVER_POOL_READ_BUDGET (256 * 1024) // bytes parsed from one child before serving the others
+#define RECEIVER_POOL_CHART_COST (4 * 1024)    // a new chart is charged to the turn of its child as this many bytes
+
+// ----------------------------------------------------------------------------
+// receiver budgets
+//
+// The charts created, the values and the bytes a child may send per second,
+// from stream.conf (0 = no limit). A child ahead of its budget is not read
+// until it is back within it, so it stops sending when its buffers fill up,
+// like with the replication throttling.
+
+struct receiver_budget {
+    size_t charts_per_second;
+    size_t samples_per_second;
+    size_t bytes_per_second;
+
+    struct replication_limiter charts_limiter;
+    struct replication_limiter samples_limiter;
+    struct replication_limiter bytes_limiter;
+
+    // since the connection, updated by the receiver and read by the statistics without a lock
+    size_t charts_created;
+    size_t samples;
+    size_t bytes;
+    usec_t throttled_usec;      // the time the child was not read because of its budget
+
+    size_t charts_paid;         // the part of the counters already added to the limiters
+    size_t samples_paid;
+    size_t bytes_paid;
 };
 
 struct receiver_state {
@@ -82,11 +409,34 @@ struct receiver_state {
     struct rrdhost_system_info *system_info;
     int update_every;
     uint32_t stream_version;
+    uint32_t capabilities;      // offered by the child, then the ones negotiated
     time_t last_msg_t;
-    char read_buffer[1024];     // Need to allow RRD_ID_LENGTH_MAX * 4 + the other fields
+    char *read_buffer;          // Need to allow RRD_ID_LENGTH_MAX * 4 + the other fields
+    int read_size;              // RECEIVER_READ_BUFFER_SIZE, it grows for the receivers of the pool
     int read_len;
+    int read_pos;               // the first byte of read_buffer not parsed yet
+    int health_enabled;
+    struct plugind *cd;
+    struct parser *parser;      // the parser of the receivers of the pool, the threads keep it on their stack
+    struct receiver_pool_thread *pool; // the thread of the pool serving this receiver, NULL for a dedicated thread
+    struct receiver_state *pool_next;
+    usec_t paused_until_ut;     // replication or the budget has throttled this receiver of the pool
+    unsigned int pool_ready:1;  // there may be more to read without waiting for the socket
+    unsigned int pool_paused:1; // the socket has been removed from the events of the pool thread
+    struct stream_slots slots;  // the charts and dimensions of the compact protocol
+    time_t clock_delta;         // the clock of the child minus ours, from TIMESTAMP
+    time_t seconds_to_replicate; // the maximum duration of the missing points to ask for
+    RRDSET *replay_st;          // the chart between REPLAY_BEGIN and REPLAY_END
+    size_t replay_points;       // the points received in the current batch
+    struct receiver_budget budget;
 #ifdef ENABLE_HTTPS
     struct netdata_ssl ssl;
+#endif
+#ifdef ENABLE_COMPRESSION
+    struct decompressor_state decompressor;
+    size_t decompressed_read;   // the bytes of decompressor.output already copied to read_buffer
+    char compressed_header[STREAM_COMPRESSION_HEADER_SIZE];
+    size_t compressed_read;     // the bytes of the current message read by the receivers of the pool, with the header
 #endif
     unsigned int shutdown:1;    // Tell the thread to exit
     unsigned int exited;      // Indicates that the thread has exited  (NOT A BITFIELD!)
@@ -97,12 +447,43 @@ extern unsigned int default_rrdpush_enabled;
 extern char *default_rrdpush_destination;
 extern char *default_rrdpush_api_key;
 extern char *default_rrdpush_send_charts_matching;
+extern unsigned int default_compression_enabled;
+extern unsigned int default_compact_enabled;
+extern unsigned int default_replication_enabled;
+extern time_t default_seconds_to_replicate;
+extern size_t replication_batch_points;
+extern size_t replication_send_points_per_second;
+extern size_t replication_receive_points_per_second;
 extern unsigned int remote_clock_resync_iterations;
+extern size_t receiver_pool_threads;
+extern size_t receiver_charts_per_second;
+extern size_t receiver_samples_per_second;
+extern size_t receiver_bytes_per_second;
+extern size_t sender_spill_max_bytes;
+extern size_t sender_spill_segment_bytes;
+extern size_t sender_spill_drain_bytes_per_second;
 
 extern void sender_init(struct sender_state *s, RRDHOST *parent);
-void sender_start(struct sender_state *s);
-void sender_commit(struct sender_state *s);
+BUFFER *sender_start(struct sender_state *s);
+unsigned char *sender_staging_samples(size_t size);
+int sender_commit(struct sender_state *s, BUFFER *wb);
+void rrdpush_sender_reset_chart_nolock(RRDSET *st);
+extern uint32_t rrdpush_sender_capabilities_offered(struct sender_state *s);
+extern int rrdpush_sender_connect(RRDHOST *host,
+#ifdef ENABLE_HTTPS
+                                  struct netdata_ssl *ssl,
+#endif
+                                  const char *destination, int default_port, int timeout, uint32_t capabilities_offered,
+                                  size_t *reconnects_counter, char *connected_to, size_t connected_to_size,
+                                  int32_t *version_negotiated, uint32_t *capabilities_negotiated);
+extern int rrdpush_sender_reset_stream(struct sender_state *s, struct sender_fanout *joining, int32_t version, uint32_t capabilities);
+extern ssize_t sender_send_buffer_nolock(struct circular_buffer *cb, int fd);
 extern int rrdpush_init();
+extern void stream_aggregate_init(void);
+extern void stream_aggregate_chart(RRDSET *st);
+extern void stream_aggregate_collect(RRDSET *st);
+extern void stream_aggregate_chart_free(RRDSET *st);
+extern int stream_aggregate_hides(RRDSET *st);
 extern int configured_as_parent();
 extern void rrdset_done_push(RRDSET *st);
 extern void rrdset_push_chart_definition_now(RRDSET *st);
@@ -111,9 +492,32 @@ extern void rrdpush_send_labels(RRDHOST *host);
 extern void rrdpush_claimed_id(RRDHOST *host);
 
 extern int rrdpush_receiver_thread_spawn(struct web_client *w, char *url);
+extern int receiver_connect(struct receiver_state *rpt);
+extern void receiver_disconnect(struct receiver_state *rpt, size_t count, FILE *fp);
+extern void receiver_release(struct receiver_state *rpt);
+extern void receiver_budget_detach(RRDHOST *host, struct receiver_state *rpt);
+extern struct parser *receiver_parser_create(struct receiver_state *rpt, FILE *fp);
+extern size_t receiver_parser_destroy(struct parser *parser);
+extern int receiver_receive_available(struct receiver_state *rpt);
+extern int receiver_pool_add(struct receiver_state *rpt);
 extern void rrdpush_sender_thread_stop(RRDHOST *host);
 
 extern void rrdpush_sender_send_this_host_variable_now(RRDHOST *host, RRDVAR *rv);
+extern void replication_request(struct sender_state *s, char *command);
+extern size_t replication_send(struct sender_state *s);
+extern void sender_spill_init(struct sender_spill *sp, RRDHOST *host);
+extern void sender_spill_reset(struct sender_spill *sp);
+extern void sender_spill_destroy(struct sender_spill *sp);
+extern size_t sender_spill_memory_size(struct sender_spill *sp);
+extern int sender_spill_add(struct sender_spill *sp, const char *data, size_t len);
+extern int sender_spill_flush(struct sender_state *s);
+extern size_t sender_spill_drain(struct sender_state *s);
+extern void sender_fanout_init(struct sender_state *s);
+extern void sender_fanout_start(struct sender_state *s);
+extern void sender_fanout_stop(struct sender_state *s);
+extern void sender_fanout_destroy(struct sender_state *s);
+extern void sender_fanout_add(struct sender_state *s, const char *data, size_t len);
+extern size_t sender_fanout_memory_size(struct sender_state *s);
 extern void log_stream_connection(const char *client_ip, const char *client_port, const char *api_key, const char *machine_guid, const char *host, const char *msg);
 
 #endif //NETDATA_RRDPUSH_H
@@ -7,24 +7,149 @@ extern int netdata_use_ssl_on_stream;
 extern char *netdata_ssl_ca_path;
 extern char *netdata_ssl_ca_file;
 
-// Collector thread starting a transmission
-void sender_start(struct sender_state *s) {
-    netdata_mutex_lock(&s->mutex);
-    buffer_flush(s->build);
+// ----------------------------------------------------------------------------
+// staging buffers of the collectors
+//
+// Every thread that sends to a parent formats its messages into a staging
+// buffer of its own, without holding the lock of the sender. The lock is
+// taken only to append the staged bytes to the circular buffer (or the disk
+// spill), so the collectors of a child do not wait for each other while they
+// format their charts. The buffers are freed when the thread exits.
+
+struct sender_staging {
+    BUFFER *build;
+    unsigned char *samples;     // the binary frame being built, for the compact protocol
+    size_t samples_size;
+    size_t connection;          // the connection of the sender the data are staged for
+    size_t memory_accounted;
+};
+
+static __thread struct sender_staging *sender_staging = NULL;
+static pthread_key_t sender_staging_key;
+static pthread_once_t sender_staging_key_once = PTHREAD_ONCE_INIT;
+
+static inline size_t sender_staging_memory_size(struct sender_staging *ss) {
+    return sizeof(*ss) + sizeof(*ss->build) + ss->build->size + ss->samples_size;
+}
+
+static void sender_staging_free(void *ptr) {
+    struct sender_staging *ss = ptr;
+
+    memory_accounting_free(MEMORY_ACCOUNTING_STREAMING, ss->memory_accounted);
+    buffer_free(ss->build);
+    freez(ss->samples);
+    freez(ss);
+}
+
+static void sender_staging_key_create(void) {
+    if(pthread_key_create(&sender_staging_key, sender_staging_free) != 0)
+        fatal("STREAM: cannot create the key of the staging buffers");
+}
+
+static inline struct sender_staging *sender_staging_get(void) {
+    if(unlikely(!sender_staging)) {
+        pthread_once(&sender_staging_key_once, sender_staging_key_create);
+
+        sender_staging = callocz(1, sizeof(struct sender_staging));
+        sender_staging->build = buffer_create(1024);
+        sender_staging->memory_accounted = sender_staging_memory_size(sender_staging);
+        memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, sender_staging->memory_accounted);
+
+        if(pthread_setspecific(sender_staging_key, sender_staging) != 0)
+            error("STREAM: cannot register the staging buffer of thread %d, it will not be freed", gettid());
+    }
+
+    return sender_staging;
+}
+
+// Collector thread starting a transmission - returns the buffer to format into
+BUFFER *sender_start(struct sender_state *s) {
+    struct sender_staging *ss = sender_staging_get();
+
+    buffer_flush(ss->build);
+    ss->connection = __atomic_load_n(&s->connection, __ATOMIC_ACQUIRE);
+    return ss->build;
+}
+
+// the scratch space of the SAMPLES frame, valid until the next call
+unsigned char *sender_staging_samples(size_t size) {
+    struct sender_staging *ss = sender_staging_get();
+
+    if(unlikely(size > ss->samples_size)) {
+        ss->samples = reallocz(ss->samples, size);
+        ss->samples_size = size;
+    }
+
+    return ss->samples;
+}
+
+static inline size_t sender_memory_size(struct sender_state *s) {
+    return sizeof(*s) + sizeof(*s->buffer) + s->buffer->size +
+           (s->replication_build ? sizeof(*s->replication_build) + s->replication_build->size : 0) +
+           sender_spill_memory_size(&s->spill) +
+           sender_fanout_memory_size(s);
+}
+
+// the buffers grow while collecting, so report the difference since the last call
+static inline void sender_memory_accounting_update(struct sender_state *s) {
+    size_t size = sender_memory_size(s);
+    if(unlikely(size != s->memory_accounted)) {
+        memory_accounting_resize(MEMORY_ACCOUNTING_STREAMING, (ssize_t)size - (ssize_t)s->memory_accounted);
+        s->memory_accounted = size;
+    }
 }
 
 // Collector thread finishing a transmission
-void sender_commit(struct sender_state *s) {
-    if(cbuffer_add_unsafe(s->host->sender->buffer, buffer_tostring(s->host->sender->build),
-       s->host->sender->build->len))
-        s->overflow = 1;
-    buffer_flush(s->build);
+// returns 0 when the data have been queued, 1 when they have been discarded because
+// the charts have been reset for a new connection meanwhile
+int sender_commit(struct sender_state *s, BUFFER *wb) {
+    struct sender_staging *ss = sender_staging_get();
+    int ret = 0;
+
+    netdata_mutex_lock(&s->mutex);
+
+    if(unlikely(ss->connection != s->connection || (ss->connection & 1)))
+        ret = 1;
+
+    else if(likely(wb->len)) {
+        const char *data = buffer_tostring(wb);
+
+        // while there is anything spilled to disk, the rest follows it there, to keep the stream in order,
+        // and while the parent is not connected, the stream is queued there for the next connection
+        if(likely(s->host->rrdpush_sender_socket != -1)) {
+            if((unlikely(s->spill.bytes) || cbuffer_add_unsafe(s->buffer, data, wb->len)) &&
+               sender_spill_add(&s->spill, data, wb->len))
+                s->overflow = 1;
+        }
+        else if(unlikely(s->spill.outage))
+            sender_spill_add(&s->spill, data, wb->len);
+
+        if(unlikely(s->fanouts_connected))
+            sender_fanout_add(s, data, wb->len);
+    }
+
+    sender_memory_accounting_update(s);
     netdata_mutex_unlock(&s->mutex);
+
+    buffer_flush(wb);
+
+    size_t size = sender_staging_memory_size(ss);
+    if(unlikely(size != ss->memory_accounted)) {
+        memory_accounting_resize(MEMORY_ACCOUNTING_STREAMING, (ssize_t)size - (ssize_t)ss->memory_accounted);
+        ss->memory_accounted = size;
+    }
+
+    return ret;
 }
 
 
 static inline void rrdpush_sender_thread_close_socket(RRDHOST *host) {
-    host->rrdpush_sender_connected = 0;
+    // the charts waiting for this parent to replicate would hold their values from the other parents too
+    if(host->sender->ready && (host->sender->capabilities & STREAM_CAP_REPLICATION))
+        host->sender->release_replication = 1;
+
+    host->sender->ready = 0;
+    host->rrdpush_sender_connected = (host->sender->fanouts_connected || host->sender->spill.outage) ? 1 : 0;
 
     if(host->rrdpush_sender_socket != -1) {
         close(host->rrdpush_sender_socket);
@@ -32,11 +157,11 @@ static inline void rrdpush_sender_thread_close_socket(RRDHOST *host) {
     }
 }
 
-static inline void rrdpush_sender_add_host_variable_to_buffer_nolock(RRDHOST *host, RRDVAR *rv) {
+static inline void rrdpush_sender_add_host_variable_to_buffer_nolock(BUFFER *wb, RRDVAR *rv) {
     calculated_number *value = (calculated_number *)rv->value;
 
     buffer_sprintf(
-            host->sender->build
+            wb
             , "VARIABLE HOST %s = " CALCULATED_NUMBER_FORMAT "\n"
             , rv->name
             , *value
@@ -47,19 +172,19 @@ static inline void rrdpush_sender_add_host_variable_to_buffer_nolock(RRDHOST *ho
 
 void rrdpush_sender_send_this_host_variable_now(RRDHOST *host, RRDVAR *rv) {
     if(host->rrdpush_send_enabled && host->rrdpush_sender_spawn && host->rrdpush_sender_connected) {
-        sender_start(host->sender);
-        rrdpush_sender_add_host_variable_to_buffer_nolock(host, rv);
-        sender_commit(host->sender);
+        BUFFER *wb = sender_start(host->sender);
+        rrdpush_sender_add_host_variable_to_buffer_nolock(wb, rv);
+        sender_commit(host->sender, wb);
     }
 }
 
 
-static int rrdpush_sender_thread_custom_host_variables_callback(void *rrdvar_ptr, void *host_ptr) {
+static int rrdpush_sender_thread_custom_host_variables_callback(void *rrdvar_ptr, void *wb_ptr) {
     RRDVAR *rv = (RRDVAR *)rrdvar_ptr;
-    RRDHOST *host = (RRDHOST *)host_ptr;
+    BUFFER *wb = (BUFFER *)wb_ptr;
 
     if(unlikely(rv->options & RRDVAR_OPTION_CUSTOM_HOST_VAR && rv->type == RRDVAR_TYPE_CALCULATED)) {
-        rrdpush_sender_add_host_variable_to_buffer_nolock(host, rv);
+        rrdpush_sender_add_host_variable_to_buffer_nolock(wb, rv);
 
         // return 1, so that the traversal will return the number of variables sent
         return 1;
@@ -70,14 +195,32 @@ static int rrdpush_sender_thread_custom_host_variables_callback(void *rrdvar_ptr
 }
 
 static void rrdpush_sender_thread_send_custom_host_variables(RRDHOST *host) {
-    sender_start(host->sender);
-    int ret = rrdvar_callback_for_all_host_variables(host, rrdpush_sender_thread_custom_host_variables_callback, host);
+    BUFFER *wb = sender_start(host->sender);
+    int ret = rrdvar_callback_for_all_host_variables(host, rrdpush_sender_thread_custom_host_variables_callback, wb);
     (void)ret;
-    sender_commit(host->sender);
+    sender_commit(host->sender, wb);
 
     debug(D_STREAM, "RRDVAR sent %d VARIABLES", ret);
 }
 
+// resets a chart, so that its definition will be resent to the central netdata
+// the caller has the chart locked
+void rrdpush_sender_reset_chart_nolock(RRDSET *st) {
+    rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_EXPOSED);
+
+    st->upstream_resync_time = 0;
+
+    // the slots of the compact protocol are given again on the new connection
+    st->state->upstream_slot = 0;
+
+    // and the parent will ask again for the points it misses
+    __atomic_store_n(&st->state->replication, REPLICATION_NONE, __ATOMIC_RELEASE);
+
+    RRDDIM *rd;
+    rrddim_foreach_read(rd, st)
+        rd->exposed = 0;
+}
+
 // resets all the chart, so that their definitions
 // will be resent to the central netdata
 static void rrdpush_sender_thread_reset_all_charts(RRDHOST *host) {
@@ -85,34 +228,147 @@ static void rrdpush_sender_thread_reset_all_charts(RRDHOST *host) {
 
     RRDSET *st;
     rrdset_foreach_read(st, host) {
-        rrdset_flag_clear(st, RRDSET_FLAG_UPSTREAM_EXPOSED);
+        rrdset_rdlock(st);
+        rrdpush_sender_reset_chart_nolock(st);
+        rrdset_unlock(st);
+    }
 
-        st->upstream_resync_time = 0;
+    rrdhost_unlock(host);
+}
 
-        rrdset_rdlock(st);
+// Defines all the charts again, for all the destinations. While the charts are reset the connection
+// counter is odd, and everything the collectors commit is discarded, so that nothing formatted
+// against the previous state of the charts follows. The caller has incremented the counter once.
+static void rrdpush_sender_redefine_all_charts(struct sender_state *s) {
+    RRDHOST *host = s->host;
 
-        RRDDIM *rd;
-        rrddim_foreach_read(rd, st)
-            rd->exposed = 0;
+    rrdpush_sender_thread_reset_all_charts(host);
 
-        rrdset_unlock(st);
+    netdata_mutex_lock(&s->mutex);
+    __atomic_store_n(&s->next_chart_slot, 0, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->connection, 1, __ATOMIC_RELEASE);
+    netdata_mutex_unlock(&s->mutex);
+
+    rrdpush_sender_thread_send_custom_host_variables(host);
+}
+
+// The parent of the sender thread disconnected, and both ends have STREAM_CAP_BACKLOG. The collectors go on,
+// queueing the stream to the spill for the next connection, after the definitions of all the charts.
+// A spill kept for a connection that did not send any of it already has them. Returns 1 while queueing.
+static int rrdpush_sender_spill_outage(struct sender_state *s) {
+    struct sender_spill *sp = &s->spill;
+
+    netdata_mutex_lock(&s->mutex);
+
+    if(sp->outage || !sp->path || !(s->capabilities & STREAM_CAP_BACKLOG)) {
+        int outage = sp->outage;
+        netdata_mutex_unlock(&s->mutex);
+        return outage;
     }
 
-    rrdhost_unlock(host);
+    int redefine = !(sp->self_contained && !sp->drained);
+    if(redefine) {
+        sender_spill_reset(sp);
+        sp->self_contained = 1;
+        __atomic_add_fetch(&s->connection, 1, __ATOMIC_RELEASE);
+    }
+
+    sp->outage = 1;
+    sp->full = 0;
+    s->host->rrdpush_sender_connected = 1;
+
+    netdata_mutex_unlock(&s->mutex);
+
+    info("STREAM %s [send]: the parent is not connected, queueing the metrics to disk until it is.", s->host->hostname);
+
+    if(redefine) {
+        // the charts are reset holding locks, so the thread cannot be cancelled meanwhile
+        netdata_thread_disable_cancelability();
+        rrdpush_sender_redefine_all_charts(s);
+        netdata_thread_enable_cancelability();
+    }
+
+    return 1;
 }
 
-static inline void rrdpush_sender_thread_data_flush(RRDHOST *host) {
-    netdata_mutex_lock(&host->sender->mutex);
+// The parent of the sender thread disconnected while the stream goes on to the fan-out destinations,
+// so the charts are defined again without waiting for it to ask for the points it misses.
+static void rrdpush_sender_release_replication(struct sender_state *s) {
+    s->release_replication = 0;
+
+    netdata_mutex_lock(&s->mutex);
+    int fanouts_connected = s->fanouts_connected ? 1 : 0;
+    if(fanouts_connected)
+        __atomic_add_fetch(&s->connection, 1, __ATOMIC_RELEASE);
+    netdata_mutex_unlock(&s->mutex);
+
+    if(fanouts_connected)
+        rrdpush_sender_redefine_all_charts(s);
+}
+
+// A destination (re)connected, so all the charts are defined again, for all the destinations.
+// joining is the fan-out destination that connected, or NULL for the one of the sender thread.
+// Returns 1 when the version or the format of the new destination differs from the one of the stream.
+int rrdpush_sender_reset_stream(struct sender_state *s, struct sender_fanout *joining, int32_t version, uint32_t capabilities) {
+    RRDHOST *host = s->host;
+
+    capabilities &= STREAM_CAP_FORMAT;
+
+    netdata_mutex_lock(&s->mutex);
+
+    if((s->ready || s->fanouts_connected) && (version != s->version || capabilities != s->capabilities)) {
+        netdata_mutex_unlock(&s->mutex);
+        error("STREAM %s [send to %s]: the parent speaks version %d with capabilities 0x%x, but the stream sent to the other parents is version %d with capabilities 0x%x.",
+              host->hostname, joining ? joining->connected_to : s->connected_to, version, capabilities, s->version, s->capabilities);
+        return 1;
+    }
+
+    uint32_t previous_capabilities = s->capabilities;
+    s->version = version;
+    s->capabilities = capabilities;
+    __atomic_add_fetch(&s->connection, 1, __ATOMIC_RELEASE);
 
-    size_t len = cbuffer_next_unsafe(host->sender->buffer, NULL);
+    struct circular_buffer *cb = joining ? joining->buffer : s->buffer;
+    size_t len = sender_queue_used(cb);
     if (len)
         error("STREAM %s [send]: discarding %zu bytes of metrics already in the buffer.", host->hostname, len);
+    cb->read = cb->write = 0;
 
-    cbuffer_remove_unsafe(host->sender->buffer, len);
-    netdata_mutex_unlock(&host->sender->mutex);
+    if(joining) {
+        joining->connected = 1;
+        joining->overflow = 0;
+        s->fanouts_connected++;
+    }
+    else {
+        // the stream queued while disconnected is sent first, when it has the format of this connection
+        struct sender_spill *sp = &s->spill;
+        if(sp->outage && sp->self_contained && !sp->drained && (capabilities & STREAM_CAP_BACKLOG) && capabilities == previous_capabilities) {
+            if(sp->bytes)
+                info("STREAM %s [send]: sending the %zu bytes of metrics queued while the parent was not connected.", host->hostname, sp->bytes);
+        }
+        else
+            sender_spill_reset(sp);
+
+        sp->outage = 0;
+        sp->full = 0;
+        s->replication_charts = 0;
+
+        // the charts defined from now on wait for this parent to ask for the points it misses
+        s->ready = 1;
+        s->release_replication = 0;
+
+        // and it needs our clock before the charts
+        if(capabilities & STREAM_CAP_TIMESTAMPS) {
+            char timestamp[50];
+            int len = snprintfz(timestamp, sizeof(timestamp) - 1, "TIMESTAMP %ld\n", now_realtime_sec());
+            cbuffer_add_unsafe(cb, timestamp, (size_t)len);
+        }
+    }
 
-    rrdpush_sender_thread_reset_all_charts(host);
-    rrdpush_sender_thread_send_custom_host_variables(host);
+    netdata_mutex_unlock(&s->mutex);
+
+    rrdpush_sender_redefine_all_charts(s);
+    return 0;
 }
 
 static inline void rrdpush_set_flags_to_newest_stream(RRDHOST *host) {
@@ -147,62 +403,92 @@ void rrdpush_clean_encoded(stream_encoded_t *se)
         freez(se->kernel_version);
 }
 
-static int rrdpush_sender_thread_connect_to_parent(RRDHOST *host, int default_port, int timeout,
-    struct sender_state *s) {
+// the capabilities we have enabled
+uint32_t rrdpush_sender_capabilities_offered(struct sender_state *s) {
+    uint32_t capabilities = 0;
+
+#ifdef ENABLE_COMPRESSION
+    if(default_compression_enabled)
+        capabilities |= STREAM_CAP_COMPRESSION;
+#endif
+    if(default_compact_enabled)
+        capabilities |= STREAM_CAP_COMPACT;
+    if(default_replication_enabled)
+        capabilities |= STREAM_CAP_REPLICATION;
+    if(s->spill.path)
+        capabilities |= STREAM_CAP_BACKLOG;
+
+    // a parent joining a stream the other parents already get, or the one that gets
+    // the stream queued while disconnected, cannot add to its format
+    netdata_mutex_lock(&s->mutex);
+    if(s->ready || s->fanouts_connected || (s->spill.outage && s->spill.bytes))
+        capabilities &= s->capabilities | ~STREAM_CAP_FORMAT;
+    netdata_mutex_unlock(&s->mutex);
+
+    return capabilities;
+}
+
+// Connects to one of the alternatives of destination and negotiates the protocol with the parent.
+// Returns the socket, in non-blocking mode, or -1 on failure. The version of the parent is stored
+// in *version_negotiated, and the capabilities both ends have in *capabilities_negotiated.
+int rrdpush_sender_connect(RRDHOST *host,
+#ifdef ENABLE_HTTPS
+                           struct netdata_ssl *ssl,
+#endif
+                           const char *destination, int default_port, int timeout, uint32_t capabilities_offered,
+                           size_t *reconnects_counter, char *connected_to, size_t connected_to_size,
+                           int32_t *version_negotiated, uint32_t *capabilities_negotiated) {
 
     struct timeval tv = {
             .tv_sec = timeout,
             .tv_usec = 0
     };
 
-    // make sure the socket is closed
-    rrdpush_sender_thread_close_socket(host);
-
     debug(D_STREAM, "STREAM: Attempting to connect...");
-    info("STREAM %s [send to %s]: connecting...", host->hostname, host->rrdpush_send_destination);
+    info("STREAM %s [send to %s]: connecting...", host->hostname, destination);
 
-    host->rrdpush_sender_socket = connect_to_one_of(
-            host->rrdpush_send_destination
+    int fd = connect_to_one_of(
+            destination
             , default_port
             , &tv
-            , &s->reconnects_counter
-            , s->connected_to
-            , sizeof(s->connected_to)-1
+            , reconnects_counter
+            , connected_to
+            , connected_to_size - 1
     );
 
-    if(unlikely(host->rrdpush_sender_socket == -1)) {
-        error("STREAM %s [send to %s]: failed to connect", host->hostname, host->rrdpush_send_destination);
-        return 0;
+    if(unlikely(fd == -1)) {
+        error("STREAM %s [send to %s]: failed to connect", host->hostname, destination);
+        return -1;
     }
 
-    info("STREAM %s [send to %s]: initializing communication...", host->hostname, s->connected_to);
+    info("STREAM %s [send to %s]: initializing communication...", host->hostname, connected_to);
 
 #ifdef ENABLE_HTTPS
     if( netdata_client_ctx ){
-        host->ssl.flags = NETDATA_SSL_START;
-        if (!host->ssl.conn){
-            host->ssl.conn = SSL_new(netdata_client_ctx);
-            if(!host->ssl.conn){
+        ssl->flags = NETDATA_SSL_START;
+        if (!ssl->conn){
+            ssl->conn = SSL_new(netdata_client_ctx);
+            if(!ssl->conn){
                 error("Failed to allocate SSL structure.");
-                host->ssl.flags = NETDATA_SSL_NO_HANDSHAKE;
+                ssl->flags = NETDATA_SSL_NO_HANDSHAKE;
             }
         }
         else{
-            SSL_clear(host->ssl.conn);
+            SSL_clear(ssl->conn);
         }
 
-        if (host->ssl.conn)
+        if (ssl->conn)
         {
-            if (SSL_set_fd(host->ssl.conn, host->rrdpush_sender_socket) != 1) {
-                error("Failed to set the socket to the SSL on socket fd %d.", host->rrdpush_sender_socket);
-                host->ssl.flags = NETDATA_SSL_NO_HANDSHAKE;
+            if (SSL_set_fd(ssl->conn, fd) != 1) {
+                error("Failed to set the socket to the SSL on socket fd %d.", fd);
+                ssl->flags = NETDATA_SSL_NO_HANDSHAKE;
             } else{
-                host->ssl.flags = NETDATA_SSL_HANDSHAKE_COMPLETE;
+                ssl->flags = NETDATA_SSL_HANDSHAKE_COMPLETE;
             }
         }
     }
     else {
-        host->ssl.flags = NETDATA_SSL_NO_HANDSHAKE;
+        ssl->flags = NETDATA_SSL_NO_HANDSHAKE;
     }
 #endif
 
@@ -214,7 +500,7 @@ static int rrdpush_sender_thread_connect_to_parent(RRDHOST *host, int default_po
 
     char http[HTTP_HEADER_SIZE + 1];
     int eol = snprintfz(http, HTTP_HEADER_SIZE,
-            "STREAM key=%s&hostname=%s&registry_hostname=%s&machine_guid=%s&update_every=%d&os=%s&timezone=%s&abbrev_timezone=%s&utc_offset=%d&hops=%d&tags=%s&ver=%u"
+            "STREAM key=%s&hostname=%s&registry_hostname=%s&machine_guid=%s&update_every=%d&os=%s&timezone=%s&abbrev_timezone=%s&utc_offset=%d&hops=%d&tags=%s&ver=%u&caps=%u"
                  "&NETDATA_SYSTEM_OS_NAME=%s"
                  "&NETDATA_SYSTEM_OS_ID=%s"
                  "&NETDATA_SYSTEM_OS_ID_LIKE=%s"
@@ -255,6 +541,7 @@ static int rrdpush_sender_thread_connect_to_parent(RRDHOST *host, int default_po
                  , host->system_info->hops + 1
                  , (host->tags) ? host->tags : ""
                  , STREAMING_PROTOCOL_CURRENT_VERSION
+                 , capabilities_offered
                  , se.os_name
                  , se.os_id
                  , (host->system_info->host_os_id_like) ? host->system_info->host_os_id_like : ""
@@ -287,54 +574,54 @@ static int rrdpush_sender_thread_connect_to_parent(RRDHOST *host, int default_po
     rrdpush_clean_encoded(&se);
 
 #ifdef ENABLE_HTTPS
-    if (!host->ssl.flags) {
+    if (!ssl->flags) {
         ERR_clear_error();
-        SSL_set_connect_state(host->ssl.conn);
-        int err = SSL_connect(host->ssl.conn);
+        SSL_set_connect_state(ssl->conn);
+        int err = SSL_connect(ssl->conn);
         if (err != 1){
-            err = SSL_get_error(host->ssl.conn, err);
-            error("SSL cannot connect with the server:  %s ",ERR_error_string((long)SSL_get_error(host->ssl.conn,err),NULL));
+            err = SSL_get_error(ssl->conn, err);
+            error("SSL cannot connect with the server:  %s ",ERR_error_string((long)SSL_get_error(ssl->conn,err),NULL));
             if (netdata_use_ssl_on_stream == NETDATA_SSL_FORCE) {
-                rrdpush_sender_thread_close_socket(host);
-                return 0;
+                close(fd);
+                return -1;
             }else {
-                host->ssl.flags = NETDATA_SSL_NO_HANDSHAKE;
+                ssl->flags = NETDATA_SSL_NO_HANDSHAKE;
             }
         }
         else {
             if (netdata_use_ssl_on_stream == NETDATA_SSL_FORCE) {
                 if (netdata_validate_server == NETDATA_SSL_VALID_CERTIFICATE) {
-                    if ( security_test_certificate(host->ssl.conn)) {
+                    if ( security_test_certificate(ssl->conn)) {
                         error("Closing the stream connection, because the server SSL certificate is not valid.");
-                        rrdpush_sender_thread_close_socket(host);
-                        return 0;
+                        close(fd);
+                        return -1;
                     }
                 }
             }
         }
     }
-    if(send_timeout(&host->ssl,host->rrdpush_sender_socket, http, strlen(http), 0, timeout) == -1) {
+    if(send_timeout(ssl,fd, http, strlen(http), 0, timeout) == -1) {
 #else
-    if(send_timeout(host->rrdpush_sender_socket, http, strlen(http), 0, timeout) == -1) {
+    if(send_timeout(fd, http, strlen(http), 0, timeout) == -1) {
 #endif
-        error("STREAM %s [send to %s]: failed to send HTTP header to remote netdata.", host->hostname, s->connected_to);
-        rrdpush_sender_thread_close_socket(host);
-        return 0;
+        error("STREAM %s [send to %s]: failed to send HTTP header to remote netdata.", host->hostname, connected_to);
+        close(fd);
+        return -1;
     }
 
-    info("STREAM %s [send to %s]: waiting response from remote netdata...", host->hostname, s->connected_to);
+    info("STREAM %s [send to %s]: waiting response from remote netdata...", host->hostname, connected_to);
 
     ssize_t received;
 #ifdef ENABLE_HTTPS
-    received = recv_timeout(&host->ssl,host->rrdpush_sender_socket, http, HTTP_HEADER_SIZE, 0, timeout);
+    received = recv_timeout(ssl,fd, http, HTTP_HEADER_SIZE, 0, timeout);
     if(received == -1) {
 #else
-    received = recv_timeout(host->rrdpush_sender_socket, http, HTTP_HEADER_SIZE, 0, timeout);
+    received = recv_timeout(fd, http, HTTP_HEADER_SIZE, 0, timeout);
     if(received == -1) {
 #endif
-        error("STREAM %s [send to %s]: remote netdata does not respond.", host->hostname, s->connected_to);
-        rrdpush_sender_thread_close_socket(host);
-        return 0;
+        error("STREAM %s [send to %s]: remote netdata does not respond.", host->hostname, connected_to);
+        close(fd);
+        return -1;
     }
 
     http[received] = '\0';
@@ -366,41 +653,95 @@ static int rrdpush_sender_thread_connect_to_parent(RRDHOST *host, int default_po
     }
 
     if(version == -1) {
-        error("STREAM %s [send to %s]: server is not replying properly (is it a netdata?).", host->hostname, s->connected_to);
-        rrdpush_sender_thread_close_socket(host);
-        return 0;
+        error("STREAM %s [send to %s]: server is not replying properly (is it a netdata?).", host->hostname, connected_to);
+        close(fd);
+        return -1;
     }
-    s->version = version;
+    *version_negotiated = version;
+
+    // the parent cannot enable what we have not offered
+    uint32_t capabilities = 0;
+    char *capabilities_start = strstr(http, START_STREAMING_PROMPT_CAPS);
+    if(version >= STREAM_VERSION_CAPABILITIES && capabilities_start)
+        capabilities = (uint32_t)strtoul(capabilities_start + strlen(START_STREAMING_PROMPT_CAPS), NULL, 10) & capabilities_offered;
+    *capabilities_negotiated = capabilities;
 
-    info("STREAM %s [send to %s]: established communication with a parent using protocol version %d - ready to send metrics..."
+    info("STREAM %s [send to %s]: established communication with a parent using protocol version %d with capabilities 0x%x - ready to send metrics..."
          , host->hostname
-         , s->connected_to
-         , version);
+         , connected_to
+         , version
+         , capabilities);
 
-    if(sock_setnonblock(host->rrdpush_sender_socket) < 0)
-        error("STREAM %s [send to %s]: cannot set non-blocking mode for socket.", host->hostname, s->connected_to);
+    if(sock_setnonblock(fd) < 0)
+        error("STREAM %s [send to %s]: cannot set non-blocking mode for socket.", host->hostname, connected_to);
 
-    if(sock_enlarge_out(host->rrdpush_sender_socket) < 0)
-        error("STREAM %s [send to %s]: cannot enlarge the socket buffer.", host->hostname, s->connected_to);
+    if(sock_enlarge_out(fd) < 0)
+        error("STREAM %s [send to %s]: cannot enlarge the socket buffer.", host->hostname, connected_to);
 
-    debug(D_STREAM, "STREAM: Connected on fd %d...", host->rrdpush_sender_socket);
+    debug(D_STREAM, "STREAM: Connected on fd %d...", fd);
 
-    return 1;
+    return fd;
+}
+
+static int rrdpush_sender_thread_connect_to_parent(RRDHOST *host, int default_port, int timeout,
+    struct sender_state *s, int32_t *version, uint32_t *capabilities) {
+
+    // make sure the socket is closed
+    rrdpush_sender_thread_close_socket(host);
+
+    host->rrdpush_sender_socket = rrdpush_sender_connect(
+            host
+#ifdef ENABLE_HTTPS
+            , &host->ssl
+#endif
+            , s->destination
+            , default_port
+            , timeout
+            , rrdpush_sender_capabilities_offered(s)
+            , &s->reconnects_counter
+            , s->connected_to
+            , sizeof(s->connected_to)
+            , version
+            , capabilities
+    );
+
+    return (host->rrdpush_sender_socket != -1);
 }
 
+
+
 static void attempt_to_connect(struct sender_state *state)
 {
     state->send_attempts = 0;
 
-    if(rrdpush_sender_thread_connect_to_parent(state->host, state->default_port, state->timeout, state)) {
-        state->last_sent_t = now_monotonic_sec();
+    int32_t version;
+    uint32_t capabilities = 0;
+    if(rrdpush_sender_thread_connect_to_parent(state->host, state->default_port, state->timeout, state, &version, &capabilities) &&
+       rrdpush_sender_reset_stream(state, NULL, version, capabilities))
+        rrdpush_sender_thread_close_socket(state->host);
 
-        // reset the buffer, to properly send charts and metrics
-        rrdpush_sender_thread_data_flush(state->host);
+    if(state->host->rrdpush_sender_socket != -1) {
+        state->last_sent_t = now_monotonic_sec();
 
         // send from the beginning
         state->begin = 0;
 
+#ifdef ENABLE_COMPRESSION
+        // every connection is a new compressed stream
+        compressor_reset(&state->compressor, capabilities & STREAM_CAP_COMPRESSION);
+        if(state->compressor.active)
+            info("STREAM %s [send to %s]: compression enabled", state->host->hostname, state->connected_to);
+#endif
+
+        if(capabilities & STREAM_CAP_COMPACT)
+            info("STREAM %s [send to %s]: compact protocol enabled", state->host->hostname, state->connected_to);
+
+        if(capabilities & STREAM_CAP_REPLICATION)
+            info("STREAM %s [send to %s]: replication enabled", state->host->hostname, state->connected_to);
+
+        if(capabilities & STREAM_CAP_BACKLOG)
+            info("STREAM %s [send to %s]: backlog enabled", state->host->hostname, state->connected_to);
+
         // make sure the next reconnection will be immediate
         state->not_connected_loops = 0;
 
@@ -408,6 +749,7 @@ static void attempt_to_connect(struct sender_state *state)
         state->sent_bytes_on_this_connection = 0;
 
         // let the data collection threads know we are ready
+        state->ready = 1;
         state->host->rrdpush_sender_connected = 1;
     }
     else {
@@ -422,6 +764,33 @@ static void attempt_to_connect(struct sender_state *state)
     }
 }
 
+// sends both parts of the circular buffer, when it has wrapped, with one system call
+ssize_t sender_send_buffer_nolock(struct circular_buffer *cb, int fd) {
+    struct iovec iov[2];
+    size_t iovcnt = 0;
+
+    if(cb->read <= cb->write) {
+        iov[iovcnt].iov_base = cb->data + cb->read;
+        iov[iovcnt++].iov_len = cb->write - cb->read;
+    }
+    else {
+        iov[iovcnt].iov_base = cb->data + cb->read;
+        iov[iovcnt++].iov_len = cb->size - cb->read;
+
+        if(cb->write) {
+            iov[iovcnt].iov_base = cb->data;
+            iov[iovcnt++].iov_len = cb->write;
+        }
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    return sendmsg(fd, &msg, MSG_DONTWAIT);
+}
+
 // TCP window is open and we have data to transmit.
 void attempt_to_send(struct sender_state *s) {
 
@@ -434,18 +803,47 @@ void attempt_to_send(struct sender_state *s) {
     char *chunk;
     size_t outstanding = cbuffer_next_unsafe(s->buffer, &chunk);
     debug(D_STREAM, "STREAM: Sending data. Buffer r=%zu w=%zu s=%zu, next chunk=%zu", cb->read, cb->write, cb->size, outstanding);
+
+    int plain = 1;
+
+#ifdef ENABLE_COMPRESSION
+    // the compressed message has to be sent completely before the next one is compressed
+    struct compressor_state *c = &s->compressor;
+    if(c->active) {
+        if(!c->output_len && outstanding)
+            cbuffer_remove_unsafe(s->buffer, compressor_compress(c, chunk, outstanding));
+
+        chunk = c->output + c->output_sent;
+        outstanding = c->output_len - c->output_sent;
+        plain = 0;
+    }
+#endif
+
     ssize_t ret;
 #ifdef ENABLE_HTTPS
     SSL *conn = s->host->ssl.conn ;
     if(conn && !s->host->ssl.flags) {
         ret = SSL_write(conn, chunk, outstanding);
+    } else if(plain) {
+        ret = sender_send_buffer_nolock(s->buffer, s->host->rrdpush_sender_socket);
     } else {
         ret = send(s->host->rrdpush_sender_socket, chunk, outstanding, MSG_DONTWAIT);
     }
 #else
-    ret = send(s->host->rrdpush_sender_socket, chunk, outstanding, MSG_DONTWAIT);
+    if(plain)
+        ret = sender_send_buffer_nolock(s->buffer, s->host->rrdpush_sender_socket);
+    else
+        ret = send(s->host->rrdpush_sender_socket, chunk, outstanding, MSG_DONTWAIT);
 #endif
     if (likely(ret > 0)) {
+#ifdef ENABLE_COMPRESSION
+        if(c->active) {
+            c->output_sent += ret;
+            if(c->output_sent == c->output_len)
+                c->output_len = c->output_sent = 0;
+        }
+        else
+#endif
         cbuffer_remove_unsafe(s->buffer, ret);
         s->sent_bytes_on_this_connection += ret;
         s->sent_bytes += ret;
@@ -474,7 +872,7 @@ int ret;
     if (s->host->ssl.conn && !s->host->stream_ssl.flags) {
         ERR_clear_error();
         int desired = sizeof(s->read_buffer) - s->read_len - 1;
-        ret = SSL_read(s->host->ssl.conn, s->read_buffer, desired);
+        ret = SSL_read(s->host->ssl.conn, s->read_buffer + s->read_len, desired);
         if (ret > 0 ) {
             s->read_len += ret;
             return;
@@ -510,29 +908,36 @@ int ret;
     rrdpush_sender_thread_close_socket(s->host);
 }
 
-// This is just a placeholder until the gap filling state machine is inserted
+// Execute the complete lines the parent has sent, keep the last partial line for the next read.
 void execute_commands(struct sender_state *s) {
     char *start = s->read_buffer, *end = &s->read_buffer[s->read_len], *newline;
     *end = 0;
     while( start<end && (newline=strchr(start, '\n')) ) {
         *newline = 0;
-        info("STREAM %s [send to %s] received command over connection: %s", s->host->hostname, s->connected_to, start);
+        if (!strncmp(start, "REPLICATE ", 10))
+            replication_request(s, start);
+        else
+            info("STREAM %s [send to %s] received command over connection: %s", s->host->hostname, s->connected_to, start);
         start = newline+1;
     }
-    if (start<end) {
+    if (start<end)
         memmove(s->read_buffer, start, end-start);
-        s->read_len = end-start;
-    }
+    s->read_len = end-start;
 }
 
 
 static void rrdpush_sender_thread_cleanup_callback(void *ptr) {
     RRDHOST *host = (RRDHOST *)ptr;
 
+    // the fan-out threads need the lock to stop
+    sender_fanout_stop(host->sender);
+
     netdata_mutex_lock(&host->sender->mutex);
 
     info("STREAM %s [send]: sending thread cleans up...", host->hostname);
 
+    // nobody will write the queue to disk anymore
+    host->sender->spill.outage = 0;
     rrdpush_sender_thread_close_socket(host);
 
     // close the pipe
@@ -562,8 +967,10 @@ void sender_init(struct sender_state *s, RRDHOST *parent) {
     memset(s, 0, sizeof(*s));
     s->host = parent;
     s->buffer = cbuffer_new(1024, 1024*1024);
-    s->build = buffer_create(1);
     netdata_mutex_init(&s->mutex);
+
+    s->memory_accounted = sender_memory_size(s);
+    memory_accounting_alloc(MEMORY_ACCOUNTING_STREAMING, s->memory_accounted);
 }
 
 void *rrdpush_sender_thread(void *ptr) {
@@ -597,6 +1004,8 @@ void *rrdpush_sender_thread(void *ptr) {
         &stream_config, CONFIG_SECTION_STREAM,
         "initial clock resync iterations",
         remote_clock_resync_iterations); // TODO: REMOVE FOR SLEW / GAPFILLING
+    sender_spill_init(&s->spill, s->host);
+    sender_fanout_init(s);
 
     // initialize rrdpush globals
     s->host->rrdpush_sender_connected = 0;
@@ -614,23 +1023,35 @@ void *rrdpush_sender_thread(void *ptr) {
     fds[Collector].events = POLLIN;
 
     netdata_thread_cleanup_push(rrdpush_sender_thread_cleanup_callback, s->host);
+    sender_fanout_start(s);
     for(; s->host->rrdpush_send_enabled && !netdata_exit ;) {
         // check for outstanding cancellation requests
         netdata_thread_testcancel();
 
         // The connection attempt blocks (after which we use the socket in nonblocking)
         if(unlikely(s->host->rrdpush_sender_socket == -1)) {
+            // queueing to the spill defines the charts again, for the fan-out destinations too
+            if(rrdpush_sender_spill_outage(s)) {
+                s->release_replication = 0;
+
+                // start over when a part could not be written, the charts defined in it would be missing
+                if(unlikely(sender_spill_flush(s))) {
+                    netdata_mutex_lock(&s->mutex);
+                    s->spill.outage = 0;
+                    netdata_mutex_unlock(&s->mutex);
+                }
+            }
+
+            if(unlikely(s->release_replication))
+                rrdpush_sender_release_replication(s);
+
+            netdata_mutex_lock(&s->mutex);
             s->overflow = 0;
-            s->read_len = 0;
             s->buffer->read = 0;
             s->buffer->write = 0;
+            netdata_mutex_unlock(&s->mutex);
+            s->read_len = 0;
             attempt_to_connect(s);
-            if (s->version >= VERSION_GAP_FILLING) {
-                time_t now = now_realtime_sec();
-                sender_start(s);
-                buffer_sprintf(s->build, "TIMESTAMP %ld", now);
-                sender_commit(s);
-            }
             rrdpush_claimed_id(s->host);
             continue;
         }
@@ -642,6 +1063,20 @@ void *rrdpush_sender_thread(void *ptr) {
             continue;
         }
 
+        // Add the next batches of the charts the parent misses, when there is room for them
+        if (s->replication_charts)
+            replication_send(s);
+
+        // Move the metrics spilled to disk back to the buffer, as the parent catches up, and write to disk the rest
+        if (s->spill.bytes) {
+            sender_spill_drain(s);
+            if (unlikely(sender_spill_flush(s))) {
+                error("STREAM %s [send to %s]: cannot write the spill to disk. Restarting connection", s->host->hostname, s->connected_to);
+                rrdpush_sender_thread_close_socket(s->host);
+                continue;
+            }
+        }
+
         // Wait until buffer opens in the socket or a rrdset_done_push wakes us
         fds[Collector].revents = 0;
         fds[Socket].revents = 0;
@@ -651,6 +1086,10 @@ void *rrdpush_sender_thread(void *ptr) {
         char *chunk;
         size_t outstanding = cbuffer_next_unsafe(s->host->sender->buffer, &chunk);
         chunk = NULL;   // Do not cache pointer outside of region - could be invalidated
+#ifdef ENABLE_COMPRESSION
+        if(s->compressor.active)
+            outstanding += s->compressor.output_len - s->compressor.output_sent;
+#endif
         netdata_mutex_unlock(&s->mutex);
         if(outstanding) {
             s->send_attempts++;
@@ -660,7 +1099,8 @@ void *rrdpush_sender_thread(void *ptr) {
             fds[Socket].events = POLLIN;
         }
 
-        int retval = poll(fds, 2, 1000);
+        // wake up often while replicating or draining the spill, to refill the buffer as it empties
+        int retval = poll(fds, 2, (s->replication_charts || s->spill.bytes) ? 100 : 1000);
         debug(D_STREAM, "STREAM: poll() finished collector=%d socket=%d (current chunk %zu bytes)...",
               fds[Collector].revents, fds[Socket].revents, outstanding);
         if(unlikely(netdata_exit)) break;
@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "rrdpush.h"
+
+/*
+ * Disk spill of the sender
+ *
+ * When the buffer of the sender is full, because the parent reads slower than
+ * we collect, the stream is appended to segment files in
+ * <cache dir>/stream-spill, instead of restarting the connection. Once the
+ * spill has data, everything the collectors commit goes to it too, so that the
+ * stream reaches the parent in order.
+ *
+ * The collectors only append to a memory buffer, under the lock of the sender.
+ * The sender thread writes it to the segments outside the lock, and moves the
+ * spilled bytes back to the buffer as it empties, at most
+ * sender_spill_drain_bytes_per_second, from the oldest segment to the newest.
+ * Each segment is deleted as soon as it has been read completely.
+ *
+ * The spill holds the stream of a single connection (the slots of the compact
+ * protocol, the charts already defined), so it is discarded when the
+ * connection is lost, unless both ends have STREAM_CAP_BACKLOG. Then, while
+ * the parent is not connected, the spill starts with the definitions of all
+ * the charts and the collectors queue their updates after them, with their
+ * collection times. The next connection sends it before anything else, if it
+ * has the same format, and the parent stores the updates at their times.
+ * Three quarters of the spill are used for the outage, the rest is left for
+ * the stream that follows it while it is drained.
+ */
+
+#define SENDER_SPILL_DRAIN_CHUNK (16 * 1024)
+
+static void sender_spill_segment_filename(struct sender_spill *sp, size_t segment, char *filename, size_t size) {
+    snprintfz(filename, size, "%s/spill-%010zu.dat", sp->path, segment);
+}
+
+static int sender_spill_segment_open(struct sender_spill *sp, size_t segment, int flags) {
+    char filename[FILENAME_MAX + 1];
+    sender_spill_segment_filename(sp, segment, filename, FILENAME_MAX);
+
+    int fd = open(filename, flags | O_CLOEXEC, 0664);
+    if(fd == -1)
+        error("STREAM %s [send]: cannot open spill segment '%s'", sp->host->hostname, filename);
+
+    return fd;
+}
+
+static void sender_spill_segment_delete(struct sender_spill *sp, size_t segment) {
+    char filename[FILENAME_MAX + 1];
+    sender_spill_segment_filename(sp, segment, filename, FILENAME_MAX);
+
+    if(unlink(filename) == -1 && errno != ENOENT)
+        error("STREAM %s [send]: cannot delete spill segment '%s'", sp->host->hostname, filename);
+}
+
+// delete the segments left by a previous run
+static void sender_spill_cleanup_directory(struct sender_spill *sp) {
+    DIR *dir = opendir(sp->path);
+    if(!dir) {
+        error("STREAM %s [send]: cannot open spill directory '%s'", sp->host->hostname, sp->path);
+        return;
+    }
+
+    struct dirent *de;
+    while((de = readdir(dir))) {
+        if(strncmp(de->d_name, "spill-", 6) != 0)
+            continue;
+
+        char filename[FILENAME_MAX + 1];
+        snprintfz(filename, FILENAME_MAX, "%s/%s", sp->path, de->d_name);
+        if(unlink(filename) == -1)
+            error("STREAM %s [send]: cannot delete stale spill segment '%s'", sp->host->hostname, filename);
+    }
+
+    closedir(dir);
+}
+
+void sender_spill_init(struct sender_spill *sp, RRDHOST *host) {
+    // the sender thread has been started again
+    if(sp->path) {
+        sender_spill_reset(sp);
+        return;
+    }
+
+    memset(sp, 0, sizeof(*sp));
+    sp->host = host;
+    sp->write_fd = -1;
+    sp->read_fd = -1;
+
+    if(!sender_spill_max_bytes)
+        return;
+
+    char path[FILENAME_MAX + 1];
+    if(mkdir(host->cache_dir, 0775) == -1 && errno != EEXIST) {
+        error("STREAM %s [send]: cannot create directory '%s' - disk spill is disabled", host->hostname, host->cache_dir);
+        return;
+    }
+
+    snprintfz(path, FILENAME_MAX, "%s/stream-spill", host->cache_dir);
+    if(mkdir(path, 0775) == -1 && errno != EEXIST) {
+        error("STREAM %s [send]: cannot create directory '%s' - disk spill is disabled", host->hostname, path);
+        return;
+    }
+
+    sp->path = strdupz(path);
+    sender_spill_cleanup_directory(sp);
+
+    info("STREAM %s [send]: disk spill of up to %zu bytes in '%s'", host->hostname, sender_spill_max_bytes, sp->path);
+}
+
+// discard everything spilled - the caller holds the lock of the sender
+void sender_spill_reset(struct sender_spill *sp) {
+    if(!sp->path)
+        return;
+
+    if(sp->write_fd != -1) {
+        close(sp->write_fd);
+        sp->write_fd = -1;
+    }
+
+    if(sp->read_fd != -1) {
+        close(sp->read_fd);
+        sp->read_fd = -1;
+    }
+
+    size_t segment;
+    for(segment = sp->read_segment; segment <= sp->write_segment ; segment++)
+        sender_spill_segment_delete(sp, segment);
+
+    if(sp->bytes)
+        error("STREAM %s [send]: discarding %zu bytes of metrics spilled to disk.", sp->host->hostname, sp->bytes);
+
+    if(sp->pending)
+        buffer_flush(sp->pending);
+
+    sp->bytes = sp->disk_bytes = 0;
+    sp->read_segment = sp->write_segment = 0;
+    sp->read_offset = sp->write_offset = 0;
+    sp->self_contained = 0;
+    sp->drained = 0;
+}
+
+void sender_spill_destroy(struct sender_spill *sp) {
+    sender_spill_reset(sp);
+    freez(sp->path);
+    sp->path = NULL;
+
+    buffer_free(sp->pending);
+    buffer_free(sp->writing);
+    sp->pending = sp->writing = NULL;
+}
+
+size_t sender_spill_memory_size(struct sender_spill *sp) {
+    return (sp->pending ? sizeof(*sp->pending) + sp->pending->size : 0) +
+           (sp->writing ? sizeof(*sp->writing) + sp->writing->size : 0);
+}
+
+// append data to the spill - the caller holds the lock of the sender
+// returns 0 on success, 1 when the spill is full or disabled
+int sender_spill_add(struct sender_spill *sp, const char *data, size_t len) {
+    if(!sp->path || sp->full)
+        return 1;
+
+    // what the sender thread has not written yet is bounded too, in case the disk is slow
+    size_t max = sp->outage ? sender_spill_max_bytes / 4 * 3 : sender_spill_max_bytes;
+    if(sp->bytes + len > max || (sp->pending && sp->pending->len + len > sender_spill_segment_bytes)) {
+        // a gap in the middle could leave updates of charts not defined, so nothing follows it
+        if(sp->outage) {
+            error("STREAM %s [send]: the spill is full, the metrics collected until the parent connects are lost.", sp->host->hostname);
+            sp->full = 1;
+        }
+        return 1;
+    }
+
+    if(!sp->bytes && !sp->outage)
+        info("STREAM %s [send]: the buffer is full, spilling metrics to disk.", sp->host->hostname);
+
+    if(!sp->pending)
+        sp->pending = buffer_create(len);
+
+    buffer_need_bytes(sp->pending, len);
+    memcpy(&sp->pending->buffer[sp->pending->len], data, len);
+    sp->pending->len += len;
+
+    sp->bytes += len;
+    return 0;
+}
+
+// append data to the segments - sender thread only
+static int sender_spill_write(struct sender_spill *sp, const char *data, size_t len) {
+    if(sp->write_fd != -1 && sp->write_offset >= sender_spill_segment_bytes) {
+        close(sp->write_fd);
+        sp->write_fd = -1;
+        sp->write_segment++;
+        sp->write_offset = 0;
+    }
+
+    if(sp->write_fd == -1) {
+        sp->write_fd = sender_spill_segment_open(sp, sp->write_segment, O_WRONLY | O_CREAT | O_TRUNC);
+        if(sp->write_fd == -1)
+            return 1;
+    }
+
+    size_t written = 0;
+    while(written < len) {
+        ssize_t ret = write(sp->write_fd, data + written, len - written);
+        if(ret == -1) {
+            if(errno == EINTR)
+                continue;
+
+            error("STREAM %s [send]: cannot write %zu bytes to spill segment %zu", sp->host->hostname, len, sp->write_segment);
+
+            // the segment ends where the last complete write ended
+            if(written && ftruncate(sp->write_fd, (off_t)sp->write_offset) == -1)
+                error("STREAM %s [send]: cannot truncate spill segment %zu", sp->host->hostname, sp->write_segment);
+            return 1;
+        }
+
+        written += (size_t)ret;
+    }
+
+    sp->write_offset += len;
+    sp->disk_bytes += len;
+    return 0;
+}
+
+// write what the collectors appended to the disk, on the sender thread, outside the lock of the sender
+// returns 1 when it could not be written, so the spill has a gap and has to be discarded
+int sender_spill_flush(struct sender_state *s) {
+    struct sender_spill *sp = &s->spill;
+
+    netdata_mutex_lock(&s->mutex);
+    BUFFER *wb = sp->pending;
+    if(!wb || !wb->len) {
+        netdata_mutex_unlock(&s->mutex);
+        return 0;
+    }
+    sp->pending = sp->writing;
+    sp->writing = wb;
+    netdata_mutex_unlock(&s->mutex);
+
+    int ret = sender_spill_write(sp, wb->buffer, wb->len);
+    if(unlikely(ret)) {
+        netdata_mutex_lock(&s->mutex);
+        sp->bytes -= wb->len;
+        sp->self_contained = 0;
+        netdata_mutex_unlock(&s->mutex);
+    }
+
+    buffer_flush(wb);
+    return ret;
+}
+
+// move spilled data back to the buffer, as much as it has room for and the rate allows
+// sender thread only, the segments are read outside the lock of the sender - returns the bytes moved
+size_t sender_spill_drain(struct sender_state *s) {
+    struct sender_spill *sp = &s->spill;
+    struct circular_buffer *cb = s->buffer;
+    size_t moved = 0;
+    char chunk[SENDER_SPILL_DRAIN_CHUNK];
+
+    while(!replication_limiter_exhausted(&sp->drain_limiter)) {
+        netdata_mutex_lock(&s->mutex);
+        size_t used = sender_buffer_used(s);
+
+        // the circular buffer keeps one byte free
+        size_t wanted = (used + 1 < cb->max_size) ? cb->max_size - used - 1 : 0;
+        if(wanted > sizeof(chunk))
+            wanted = sizeof(chunk);
+
+        // all of it has been read from the disk, the rest has not been written yet
+        if(wanted && !sp->disk_bytes && sp->pending && sp->pending->len) {
+            if(wanted > sp->pending->len)
+                wanted = sp->pending->len;
+
+            if(cbuffer_add_unsafe(cb, sp->pending->buffer, wanted))
+                wanted = 0;
+            else {
+                memmove(sp->pending->buffer, &sp->pending->buffer[wanted], sp->pending->len - wanted);
+                sp->pending->len -= wanted;
+                sp->bytes -= wanted;
+                sp->drained = 1;
+            }
+
+            netdata_mutex_unlock(&s->mutex);
+
+            if(!wanted)
+                break;
+
+            replication_limiter_add(&sp->drain_limiter, wanted, sender_spill_drain_bytes_per_second);
+            moved += wanted;
+            continue;
+        }
+        netdata_mutex_unlock(&s->mutex);
+
+        if(!wanted || !sp->disk_bytes)
+            break;
+
+        if(sp->read_fd == -1) {
+            sp->read_fd = sender_spill_segment_open(sp, sp->read_segment, O_RDONLY);
+            if(sp->read_fd == -1)
+                break;
+        }
+
+        ssize_t ret = pread(sp->read_fd, chunk, wanted, (off_t)sp->read_offset);
+        if(ret == -1 && errno == EINTR)
+            continue;
+
+        if(ret == 0 && sp->read_segment < sp->write_segment) {
+            // this segment has been read completely, the writer has moved to the next one
+            close(sp->read_fd);
+            sp->read_fd = -1;
+            sender_spill_segment_delete(sp, sp->read_segment);
+            sp->read_segment++;
+            sp->read_offset = 0;
+            continue;
+        }
+
+        if(ret <= 0) {
+            error("STREAM %s [send]: cannot read spill segment %zu at offset %zu", sp->host->hostname, sp->read_segment, sp->read_offset);
+            break;
+        }
+
+        // only the sender thread empties the buffer, so the room measured above is still there
+        netdata_mutex_lock(&s->mutex);
+        int full = cbuffer_add_unsafe(cb, chunk, (size_t)ret);
+        if(!full) {
+            sp->bytes -= (size_t)ret;
+            sp->drained = 1;
+        }
+        netdata_mutex_unlock(&s->mutex);
+
+        if(full)
+            break;
+
+        replication_limiter_add(&sp->drain_limiter, (size_t)ret, sender_spill_drain_bytes_per_second);
+
+        sp->read_offset += (size_t)ret;
+        sp->disk_bytes -= (size_t)ret;
+        moved += (size_t)ret;
+    }
+
+    // everything has been moved back, start again from the first segment
+    if(moved) {
+        netdata_mutex_lock(&s->mutex);
+        if(!sp->bytes) {
+            info("STREAM %s [send]: the metrics spilled to disk have been moved back to the buffer.", sp->host->hostname);
+            sender_spill_reset(sp);
+        }
+        netdata_mutex_unlock(&s->mutex);
+    }
+
+    return moved;
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libnetdata/libnetdata.h"
+#include "libnetdata/required_dummies.h"
+#include "streaming/rrdpush.h"
+#include <setjmp.h>
+#include <cmocka.h>
+
+// the receiver of the test parses this many lines at a time, in place of RECEIVER_POOL_READ_BUDGET bytes
+#define TEST_BUDGET_LINES 100
+#define TEST_BURST_LINES (10 * TEST_BUDGET_LINES)
+#define TEST_LINE "SET test = 1\n"
+
+size_t receiver_pool_threads = 1;
+
+static volatile size_t lines_parsed = 0;
+
+// the functions of receiver.c used by the pool
+
+int receiver_connect(struct receiver_state *rpt)
+{
+    (void)rpt;
+    return 0;
+}
+
+void receiver_disconnect(struct receiver_state *rpt, size_t count, FILE *fp)
+{
+    (void)rpt;
+    (void)count;
+    (void)fp;
+}
+
+void receiver_release(struct receiver_state *rpt)
+{
+    (void)rpt;
+}
+
+struct parser *receiver_parser_create(struct receiver_state *rpt, FILE *fp)
+{
+    (void)fp;
+    return (struct parser *)rpt;
+}
+
+size_t receiver_parser_destroy(struct parser *parser)
+{
+    (void)parser;
+    return 0;
+}
+
+// like the real one: parse what has been read up to the budget, then read more until the socket has nothing
+int receiver_receive_available(struct receiver_state *rpt)
+{
+    size_t parsed = 0;
+
+    for (;;) {
+        while (parsed < TEST_BUDGET_LINES && rpt->read_pos < rpt->read_len) {
+            char *eol = memchr(&rpt->read_buffer[rpt->read_pos], '\n', (size_t)(rpt->read_len - rpt->read_pos));
+            if (!eol)
+                break;
+
+            rpt->read_pos = (int)(eol - rpt->read_buffer) + 1;
+            parsed++;
+            __atomic_add_fetch(&lines_parsed, 1, __ATOMIC_RELAXED);
+        }
+
+        if (parsed >= TEST_BUDGET_LINES)
+            return 1;
+
+        if (rpt->read_pos == rpt->read_len)
+            rpt->read_pos = rpt->read_len = 0;
+        else if (rpt->read_len == rpt->read_size)
+            return -1;
+
+        ssize_t ret = read(rpt->fd, &rpt->read_buffer[rpt->read_len], (size_t)(rpt->read_size - rpt->read_len));
+        if (ret == 0)
+            return -1;
+        if (ret < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+        rpt->read_len += (int)ret;
+    }
+}
+
+static void test_burst_over_budget(void **state)
+{
+    (void)state;
+
+    int fds[2];
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    struct receiver_state rpt;
+    memset(&rpt, 0, sizeof(rpt));
+    rpt.fd = fds[0];
+    rpt.hostname = "child";
+    rpt.client_ip = "localhost";
+    rpt.client_port = "0";
+    rpt.read_size = TEST_BURST_LINES * (int)strlen(TEST_LINE);
+    rpt.read_buffer = callocz(1, (size_t)rpt.read_size);
+
+    assert_int_equal(receiver_pool_add(&rpt), 0);
+
+    // wait for the first turn of the child, which finds nothing to read
+    usec_t timeout_ut = now_monotonic_usec() + 5 * USEC_PER_SEC;
+    while (!rpt.parser && now_monotonic_usec() < timeout_ut)
+        sleep_usec(10 * USEC_PER_MS);
+    assert_non_null(rpt.parser);
+    sleep_usec(100 * USEC_PER_MS);
+
+    // one burst with many times the budget, and then nothing: the socket is readable only once
+    char *burst = mallocz((size_t)rpt.read_size);
+    for (size_t i = 0; i < TEST_BURST_LINES; i++)
+        memcpy(&burst[i * strlen(TEST_LINE)], TEST_LINE, strlen(TEST_LINE));
+    assert_int_equal(write(fds[1], burst, (size_t)rpt.read_size), rpt.read_size);
+    freez(burst);
+
+    // the pool waits up to a second for events when no receiver is ready
+    timeout_ut = now_monotonic_usec() + 3 * USEC_PER_SEC;
+    while (__atomic_load_n(&lines_parsed, __ATOMIC_RELAXED) < TEST_BURST_LINES && now_monotonic_usec() < timeout_ut)
+        sleep_usec(10 * USEC_PER_MS);
+
+    assert_int_equal(__atomic_load_n(&lines_parsed, __ATOMIC_RELAXED), TEST_BURST_LINES);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_burst_over_budget)
+    };
+
+    return cmocka_run_group_tests_name("receiver_pool", tests, NULL, NULL);
+}
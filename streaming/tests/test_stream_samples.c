@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libnetdata/libnetdata.h"
+#include "libnetdata/required_dummies.h"
+#include "streaming/rrdpush.h"
+#include <setjmp.h>
+#include <cmocka.h>
+
+static void test_varint_round_trip(void **state)
+{
+    (void)state;
+
+    uint64_t values[] = {
+        0, 1, 0x7f, 0x80, 0x3fff, 0x4000, 0xffffffffULL, 0x100000000ULL, INT64_MAX, UINT64_MAX - 1, UINT64_MAX
+    };
+    size_t sizes[] = {
+        1, 1, 1, 2, 2, 3, 5, 5, 9, 10, 10
+    };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        unsigned char buffer[STREAM_VARINT_MAX_BYTES];
+        uint64_t decoded = 0;
+
+        size_t used = stream_varint_encode(buffer, values[i]);
+        assert_int_equal(used, sizes[i]);
+        assert_int_equal(stream_varint_decode(buffer, used, &decoded), used);
+        assert_true(decoded == values[i]);
+    }
+}
+
+static void test_varint_malformed(void **state)
+{
+    (void)state;
+
+    unsigned char buffer[STREAM_VARINT_MAX_BYTES + 1] = { 0 };
+    uint64_t decoded = 12345;
+
+    // nothing to decode
+    assert_int_equal(stream_varint_decode(buffer, 0, &decoded), 0);
+
+    // the last byte says more follow
+    size_t used = stream_varint_encode(buffer, 0x4000);
+    for (size_t size = 0; size < used; size++)
+        assert_int_equal(stream_varint_decode(buffer, size, &decoded), 0);
+
+    // longer than any 64-bit value
+    memset(buffer, 0x80, sizeof(buffer));
+    buffer[STREAM_VARINT_MAX_BYTES] = 0x01;
+    assert_int_equal(stream_varint_decode(buffer, sizeof(buffer), &decoded), 0);
+
+    assert_true(decoded == 12345);
+}
+
+static void test_zigzag(void **state)
+{
+    (void)state;
+
+    assert_true(stream_zigzag_encode(0) == 0);
+    assert_true(stream_zigzag_encode(-1) == 1);
+    assert_true(stream_zigzag_encode(1) == 2);
+    assert_true(stream_zigzag_encode(-2) == 3);
+    assert_true(stream_zigzag_encode(INT64_MAX) == UINT64_MAX - 1);
+    assert_true(stream_zigzag_encode(INT64_MIN) == UINT64_MAX);
+
+    int64_t values[] = { 0, 1, -1, 63, -64, 64, -65, INT32_MAX, INT32_MIN, INT64_MAX, INT64_MIN, INT64_MIN + 1 };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        unsigned char buffer[STREAM_VARINT_MAX_BYTES];
+        uint64_t decoded;
+
+        size_t used = stream_varint_encode(buffer, stream_zigzag_encode(values[i]));
+        assert_int_equal(stream_varint_decode(buffer, used, &decoded), used);
+        assert_true(stream_zigzag_decode(decoded) == values[i]);
+    }
+
+    // small differences either way take a single byte
+    unsigned char buffer[STREAM_VARINT_MAX_BYTES];
+    assert_int_equal(stream_varint_encode(buffer, stream_zigzag_encode(-64)), 1);
+    assert_int_equal(stream_varint_encode(buffer, stream_zigzag_encode(63)), 1);
+}
+
+// a frame like rrdpush_send_chart_samples_nolock() makes it: chart slot, microseconds, timestamp, slot and delta pairs
+static size_t samples_frame(unsigned char *frame, const int64_t *deltas, size_t dimensions)
+{
+    unsigned char *p = frame;
+
+    p += stream_varint_encode(p, 1234);
+    p += stream_varint_encode(p, 1000000);
+    p += stream_varint_encode(p, 1600000000);
+    for (size_t i = 0; i < dimensions; i++) {
+        p += stream_varint_encode(p, i);
+        p += stream_varint_encode(p, stream_zigzag_encode(deltas[i]));
+    }
+
+    return (size_t)(p - frame);
+}
+
+// decodes a frame like streaming_samples() does, returns 0 if it is corrupted
+static int samples_decode(const unsigned char *frame, size_t size, int64_t *deltas, size_t *dimensions)
+{
+    const unsigned char *p = frame, *end = frame + size;
+    uint64_t chart_slot, microseconds, timestamp, slot, delta;
+
+    if (!stream_samples_next(&p, end, &chart_slot) || !stream_samples_next(&p, end, &microseconds) ||
+        !stream_samples_next(&p, end, &timestamp))
+        return 0;
+
+    if (chart_slot != 1234 || microseconds != 1000000 || timestamp != 1600000000)
+        return 0;
+
+    *dimensions = 0;
+    while (p < end) {
+        if (!stream_samples_next(&p, end, &slot) || !stream_samples_next(&p, end, &delta))
+            return 0;
+
+        if (slot != *dimensions)
+            return 0;
+
+        deltas[(*dimensions)++] = stream_zigzag_decode(delta);
+    }
+
+    return 1;
+}
+
+static void test_samples_frame(void **state)
+{
+    (void)state;
+
+    int64_t deltas[] = { 0, 1, -1, 1000, -1000, INT64_MAX, INT64_MIN };
+    size_t dimensions = sizeof(deltas) / sizeof(deltas[0]);
+
+    unsigned char frame[(3 + 2 * 7) * STREAM_VARINT_MAX_BYTES];
+    size_t size = samples_frame(frame, deltas, dimensions);
+
+    int64_t decoded[7];
+    size_t decoded_dimensions;
+    assert_int_equal(samples_decode(frame, size, decoded, &decoded_dimensions), 1);
+    assert_int_equal(decoded_dimensions, dimensions);
+    for (size_t i = 0; i < dimensions; i++)
+        assert_true(decoded[i] == deltas[i]);
+
+    // every cut of the frame is rejected, except the ones between two dimensions
+    size_t complete = samples_frame(frame, deltas, 0);
+    for (size_t d = 0; d < dimensions; d++) {
+        size_t next = samples_frame(frame, deltas, d + 1);
+        for (size_t cut = complete + 1; cut < next; cut++)
+            assert_int_equal(samples_decode(frame, cut, decoded, &decoded_dimensions), 0);
+        complete = next;
+    }
+    for (size_t cut = 0; cut < samples_frame(frame, deltas, 0); cut++)
+        assert_int_equal(samples_decode(frame, cut, decoded, &decoded_dimensions), 0);
+
+    // the last byte of the frame says more follow
+    size = samples_frame(frame, deltas, dimensions);
+    frame[size - 1] |= 0x80;
+    assert_int_equal(samples_decode(frame, size, decoded, &decoded_dimensions), 0);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_varint_round_trip),
+        cmocka_unit_test(test_varint_malformed),
+        cmocka_unit_test(test_zigzag),
+        cmocka_unit_test(test_samples_frame)
+    };
+
+    return cmocka_run_group_tests_name("stream_samples", tests, NULL, NULL);
+}
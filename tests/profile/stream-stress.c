@@ -0,0 +1,618 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * stream-stress - a load generator for the streaming receiver of a parent
+ *
+ * It connects CHILDREN synthetic children to a running parent, and streams
+ * CHARTS charts of DIMENSIONS dimensions each, every UPDATE_EVERY seconds, or
+ * as fast as the parent reads them (-f). The children speak the plain text
+ * protocol, so the parent runs its real receiver, streaming_parser() and
+ * database code for each of them.
+ *
+ * Every second it prints:
+ *
+ *  - the children connected
+ *  - the points and the bytes sent per second
+ *  - the time to send one update of all the charts of a child (50th and
+ *    99th percentile, and the maximum) - it grows when the parent does not
+ *    read fast enough
+ *  - the lag of the parent: now - the last entry of the first chart of the
+ *    first child, as the API of the parent reports it
+ *  - the CPU and the resident memory of the parent process (-p PID)
+ *  - the CPU of stream-stress itself, to know when it is the bottleneck
+ *
+ * and a summary when it exits (-d SECONDS, or Ctrl-C).
+ *
+ * The parent needs the API key enabled in its stream.conf, and no limit on
+ * the rate of new streams in netdata.conf:
+ *
+ *   [11111111-2222-3333-4444-555555555555]
+ *       enabled = yes
+ *       default memory mode = ram
+ *
+ *   [web]
+ *       accept a streaming request every seconds = 0
+ *
+ * 1. build netdata (as normally)
+ * 2. cd tests/profile/
+ * 3. make stream-stress
+ * 4. ./stream-stress -c 100 -C 200 -D 10 -p $(pidof netdata)
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define DEFAULT_API_KEY "11111111-2222-3333-4444-555555555555"
+#define LATENCY_BUCKETS 40  // powers of two of microseconds
+
+static char *host = "localhost";
+static char *port = "19999";
+static char *api_key = DEFAULT_API_KEY;
+static char *prefix = "stress";
+static size_t children = 1;
+static size_t charts = 100;
+static size_t dimensions = 10;
+static size_t update_every = 1;
+static size_t threads = 0;
+static size_t duration = 0;
+static int flood = 0;
+static pid_t parent_pid = 0;
+
+static volatile int stop = 0;
+
+struct latency {
+	uint64_t buckets[LATENCY_BUCKETS];
+	uint64_t max;
+};
+
+struct child {
+	size_t id;
+	int fd;
+	char hostname[100];
+	char machine_guid[37];
+	char *buffer;
+	size_t size;
+	uint64_t iteration;
+};
+
+struct worker {
+	size_t id;
+	pthread_t thread;
+	struct child *children;     // the children of this worker
+	size_t count;
+
+	// updated by the worker, read by the reporter
+	uint64_t points;
+	uint64_t bytes;
+	uint64_t connected;
+	uint64_t disconnects;
+	struct latency latency;
+};
+
+static struct worker *workers;
+
+// ----------------------------------------------------------------------------
+// helpers
+
+static uint64_t now_usec(int clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void latency_add(struct latency *l, uint64_t usec) {
+	size_t bucket = 0;
+	while(bucket < LATENCY_BUCKETS - 1 && (1ULL << bucket) <= usec)
+		bucket++;
+
+	__atomic_add_fetch(&l->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+	uint64_t max = __atomic_load_n(&l->max, __ATOMIC_RELAXED);
+	while(usec > max && !__atomic_compare_exchange_n(&l->max, &max, usec, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+}
+
+// the upper bound of the bucket the percentile falls in
+static uint64_t latency_percentile(struct latency *l, double percentile) {
+	uint64_t count = 0, seen = 0;
+	size_t i;
+
+	for(i = 0; i < LATENCY_BUCKETS ;i++)
+		count += l->buckets[i];
+
+	if(!count)
+		return 0;
+
+	uint64_t wanted = (uint64_t)((double)count * percentile / 100.0);
+	if(wanted < 1) wanted = 1;
+
+	for(i = 0; i < LATENCY_BUCKETS ;i++) {
+		seen += l->buckets[i];
+		if(seen >= wanted)
+			return 1ULL << i;
+	}
+
+	return 1ULL << (LATENCY_BUCKETS - 1);
+}
+
+static int connect_to_parent(void) {
+	struct addrinfo hints, *ai, *p;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int ret = getaddrinfo(host, port, &hints, &ai);
+	if(ret) {
+		fprintf(stderr, "cannot resolve %s:%s: %s\n", host, port, gai_strerror(ret));
+		return -1;
+	}
+
+	int fd = -1;
+	for(p = ai; p ;p = p->ai_next) {
+		fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+		if(fd == -1)
+			continue;
+
+		if(connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(ai);
+	return fd;
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+	while(len) {
+		ssize_t ret = send(fd, data, len, MSG_NOSIGNAL);
+		if(ret == -1) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		data += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// the children
+
+static void child_disconnect(struct worker *w, struct child *c) {
+	if(c->fd == -1)
+		return;
+
+	close(c->fd);
+	c->fd = -1;
+	__atomic_sub_fetch(&w->connected, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&w->disconnects, 1, __ATOMIC_RELAXED);
+}
+
+static int child_connect(struct worker *w, struct child *c) {
+	c->fd = connect_to_parent();
+	if(c->fd == -1)
+		return -1;
+
+	int one = 1;
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	// version 3 is the latest one without compression
+	int len = snprintf(c->buffer, c->size,
+			"STREAM key=%s&hostname=%s&registry_hostname=%s&machine_guid=%s&update_every=%zu"
+			"&os=linux&timezone=UTC&abbrev_timezone=UTC&utc_offset=0&hops=1&tags=&ver=3"
+			" HTTP/1.1\r\n"
+			"User-Agent: stream-stress/1.0\r\n"
+			"Accept: */*\r\n\r\n"
+			, api_key, c->hostname, c->hostname, c->machine_guid, update_every);
+
+	if(send_all(c->fd, c->buffer, (size_t)len) == -1)
+		goto failed;
+
+	char response[1024 + 1];
+	ssize_t received = recv(c->fd, response, sizeof(response) - 1, 0);
+	if(received <= 0)
+		goto failed;
+
+	response[received] = '\0';
+	if(strncmp(response, "Hit me baby", 11) != 0) {
+		fprintf(stderr, "child %s: the parent refused the stream: %s\n", c->hostname, response);
+		goto failed;
+	}
+
+	// the definitions of the charts
+	size_t used = 0, i, d;
+	for(i = 0; i < charts ;i++) {
+		used += (size_t)snprintf(&c->buffer[used], c->size - used,
+				"CHART \"%s.chart_%zu\" \"\" \"stress chart %zu\" \"points\" \"stress\" \"%s.chart\" \"line\" %zu %zu \"\" \"stream-stress\" \"\"\n"
+				, prefix, i, i, prefix, 100000 + i, update_every);
+
+		for(d = 0; d < dimensions ;d++)
+			used += (size_t)snprintf(&c->buffer[used], c->size - used,
+					"DIMENSION \"dim_%zu\" \"\" \"absolute\" 1 1 \"\"\n", d);
+
+		if(c->size - used < 4096) {
+			if(send_all(c->fd, c->buffer, used) == -1)
+				goto failed;
+			used = 0;
+		}
+	}
+
+	if(used && send_all(c->fd, c->buffer, used) == -1)
+		goto failed;
+
+	__atomic_add_fetch(&w->connected, 1, __ATOMIC_RELAXED);
+	return 0;
+
+failed:
+	close(c->fd);
+	c->fd = -1;
+	return -1;
+}
+
+// format and send one update of all the charts of the child
+static int child_send_update(struct worker *w, struct child *c) {
+	uint64_t started = now_usec(CLOCK_MONOTONIC);
+	size_t used = 0, bytes = 0, i, d;
+
+	// with -f the parent uses its own clock, since we are faster than real time
+	uint64_t usec = flood ? 0 : update_every * 1000000ULL;
+
+	for(i = 0; i < charts ;i++) {
+		used += (size_t)snprintf(&c->buffer[used], c->size - used,
+				"BEGIN \"%s.chart_%zu\" %llu\n", prefix, i, (unsigned long long)usec);
+
+		for(d = 0; d < dimensions ;d++)
+			used += (size_t)snprintf(&c->buffer[used], c->size - used,
+					"SET \"dim_%zu\" = %llu\n", d, (unsigned long long)((c->iteration + d) % 1000));
+
+		used += (size_t)snprintf(&c->buffer[used], c->size - used, "END\n");
+
+		if(c->size - used < 4096) {
+			if(send_all(c->fd, c->buffer, used) == -1)
+				return -1;
+			bytes += used;
+			used = 0;
+		}
+	}
+
+	if(used && send_all(c->fd, c->buffer, used) == -1)
+		return -1;
+	bytes += used;
+
+	c->iteration++;
+	latency_add(&w->latency, now_usec(CLOCK_MONOTONIC) - started);
+	__atomic_add_fetch(&w->points, charts * dimensions, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&w->bytes, bytes, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void *worker_thread(void *ptr) {
+	struct worker *w = ptr;
+	uint64_t step = update_every * 1000000ULL;
+	uint64_t next = now_usec(CLOCK_MONOTONIC);
+
+	while(!stop) {
+		size_t i;
+		for(i = 0; i < w->count && !stop ;i++) {
+			struct child *c = &w->children[i];
+
+			if(c->fd == -1 && child_connect(w, c) == -1) {
+				usleep(100000);     // do not spin while the parent is away
+				continue;
+			}
+
+			if(child_send_update(w, c) == -1) {
+				fprintf(stderr, "child %s: disconnected from the parent\n", c->hostname);
+				child_disconnect(w, c);
+			}
+		}
+
+		if(flood)
+			continue;
+
+		next += step;
+		uint64_t now = now_usec(CLOCK_MONOTONIC);
+		if(next > now)
+			usleep((useconds_t)(next - now));
+		else
+			next = now;     // behind, the latency reports it
+	}
+
+	for(size_t i = 0; i < w->count ;i++)
+		child_disconnect(w, &w->children[i]);
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// the parent
+
+// the seconds since the last entry of the first chart of the first child, -1 when unknown
+static long parent_lag(void) {
+	int fd = connect_to_parent();
+	if(fd == -1)
+		return -1;
+
+	char request[1024];
+	int len = snprintf(request, sizeof(request),
+			"GET /host/%s/api/v1/chart?chart=%s.chart_0 HTTP/1.0\r\n"
+			"Connection: close\r\n\r\n"
+			, workers[0].children[0].hostname, prefix);
+
+	long lag = -1;
+	if(send_all(fd, request, (size_t)len) == 0) {
+		static char response[65536 + 1];
+		size_t used = 0;
+		ssize_t ret;
+		while(used < sizeof(response) - 1 && (ret = recv(fd, &response[used], sizeof(response) - 1 - used, 0)) > 0)
+			used += (size_t)ret;
+		response[used] = '\0';
+
+		char *s = strstr(response, "\"last_entry\":");
+		if(s) {
+			long last_entry = strtol(s + 13, NULL, 10);
+			if(last_entry > 0)
+				lag = (long)time(NULL) - last_entry;
+		}
+	}
+
+	close(fd);
+	return lag;
+}
+
+// the cpu time (usec) and the resident memory (KiB) of the parent, from /proc
+static int parent_resources(uint64_t *cpu_usec, uint64_t *rss_kib) {
+	char filename[100], buffer[4096 + 1];
+
+	snprintf(filename, sizeof(filename), "/proc/%d/stat", (int)parent_pid);
+	FILE *fp = fopen(filename, "r");
+	if(!fp)
+		return -1;
+
+	size_t len = fread(buffer, 1, sizeof(buffer) - 1, fp);
+	fclose(fp);
+	buffer[len] = '\0';
+
+	// the fields after the name of the process, which may have spaces
+	char *s = strrchr(buffer, ')');
+	if(!s)
+		return -1;
+
+	unsigned long long utime, stime;
+	if(sscanf(s + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+		return -1;
+
+	long hz = sysconf(_SC_CLK_TCK);
+	*cpu_usec = (utime + stime) * 1000000ULL / (uint64_t)hz;
+
+	snprintf(filename, sizeof(filename), "/proc/%d/status", (int)parent_pid);
+	fp = fopen(filename, "r");
+	if(!fp)
+		return -1;
+
+	*rss_kib = 0;
+	while(fgets(buffer, sizeof(buffer), fp)) {
+		if(!strncmp(buffer, "VmRSS:", 6)) {
+			*rss_kib = strtoull(&buffer[6], NULL, 10);
+			break;
+		}
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+static uint64_t self_cpu_usec(void) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+// ----------------------------------------------------------------------------
+// reporting
+
+static void on_signal(int signo) {
+	(void)signo;
+	stop = 1;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+			"\n"
+			"Usage: %s [options]\n"
+			"\n"
+			"  -h HOST          the parent, default: %s\n"
+			"  -P PORT          the port of the parent, default: %s\n"
+			"  -k KEY           the API key of the children, default: %s\n"
+			"  -c CHILDREN      the children to connect, default: %zu\n"
+			"  -C CHARTS        the charts of each child, default: %zu\n"
+			"  -D DIMENSIONS    the dimensions of each chart, default: %zu\n"
+			"  -u SECONDS       the update every of the charts, default: %zu\n"
+			"  -f               flood, send the updates as fast as the parent reads them\n"
+			"  -t THREADS       the threads sending for the children, default: the children, up to 16\n"
+			"  -d SECONDS       stop after this time and print a summary, default: run until Ctrl-C\n"
+			"  -p PID           the pid of the parent, to report its CPU and memory\n"
+			"  -n PREFIX        the prefix of the children and the charts, default: %s\n"
+			"\n"
+			, name, host, port, api_key, children, charts, dimensions, update_every, prefix);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	while((opt = getopt(argc, argv, "h:P:k:c:C:D:u:ft:d:p:n:")) != -1) {
+		switch(opt) {
+			case 'h': host = optarg; break;
+			case 'P': port = optarg; break;
+			case 'k': api_key = optarg; break;
+			case 'c': children = strtoul(optarg, NULL, 10); break;
+			case 'C': charts = strtoul(optarg, NULL, 10); break;
+			case 'D': dimensions = strtoul(optarg, NULL, 10); break;
+			case 'u': update_every = strtoul(optarg, NULL, 10); break;
+			case 'f': flood = 1; break;
+			case 't': threads = strtoul(optarg, NULL, 10); break;
+			case 'd': duration = strtoul(optarg, NULL, 10); break;
+			case 'p': parent_pid = (pid_t)strtol(optarg, NULL, 10); break;
+			case 'n': prefix = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if(!children || !charts || !dimensions || !update_every)
+		usage(argv[0]);
+
+	if(!threads)
+		threads = (children < 16) ? children : 16;
+	if(threads > children)
+		threads = children;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+
+	// a child is assigned to worker (id % threads)
+	workers = calloc(threads, sizeof(struct worker));
+	size_t i;
+	for(i = 0; i < threads ;i++) {
+		workers[i].id = i;
+		workers[i].count = children / threads + ((i < children % threads) ? 1 : 0);
+		workers[i].children = calloc(workers[i].count, sizeof(struct child));
+	}
+
+	for(i = 0; i < children ;i++) {
+		struct child *c = &workers[i % threads].children[i / threads];
+		c->id = i;
+		c->fd = -1;
+		c->size = 64 * 1024 + dimensions * 64;  // room for at least one whole chart
+		c->buffer = malloc(c->size);
+		snprintf(c->hostname, sizeof(c->hostname), "%s-child-%zu", prefix, i);
+		snprintf(c->machine_guid, sizeof(c->machine_guid), "5354524d-0000-4000-8000-%012llx", (unsigned long long)(i & 0xffffffffffffULL));
+	}
+
+	printf("\n");
+	printf("PARENT      : %s:%s%s\n", host, port, parent_pid ? "" : " (use -p PID for its CPU and memory)");
+	printf("CHILDREN    : %zu, on %zu threads\n", children, threads);
+	printf("CHARTS      : %zu per child, of %zu dimensions\n", charts, dimensions);
+	printf("POINTS      : %zu per %s\n", children * charts * dimensions, flood ? "round (flood)" : "update");
+	printf("\n");
+
+	for(i = 0; i < threads ;i++)
+		pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+
+	printf("%10s %14s %10s %10s %10s %10s %6s %8s %10s %8s\n",
+		   "connected", "points/s", "MiB/s", "p50 us", "p99 us", "max us", "lag s", "cpu %", "rss MiB", "self %");
+
+	uint64_t started = now_usec(CLOCK_MONOTONIC), last = started;
+	uint64_t last_points = 0, last_bytes = 0, last_cpu = 0, last_self = self_cpu_usec(), rss_max = 0, first_cpu = 0;
+	long lag_max = -1;
+	struct latency last_latency, total_latency;
+	memset(&last_latency, 0, sizeof(last_latency));
+
+	if(parent_pid && parent_resources(&first_cpu, &rss_max) == 0)
+		last_cpu = first_cpu;
+
+	while(!stop) {
+		sleep(1);
+
+		uint64_t now = now_usec(CLOCK_MONOTONIC);
+		double seconds = (double)(now - last) / 1000000.0;
+		last = now;
+
+		uint64_t points = 0, bytes = 0, connected = 0;
+		struct latency interval;
+		memset(&interval, 0, sizeof(interval));
+		memset(&total_latency, 0, sizeof(total_latency));
+
+		for(i = 0; i < threads ;i++) {
+			points += __atomic_load_n(&workers[i].points, __ATOMIC_RELAXED);
+			bytes += __atomic_load_n(&workers[i].bytes, __ATOMIC_RELAXED);
+			connected += __atomic_load_n(&workers[i].connected, __ATOMIC_RELAXED);
+
+			size_t b;
+			for(b = 0; b < LATENCY_BUCKETS ;b++)
+				total_latency.buckets[b] += __atomic_load_n(&workers[i].latency.buckets[b], __ATOMIC_RELAXED);
+
+			uint64_t max = __atomic_exchange_n(&workers[i].latency.max, 0, __ATOMIC_RELAXED);
+			if(max > interval.max) interval.max = max;
+		}
+
+		if(interval.max > total_latency.max) total_latency.max = interval.max;
+		for(size_t b = 0; b < LATENCY_BUCKETS ;b++)
+			interval.buckets[b] = total_latency.buckets[b] - last_latency.buckets[b];
+		last_latency = total_latency;
+
+		long lag = parent_lag();
+		if(lag > lag_max) lag_max = lag;
+
+		double cpu = -1;
+		uint64_t cpu_usec, rss_kib = 0;
+		if(parent_pid && parent_resources(&cpu_usec, &rss_kib) == 0) {
+			cpu = (double)(cpu_usec - last_cpu) * 100.0 / (seconds * 1000000.0);
+			last_cpu = cpu_usec;
+			if(rss_kib > rss_max) rss_max = rss_kib;
+		}
+
+		uint64_t self = self_cpu_usec();
+		double self_cpu = (double)(self - last_self) * 100.0 / (seconds * 1000000.0);
+		last_self = self;
+
+		printf("%10llu %14.0f %10.2f %10llu %10llu %10llu %6ld %8.1f %10.1f %8.1f\n"
+			   , (unsigned long long)connected
+			   , (double)(points - last_points) / seconds
+			   , (double)(bytes - last_bytes) / seconds / 1048576.0
+			   , (unsigned long long)latency_percentile(&interval, 50.0)
+			   , (unsigned long long)latency_percentile(&interval, 99.0)
+			   , (unsigned long long)interval.max
+			   , lag
+			   , cpu
+			   , (double)rss_kib / 1024.0
+			   , self_cpu
+		);
+		fflush(stdout);
+
+		last_points = points;
+		last_bytes = bytes;
+
+		if(duration && now - started >= duration * 1000000ULL)
+			stop = 1;
+	}
+
+	for(i = 0; i < threads ;i++)
+		pthread_join(workers[i].thread, NULL);
+
+	double seconds = (double)(now_usec(CLOCK_MONOTONIC) - started) / 1000000.0;
+	uint64_t disconnects = 0;
+	for(i = 0; i < threads ;i++)
+		disconnects += workers[i].disconnects;
+
+	printf("\n");
+	printf("DURATION    : %.1f seconds\n", seconds);
+	printf("POINTS      : %llu, %.0f per second\n", (unsigned long long)last_points, (double)last_points / seconds);
+	printf("BYTES       : %llu, %.2f MiB per second\n", (unsigned long long)last_bytes, (double)last_bytes / seconds / 1048576.0);
+	printf("UPDATE SEND : p50 %llu us, p99 %llu us\n", (unsigned long long)latency_percentile(&total_latency, 50.0), (unsigned long long)latency_percentile(&total_latency, 99.0));
+	printf("DISCONNECTS : %llu\n", (unsigned long long)disconnects);
+	printf("MAX LAG     : %ld seconds\n", lag_max);
+	if(parent_pid) {
+		printf("PARENT CPU  : %.1f%% on average\n", (double)(last_cpu - first_cpu) * 100.0 / (seconds * 1000000.0));
+		printf("PARENT RSS  : %.1f MiB at most\n", (double)rss_max / 1024.0);
+	}
+
+	return 0;
+}
@@ -17,6 +17,91 @@ struct prometheus_output_options {
     { NULL, PROMETHEUS_OUTPUT_NONE },
 };
 
+// ----------------------------------------------------------------------------
+// prometheus_all_hosts is sent while it is generated, one or more hosts per part,
+// so that parents with many children do not need all of them in memory at once
+
+struct allmetrics_prometheus_all_hosts {
+    char *prefix;
+    EXPORTING_OPTIONS exporting_options;
+    PROMETHEUS_OUTPUT_OPTIONS output_options;
+    time_t after, before;
+    BUFFER *preamble;                   // the beginning of the first part
+
+    char (*guids)[GUID_LEN + 1];        // the hosts, looked up again for each part
+    size_t guids_count;
+    size_t next;
+};
+
+static int allmetrics_prometheus_all_hosts_generator(struct web_client *w, BUFFER *wb, void *data) {
+    (void)w;
+    struct allmetrics_prometheus_all_hosts *a = (struct allmetrics_prometheus_all_hosts *)data;
+
+    if(a->preamble) {
+        buffer_strcat(wb, buffer_tostring(a->preamble));
+        buffer_free(a->preamble);
+        a->preamble = NULL;
+    }
+
+    while(a->next < a->guids_count && wb->len < NETDATA_WEB_RESPONSE_STREAM_PART_SIZE) {
+        RRDHOST *h = rrdhost_find_by_guid(a->guids[a->next++], 0);
+        if(likely(h))
+            rrd_stats_api_v1_charts_allmetrics_prometheus_next_host(
+                    h, wb, a->prefix, a->exporting_options, a->output_options, a->after, a->before);
+    }
+
+    return (a->next < a->guids_count);
+}
+
+static void allmetrics_prometheus_all_hosts_free(void *data) {
+    struct allmetrics_prometheus_all_hosts *a = (struct allmetrics_prometheus_all_hosts *)data;
+    buffer_free(a->preamble);
+    freez(a->prefix);
+    freez(a->guids);
+    freez(a);
+}
+
+static void allmetrics_prometheus_all_hosts_stream(
+        RRDHOST *host
+        , struct web_client *w
+        , const char *server
+        , const char *prefix
+        , EXPORTING_OPTIONS exporting_options
+        , PROMETHEUS_OUTPUT_OPTIONS output_options
+) {
+    BUFFER *preamble = buffer_create(1024);
+
+    time_t after, before;
+    if(!rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts_begin(
+            host, preamble, server, exporting_options, output_options, &after, &before)) {
+        buffer_free(preamble);
+        return;
+    }
+
+    struct allmetrics_prometheus_all_hosts *a = callocz(1, sizeof(struct allmetrics_prometheus_all_hosts));
+    a->prefix = strdupz(prefix ? prefix : "");
+    a->exporting_options = exporting_options;
+    a->output_options = output_options;
+    a->after = after;
+    a->before = before;
+    a->preamble = preamble;
+
+    RRDHOST *h;
+    size_t size = 0;
+
+    rrd_rdlock();
+    rrdhost_foreach_read(h) {
+        if(unlikely(a->guids_count == size)) {
+            size = (size) ? size * 2 : 64;
+            a->guids = reallocz(a->guids, size * sizeof(*a->guids));
+        }
+        strncpyz(a->guids[a->guids_count++], h->machine_guid, GUID_LEN);
+    }
+    rrd_unlock();
+
+    web_client_stream_response(w, allmetrics_prometheus_all_hosts_generator, a, allmetrics_prometheus_all_hosts_free);
+}
+
 inline int web_client_api_request_v1_allmetrics(RRDHOST *host, struct web_client *w, char *url) {
     int format = ALLMETRICS_SHELL;
     const char *prometheus_server = w->client_ip;
@@ -109,9 +194,9 @@ inline int web_client_api_request_v1_allmetrics(RRDHOST *host, struct web_client
 
         case ALLMETRICS_PROMETHEUS_ALL_HOSTS:
             w->response.data->contenttype = CT_PROMETHEUS;
-            rrd_stats_api_v1_charts_allmetrics_prometheus_all_hosts(
+            allmetrics_prometheus_all_hosts_stream(
                     host
-                    , w->response.data
+                    , w
                     , prometheus_server
                     , prometheus_prefix
                     , prometheus_exporting_options
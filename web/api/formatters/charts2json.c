@@ -36,12 +36,8 @@ const char* get_release_channel() {
     return (use_stable)?"stable":"nightly";
 }
 
-void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived) {
+static void charts2json_header(RRDHOST *host, BUFFER *wb) {
     static char *custom_dashboard_info_js_filename = NULL;
-    size_t c, dimensions = 0, memory = 0, alarms = 0;
-    RRDSET *st;
-
-    time_t now = now_realtime_sec();
 
     if(unlikely(!custom_dashboard_info_js_filename))
         custom_dashboard_info_js_filename = config_get(CONFIG_SECTION_WEB, "custom dashboard_info.js", "");
@@ -67,23 +63,24 @@ void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived
                    , rrd_memory_mode_name(host->rrd_memory_mode)
                    , custom_dashboard_info_js_filename
     );
+}
 
-    c = 0;
-    rrdhost_rdlock(host);
-    rrdset_foreach_read(st, host) {
-        if ((!show_archived && rrdset_is_available_for_viewers(st)) || (show_archived && rrdset_is_archived(st))) {
-            if(c) buffer_strcat(wb, ",");
-            buffer_strcat(wb, "\n\t\t\"");
-            buffer_strcat(wb, st->id);
-            buffer_strcat(wb, "\": ");
-            rrdset2json(st, wb, &dimensions, &memory, skip_volatile);
+static inline void charts2json_chart(RRDSET *st, BUFFER *wb, size_t c, size_t *dimensions, size_t *memory, int skip_volatile, time_t now) {
+    if(c) buffer_strcat(wb, ",");
+    buffer_strcat(wb, "\n\t\t\"");
+    buffer_strcat(wb, st->id);
+    buffer_strcat(wb, "\": ");
+    rrdset2json(st, wb, dimensions, memory, skip_volatile);
 
-            c++;
-            st->last_accessed_time = now;
-        }
-    }
+    st->last_accessed_time = now;
+}
+
+// the caller holds the rrd read lock
+static void charts2json_footer(RRDHOST *host, BUFFER *wb, size_t c, size_t dimensions, size_t memory, time_t now) {
+    size_t alarms = 0;
 
     RRDCALC *rc;
+    rrdhost_rdlock(host);
     for(rc = host->alarms; rc ; rc = rc->next) {
         if(rc->rrdset)
             alarms++;
@@ -106,8 +103,6 @@ void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived
     );
 
     if(unlikely(rrd_hosts_available > 1)) {
-        rrd_rdlock();
-
         size_t found = 0;
         RRDHOST *h;
         rrdhost_foreach_read(h) {
@@ -123,8 +118,6 @@ void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived
                 found++;
             }
         }
-
-        rrd_unlock();
     }
     else {
         buffer_sprintf(wb
@@ -138,6 +131,118 @@ void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived
     buffer_sprintf(wb, "\n\t]\n}\n");
 }
 
+void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived) {
+    size_t c, dimensions = 0, memory = 0;
+    RRDSET *st;
+
+    time_t now = now_realtime_sec();
+
+    charts2json_header(host, wb);
+
+    c = 0;
+    rrdhost_rdlock(host);
+    rrdset_foreach_read(st, host) {
+        if ((!show_archived && rrdset_is_available_for_viewers(st)) || (show_archived && rrdset_is_archived(st))) {
+            charts2json_chart(st, wb, c, &dimensions, &memory, skip_volatile, now);
+            c++;
+        }
+    }
+    rrdhost_unlock(host);
+
+    rrd_rdlock();
+    charts2json_footer(host, wb, c, dimensions, memory, now);
+    rrd_unlock();
+}
+
+// ----------------------------------------------------------------------------
+// the same JSON, generated in parts
+//
+// The ids of the charts are copied when the stream is created, and each part
+// looks them up again, so that no lock is held between the parts. Charts
+// deleted in the meantime are skipped. So is the host, found by its machine
+// guid for each part: when it has been deleted, the response ends.
+
+struct charts2json_stream {
+    char machine_guid[GUID_LEN + 1];
+    uint32_t hash_machine_guid;
+    int skip_volatile;
+
+    char **ids;
+    size_t ids_count;
+    size_t next;
+
+    size_t c, dimensions, memory;
+};
+
+struct charts2json_stream *charts2json_stream_create(RRDHOST *host, int skip_volatile) {
+    struct charts2json_stream *cs = callocz(1, sizeof(struct charts2json_stream));
+    strncpyz(cs->machine_guid, host->machine_guid, GUID_LEN);
+    cs->hash_machine_guid = host->hash_machine_guid;
+    cs->skip_volatile = skip_volatile;
+
+    size_t size = 0;
+    RRDSET *st;
+
+    rrdhost_rdlock(host);
+    rrdset_foreach_read(st, host) {
+        if(!rrdset_is_available_for_viewers(st))
+            continue;
+
+        if(unlikely(cs->ids_count == size)) {
+            size = (size) ? size * 2 : 1024;
+            cs->ids = reallocz(cs->ids, size * sizeof(char *));
+        }
+
+        cs->ids[cs->ids_count++] = strdupz(st->id);
+    }
+    rrdhost_unlock(host);
+
+    return cs;
+}
+
+int charts2json_stream_next(struct charts2json_stream *cs, BUFFER *wb, size_t size) {
+    time_t now = now_realtime_sec();
+
+    // the hosts are freed with the rrd write lock held
+    rrd_rdlock();
+
+    RRDHOST *host = rrdhost_find_by_guid(cs->machine_guid, cs->hash_machine_guid);
+    if(unlikely(!host)) {
+        rrd_unlock();
+        error("The host '%s' has been deleted while its charts were being sent.", cs->machine_guid);
+        return 0;
+    }
+
+    if(!cs->next)
+        charts2json_header(host, wb);
+
+    rrdhost_rdlock(host);
+    while(cs->next < cs->ids_count && wb->len < size) {
+        RRDSET *st = rrdset_find(host, cs->ids[cs->next++]);
+        if(likely(st && rrdset_is_available_for_viewers(st))) {
+            charts2json_chart(st, wb, cs->c, &cs->dimensions, &cs->memory, cs->skip_volatile, now);
+            cs->c++;
+        }
+    }
+    rrdhost_unlock(host);
+
+    int more = (cs->next < cs->ids_count);
+    if(!more)
+        charts2json_footer(host, wb, cs->c, cs->dimensions, cs->memory, now);
+
+    rrd_unlock();
+    return more;
+}
+
+void charts2json_stream_free(struct charts2json_stream *cs) {
+    size_t i;
+    for(i = 0; i < cs->ids_count ; i++)
+        freez(cs->ids[i]);
+
+    freez(cs->ids);
+    freez(cs);
+}
+
 // generate collectors list for the api/v1/info call
 
 struct collector {
@@ -6,6 +6,12 @@
 #include "rrd2json.h"
 
 extern void charts2json(RRDHOST *host, BUFFER *wb, int skip_volatile, int show_archived);
+
+struct charts2json_stream;
+extern struct charts2json_stream *charts2json_stream_create(RRDHOST *host, int skip_volatile);
+// appends charts to wb until it has size bytes, returns 0 when the JSON is complete
+extern int charts2json_stream_next(struct charts2json_stream *cs, BUFFER *wb, size_t size);
+extern void charts2json_stream_free(struct charts2json_stream *cs);
 extern void chartcollectors2json(RRDHOST *host, BUFFER *wb);
 extern const char* get_release_channel();
 
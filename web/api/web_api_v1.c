@@ -4,6 +4,9 @@
 
 char *api_secret;
 
+int web_api_statistics = 1;
+int web_api_chart_statistics = 0;
+
 static struct {
     const char *name;
     uint32_t hash;
@@ -74,6 +77,9 @@ static struct {
         , {           NULL, 0, 0}
 };
 
+static void web_client_api_v1_init_executor(void);
+static void web_client_api_v1_init_statistics(void);
+
 void web_client_api_v1_init(void) {
     int i;
 
@@ -87,6 +93,8 @@ void web_client_api_v1_init(void) {
         api_v1_data_google_formats[i].hash = simple_hash(api_v1_data_google_formats[i].name);
 
     web_client_api_v1_init_grouping();
+    web_client_api_v1_init_executor();
+    web_client_api_v1_init_statistics();
 
 	uuid_t uuid;
 
@@ -343,16 +351,210 @@ inline int web_client_api_request_single_chart(RRDHOST *host, struct web_client
     return ret;
 }
 
+static void latency_histogram2json(BUFFER *wb, const char *name, HISTOGRAM *h, int last) {
+    HISTOGRAM copy;
+    histogram_snapshot(&copy, h);
+
+    buffer_sprintf(wb, "\t\t\t\"%s\": ", name);
+    histogram_to_json(&copy, wb);
+    buffer_strcat(wb, last ? "\n" : ",\n");
+}
+
+static void rrdset_latency2json(BUFFER *wb, const char *id, RRDSET_LATENCY *latency, int first) {
+    buffer_sprintf(wb, "%s\t\t\"%s\": {\n", first ? "" : ",\n", id);
+    latency_histogram2json(wb, "done", &latency->done, 0);
+    latency_histogram2json(wb, "store", &latency->store, 0);
+    latency_histogram2json(wb, "jitter", &latency->jitter, 1);
+    buffer_strcat(wb, "\t\t}");
+}
+
+inline int web_client_api_request_v1_latency(RRDHOST *host, struct web_client *w, char *url) {
+    char *chart = NULL;
+    BUFFER *wb = w->response.data;
+    RRDSET *st;
+    struct plugind *cd;
+    int first;
+
+    while(url) {
+        char *value = mystrsep(&url, "&");
+        if(!value || !*value) continue;
+
+        char *name = mystrsep(&value, "=");
+        if(!name || !*name) continue;
+        if(!value || !*value) continue;
+
+        if(!strcmp(name, "chart")) chart = value;
+    }
+
+    buffer_flush(wb);
+    wb->contenttype = CT_APPLICATION_JSON;
+
+    RRDSET_LATENCY all;
+    rrdset_latency_all_get(&all);
+
+    buffer_sprintf(wb, "{\n\t\"collection_histograms\": %s,\n\t\"all_charts\": {\n", rrdset_latency_collection ? "true" : "false");
+    rrdset_latency2json(wb, "all", &all, 1);
+    buffer_strcat(wb, "\n\t},\n\t\"plugins\": {\n");
+
+    first = 1;
+    netdata_mutex_lock(&pluginsd_root_mutex);
+    for(cd = pluginsd_root; cd; cd = cd->next) {
+        if(!cd->enabled || cd->obsolete)
+            continue;
+
+        buffer_sprintf(wb, "%s\t\t\"%s\": {\n", first ? "" : ",\n", cd->id);
+        latency_histogram2json(wb, "update", &cd->update_latency, 0);
+        latency_histogram2json(wb, "done", &cd->done_latency, 1);
+        buffer_strcat(wb, "\t\t}");
+        first = 0;
+    }
+    netdata_mutex_unlock(&pluginsd_root_mutex);
+
+    buffer_sprintf(wb, "\n\t},\n\t\"per_chart_histograms\": %s,\n\t\"charts\": {\n", rrdset_latency_histograms ? "true" : "false");
+
+    first = 1;
+    rrdhost_rdlock(host);
+    rrdset_foreach_read(st, host) {
+        if(!st->state->latency)
+            continue;
+
+        if(chart && strcmp(chart, st->id) != 0 && strcmp(chart, st->name) != 0)
+            continue;
+
+        rrdset_latency2json(wb, st->id, st->state->latency, first);
+        first = 0;
+    }
+    rrdhost_unlock(host);
+
+    buffer_strcat(wb, "\n\t}\n}\n");
+
+    buffer_no_cacheable(wb);
+    return HTTP_RESP_OK;
+}
+
+inline int web_client_api_request_v1_stats(RRDHOST *host, struct web_client *w, char *url) {
+    char *chart = NULL;
+    BUFFER *wb = w->response.data;
+    WEB_API_ENDPOINT *ep;
+    RRDSET *st;
+    int first;
+
+    while(url) {
+        char *value = mystrsep(&url, "&");
+        if(!value || !*value) continue;
+
+        char *name = mystrsep(&value, "=");
+        if(!name || !*name) continue;
+        if(!value || !*value) continue;
+
+        if(!strcmp(name, "chart")) chart = value;
+    }
+
+    buffer_flush(wb);
+    wb->contenttype = CT_APPLICATION_JSON;
+
+    buffer_sprintf(wb, "{\n\t\"api_statistics\": %s,\n\t\"endpoints\": {\n", web_api_statistics ? "true" : "false");
+
+    first = 1;
+    for(ep = web_client_api_v1_endpoints(); ep; ep = ep->next) {
+        if(!__atomic_load_n(&ep->latency.count, __ATOMIC_RELAXED))
+            continue;
+
+        buffer_sprintf(wb, "%s\t\t\"%s\": {\n", first ? "" : ",\n", ep->name);
+        latency_histogram2json(wb, "latency", &ep->latency, 0);
+        latency_histogram2json(wb, "bytes", &ep->bytes, 0);
+        latency_histogram2json(wb, "sent", &ep->sent, 0);
+        latency_histogram2json(wb, "points", &ep->points, 1);
+        buffer_strcat(wb, "\t\t}");
+        first = 0;
+    }
+
+    buffer_sprintf(wb, "\n\t},\n\t\"per_chart_statistics\": %s,\n\t\"charts\": {\n", web_api_chart_statistics ? "true" : "false");
+
+    first = 1;
+    rrdhost_rdlock(host);
+    rrdset_foreach_read(st, host) {
+        RRDSET_QUERIES *queries = __atomic_load_n(&st->state->queries, __ATOMIC_ACQUIRE);
+        if(!queries)
+            continue;
+
+        if(chart && strcmp(chart, st->id) != 0 && strcmp(chart, st->name) != 0)
+            continue;
+
+        buffer_sprintf(wb, "%s\t\t\"%s\": {\n", first ? "" : ",\n", st->id);
+        latency_histogram2json(wb, "duration", &queries->duration, 0);
+        latency_histogram2json(wb, "bytes", &queries->bytes, 0);
+        latency_histogram2json(wb, "points", &queries->points, 1);
+        buffer_strcat(wb, "\t\t}");
+        first = 0;
+    }
+    rrdhost_unlock(host);
+
+    buffer_strcat(wb, "\n\t}\n}\n");
+
+    buffer_no_cacheable(wb);
+    return HTTP_RESP_OK;
+}
+
 inline int web_client_api_request_v1_alarm_variables(RRDHOST *host, struct web_client *w, char *url) {
     return web_client_api_request_single_chart(host, w, url, health_api_v1_chart_variables2json);
 }
 
+// ----------------------------------------------------------------------------
+// conditional responses
+//
+// The ETag of /api/v1/data is computed before the response is generated, from
+// the query and the state of the database the response depends on, so that
+// clients that already have it get 304 Not Modified without running the query.
+// It is weak, because the volatile parts of the response do not change it.
+
+static inline uint32_t api_etag_hash(uint32_t hval, const void *data, size_t len) {
+    const unsigned char *s = (const unsigned char *)data, *end = s + len;
+    while(s < end) {
+        hval *= 16777619;
+        hval ^= (uint32_t) *s++;
+    }
+    return hval;
+}
+
+#define api_etag_hash_str(hval, s) api_etag_hash(hval, s, strlen(s))
+
+// sets the ETag of the response and returns 1 when the client already has it
+static inline int api_etag_matches(struct web_client *w, const char *etag) {
+    buffer_sprintf(w->response.header, "ETag: %s\r\n", etag);
+
+    // let the clients keep the response, provided that they revalidate it
+    w->response.data->options |= WB_CONTENT_REVALIDATE;
+
+    if(!web_client_etag_matches(w, etag))
+        return 0;
+
+    buffer_flush(w->response.data);
+    buffer_no_cacheable(w->response.data);
+    return 1;
+}
+
+static int charts2json_generator(struct web_client *w, BUFFER *wb, void *data) {
+    (void)w;
+    return charts2json_stream_next((struct charts2json_stream *)data, wb, NETDATA_WEB_RESPONSE_STREAM_PART_SIZE);
+}
+
+static void charts2json_generator_free(void *data) {
+    charts2json_stream_free((struct charts2json_stream *)data);
+}
+
 inline int web_client_api_request_v1_charts(RRDHOST *host, struct web_client *w, char *url) {
     (void)url;
 
     buffer_flush(w->response.data);
     w->response.data->contenttype = CT_APPLICATION_JSON;
-    charts2json(host, w->response.data, 0, 0);
+
+    // the charts are updated on every collection, with their first and last entries,
+    // so there is no ETag to revalidate them with
+    buffer_no_cacheable(w->response.data);
+
+    // on parents the charts may be too many to have all of them in memory as JSON
+    web_client_stream_response(w, charts2json_generator, charts2json_stream_create(host, 0), charts2json_generator_free);
     return HTTP_RESP_OK;
 }
 
@@ -382,6 +584,24 @@ void fix_google_param(char *s) {
 }
 
 // returns the HTTP code
+// the query statistics of a chart, allocated by its first query
+static RRDSET_QUERIES *rrdset_queries(RRDSET *st) {
+    RRDSET_QUERIES *queries = __atomic_load_n(&st->state->queries, __ATOMIC_ACQUIRE);
+    if(likely(queries))
+        return queries;
+
+    // another thread may be querying the same chart
+    RRDSET_QUERIES *expected = NULL;
+    queries = callocz(1, sizeof(RRDSET_QUERIES));
+    if(__atomic_compare_exchange_n(&st->state->queries, &expected, queries, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        memory_accounting_alloc(MEMORY_ACCOUNTING_CHARTS, sizeof(RRDSET_QUERIES));
+        return queries;
+    }
+
+    freez(queries);
+    return expected;
+}
+
 inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, char *url) {
     debug(D_WEB_CLIENT, "%llu: API v1 data with URL '%s'", w->id, url);
 
@@ -411,6 +631,9 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
     uint32_t format = DATASOURCE_JSON;
     uint32_t options = 0x00000000;
 
+    // the hash of the query, for the ETag
+    uint32_t query_hash = api_etag_hash_str(0x811c9dc5, host->machine_guid);
+
     while(url) {
         char *value = mystrsep(&url, "&");
         if(!value || !*value) continue;
@@ -421,6 +644,14 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
 
         debug(D_WEB_CLIENT, "%llu: API v1 data query param '%s' with value '%s'", w->id, name, value);
 
+        // ignore the cache busting parameter of jQuery
+        if(strcmp(name, "_") != 0) {
+            query_hash = api_etag_hash_str(query_hash, name);
+            query_hash = api_etag_hash(query_hash, "=", 1);
+            query_hash = api_etag_hash_str(query_hash, value);
+            query_hash = api_etag_hash(query_hash, "&", 1);
+        }
+
         // name and value are now the parameters
         // they are not null and not empty
 
@@ -575,6 +806,36 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
           , options
     );
 
+    {
+        // the data of the query change only when the charts queried are collected
+        time_t first_entry_t, last_entry_t;
+        size_t version = 0;
+
+        if(context_param_list) {
+            RRDDIM *rd;
+            for(rd = context_param_list->rd; rd ; rd = rd->next)
+                version++;
+
+            first_entry_t = context_param_list->first_entry_t;
+            last_entry_t = context_param_list->last_entry_t;
+        }
+        else {
+            rrdset_rdlock(st);
+            first_entry_t = rrdset_first_entry_t_nolock(st);
+            last_entry_t = rrdset_last_entry_t_nolock(st);
+            version = st->counter_done;
+            rrdset_unlock(st);
+        }
+
+        char etag[100];
+        snprintfz(etag, sizeof(etag) - 1, "W/\"d-%08x-%lx-%lx-%zx\"", query_hash, (unsigned long)first_entry_t, (unsigned long)last_entry_t, version);
+        if(api_etag_matches(w, etag)) {
+            free_context_param_list(&context_param_list);
+            ret = HTTP_RESP_NOT_MODIFIED;
+            goto cleanup;
+        }
+    }
+
     if(outFileName && *outFileName) {
         buffer_sprintf(w->response.header, "Content-Disposition: attachment; filename=\"%s\"\r\n", outFileName);
         debug(D_WEB_CLIENT, "%llu: generating outfilename header: '%s'", w->id, outFileName);
@@ -600,9 +861,20 @@ inline int web_client_api_request_v1_data(RRDHOST *host, struct web_client *w, c
         buffer_strcat(w->response.data, "(");
     }
 
+    // the queries of a single chart are kept per chart
+    usec_t query_started_ut = (web_api_chart_statistics && !context_param_list) ? now_monotonic_usec() : 0;
+    uint64_t query_points_read = rrdr_query_thread_points_read();
+
     ret = rrdset2anything_api_v1(st, w->response.data, dimensions, format, points, after, before, group, group_time
                                  , options, &last_timestamp_in_data, context_param_list, chart_label_key);
 
+    if(unlikely(query_started_ut)) {
+        RRDSET_QUERIES *queries = rrdset_queries(st);
+        histogram_add(&queries->duration, now_monotonic_usec() - query_started_ut);
+        histogram_add(&queries->bytes, w->response.data->len);
+        histogram_add(&queries->points, rrdr_query_thread_points_read() - query_points_read);
+    }
+
     free_context_param_list(&context_param_list);
 
     if(format == DATASOURCE_DATATABLE_JSONP) {
@@ -970,6 +1242,22 @@ inline int web_client_api_request_v1_info_fill_buffer(RRDHOST *host, BUFFER *wb)
     chartcollectors2json(host, wb);
     buffer_strcat(wb, "\n\t],\n");
 
+    {
+        MEMORY_ACCOUNTING_STATISTICS memory_stats[MEMORY_ACCOUNTING_SUBSYSTEMS];
+        memory_accounting_get(memory_stats);
+
+        buffer_strcat(wb, "\t\"memory\": {");
+        size_t i;
+        for (i = 0; i < MEMORY_ACCOUNTING_SUBSYSTEMS; i++)
+            buffer_sprintf(wb, "%s\n\t\t\"%s\": %zd", i ? "," : "", memory_accounting_subsystem_name(i), memory_stats[i].bytes);
+#ifdef ENABLE_DBENGINE
+        SLAB_STATISTICS descr_stats, page_stats;
+        pg_cache_get_allocator_statistics(&descr_stats, &page_stats);
+        buffer_sprintf(wb, ",\n\t\t\"dbengine\": %zu", descr_stats.chunks * descr_stats.chunk_size + page_stats.chunks * page_stats.chunk_size);
+#endif
+        buffer_strcat(wb, "\n\t},\n");
+    }
+
 #ifdef DISABLE_CLOUD
     buffer_strcat(wb, "\t\"cloud-enabled\": false,\n");
 #else
@@ -1106,31 +1394,74 @@ static struct api_command {
     const char *command;
     uint32_t hash;
     WEB_CLIENT_ACL acl;
+    int executor;                       // 1 = run it in the query executor
     int (*callback)(RRDHOST *host, struct web_client *w, char *url);
 } api_commands[] = {
-        { "info",            0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_info            },
-        { "data",            0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_data            },
-        { "chart",           0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_chart           },
-        { "charts",          0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_charts          },
-        { "archivedcharts",  0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_archivedcharts  },
+        { "info",            0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_info            },
+        { "data",            0, WEB_CLIENT_ACL_DASHBOARD, 1, web_client_api_request_v1_data            },
+        { "chart",           0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_chart           },
+        { "charts",          0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_charts          },
+        { "archivedcharts",  0, WEB_CLIENT_ACL_DASHBOARD, 1, web_client_api_request_v1_archivedcharts  },
 
         // registry checks the ACL by itself, so we allow everything
-        { "registry",        0, WEB_CLIENT_ACL_NOCHECK,   web_client_api_request_v1_registry        },
+        { "registry",        0, WEB_CLIENT_ACL_NOCHECK,   0, web_client_api_request_v1_registry        },
 
         // badges can be fetched with both dashboard and badge permissions
-        { "badge.svg",       0, WEB_CLIENT_ACL_DASHBOARD|WEB_CLIENT_ACL_BADGE, web_client_api_request_v1_badge },
-
-        { "alarms",          0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_alarms          },
-        { "alarms_values",   0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_alarms_values   },
-        { "alarm_log",       0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_alarm_log       },
-        { "alarm_variables", 0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_alarm_variables },
-        { "alarm_count",     0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_alarm_count     },
-        { "allmetrics",      0, WEB_CLIENT_ACL_DASHBOARD, web_client_api_request_v1_allmetrics      },
-        { "manage/health",   0, WEB_CLIENT_ACL_MGMT,      web_client_api_request_v1_mgmt_health     },
+        { "badge.svg",       0, WEB_CLIENT_ACL_DASHBOARD|WEB_CLIENT_ACL_BADGE, 1, web_client_api_request_v1_badge },
+
+        { "alarms",          0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_alarms          },
+        { "alarms_values",   0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_alarms_values   },
+        { "alarm_log",       0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_alarm_log       },
+        { "alarm_variables", 0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_alarm_variables },
+        { "alarm_count",     0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_alarm_count     },
+        { "allmetrics",      0, WEB_CLIENT_ACL_DASHBOARD, 1, web_client_api_request_v1_allmetrics      },
+        { "latency",         0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_latency         },
+        { "stats",           0, WEB_CLIENT_ACL_DASHBOARD, 0, web_client_api_request_v1_stats           },
+        { "manage/health",   0, WEB_CLIENT_ACL_MGMT,      0, web_client_api_request_v1_mgmt_health     },
         // terminator
-        { NULL,              0, WEB_CLIENT_ACL_NONE,      NULL                                      },
+        { NULL,              0, WEB_CLIENT_ACL_NONE,      0, NULL                                      },
 };
 
+// the query executor statistics of the commands it runs
+static WEB_EXECUTOR_ENDPOINT *api_commands_executor[sizeof(api_commands) / sizeof(api_commands[0])];
+
+static void web_client_api_v1_init_executor(void) {
+    int i;
+
+    for(i = 0; api_commands[i].command ; i++) {
+        if(api_commands[i].executor)
+            api_commands_executor[i] = web_executor_endpoint_add(api_commands[i].command);
+    }
+}
+
+// the statistics of the commands, when api statistics are enabled
+static WEB_API_ENDPOINT *api_commands_statistics[sizeof(api_commands) / sizeof(api_commands[0])];
+static WEB_API_ENDPOINT *api_endpoints_root = NULL;
+
+static void web_client_api_v1_init_statistics(void) {
+    WEB_API_ENDPOINT **last = &api_endpoints_root;
+    int i;
+
+    web_api_statistics = config_get_boolean(CONFIG_SECTION_WEB, "api statistics", web_api_statistics);
+    web_api_chart_statistics = config_get_boolean(CONFIG_SECTION_WEB, "per chart api statistics", web_api_chart_statistics);
+
+    if(!web_api_statistics)
+        return;
+
+    for(i = 0; api_commands[i].command ; i++) {
+        WEB_API_ENDPOINT *ep = callocz(1, sizeof(WEB_API_ENDPOINT));
+        ep->name = api_commands[i].command;
+
+        api_commands_statistics[i] = ep;
+        *last = ep;
+        last = &ep->next;
+    }
+}
+
+WEB_API_ENDPOINT *web_client_api_v1_endpoints(void) {
+    return api_endpoints_root;
+}
+
 inline int web_client_api_request_v1(RRDHOST *host, struct web_client *w, char *url) {
     static int initialized = 0;
     int i;
@@ -1152,8 +1483,16 @@ inline int web_client_api_request_v1(RRDHOST *host, struct web_client *w, char *
                 if(unlikely(api_commands[i].acl != WEB_CLIENT_ACL_NOCHECK) &&  !(w->acl & api_commands[i].acl))
                     return web_client_permission_denied(w);
 
+                w->api_endpoint = api_commands_statistics[i];
+
+                if(api_commands[i].executor && api_commands_executor[i] && web_executor_can_submit(w, host))
+                    return web_executor_submit(w, api_commands_executor[i], host, api_commands[i].callback, (w->decoded_query_string + 1));
+
                 //return api_commands[i].callback(host, w, url);
-                return api_commands[i].callback(host, w, (w->decoded_query_string + 1));
+                uint64_t points_read = rrdr_query_thread_points_read();
+                int ret = api_commands[i].callback(host, w, (w->decoded_query_string + 1));
+                w->stats_db_points_read += rrdr_query_thread_points_read() - points_read;
+                return ret;
             }
         }
 
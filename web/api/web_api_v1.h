@@ -8,6 +8,41 @@
 #include "web/api/formatters/rrd2json.h"
 #include "web/api/health/health_cmdapi.h"
 
+// ----------------------------------------------------------------------------
+// api statistics
+//
+// With "api statistics" enabled, every API v1 endpoint keeps histograms of its
+// response time, the size of its responses before and after compression and
+// the db points read by its queries. With "per chart api statistics" enabled,
+// the /api/v1/data queries of every chart are kept too. They are charted and
+// given by /api/v1/stats.
+
+typedef struct web_api_endpoint {
+    const char *name;
+
+    HISTOGRAM latency;                  // usec from the request to the response
+    HISTOGRAM bytes;                    // the size of the response
+    HISTOGRAM sent;                     // the size of the response after compression
+    HISTOGRAM points;                   // the db points read by its queries
+
+    HISTOGRAM latency_charted;          // the state of latency when last charted
+
+    struct web_api_endpoint *next;
+} WEB_API_ENDPOINT;
+
+extern int web_api_statistics;
+extern int web_api_chart_statistics;
+
+// the endpoints are added by web_client_api_v1_init() and never freed
+extern WEB_API_ENDPOINT *web_client_api_v1_endpoints(void);
+
+static inline void web_client_api_v1_endpoint_done(WEB_API_ENDPOINT *ep, usec_t latency, size_t bytes, size_t sent, size_t points) {
+    histogram_add(&ep->latency, latency);
+    histogram_add(&ep->bytes, bytes);
+    histogram_add(&ep->sent, sent);
+    histogram_add(&ep->points, points);
+}
+
 extern uint32_t web_client_api_request_v1_data_options(char *o);
 extern uint32_t web_client_api_request_v1_data_format(char *name);
 extern uint32_t web_client_api_request_v1_data_google_format(char *name);
@@ -18,6 +53,8 @@ extern int web_client_api_request_v1_alarm_log(RRDHOST *host, struct web_client
 extern int web_client_api_request_single_chart(RRDHOST *host, struct web_client *w, char *url, void callback(RRDSET *st, BUFFER *buf));
 extern int web_client_api_request_v1_alarm_variables(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_alarm_count(RRDHOST *host, struct web_client *w, char *url);
+extern int web_client_api_request_v1_latency(RRDHOST *host, struct web_client *w, char *url);
+extern int web_client_api_request_v1_stats(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_charts(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_archivedcharts(RRDHOST *host, struct web_client *w, char *url);
 extern int web_client_api_request_v1_chart(RRDHOST *host, struct web_client *w, char *url);
@@ -0,0 +1,592 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#define WEB_SERVER_INTERNALS 1
+#include "web_server.h"
+
+#ifdef ENABLE_HTTP2
+
+#include <nghttp2/nghttp2.h>
+
+/*
+ * The frames of an HTTP/2 connection are parsed and generated by nghttp2,
+ * which we feed with the bytes received on the socket of the connection and
+ * ask for the bytes to send on it, so that the socket I/O stays in the poll
+ * loop of the web server thread.
+ *
+ * When the headers of a request are complete, they are written as an HTTP/1.1
+ * request to the web client of its stream, which processes it. The response
+ * header it generates is converted to HTTP/2 header fields and its response
+ * data are given to nghttp2 as the body of the stream.
+ *
+ * The web client of a stream is owned by the query executor while its query
+ * runs: if the stream or the connection is closed in the meantime, it is
+ * released when the query completes.
+ */
+
+#define HTTP2_CLIENT_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_CLIENT_PREFACE_LENGTH (sizeof(HTTP2_CLIENT_PREFACE) - 1)
+#define HTTP2_SEND_BUFFER_SIZE 65536
+
+int web_enable_http2 = 1;
+static uint32_t http2_max_concurrent_streams = 256;
+static nghttp2_session_callbacks *http2_callbacks = NULL;
+
+struct http2_stream {
+    int32_t id;
+    struct http2_session *session;      // NULL when the stream was closed while its query runs
+    struct web_client *w;               // the web client processing the request of the stream
+
+    char method[16];
+    char *path;
+
+    struct http2_stream *prev;
+    struct http2_stream *next;
+};
+
+struct http2_session {
+    nghttp2_session *session;
+    struct web_client *w;               // the web client of the connection
+
+    BUFFER *out;                        // the frames to be sent
+    size_t out_sent;
+
+    struct http2_stream *streams;
+    int freeing;
+};
+
+// ----------------------------------------------------------------------------
+// streams
+
+static void http2_stream_free(struct http2_stream *st) {
+    struct web_client *w = st->w;
+
+    w->h2_stream = NULL;
+    web_client_release_request(w);
+
+    freez(st->path);
+    freez(st);
+}
+
+static void http2_stream_close(struct http2_session *s, struct http2_stream *st) {
+    if(st->next) st->next->prev = st->prev;
+    if(st->prev) st->prev->next = st->next;
+    else s->streams = st->next;
+    st->prev = st->next = NULL;
+
+    if(unlikely(web_client_flag_check(st->w, WEB_CLIENT_FLAG_EXECUTOR))) {
+        debug(D_WEB_CLIENT, "%llu: HTTP/2 stream %d will be freed when its query completes.", st->w->id, st->id);
+        st->session = NULL;
+        return;
+    }
+
+    http2_stream_free(st);
+}
+
+static ssize_t http2_stream_data_read(nghttp2_session *session, int32_t stream_id, uint8_t *buf, size_t length, uint32_t *data_flags, nghttp2_data_source *source, void *user_data) {
+    (void)session;
+    (void)stream_id;
+    (void)user_data;
+
+    struct web_client *w = ((struct http2_stream *)source->ptr)->w;
+
+    size_t left = w->response.data->len - w->response.sent;
+    if(length > left) length = left;
+
+    memcpy(buf, &w->response.data->buffer[w->response.sent], length);
+    w->response.sent += length;
+    w->stats_sent_bytes += length;
+
+    if(w->response.sent == w->response.data->len)
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+
+    return (ssize_t)length;
+}
+
+// files are read at once, the stream has no socket to poll them with - the ones that are
+// not in the cache of the web files are refused when they are bigger than a few pages
+static void http2_stream_read_file(struct web_client *w) {
+    int fd = w->ifd;
+    if(fd == -1 || fd == w->ofd)
+        return;
+
+    while(w->ifd == fd && w->response.data->len < w->response.rlen && web_client_read_file(w) > 0) ;
+
+    close(fd);
+    w->ifd = w->ofd;
+}
+
+static inline int http2_connection_specific_header(const char *name, size_t len) {
+    return (len == 10 && !strncmp(name, "connection", len))
+           || (len == 10 && !strncmp(name, "keep-alive", len))
+           || (len == 17 && !strncmp(name, "transfer-encoding", len))
+           || (len == 7 && !strncmp(name, "upgrade", len));
+}
+
+// submit the response the web client of the stream prepared
+static void http2_stream_respond(struct http2_stream *st) {
+    struct http2_session *s = st->session;
+    struct web_client *w = st->w;
+
+    if(unlikely(w->mode == WEB_CLIENT_MODE_FILECOPY))
+        http2_stream_read_file(w);
+
+    char *h = (char *)buffer_tostring(w->response.header_output);
+    if(unlikely(!*h || web_client_check_dead(w))) {
+        nghttp2_submit_rst_stream(s->session, NGHTTP2_FLAG_NONE, st->id, NGHTTP2_INTERNAL_ERROR);
+        return;
+    }
+
+    // convert the HTTP/1.1 response header to HTTP/2 header fields
+    size_t lines = 1;
+    char *s1;
+    for(s1 = h; *s1 ; s1++)
+        if(*s1 == '\n') lines++;
+
+    nghttp2_nv *nva = mallocz(lines * sizeof(nghttp2_nv));
+
+    char status[10];
+    snprintfz(status, 9, "%d", w->response.code);
+    nva[0].name = (uint8_t *)":status";
+    nva[0].namelen = 7;
+    nva[0].value = (uint8_t *)status;
+    nva[0].valuelen = strlen(status);
+    nva[0].flags = NGHTTP2_NV_FLAG_NONE;
+    size_t n = 1;
+
+    // skip the status line
+    s1 = strchr(h, '\n');
+    while(s1 && *++s1 && *s1 != '\r' && n < lines) {
+        char *name = s1;
+        s1 = strchr(name, '\n');
+        if(unlikely(!s1)) break;
+
+        char *colon = name;
+        while(colon < s1 && *colon != ':') colon++;
+        if(unlikely(colon == s1)) continue;
+
+        char *value = colon + 1;
+        while(*value == ' ') value++;
+
+        char *value_end = (s1[-1] == '\r') ? &s1[-1] : s1;
+        if(unlikely(value_end < value)) value_end = value;
+
+        // HTTP/2 header field names are lowercase
+        char *c;
+        for(c = name; c < colon ; c++)
+            *c = (char)tolower(*c);
+
+        if(unlikely(http2_connection_specific_header(name, (size_t)(colon - name))))
+            continue;
+
+        nva[n].name = (uint8_t *)name;
+        nva[n].namelen = (size_t)(colon - name);
+        nva[n].value = (uint8_t *)value;
+        nva[n].valuelen = (size_t)(value_end - value);
+        nva[n].flags = NGHTTP2_NV_FLAG_NONE;
+        n++;
+    }
+
+    nghttp2_data_provider data_provider;
+    data_provider.source.ptr = st;
+    data_provider.read_callback = http2_stream_data_read;
+
+    w->response.sent = 0;
+
+    int rc = nghttp2_submit_response(s->session, st->id, nva, n, w->response.data->len ? &data_provider : NULL);
+    if(unlikely(rc != 0)) {
+        error("%llu: Cannot submit the response of HTTP/2 stream %d: %s", w->id, st->id, nghttp2_strerror(rc));
+        nghttp2_submit_rst_stream(s->session, NGHTTP2_FLAG_NONE, st->id, NGHTTP2_INTERNAL_ERROR);
+    }
+
+    freez(nva);
+}
+
+// the request of the stream has been received
+static void http2_stream_request(struct http2_stream *st) {
+    struct http2_session *s = st->session;
+    struct web_client *w = st->w;
+
+    // the streaming protocol takes over the socket, it cannot run in a stream
+    if(unlikely(!st->method[0] || !st->path || !strcmp(st->method, "STREAM"))) {
+        nghttp2_submit_rst_stream(s->session, NGHTTP2_FLAG_NONE, st->id, NGHTTP2_REFUSED_STREAM);
+        return;
+    }
+
+    // the headers were collected in the response header buffer, that is unused until the response
+    BUFFER *request = w->response.data;
+    buffer_flush(request);
+    buffer_strcat(request, st->method);
+    buffer_strcat(request, " ");
+    buffer_strcat(request, st->path);
+    buffer_strcat(request, " HTTP/1.1\r\n");
+    buffer_strcat(request, buffer_tostring(w->response.header));
+    buffer_strcat(request, "\r\n");
+    buffer_flush(w->response.header);
+
+    w->stats_received_bytes += buffer_strlen(request);
+
+    web_client_process_request(w);
+
+    // the query executor will give the client back when its response is ready
+    if(web_client_flag_check(w, WEB_CLIENT_FLAG_EXECUTOR))
+        return;
+
+    http2_stream_respond(st);
+}
+
+// ----------------------------------------------------------------------------
+// nghttp2 callbacks
+
+static int http2_on_begin_headers(nghttp2_session *session, const nghttp2_frame *frame, void *user_data) {
+    struct http2_session *s = (struct http2_session *)user_data;
+
+    if(frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST)
+        return 0;
+
+    struct web_client *cw = s->w;
+    // the stream is not a connection, it is counted and logged as a request of its connection
+    struct web_client *w = web_client_get_from_cache_for_request();
+
+    w->ifd = w->ofd = -1;
+    strncpyz(w->client_ip,   cw->client_ip,   sizeof(w->client_ip) - 1);
+    strncpyz(w->client_port, cw->client_port, sizeof(w->client_port) - 1);
+    strncpyz(w->client_host, cw->client_host, sizeof(w->client_host) - 1);
+    w->port_acl = cw->port_acl;
+    w->acl = cw->acl;
+    w->origin[0] = '*'; w->origin[1] = '\0';
+    web_client_flag_set(w, WEB_CLIENT_FLAG_HTTP2_STREAM);
+
+    struct http2_stream *st = callocz(1, sizeof(struct http2_stream));
+    st->id = frame->hd.stream_id;
+    st->session = s;
+    st->w = w;
+    w->h2_stream = st;
+
+    st->next = s->streams;
+    if(s->streams) s->streams->prev = st;
+    s->streams = st;
+
+    nghttp2_session_set_stream_user_data(session, st->id, st);
+
+    debug(D_WEB_CLIENT, "%llu: HTTP/2 stream %d of connection %llu.", w->id, st->id, cw->id);
+    return 0;
+}
+
+static int http2_on_header(nghttp2_session *session, const nghttp2_frame *frame, const uint8_t *name, size_t namelen, const uint8_t *value, size_t valuelen, uint8_t flags, void *user_data) {
+    (void)flags;
+    (void)user_data;
+
+    if(frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST)
+        return 0;
+
+    struct http2_stream *st = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if(unlikely(!st))
+        return 0;
+
+    BUFFER *headers = st->w->response.header;
+    if(unlikely(buffer_strlen(headers) + namelen + valuelen > NETDATA_WEB_REQUEST_MAX_SIZE))
+        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+
+    // nghttp2 gives us null terminated names and values
+    const char *n = (const char *)name, *v = (const char *)value;
+
+    if(*n == ':') {
+        if(!strcmp(n, ":method"))
+            strncpyz(st->method, v, sizeof(st->method) - 1);
+
+        else if(!strcmp(n, ":path")) {
+            freez(st->path);
+            st->path = strdupz(v);
+        }
+        else if(!strcmp(n, ":authority")) {
+            buffer_strcat(headers, "Host: ");
+            buffer_strcat(headers, v);
+            buffer_strcat(headers, "\r\n");
+        }
+
+        return 0;
+    }
+
+    buffer_strcat(headers, n);
+    buffer_strcat(headers, ": ");
+    buffer_strcat(headers, v);
+    buffer_strcat(headers, "\r\n");
+    return 0;
+}
+
+static int http2_on_frame_recv(nghttp2_session *session, const nghttp2_frame *frame, void *user_data) {
+    (void)user_data;
+
+    if((frame->hd.type == NGHTTP2_HEADERS || frame->hd.type == NGHTTP2_DATA) && (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+        struct http2_stream *st = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+        if(likely(st))
+            http2_stream_request(st);
+    }
+
+    return 0;
+}
+
+static int http2_on_stream_close(nghttp2_session *session, int32_t stream_id, uint32_t error_code, void *user_data) {
+    (void)error_code;
+
+    struct http2_session *s = (struct http2_session *)user_data;
+    if(unlikely(s->freeing))
+        return 0;
+
+    struct http2_stream *st = nghttp2_session_get_stream_user_data(session, stream_id);
+    if(likely(st))
+        http2_stream_close(s, st);
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// connections
+
+static void http2_connection_update(struct http2_session *s) {
+    struct web_client *w = s->w;
+
+    if(nghttp2_session_want_read(s->session))
+        web_client_enable_wait_receive(w);
+    else
+        web_client_disable_wait_receive(w);
+
+    if(nghttp2_session_want_write(s->session) || s->out_sent < buffer_strlen(s->out))
+        web_client_enable_wait_send(w);
+    else
+        web_client_disable_wait_send(w);
+}
+
+static int http2_connection_start(struct web_client *w) {
+    struct http2_session *s = callocz(1, sizeof(struct http2_session));
+    s->w = w;
+
+    int rc = nghttp2_session_server_new(&s->session, http2_callbacks, s);
+    if(unlikely(rc != 0)) {
+        error("%llu: Cannot create an HTTP/2 session: %s", w->id, nghttp2_strerror(rc));
+        freez(s);
+        WEB_CLIENT_IS_DEAD(w);
+        return 1;
+    }
+
+    nghttp2_settings_entry settings[] = {
+        { .settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, .value = http2_max_concurrent_streams },
+    };
+    nghttp2_submit_settings(s->session, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(nghttp2_settings_entry));
+
+    s->out = buffer_create(HTTP2_SEND_BUFFER_SIZE);
+    w->h2 = s;
+
+    debug(D_WEB_CLIENT, "%llu: Switched to HTTP/2.", w->id);
+    return 1;
+}
+
+int http2_connection_detect(struct web_client *w) {
+    if(likely(w->h2))
+        return 1;
+
+    if(!web_enable_http2 || !http2_callbacks || w->header_parse_tries)
+        return 0;
+
+#ifdef ENABLE_HTTPS
+    if(w->ssl.conn && !w->ssl.flags) {
+        const unsigned char *alpn = NULL;
+        unsigned int alpn_length = 0;
+
+        SSL_get0_alpn_selected(w->ssl.conn, &alpn, &alpn_length);
+        if(alpn_length == 2 && !memcmp(alpn, "h2", 2))
+            return http2_connection_start(w);
+
+        return 0;
+    }
+
+    // the clients that are redirected to TLS speak HTTP/1.1 until then
+    if(netdata_srv_ctx && w->ssl.conn && (w->ssl.flags & NETDATA_SSL_NO_HANDSHAKE) &&
+       (web_client_is_using_ssl_force(w) || web_client_is_using_ssl_default(w)))
+        return 0;
+#endif
+
+    size_t len = w->response.data->len;
+    if(len > HTTP2_CLIENT_PREFACE_LENGTH)
+        len = HTTP2_CLIENT_PREFACE_LENGTH;
+
+    if(!len || memcmp(w->response.data->buffer, HTTP2_CLIENT_PREFACE, len) != 0)
+        return 0;
+
+    if(len < HTTP2_CLIENT_PREFACE_LENGTH)
+        return -1;
+
+    return http2_connection_start(w);
+}
+
+void http2_connection_receive(struct web_client *w) {
+    struct http2_session *s = w->h2;
+    if(unlikely(!s))
+        return;
+
+    for(;;) {
+        ssize_t ret = nghttp2_session_mem_recv(s->session, (const uint8_t *)w->response.data->buffer, w->response.data->len);
+        buffer_flush(w->response.data);
+
+        if(unlikely(ret < 0)) {
+            info("%llu: HTTP/2 session of %s port %s failed: %s", w->id, w->client_ip, w->client_port, nghttp2_strerror((int)ret));
+            WEB_CLIENT_IS_DEAD(w);
+            return;
+        }
+
+#ifdef ENABLE_HTTPS
+        // TLS may have decrypted more than we have read, the socket will not tell us about it
+        if(w->ssl.conn && !w->ssl.flags && SSL_pending(w->ssl.conn) > 0 && web_client_receive(w) > 0)
+            continue;
+#endif
+
+        break;
+    }
+
+    http2_connection_update(s);
+}
+
+static inline int http2_connection_would_block(struct web_client *w, ssize_t bytes) {
+#ifdef ENABLE_HTTPS
+    if(w->ssl.conn && !w->ssl.flags) {
+        int err = SSL_get_error(w->ssl.conn, (int)bytes);
+        return (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ);
+    }
+#endif
+
+    return (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+ssize_t http2_connection_send(struct web_client *w) {
+    struct http2_session *s = w->h2;
+    if(unlikely(!s))
+        return -1;
+
+    ssize_t total = 0;
+
+    for(;;) {
+        if(s->out_sent == s->out->len) {
+            // all sent, collect the next frames
+            buffer_flush(s->out);
+            s->out_sent = 0;
+
+            while(s->out->len < HTTP2_SEND_BUFFER_SIZE) {
+                const uint8_t *data;
+                ssize_t len = nghttp2_session_mem_send(s->session, &data);
+
+                if(unlikely(len < 0)) {
+                    error("%llu: Cannot prepare the HTTP/2 frames to send: %s", w->id, nghttp2_strerror((int)len));
+                    WEB_CLIENT_IS_DEAD(w);
+                    return -1;
+                }
+
+                if(!len)
+                    break;
+
+                buffer_need_bytes(s->out, (size_t)len + 1);
+                memcpy(&s->out->buffer[s->out->len], data, (size_t)len);
+                s->out->len += len;
+            }
+
+            if(!s->out->len)
+                break;
+        }
+
+        // retries have to send the same bytes, for TLS
+        ssize_t bytes = web_client_send_data(w, &s->out->buffer[s->out_sent], s->out->len - s->out_sent, MSG_DONTWAIT);
+        if(likely(bytes > 0)) {
+            s->out_sent += bytes;
+            total += bytes;
+            continue;
+        }
+
+        if(http2_connection_would_block(w, bytes))
+            break;
+
+        debug(D_WEB_CLIENT, "%llu: Failed to send HTTP/2 frames to client.", w->id);
+        WEB_CLIENT_IS_DEAD(w);
+        return -1;
+    }
+
+    http2_connection_update(s);
+    return total;
+}
+
+void http2_connection_free(struct web_client *w) {
+    struct http2_session *s = w->h2;
+    if(!s)
+        return;
+
+    // the streams are freed by us, not by nghttp2
+    s->freeing = 1;
+    while(s->streams)
+        http2_stream_close(s, s->streams);
+
+    nghttp2_session_del(s->session);
+    buffer_free(s->out);
+    freez(s);
+    w->h2 = NULL;
+}
+
+struct web_client *http2_stream_executor_done(struct web_client *w) {
+    struct http2_stream *st = w->h2_stream;
+
+    if(unlikely(!st->session)) {
+        debug(D_WEB_CLIENT, "%llu: HTTP/2 STREAM CLOSED WHILE ITS QUERY WAS RUNNING", w->id);
+        http2_stream_free(st);
+        return NULL;
+    }
+
+    web_client_process_request_done(w);
+    http2_stream_respond(st);
+
+    struct http2_session *s = st->session;
+    http2_connection_update(s);
+    return s->w;
+}
+
+// ----------------------------------------------------------------------------
+// initialization
+
+#ifdef ENABLE_HTTPS
+// prefer h2 when the client offers it
+static int http2_alpn_select(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *arg) {
+    static const unsigned char protocols[] = { 2, 'h', '2', 8, 'h', 't', 't', 'p', '/', '1', '.', '1' };
+    (void)ssl;
+    (void)arg;
+
+    if(SSL_select_next_proto((unsigned char **)out, outlen, protocols, sizeof(protocols), in, inlen) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+
+    return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
+void http2_init(void) {
+    web_enable_http2 = config_get_boolean(CONFIG_SECTION_WEB, "enable http2", web_enable_http2);
+
+    long long streams = config_get_number(CONFIG_SECTION_WEB, "http2 max concurrent streams", http2_max_concurrent_streams);
+    if(streams < 1) streams = 1;
+    http2_max_concurrent_streams = (uint32_t)streams;
+
+    if(!web_enable_http2)
+        return;
+
+    if(nghttp2_session_callbacks_new(&http2_callbacks) != 0) {
+        error("Cannot initialize HTTP/2, the web server will speak HTTP/1.1 only.");
+        http2_callbacks = NULL;
+        return;
+    }
+
+    nghttp2_session_callbacks_set_on_begin_headers_callback(http2_callbacks, http2_on_begin_headers);
+    nghttp2_session_callbacks_set_on_header_callback(http2_callbacks, http2_on_header);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(http2_callbacks, http2_on_frame_recv);
+    nghttp2_session_callbacks_set_on_stream_close_callback(http2_callbacks, http2_on_stream_close);
+
+#ifdef ENABLE_HTTPS
+    if(netdata_srv_ctx)
+        SSL_CTX_set_alpn_select_cb(netdata_srv_ctx, http2_alpn_select, NULL);
+#endif
+}
+
+#endif // ENABLE_HTTP2
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_WEB_HTTP2_H
+#define NETDATA_WEB_HTTP2_H 1
+
+#include "web_client.h"
+
+#ifdef ENABLE_HTTP2
+
+// ----------------------------------------------------------------------------
+// HTTP/2
+//
+// A connection negotiating h2 with ALPN on TLS, or starting with the HTTP/2
+// preface in clear text (prior knowledge), multiplexes its requests in
+// streams. Each stream gets a web client without a socket, that processes
+// its request as if it was received with HTTP/1.1, so that the API, the
+// files and the query executor are shared by both protocols.
+
+extern int web_enable_http2;
+
+extern void http2_init(void);
+
+// returns 1 when the connection speaks HTTP/2, 0 when it speaks HTTP/1.x
+// and -1 when more bytes are needed to tell
+extern int http2_connection_detect(struct web_client *w);
+
+// process the frames received in w->response.data and set the wait flags of the connection
+extern void http2_connection_receive(struct web_client *w);
+
+// send the pending frames, until the socket would block
+extern ssize_t http2_connection_send(struct web_client *w);
+
+// the connection is closed, release its streams
+extern void http2_connection_free(struct web_client *w);
+
+// the query of a stream has been run by the query executor, returns the
+// connection to send its response, or NULL when the stream has been closed
+extern struct web_client *http2_stream_executor_done(struct web_client *w);
+
+#endif // ENABLE_HTTP2
+
+#endif //NETDATA_WEB_HTTP2_H
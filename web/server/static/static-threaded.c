@@ -45,10 +45,19 @@ struct web_server_static_threaded_worker {
     volatile size_t disconnected;
     volatile size_t receptions;
     volatile size_t sends;
+    volatile size_t requests;
     volatile size_t max_concurrent;
 
     volatile size_t files_read;
     volatile size_t file_reads;
+
+    // the clients whose queries have been run by the query executor
+    int executor_registered;
+    int executor_pipe[2];
+    netdata_mutex_t executor_mutex;
+    struct web_client **executor_completed;
+    size_t executor_completed_used;
+    size_t executor_completed_size;
 };
 
 static long long static_threaded_workers_count = 1;
@@ -65,6 +74,17 @@ static inline int web_server_check_client_status(struct web_client *w) {
     return 0;
 }
 
+// poll the socket of the client for what it waits for
+static inline int web_server_client_events(POLLINFO *pi, struct web_client *w, short int *events) {
+    if(unlikely(w->ifd == pi->fd && web_client_has_wait_receive(w)))
+        *events |= POLLIN;
+
+    if(unlikely(w->ofd == pi->fd && web_client_has_wait_send(w)))
+        *events |= POLLOUT;
+
+    return web_server_check_client_status(w);
+}
+
 // ----------------------------------------------------------------------------
 // web server files
 
@@ -117,6 +137,7 @@ static int web_server_file_read_callback(POLLINFO *pi, short int *events) {
 
         debug(D_WEB_CLIENT, "%llu: SIGNALING W TO SEND (iFD %d, oFD %d)", w->id, pi->fd, wpi->fd);
         p->fds[wpi->slot].events |= POLLOUT;
+        poll_update_events(wpi);
     }
 
     if(unlikely(ret <= 0 || w->ifd == w->ofd)) {
@@ -137,6 +158,145 @@ static int web_server_file_write_callback(POLLINFO *pi, short int *events) {
     return -1;
 }
 
+// ----------------------------------------------------------------------------
+// web server query executor completions
+
+// called by the query executor threads
+static void web_server_executor_done(struct web_client *w, void *data) {
+    struct web_server_static_threaded_worker *worker = (struct web_server_static_threaded_worker *)data;
+
+    netdata_mutex_lock(&worker->executor_mutex);
+    if(worker->executor_completed_used == worker->executor_completed_size) {
+        worker->executor_completed_size = worker->executor_completed_size ? worker->executor_completed_size * 2 : 16;
+        worker->executor_completed = reallocz(worker->executor_completed, worker->executor_completed_size * sizeof(struct web_client *));
+    }
+    worker->executor_completed[worker->executor_completed_used++] = w;
+    netdata_mutex_unlock(&worker->executor_mutex);
+
+    // the pipe may be full of earlier notifications, it is enough that it is not empty
+    char c = 1;
+    if(write(worker->executor_pipe[PIPE_WRITE], &c, 1) == -1 && errno != EAGAIN)
+        error("Cannot notify web server thread %d of a completed query", worker->id + 1);
+}
+
+static void *web_server_executor_add_callback(POLLINFO *pi, short int *events, void *data) {
+    *events = POLLIN;
+    pi->data = data;
+    return data;
+}
+
+static void web_server_executor_del_callback(POLLINFO *pi) {
+    (void)pi;
+}
+
+// poll the socket of a client given back by the query executor
+static void web_server_executor_poll_client(POLLJOB *p, struct web_client *w) {
+    POLLINFO *wpi = pollinfo_from_slot(p, w->pollinfo_slot);
+    if(unlikely(web_server_check_client_status(w) == -1)) {
+        poll_close_fd(wpi);
+        return;
+    }
+
+    short int wevents = 0;
+    if(w->ifd == wpi->fd && web_client_has_wait_receive(w))
+        wevents |= POLLIN;
+
+    if(w->ofd == wpi->fd && web_client_has_wait_send(w))
+        wevents |= POLLOUT;
+
+    p->fds[wpi->slot].events = wevents;
+    poll_update_events(wpi);
+}
+
+static int web_server_executor_rcv_callback(POLLINFO *pi, short int *events) {
+    POLLJOB *p = pi->p;
+    int fd = pi->fd;
+
+    char buf[256];
+    while(read(fd, buf, sizeof(buf)) > 0) ;
+
+    netdata_mutex_lock(&worker_private->executor_mutex);
+    size_t used = worker_private->executor_completed_used;
+    struct web_client **completed = worker_private->executor_completed;
+    worker_private->executor_completed = NULL;
+    worker_private->executor_completed_used = 0;
+    worker_private->executor_completed_size = 0;
+    netdata_mutex_unlock(&worker_private->executor_mutex);
+
+    size_t i;
+    for(i = 0; i < used ; i++) {
+        struct web_client *w = completed[i];
+        web_client_flag_clear(w, WEB_CLIENT_FLAG_EXECUTOR);
+
+#ifdef ENABLE_HTTP2
+        // the response of an HTTP/2 stream is sent by its connection
+        if(unlikely(web_client_flag_check(w, WEB_CLIENT_FLAG_HTTP2_STREAM))) {
+            w = http2_stream_executor_done(w);
+            if(likely(w))
+                web_server_executor_poll_client(p, w);
+            continue;
+        }
+#endif
+
+        if(unlikely(!w->pollinfo_slot)) {
+            debug(D_WEB_CLIENT, "%llu: CLIENT DISCONNECTED WHILE ITS QUERY WAS RUNNING", w->id);
+            web_client_release(w);
+            continue;
+        }
+
+        web_client_process_request_done(w);
+        web_server_executor_poll_client(p, w);
+    }
+    freez(completed);
+
+    *events = POLLIN;
+    return 0;
+}
+
+static int web_server_executor_snd_callback(POLLINFO *pi, short int *events) {
+    (void)pi;
+    *events = POLLIN;
+    return 0;
+}
+
+// add the notification pipe to our poll loop, the first time we receive a request
+static void web_server_executor_register(POLLJOB *p) {
+    if(pipe(worker_private->executor_pipe) == -1) {
+        error("Cannot create the query executor pipe of web server thread %d", worker_private->id + 1);
+        worker_private->executor_pipe[PIPE_READ] = worker_private->executor_pipe[PIPE_WRITE] = -1;
+        return;
+    }
+
+    sock_setnonblock(worker_private->executor_pipe[PIPE_READ]);
+    sock_setnonblock(worker_private->executor_pipe[PIPE_WRITE]);
+
+    POLLINFO *epi = poll_add_fd(
+            p
+            , worker_private->executor_pipe[PIPE_READ]
+            , 0
+            , 0
+            , POLLINFO_FLAG_CLIENT_SOCKET | POLLINFO_FLAG_DONT_TIMEOUT
+            , "EXECUTOR"
+            , ""
+            , ""
+            , web_server_executor_add_callback
+            , web_server_executor_del_callback
+            , web_server_executor_rcv_callback
+            , web_server_executor_snd_callback
+            , (void *)worker_private
+    );
+
+    if(!epi) {
+        error("Cannot add the query executor pipe of web server thread %d to its poll loop", worker_private->id + 1);
+        close(worker_private->executor_pipe[PIPE_READ]);
+        close(worker_private->executor_pipe[PIPE_WRITE]);
+        worker_private->executor_pipe[PIPE_READ] = worker_private->executor_pipe[PIPE_WRITE] = -1;
+        return;
+    }
+
+    web_executor_register_thread(web_server_executor_done, worker_private);
+}
+
 // ----------------------------------------------------------------------------
 // web server clients
 
@@ -227,12 +387,21 @@ static void web_server_del_callback(POLLINFO *pi) {
     struct web_client *w = (struct web_client *)pi->data;
 
     w->pollinfo_slot = 0;
+
+#ifdef ENABLE_HTTP2
+    if(unlikely(w->h2))
+        http2_connection_free(w);
+#endif
+
     if(unlikely(w->pollinfo_filecopy_slot)) {
         POLLINFO *fpi = pollinfo_from_slot(pi->p, w->pollinfo_filecopy_slot);  // POLLINFO of the client socket
         (void)fpi;
 
         debug(D_WEB_CLIENT, "%llu: THE CLIENT WILL BE FRED BY READING FILE JOB ON FD %d", w->id, fpi->fd);
     }
+    else if(unlikely(web_client_flag_check(w, WEB_CLIENT_FLAG_EXECUTOR))) {
+        debug(D_WEB_CLIENT, "%llu: THE CLIENT WILL BE FREED WHEN ITS QUERY COMPLETES", w->id);
+    }
     else {
         if(web_client_flag_check(w, WEB_CLIENT_FLAG_DONT_CLOSE_SOCKET))
             pi->flags |= POLLINFO_FLAG_DONT_CLOSE;
@@ -242,18 +411,18 @@ static void web_server_del_callback(POLLINFO *pi) {
     }
 }
 
-static int web_server_rcv_callback(POLLINFO *pi, short int *events) {
-    worker_private->receptions++;
-
-    struct web_client *w = (struct web_client *)pi->data;
+// process the request received, or pipelined, on the socket of the client
+static int web_server_process_request(POLLINFO *pi, struct web_client *w, short int *events) {
     int fd = pi->fd;
 
-    if(unlikely(web_client_receive(w) < 0))
-        return -1;
-
     debug(D_WEB_CLIENT, "%llu: processing received data on fd %d.", w->id, fd);
+    worker_private->requests++;
     web_client_process_request(w);
 
+    // the query executor will give the client back when its response is ready
+    if(unlikely(web_client_flag_check(w, WEB_CLIENT_FLAG_EXECUTOR)))
+        return 0;
+
     if(unlikely(w->mode == WEB_CLIENT_MODE_FILECOPY)) {
         if(w->pollinfo_filecopy_slot == 0) {
             debug(D_WEB_CLIENT, "%llu: FILECOPY DETECTED ON FD %d", w->id, pi->fd);
@@ -298,34 +467,77 @@ static int web_server_rcv_callback(POLLINFO *pi, short int *events) {
     return web_server_check_client_status(w);
 }
 
+static int web_server_rcv_callback(POLLINFO *pi, short int *events) {
+    worker_private->receptions++;
+
+    if(unlikely(!worker_private->executor_registered)) {
+        // adding a slot may move the slots in memory
+        size_t slot = pi->slot;
+        POLLJOB *p = pi->p;
+        worker_private->executor_registered = 1;
+        web_server_executor_register(p);
+        pi = pollinfo_from_slot(p, slot);
+    }
+
+    struct web_client *w = (struct web_client *)pi->data;
+
+    if(unlikely(web_client_receive(w) < 0))
+        return -1;
+
+#ifdef ENABLE_HTTP2
+    switch(http2_connection_detect(w)) {
+        case 1:
+            http2_connection_receive(w);
+            return web_server_client_events(pi, w, events);
+
+        case -1:
+            // wait for the rest of the HTTP/2 preface
+            *events |= POLLIN;
+            return 0;
+    }
+#endif
+
+    return web_server_process_request(pi, w, events);
+}
+
 static int web_server_snd_callback(POLLINFO *pi, short int *events) {
     worker_private->sends++;
 
     struct web_client *w = (struct web_client *)pi->data;
-    int fd = pi->fd;
 
-    debug(D_WEB_CLIENT, "%llu: sending data on fd %d.", w->id, fd);
+    debug(D_WEB_CLIENT, "%llu: sending data on fd %d.", w->id, pi->fd);
+
+#ifdef ENABLE_HTTP2
+    if(unlikely(w->h2)) {
+        if(unlikely(http2_connection_send(w) < 0))
+            return -1;
+
+        return web_server_client_events(pi, w, events);
+    }
+#endif
 
     if(unlikely(web_client_send(w) < 0))
         return -1;
 
-    if(unlikely(w->ifd == fd && web_client_has_wait_receive(w)))
-        *events |= POLLIN;
+    // the next request has been received with the one we just served
+    if(unlikely(web_client_flag_check(w, WEB_CLIENT_FLAG_PIPELINED) && !web_client_check_dead(w)))
+        return web_server_process_request(pi, w, events);
 
-    if(unlikely(w->ofd == fd && web_client_has_wait_send(w)))
-        *events |= POLLOUT;
-
-    return web_server_check_client_status(w);
+    return web_server_client_events(pi, w, events);
 }
 
 static void web_server_tmr_callback(void *timer_data) {
     worker_private = (struct web_server_static_threaded_worker *)timer_data;
 
-    static __thread RRDSET *st = NULL;
-    static __thread RRDDIM *rd_user = NULL, *rd_system = NULL;
+    static __thread RRDSET *st = NULL, *st_requests = NULL;
+    static __thread RRDDIM *rd_user = NULL, *rd_system = NULL, *rd_connections = NULL, *rd_requests = NULL;
 
     if(unlikely(netdata_exit)) return;
 
+    // the first thread gives back to the system the idle buffers of the pool
+    if(worker_private->id == 0)
+        web_buffer_pool_trim();
+
     if(unlikely(!st)) {
         char id[100 + 1];
         char title[100 + 1];
@@ -356,9 +568,55 @@ static void web_server_tmr_callback(void *timer_data) {
 
     struct rusage rusage;
     getrusage(RUSAGE_THREAD, &rusage);
-    rrddim_set_by_pointer(st, rd_user, rusage.ru_utime.tv_sec * 1000000ULL + rusage.ru_utime.tv_usec);
-    rrddim_set_by_pointer(st, rd_system, rusage.ru_stime.tv_sec * 1000000ULL + rusage.ru_stime.tv_usec);
+    usec_t user = rusage.ru_utime.tv_sec * 1000000ULL + rusage.ru_utime.tv_usec;
+    usec_t system = rusage.ru_stime.tv_sec * 1000000ULL + rusage.ru_stime.tv_usec;
+    rrddim_set_by_pointer(st, rd_user, user);
+    rrddim_set_by_pointer(st, rd_system, system);
     rrdset_done(st);
+
+    // the connections accepted and the requests received by this thread,
+    // to check how evenly they are spread among the threads
+    if(unlikely(!st_requests)) {
+        char id[100 + 1];
+        char title[100 + 1];
+
+        snprintfz(id, 100, "web_thread%d_requests", worker_private->id + 1);
+        snprintfz(title, 100, "Netdata web server thread No %d connections and requests", worker_private->id + 1);
+
+        st_requests = rrdset_create_localhost(
+                "netdata"
+                , id
+                , NULL
+                , "web"
+                , "netdata.web_requests"
+                , title
+                , "events/s"
+                , "web"
+                , "stats"
+                , 132050 + worker_private->id
+                , default_rrd_update_every
+                , RRDSET_TYPE_LINE
+        );
+
+        rd_connections = rrddim_add(st_requests, "connections", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+        rd_requests    = rrddim_add(st_requests, "requests", NULL, 1, 1, RRD_ALGORITHM_INCREMENTAL);
+    }
+    else
+        rrdset_next(st_requests);
+
+    rrddim_set_by_pointer(st_requests, rd_connections, (collected_number)worker_private->connected);
+    rrddim_set_by_pointer(st_requests, rd_requests, (collected_number)worker_private->requests);
+    rrdset_done(st_requests);
+
+#ifdef NETDATA_WITH_ZLIB
+    // the CPU utilization of the thread since the last run, to adapt the compression level to it
+    static __thread usec_t last_cpu = 0, last_ut = 0;
+    usec_t now_ut = now_monotonic_usec();
+    if(likely(last_ut && now_ut > last_ut))
+        web_client_set_thread_cpu_load((int)((user + system - last_cpu) * 100 / (now_ut - last_ut)));
+    last_cpu = user + system;
+    last_ut = now_ut;
+#endif
 }
 
 // ----------------------------------------------------------------------------
@@ -367,13 +625,23 @@ static void web_server_tmr_callback(void *timer_data) {
 static void socket_listen_main_static_threaded_worker_cleanup(void *ptr) {
     worker_private = (struct web_server_static_threaded_worker *)ptr;
 
+    // the clients in the query executor are freed with the cache below, and they notify the pipe
+    web_executor_unregister_thread();
+    if(worker_private->executor_registered && worker_private->executor_pipe[PIPE_WRITE] != -1)
+        close(worker_private->executor_pipe[PIPE_WRITE]);
+
+    freez(worker_private->executor_completed);
+    worker_private->executor_completed = NULL;
+    worker_private->executor_completed_used = worker_private->executor_completed_size = 0;
+
     info("freeing local web clients cache...");
     web_client_cache_destroy();
 
-    info("stopped after %zu connects, %zu disconnects (max concurrent %zu), %zu receptions and %zu sends",
+    info("stopped after %zu connects, %zu disconnects (max concurrent %zu), %zu requests, %zu receptions and %zu sends",
             worker_private->connected,
             worker_private->disconnected,
             worker_private->max_concurrent,
+            worker_private->requests,
             worker_private->receptions,
             worker_private->sends
     );
@@ -387,7 +655,7 @@ void *socket_listen_main_static_threaded_worker(void *ptr) {
 
     netdata_thread_cleanup_push(socket_listen_main_static_threaded_worker_cleanup, ptr);
 
-            poll_events(&api_sockets
+            poll_events(api_thread_listen_sockets(worker_private->id)
                         , web_server_add_callback
                         , web_server_del_callback
                         , web_server_rcv_callback
@@ -415,6 +683,9 @@ static void socket_listen_main_static_threaded_cleanup(void *ptr) {
     struct netdata_static_thread *static_thread = (struct netdata_static_thread *)ptr;
     static_thread->enabled = NETDATA_MAIN_THREAD_EXITING;
 
+    info("stopping the query executor...");
+    web_executor_stop();
+
     int i, found = 0;
     usec_t max = 2 * USEC_PER_SEC, step = 50000;
 
@@ -446,22 +717,21 @@ static void socket_listen_main_static_threaded_cleanup(void *ptr) {
         error("%d static web threads are taking too long to finish. Giving up.", found);
 
     info("closing all web server sockets...");
-    listen_sockets_close(&api_sockets);
+    api_listen_sockets_close();
 
     info("all static web threads stopped.");
     static_thread->enabled = NETDATA_MAIN_THREAD_EXITED;
 }
 
-void *socket_listen_main_static_threaded(void *ptr) {
-    netdata_thread_cleanup_push(socket_listen_main_static_threaded_cleanup, ptr);
-    web_server_mode = WEB_SERVER_MODE_STATIC_THREADED;
+// the number of web server threads, from the configuration
+// it is also called when the listening sockets are opened, before the threads are started
+long long static_threaded_workers_setup(void) {
+    static int configured = 0;
+    if(configured)
+        return static_threaded_workers_count;
 
-    if(!api_sockets.opened)
-        fatal("LISTENER: no listen sockets available.");
+    configured = 1;
 
-#ifdef ENABLE_HTTPS
-    security_start_ssl(NETDATA_SSL_CONTEXT_SERVER);
-#endif
     // 6 threads is the optimal value
     // since 6 are the parallel connections browsers will do
     // so, if the machine has more CPUs, avoid using resources unnecessarily
@@ -483,6 +753,27 @@ void *socket_listen_main_static_threaded(void *ptr) {
     }
 #endif
 
+    return static_threaded_workers_count;
+}
+
+void *socket_listen_main_static_threaded(void *ptr) {
+    netdata_thread_cleanup_push(socket_listen_main_static_threaded_cleanup, ptr);
+    web_server_mode = WEB_SERVER_MODE_STATIC_THREADED;
+
+    if(!api_sockets.opened)
+        fatal("LISTENER: no listen sockets available.");
+
+#ifdef ENABLE_HTTPS
+    security_start_ssl(NETDATA_SSL_CONTEXT_SERVER);
+#endif
+#ifdef ENABLE_HTTP2
+    http2_init();
+#endif
+    web_file_cache_init();
+    web_buffer_pool_init();
+
+    static_threaded_workers_setup();
+
     size_t max_sockets = (size_t)config_get_number(CONFIG_SECTION_WEB, "web server max sockets",
                                                    (long long int)(rlimit_nofile.rlim_cur / 4));
 
@@ -492,6 +783,11 @@ void *socket_listen_main_static_threaded(void *ptr) {
     web_server_is_multithreaded = (static_threaded_workers_count > 1);
 
     int i;
+    for (i = 0; i < static_threaded_workers_count; i++)
+        netdata_mutex_init(&static_workers_private_data[i].executor_mutex);
+
+    web_executor_start();
+
     for (i = 1; i < static_threaded_workers_count; i++) {
         static_workers_private_data[i].id = i;
         static_workers_private_data[i].max_sockets = max_sockets / static_threaded_workers_count;
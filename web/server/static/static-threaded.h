@@ -6,5 +6,6 @@
 #include "web/server/web_server.h"
 
 extern void *socket_listen_main_static_threaded(void *ptr);
+extern long long static_threaded_workers_setup(void);
 
 #endif //NETDATA_WEB_SERVER_STATIC_THREADED_H
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "web_server.h"
+
+// the buffers of each class are kept in a stack: the most recently returned
+// ones are given first, and the ones at the bottom are the idle ones to trim
+
+#define WEB_BUFFER_POOL_CLASS_ENTRIES 64
+
+struct web_buffer_pool_entry {
+    BUFFER *wb;
+    time_t returned_t;
+};
+
+struct web_buffer_pool_class {
+    size_t size;
+    size_t used;
+    struct web_buffer_pool_entry entries[WEB_BUFFER_POOL_CLASS_ENTRIES];
+};
+
+static struct web_buffer_pool {
+    netdata_mutex_t mutex;
+    int enabled;
+    time_t idle_seconds;
+
+    struct web_buffer_pool_class classes[WEB_BUFFER_POOL_CLASSES];
+
+    WEB_BUFFER_POOL_STATISTICS stats;
+} pool = {
+    .mutex = NETDATA_MUTEX_INITIALIZER,
+    .enabled = 0,
+    .idle_seconds = 60,
+    .classes = {
+        { .size =       64 * 1024 },
+        { .size =      256 * 1024 },
+        { .size =     1024 * 1024 },
+        { .size =  4 * 1024 * 1024 },
+        { .size = 16 * 1024 * 1024 },
+    },
+    .stats = {
+        .max_bytes = 32 * 1024 * 1024,
+    },
+};
+
+#define web_buffer_memory_size(wb) (sizeof(BUFFER) + (wb)->size)
+
+BUFFER *web_buffer_pool_get(size_t size) {
+    size_t c;
+    for(c = 0; c < WEB_BUFFER_POOL_CLASSES && pool.classes[c].size < size ; c++) ;
+
+    // larger than the largest class
+    if(unlikely(c == WEB_BUFFER_POOL_CLASSES)) {
+        netdata_mutex_lock(&pool.mutex);
+        pool.stats.misses++;
+        netdata_mutex_unlock(&pool.mutex);
+        return buffer_create(size);
+    }
+
+    struct web_buffer_pool_class *pc = &pool.classes[c];
+    BUFFER *wb = NULL;
+
+    netdata_mutex_lock(&pool.mutex);
+    if(pc->used) {
+        wb = pc->entries[--pc->used].wb;
+        pool.stats.buffers--;
+        pool.stats.bytes -= wb->size;
+        pool.stats.hits++;
+    }
+    else
+        pool.stats.misses++;
+    netdata_mutex_unlock(&pool.mutex);
+
+    if(wb) {
+        memory_accounting_free(MEMORY_ACCOUNTING_WEB, web_buffer_memory_size(wb));
+        buffer_reset(wb);
+        return wb;
+    }
+
+    return buffer_create(pc->size);
+}
+
+void web_buffer_pool_put(BUFFER *wb) {
+    if(unlikely(!wb))
+        return;
+
+    // too small to pool, or so large that it is not worth keeping
+    if(!pool.enabled || wb->size < pool.classes[0].size || wb->size >= 4 * pool.classes[WEB_BUFFER_POOL_CLASSES - 1].size) {
+        buffer_free(wb);
+        return;
+    }
+
+    size_t c;
+    for(c = WEB_BUFFER_POOL_CLASSES - 1; pool.classes[c].size > wb->size ; c--) ;
+
+    struct web_buffer_pool_class *pc = &pool.classes[c];
+    int kept = 0;
+
+    netdata_mutex_lock(&pool.mutex);
+    if(pc->used < WEB_BUFFER_POOL_CLASS_ENTRIES && pool.stats.bytes + wb->size <= pool.stats.max_bytes) {
+        pc->entries[pc->used].wb = wb;
+        pc->entries[pc->used].returned_t = now_monotonic_sec();
+        pc->used++;
+        pool.stats.buffers++;
+        pool.stats.bytes += wb->size;
+        pool.stats.returned++;
+        kept = 1;
+    }
+    else
+        pool.stats.dropped++;
+    netdata_mutex_unlock(&pool.mutex);
+
+    if(kept)
+        memory_accounting_alloc(MEMORY_ACCOUNTING_WEB, web_buffer_memory_size(wb));
+    else
+        buffer_free(wb);
+}
+
+void web_buffer_pool_trim(void) {
+    if(!pool.enabled)
+        return;
+
+    BUFFER *trimmed[WEB_BUFFER_POOL_CLASS_ENTRIES];
+    time_t expired_t = now_monotonic_sec() - pool.idle_seconds;
+    size_t c;
+
+    for(c = 0; c < WEB_BUFFER_POOL_CLASSES ; c++) {
+        struct web_buffer_pool_class *pc = &pool.classes[c];
+        size_t i, count = 0;
+
+        netdata_mutex_lock(&pool.mutex);
+        while(count < pc->used && pc->entries[count].returned_t < expired_t) {
+            trimmed[count] = pc->entries[count].wb;
+            pool.stats.buffers--;
+            pool.stats.bytes -= trimmed[count]->size;
+            count++;
+        }
+
+        if(count) {
+            memmove(&pc->entries[0], &pc->entries[count], (pc->used - count) * sizeof(struct web_buffer_pool_entry));
+            pc->used -= count;
+            pool.stats.trimmed += count;
+        }
+        netdata_mutex_unlock(&pool.mutex);
+
+        for(i = 0; i < count ; i++) {
+            memory_accounting_free(MEMORY_ACCOUNTING_WEB, web_buffer_memory_size(trimmed[i]));
+            buffer_free(trimmed[i]);
+        }
+    }
+}
+
+void web_buffer_pool_get_statistics(WEB_BUFFER_POOL_STATISTICS *stats) {
+    netdata_mutex_lock(&pool.mutex);
+    *stats = pool.stats;
+    netdata_mutex_unlock(&pool.mutex);
+}
+
+void web_buffer_pool_init(void) {
+    long long mb = config_get_number(CONFIG_SECTION_WEB, "web buffers pool size MB", (long long)(pool.stats.max_bytes / 1024 / 1024));
+    if(mb < 1)
+        return;
+
+    long long idle = config_get_number(CONFIG_SECTION_WEB, "web buffers pool idle seconds", (long long)pool.idle_seconds);
+    if(idle < 1) idle = 1;
+
+    netdata_mutex_lock(&pool.mutex);
+    pool.stats.max_bytes = (size_t)mb * 1024 * 1024;
+    pool.idle_seconds = (time_t)idle;
+    pool.enabled = 1;
+    netdata_mutex_unlock(&pool.mutex);
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_WEB_BUFFER_POOL_H
+#define NETDATA_WEB_BUFFER_POOL_H 1
+
+#include "libnetdata/libnetdata.h"
+
+// ----------------------------------------------------------------------------
+// web buffers pool
+//
+// The response buffer of a web client grows to the size of the largest
+// response it has served. Instead of keeping it that big while the client is
+// idle (or cached for reuse), the large buffers are given back to a pool
+// shared by all web clients when their response completes, in size classes
+// of 64KiB, 256KiB, 1MiB, 4MiB and 16MiB. Responses of known size (files,
+// parts of streamed responses) get a buffer of the pool, instead of
+// growing the buffer of the client.
+//
+// The pool keeps up to "web buffers pool size MB" of buffers, and frees the
+// ones not used for "web buffers pool idle seconds".
+
+#define WEB_BUFFER_POOL_CLASSES 5
+
+typedef struct web_buffer_pool_statistics {
+    size_t hits;                        // buffers given from the pool
+    size_t misses;                      // buffers allocated, because the pool had none of their class
+    size_t returned;                    // buffers kept by the pool
+    size_t dropped;                     // buffers freed, because the pool was full
+    size_t trimmed;                     // buffers freed, because they were idle
+
+    size_t buffers;                     // buffers in the pool now
+    size_t bytes;                       // bytes of the buffers in the pool now
+    size_t max_bytes;
+} WEB_BUFFER_POOL_STATISTICS;
+
+extern void web_buffer_pool_init(void);
+
+// a buffer of at least size bytes, from the pool when it has one
+extern BUFFER *web_buffer_pool_get(size_t size);
+
+// give a buffer back to the pool, or free it
+extern void web_buffer_pool_put(BUFFER *wb);
+
+// free the buffers idle for long
+extern void web_buffer_pool_trim(void);
+
+extern void web_buffer_pool_get_statistics(WEB_BUFFER_POOL_STATISTICS *stats);
+
+#endif //NETDATA_WEB_BUFFER_POOL_H
@@ -5,11 +5,22 @@
 // this is an async I/O implementation of the web server request parser
 // it is used by all netdata web servers
 
+// the streams of HTTP/2 have no socket to poll a file with, so it is read at once on the thread of
+// their connection - only the small files that are not in the cache of the web files are read
+#define WEB_CLIENT_HTTP2_UNCACHED_FILE_MAX (64 * 1024)
+
 int respect_web_browser_do_not_track_policy = 0;
 char *web_x_frame_options = NULL;
 
 #ifdef NETDATA_WITH_ZLIB
 int web_enable_gzip = 1, web_gzip_level = 3, web_gzip_strategy = Z_DEFAULT_STRATEGY;
+int web_compression_adaptive = 1;
+#ifdef ENABLE_ZSTD
+int web_enable_zstd = 1, web_zstd_level = 3;
+#endif /* ENABLE_ZSTD */
+#ifdef ENABLE_BROTLI
+int web_enable_brotli = 1, web_brotli_level = 4;
+#endif /* ENABLE_BROTLI */
 #endif /* NETDATA_WITH_ZLIB */
 
 inline int web_client_permission_denied(struct web_client *w) {
@@ -67,6 +78,61 @@ char *strip_control_characters(char *url) {
     return url;
 }
 
+static inline void web_client_generator_free(struct web_client *w) {
+    if(likely(!w->response.generator))
+        return;
+
+    if(w->response.generator_free)
+        w->response.generator_free(w->response.generator_data);
+
+    w->response.generator = NULL;
+    w->response.generator_data = NULL;
+    w->response.generator_free = NULL;
+}
+
+// make room for size more bytes in the response buffer, with a buffer of the pool,
+// instead of growing the buffer of the client
+void web_client_reserve_response(struct web_client *w, size_t size) {
+    BUFFER *wb = w->response.data;
+    if(likely(wb->size - wb->len >= size))
+        return;
+
+    // it is already a buffer of the pool
+    if(w->response.data_own) {
+        buffer_need_bytes(wb, size);
+        return;
+    }
+
+    BUFFER *pwb = web_buffer_pool_get(wb->len + size);
+    memcpy(pwb->buffer, wb->buffer, wb->len + 1);
+    pwb->len = wb->len;
+    pwb->contenttype = wb->contenttype;
+    pwb->options = wb->options;
+    pwb->date = wb->date;
+    pwb->expires = wb->expires;
+
+    w->response.data_own = wb;
+    w->response.data = pwb;
+}
+
+// give the response buffer to the pool, when it is a buffer of the pool,
+// or it has grown, so that idle clients do not keep large buffers
+static inline void web_client_release_response(struct web_client *w) {
+    if(w->response.data_own) {
+        web_buffer_pool_put(w->response.data);
+        w->response.data = w->response.data_own;
+        w->response.data_own = NULL;
+    }
+    else if(unlikely(w->response.data->size > NETDATA_WEB_RESPONSE_INITIAL_SIZE)) {
+        web_buffer_pool_put(w->response.data);
+        w->response.data = buffer_create(NETDATA_WEB_RESPONSE_INITIAL_SIZE);
+    }
+    else
+        return;
+
+    web_client_memory_accounting_update(w);
+}
+
 void web_client_request_done(struct web_client *w) {
     web_client_uncrock_socket(w);
 
@@ -76,7 +142,8 @@ void web_client_request_done(struct web_client *w) {
         struct timeval tv;
         now_realtime_timeval(&tv);
 
-        size_t size = (w->mode == WEB_CLIENT_MODE_FILECOPY)?w->response.rlen:w->response.data->len;
+        size_t size = (w->mode == WEB_CLIENT_MODE_FILECOPY)?w->response.rlen:
+                      (w->response.streamed)?w->response.streamed:w->response.data->len;
         size_t sent = size;
 #ifdef NETDATA_WITH_ZLIB
         if(likely(w->response.zoutput)) sent = (size_t)w->response.zstream.total_out;
@@ -85,15 +152,22 @@ void web_client_request_done(struct web_client *w) {
         // --------------------------------------------------------------------
         // global statistics
 
-        finished_web_request_statistics(dt_usec(&tv, &w->tv_in),
+        usec_t dt = dt_usec(&tv, &w->tv_in);
+
+        finished_web_request_statistics(dt,
                                         w->stats_received_bytes,
                                         w->stats_sent_bytes,
                                         size,
                                         sent);
 
+        if(w->api_endpoint)
+            web_client_api_v1_endpoint_done(w->api_endpoint, dt, size, sent, w->stats_db_points_read);
+
         w->stats_received_bytes = 0;
         w->stats_sent_bytes = 0;
 
+        web_client_memory_accounting_update(w);
+
 
         // --------------------------------------------------------------------
 
@@ -159,6 +233,7 @@ void web_client_request_done(struct web_client *w) {
     w->origin[1] = '\0';
 
     freez(w->user_agent); w->user_agent = NULL;
+    freez(w->if_none_match); w->if_none_match = NULL;
     if (w->auth_bearer_token) {
         freez(w->auth_bearer_token);
         w->auth_bearer_token = NULL;
@@ -170,15 +245,32 @@ void web_client_request_done(struct web_client *w) {
     web_client_disable_donottrack(w);
     web_client_disable_tracking_required(w);
     web_client_disable_keepalive(w);
+    web_client_flag_clear(w, WEB_CLIENT_FLAG_ACCEPT_GZIP);
+    web_client_flag_clear(w, WEB_CLIENT_FLAG_ACCEPT_BROTLI);
     w->decoded_url[0] = '\0';
+    w->api_endpoint = NULL;
+    w->stats_db_points_read = 0;
 
     buffer_reset(w->response.header_output);
     buffer_reset(w->response.header);
     buffer_reset(w->response.data);
+    web_client_release_response(w);
+
+    // the next request has already been received, process it now
+    if(unlikely(w->pipelined && w->pipelined->len)) {
+        buffer_strcat(w->response.data, buffer_tostring(w->pipelined));
+        buffer_flush(w->pipelined);
+        web_client_flag_set(w, WEB_CLIENT_FLAG_PIPELINED);
+    }
+
     w->response.rlen = 0;
     w->response.sent = 0;
     w->response.code = 0;
 
+    // the client may go away before a streamed response is complete
+    web_client_generator_free(w);
+    w->response.streamed = 0;
+
     w->header_parse_tries = 0;
     w->header_parse_last_size = 0;
 
@@ -191,7 +283,27 @@ void web_client_request_done(struct web_client *w) {
 #ifdef NETDATA_WITH_ZLIB
     if(w->response.zinitialized) {
         debug(D_DEFLATE, "%llu: Freeing compression resources.", w->id);
-        deflateEnd(&w->response.zstream);
+        switch(w->response.zencoding) {
+#ifdef ENABLE_ZSTD
+            case WEB_CLIENT_ENCODING_ZSTD:
+                ZSTD_freeCCtx(w->response.zstd);
+                w->response.zstd = NULL;
+                break;
+#endif
+#ifdef ENABLE_BROTLI
+            case WEB_CLIENT_ENCODING_BROTLI:
+                BrotliEncoderDestroyInstance(w->response.brotli);
+                w->response.brotli = NULL;
+                break;
+#endif
+            default:
+                deflateEnd(&w->response.zstream);
+                break;
+        }
+        w->response.zencoding = WEB_CLIENT_ENCODING_NONE;
+        w->response.zfinish = 0;
+        w->response.zdraining = 0;
+        w->response.zfinished = 0;
         w->response.zsent = 0;
         w->response.zhave = 0;
         w->response.zstream.avail_in = 0;
@@ -293,7 +405,7 @@ static struct {
         , {       NULL, 0, 0}
 };
 
-static inline uint8_t contenttype_for_filename(const char *filename) {
+uint8_t contenttype_for_filename(const char *filename) {
     // info("checking filename '%s'", filename);
 
     static int initialized = 0;
@@ -373,6 +485,13 @@ int mysendfile(struct web_client *w, char *filename) {
         return HTTP_RESP_BAD_REQUEST;
     }
 
+    // serve it from memory, if it is in the cache of the web files
+    int code = web_file_cache_send(w, filename);
+    if(likely(code)) {
+        debug(D_WEB_CLIENT_ACCESS, "%llu: Sending file '%s' from the cache (%zu bytes).", w->id, filename, w->response.data->len);
+        return code;
+    }
+
     // find the physical file on disk
     char webfilename[FILENAME_MAX + 1];
     snprintfz(webfilename, FILENAME_MAX, "%s/%s", netdata_configured_web_dir, filename);
@@ -414,6 +533,14 @@ int mysendfile(struct web_client *w, char *filename) {
         done = 1;
     }
 
+    if(unlikely(web_client_flag_check(w, WEB_CLIENT_FLAG_HTTP2_STREAM) && statbuf.st_size > WEB_CLIENT_HTTP2_UNCACHED_FILE_MAX)) {
+        error("%llu: File '%s' (%ld bytes) is not in the cache of the web files, it cannot be sent over HTTP/2.", w->id, webfilename, (long)statbuf.st_size);
+        w->response.data->contenttype = CT_TEXT_HTML;
+        buffer_strcat(w->response.data, "File is too big to be sent over HTTP/2, please use HTTP/1.1: ");
+        buffer_strcat_htmlescape(w->response.data, webfilename);
+        return HTTP_RESP_SERVICE_UNAVAILABLE;
+    }
+
     // open the file
     w->ifd = open(webfilename, O_NONBLOCK, O_RDONLY);
     if(w->ifd == -1) {
@@ -445,7 +572,7 @@ int mysendfile(struct web_client *w, char *filename) {
     web_client_enable_wait_receive(w);
     web_client_disable_wait_send(w);
     buffer_flush(w->response.data);
-    buffer_need_bytes(w->response.data, (size_t)statbuf.st_size);
+    web_client_reserve_response(w, (size_t)statbuf.st_size);
     w->response.rlen = (size_t)statbuf.st_size;
 #ifdef __APPLE__
     w->response.data->date = statbuf.st_mtimespec.tv_sec;
@@ -461,7 +588,70 @@ int mysendfile(struct web_client *w, char *filename) {
 
 
 #ifdef NETDATA_WITH_ZLIB
-void web_client_enable_deflate(struct web_client *w, int gzip) {
+// the CPU utilization of the web server thread, set by the web server every second
+static __thread int web_thread_cpu_load = 0;
+
+void web_client_set_thread_cpu_load(int percent) {
+    web_thread_cpu_load = percent;
+}
+
+// when the web server thread is busy, trade compression ratio for CPU:
+// the configured level is used up to 50% CPU, and it is lowered
+// gradually to the fastest level of the compressor at 90% CPU
+static int web_client_compression_level(int level, int fastest) {
+    int load = web_thread_cpu_load;
+
+    if(!web_compression_adaptive || load <= 50 || level <= fastest)
+        return level;
+
+    if(load >= 90)
+        return fastest;
+
+    return level - (level - fastest) * (load - 50) / 40;
+}
+
+static const char *web_client_encoding_name(WEB_CLIENT_ENCODING encoding) {
+    switch(encoding) {
+        case WEB_CLIENT_ENCODING_ZSTD:
+            return "zstd";
+
+        case WEB_CLIENT_ENCODING_BROTLI:
+            return "br";
+
+        default:
+            return "gzip";
+    }
+}
+
+// returns 1 when the encoding is listed in the Accept-Encoding header,
+// without a zero quality value (e.g. "gzip;q=0")
+static int web_client_accepts_encoding(const char *header, const char *encoding) {
+    size_t len = strlen(encoding);
+    const char *s = header;
+
+    while(*s) {
+        while(*s == ' ' || *s == '\t' || *s == ',') s++;
+
+        const char *name = s;
+        while(*s && *s != ',' && *s != ';' && *s != ' ' && *s != '\t') s++;
+
+        int match = ((size_t)(s - name) == len && !strncasecmp(name, encoding, len));
+
+        // the parameters of the encoding
+        while(*s && *s != ',') {
+            if(*s == 'q' && s[1] == '=' && match && strtod(&s[2], NULL) <= 0.0)
+                match = 0;
+            s++;
+        }
+
+        if(match)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void web_client_enable_compression(struct web_client *w, WEB_CLIENT_ENCODING encoding) {
     if(unlikely(w->response.zinitialized)) {
         debug(D_DEFLATE, "%llu: Compression has already be initialized for this client.", w->id);
         return;
@@ -488,26 +678,150 @@ void web_client_enable_deflate(struct web_client *w, int gzip) {
     w->response.zstream.zfree = Z_NULL;
     w->response.zstream.opaque = Z_NULL;
 
-//  if(deflateInit(&w->response.zstream, Z_DEFAULT_COMPRESSION) != Z_OK) {
-//      error("%llu: Failed to initialize zlib. Proceeding without compression.", w->id);
-//      return;
-//  }
+    switch(encoding) {
+#ifdef ENABLE_ZSTD
+        case WEB_CLIENT_ENCODING_ZSTD:
+            w->response.zstd = ZSTD_createCCtx();
+            if(!w->response.zstd || ZSTD_isError(ZSTD_CCtx_setParameter(w->response.zstd, ZSTD_c_compressionLevel, web_client_compression_level(web_zstd_level, 1)))) {
+                error("%llu: Failed to initialize zstd. Proceeding without compression.", w->id);
+                ZSTD_freeCCtx(w->response.zstd);
+                w->response.zstd = NULL;
+                return;
+            }
+            break;
+#endif
 
-    // Select GZIP compression: windowbits = 15 + 16 = 31
-    if(deflateInit2(&w->response.zstream, web_gzip_level, Z_DEFLATED, 15 + ((gzip)?16:0), 8, web_gzip_strategy) != Z_OK) {
-        error("%llu: Failed to initialize zlib. Proceeding without compression.", w->id);
-        return;
+#ifdef ENABLE_BROTLI
+        case WEB_CLIENT_ENCODING_BROTLI:
+            w->response.brotli = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+            if(!w->response.brotli || !BrotliEncoderSetParameter(w->response.brotli, BROTLI_PARAM_QUALITY, (uint32_t)web_client_compression_level(web_brotli_level, BROTLI_MIN_QUALITY))) {
+                error("%llu: Failed to initialize brotli. Proceeding without compression.", w->id);
+                if(w->response.brotli) BrotliEncoderDestroyInstance(w->response.brotli);
+                w->response.brotli = NULL;
+                return;
+            }
+            break;
+#endif
+
+        default:
+            // Select GZIP compression: windowbits = 15 + 16 = 31
+            encoding = WEB_CLIENT_ENCODING_GZIP;
+            if(deflateInit2(&w->response.zstream, web_client_compression_level(web_gzip_level, 1), Z_DEFLATED, 15 + 16, 8, web_gzip_strategy) != Z_OK) {
+                error("%llu: Failed to initialize zlib. Proceeding without compression.", w->id);
+                return;
+            }
+            break;
     }
 
+    w->response.zencoding = encoding;
+    w->response.zfinish = 0;
+    w->response.zdraining = 0;
+    w->response.zfinished = 0;
     w->response.zsent = 0;
     w->response.zoutput = 1;
     w->response.zinitialized = 1;
     w->flags |= WEB_CLIENT_CHUNKED_TRANSFER;
 
-    debug(D_DEFLATE, "%llu: Initialized compression.", w->id);
+    debug(D_DEFLATE, "%llu: Initialized %s compression.", w->id, web_client_encoding_name(encoding));
 }
 #endif // NETDATA_WITH_ZLIB
 
+// the response is sent as it is (e.g. it is already compressed)
+// the compression resources, if any, are released by web_client_request_done()
+void web_client_disable_deflate(struct web_client *w) {
+    w->response.zoutput = 0;
+    web_client_flag_clear(w, WEB_CLIENT_CHUNKED_TRANSFER);
+}
+
+// ----------------------------------------------------------------------------
+// streamed responses
+//
+// The parts of a streamed response replace each other in w->response.data, as
+// soon as the previous one has been sent (or passed through the compressor),
+// so the memory used does not depend on the size of the response, and its
+// first bytes are sent before the rest is generated.
+//
+// Uncompressed parts are sent as chunks: the room for the size of the chunk is
+// kept at the beginning of the buffer and filled when the part is ready.
+// Compressed parts are fed to deflate, which sends chunks of its own.
+
+#define WEB_CLIENT_CHUNK_HEADER "00000000\r\n"
+#define WEB_CLIENT_CHUNK_HEADER_SIZE (sizeof(WEB_CLIENT_CHUNK_HEADER) - 1)
+
+static void web_client_generate_next(struct web_client *w) {
+    buffer_flush(w->response.data);
+    web_client_reserve_response(w, NETDATA_WEB_RESPONSE_STREAM_PART_SIZE);
+
+    BUFFER *wb = w->response.data;
+    w->response.sent = 0;
+
+    int chunked = !w->response.zoutput;
+    if(chunked)
+        buffer_strcat(wb, WEB_CLIENT_CHUNK_HEADER);
+
+    size_t start = wb->len;
+    int more = w->response.generator(w, wb, w->response.generator_data);
+    size_t len = wb->len - start;
+    w->response.streamed += len;
+
+    debug(D_WEB_CLIENT, "%llu: Generated %zu bytes of a streamed response (%zu so far, %s).", w->id, len, w->response.streamed, more?"more to come":"completed");
+
+    if(chunked) {
+        if(likely(len)) {
+            char hex[WEB_CLIENT_CHUNK_HEADER_SIZE + 1];
+            snprintf(hex, sizeof(hex), "%08zX\r\n", len);
+            memcpy(wb->buffer, hex, WEB_CLIENT_CHUNK_HEADER_SIZE);
+            buffer_strcat(wb, "\r\n");
+        }
+        else
+            // an empty chunk would end the response
+            buffer_flush(wb);
+
+        if(!more)
+            buffer_strcat(wb, "0\r\n\r\n");
+    }
+
+    if(!more)
+        web_client_generator_free(w);
+}
+
+// send the response while it is generated, by the generator given
+// the generator_data are released with free_data, when the response is complete or the client goes away
+void web_client_stream_response(struct web_client *w, web_client_generator_t generator, void *data, void (*free_data)(void *data)) {
+    web_client_generator_free(w);
+
+    w->response.generator = generator;
+    w->response.generator_data = data;
+    w->response.generator_free = free_data;
+    w->response.streamed = 0;
+
+    if(web_client_flag_check(w, WEB_CLIENT_FLAG_HTTP2_STREAM) || !(web_client_check_tcp(w) || web_client_check_unix(w))) {
+        // HTTP/2 frames the response by itself, and the clients without a socket
+        // (i.e. ACLK) use the whole response, so it is generated at once
+        while(generator(w, w->response.data, data)) ;
+        web_client_generator_free(w);
+        return;
+    }
+
+    // the compressor sends its output in chunks already
+    web_client_flag_set(w, WEB_CLIENT_CHUNKED_TRANSFER);
+
+    web_client_generate_next(w);
+}
+
+// returns 1 when the If-None-Match header of the request matches the ETag
+int web_client_etag_matches(struct web_client *w, const char *etag) {
+    if(likely(!w->if_none_match))
+        return 0;
+
+    if(strcmp(w->if_none_match, "*") != 0 && !strstr(w->if_none_match, etag))
+        return 0;
+
+    // the 304 response has no body to compress
+    web_client_disable_deflate(w);
+    return 1;
+}
+
 void buffer_data_options2string(BUFFER *wb, uint32_t options) {
     int count = 0;
 
@@ -699,6 +1013,9 @@ const char *web_response_code_to_string(int code) {
         case HTTP_RESP_MOVED_PERM:
             return "Moved Permanently";
 
+        case HTTP_RESP_NOT_MODIFIED:
+            return "Not Modified";
+
         case HTTP_RESP_REDIR_TEMP:
             return "Temporary Redirect";
 
@@ -736,7 +1053,8 @@ const char *web_response_code_to_string(int code) {
 
 static inline char *http_header_parse(struct web_client *w, char *s, int parse_useragent) {
     static uint32_t hash_origin = 0, hash_connection = 0, hash_donottrack = 0, hash_useragent = 0,
-                    hash_authorization = 0, hash_host = 0, hash_forwarded_proto = 0, hash_forwarded_host = 0;
+                    hash_authorization = 0, hash_host = 0, hash_forwarded_proto = 0, hash_forwarded_host = 0,
+                    hash_if_none_match = 0;
 #ifdef NETDATA_WITH_ZLIB
     static uint32_t hash_accept_encoding = 0;
 #endif
@@ -753,6 +1071,7 @@ static inline char *http_header_parse(struct web_client *w, char *s, int parse_u
         hash_host = simple_uhash("Host");
         hash_forwarded_proto = simple_uhash("X-Forwarded-Proto");
         hash_forwarded_host = simple_uhash("X-Forwarded-Host");
+        hash_if_none_match = simple_uhash("If-None-Match");
     }
 
     char *e = s;
@@ -802,16 +1121,33 @@ static inline char *http_header_parse(struct web_client *w, char *s, int parse_u
     else if(hash == hash_host && !strcasecmp(s, "Host")){
         strncpyz(w->server_host, v, ((size_t)(ve - v) < sizeof(w->server_host)-1 ? (size_t)(ve - v) : sizeof(w->server_host)-1));
     }
+    else if(hash == hash_if_none_match && !strcasecmp(s, "If-None-Match")) {
+        freez(w->if_none_match);
+        w->if_none_match = strdupz(v);
+    }
 #ifdef NETDATA_WITH_ZLIB
     else if(hash == hash_accept_encoding && !strcasecmp(s, "Accept-Encoding")) {
-        if(web_enable_gzip) {
-            if(strcasestr(v, "gzip"))
-                web_client_enable_deflate(w, 1);
-            //
-            // does not seem to work
-            // else if(strcasestr(v, "deflate"))
-            //  web_client_enable_deflate(w, 0);
+        // prefer zstd, then brotli, then gzip
+        WEB_CLIENT_ENCODING encoding = WEB_CLIENT_ENCODING_NONE;
+
+        if(web_enable_gzip && web_client_accepts_encoding(v, "gzip")) {
+            web_client_flag_set(w, WEB_CLIENT_FLAG_ACCEPT_GZIP);
+            encoding = WEB_CLIENT_ENCODING_GZIP;
         }
+#ifdef ENABLE_BROTLI
+        if(web_enable_brotli && web_client_accepts_encoding(v, "br")) {
+            web_client_flag_set(w, WEB_CLIENT_FLAG_ACCEPT_BROTLI);
+            encoding = WEB_CLIENT_ENCODING_BROTLI;
+        }
+#endif
+#ifdef ENABLE_ZSTD
+        if(web_enable_zstd && web_client_accepts_encoding(v, "zstd"))
+            encoding = WEB_CLIENT_ENCODING_ZSTD;
+#endif
+
+        // the responses of HTTP/2 streams are not chunked, they are compressed only when precompressed
+        if(encoding != WEB_CLIENT_ENCODING_NONE && !web_client_flag_check(w, WEB_CLIENT_FLAG_HTTP2_STREAM))
+            web_client_enable_compression(w, encoding);
     }
 #endif /* NETDATA_WITH_ZLIB */
 #ifdef ENABLE_HTTPS
@@ -949,6 +1285,31 @@ void web_client_split_path_query(struct web_client *w, char *s) {
     w->url_path_length = strlen(s);
 }
 
+/**
+ * Save pipelined
+ *
+ * Keep the requests received after the current one, to be processed
+ * when its response has been sent.
+ *
+ * @param w is the structure with the client request
+ * @param s is the first byte after the end of the current request
+ */
+static void web_client_save_pipelined(struct web_client *w, const char *s) {
+    size_t len = w->response.data->len - (size_t)(s - w->response.data->buffer);
+
+    if(unlikely(!w->pipelined))
+        w->pipelined = buffer_create(len + 1);
+
+    buffer_flush(w->pipelined);
+    buffer_need_bytes(w->pipelined, len + 1);
+    memcpy(w->pipelined->buffer, s, len);
+    w->pipelined->len = len;
+    w->pipelined->buffer[len] = '\0';
+
+    // a client pipelining its requests expects the connection to persist
+    web_client_enable_keepalive(w);
+}
+
 /**
  * Request validate
  *
@@ -1000,20 +1361,13 @@ static inline HTTP_VALIDATION http_request_validate(struct web_client *w) {
 
         return HTTP_VALIDATION_NOT_SUPPORTED;
     } else if (!is_it_valid) {
-        //Invalid request, we have more data after the end of message
+        // we may have more data after the end of the request,
+        // the next requests of a client pipelining them
         char *check = strstr((char *)buffer_tostring(w->response.data), "\r\n\r\n");
-        if(check) {
-            check += 4;
-            if (*check) {
-                w->header_parse_tries = 0;
-                w->header_parse_last_size = 0;
-                web_client_disable_wait_receive(w);
-                return HTTP_VALIDATION_NOT_SUPPORTED;
-            }
+        if(!check || !check[4]) {
+            web_client_enable_wait_receive(w);
+            return HTTP_VALIDATION_INCOMPLETE;
         }
-
-        web_client_enable_wait_receive(w);
-        return HTTP_VALIDATION_INCOMPLETE;
     }
 
     //After the method we have the path and query string together
@@ -1051,6 +1405,9 @@ static inline HTTP_VALIDATION http_request_validate(struct web_client *w) {
             if(unlikely(*s == '\r' && s[1] == '\n')) {
                 // a valid complete HTTP request found
 
+                if(unlikely(s[2] && w->mode != WEB_CLIENT_MODE_STREAM))
+                    web_client_save_pipelined(w, &s[2]);
+
                 *ue = '\0';
                 //This is to avoid crash in line
                 w->url_search_path = NULL;
@@ -1116,7 +1473,7 @@ static inline HTTP_VALIDATION http_request_validate(struct web_client *w) {
     return HTTP_VALIDATION_INCOMPLETE;
 }
 
-static inline ssize_t web_client_send_data(struct web_client *w,const void *buf,size_t len, int flags)
+ssize_t web_client_send_data(struct web_client *w,const void *buf,size_t len, int flags)
 {
     ssize_t bytes;
 #ifdef ENABLE_HTTPS
@@ -1137,7 +1494,7 @@ static inline ssize_t web_client_send_data(struct web_client *w,const void *buf,
 }
 
 void web_client_build_http_header(struct web_client *w) {
-    if(unlikely(w->response.code != HTTP_RESP_OK))
+    if(unlikely(w->response.code != HTTP_RESP_OK && w->response.code != HTTP_RESP_NOT_MODIFIED))
         buffer_no_cacheable(w->response.data);
 
     // set a proper expiration date, if not already set
@@ -1233,7 +1590,9 @@ void web_client_build_http_header(struct web_client *w) {
         buffer_sprintf(w->response.header_output,
                 "Cache-Control: %s\r\n"
                         "Expires: %s\r\n",
-                (w->response.data->options & WB_CONTENT_NO_CACHEABLE)?"no-cache, no-store, must-revalidate\r\nPragma: no-cache":"public",
+                (w->response.data->options & WB_CONTENT_NO_CACHEABLE)?
+                    ((w->response.data->options & WB_CONTENT_REVALIDATE)?"no-cache":"no-cache, no-store, must-revalidate\r\nPragma: no-cache"):
+                    "public",
                 edate);
     }
 
@@ -1242,8 +1601,10 @@ void web_client_build_http_header(struct web_client *w) {
         buffer_strcat(w->response.header_output, buffer_tostring(w->response.header));
 
     // headers related to the transfer method
+#ifdef NETDATA_WITH_ZLIB
     if(likely(w->response.zoutput))
-        buffer_strcat(w->response.header_output, "Content-Encoding: gzip\r\n");
+        buffer_sprintf(w->response.header_output, "Content-Encoding: %s\r\n", web_client_encoding_name(w->response.zencoding));
+#endif
 
     if(likely(w->flags & WEB_CLIENT_CHUNKED_TRANSFER))
         buffer_strcat(w->response.header_output, "Transfer-Encoding: chunked\r\n");
@@ -1252,6 +1613,10 @@ void web_client_build_http_header(struct web_client *w) {
             // we know the content length, put it
             buffer_sprintf(w->response.header_output, "Content-Length: %zu\r\n", w->response.data->len? w->response.data->len: w->response.rlen);
         }
+        else if(w->response.code == HTTP_RESP_NOT_MODIFIED) {
+            // 304 responses have no body, the connection can be kept alive
+            ;
+        }
         else {
             // we don't know the content length, disable keep-alive
             web_client_disable_keepalive(w);
@@ -1265,6 +1630,10 @@ void web_client_build_http_header(struct web_client *w) {
 static inline void web_client_send_http_header(struct web_client *w) {
     web_client_build_http_header(w);
 
+    // the header of an HTTP/2 stream is sent by its connection
+    if(unlikely(web_client_flag_check(w, WEB_CLIENT_FLAG_HTTP2_STREAM)))
+        return;
+
     // sent the HTTP header
     debug(D_WEB_DATA, "%llu: Sending response HTTP header of size %zu: '%s'"
           , w->id
@@ -1529,6 +1898,7 @@ static inline int web_client_process_url(RRDHOST *host, struct web_client *w, ch
 }
 
 void web_client_process_request(struct web_client *w) {
+    web_client_flag_clear(w, WEB_CLIENT_FLAG_PIPELINED);
 
     // start timing us
     now_realtime_timeval(&w->tv_in);
@@ -1576,7 +1946,15 @@ void web_client_process_request(struct web_client *w) {
                         break;
                     }
 
-                    w->response.code = web_client_process_url(localhost, w, w->decoded_url);
+                    {
+                        int code = web_client_process_url(localhost, w, w->decoded_url);
+
+                        // the query executor owns the client until its response is ready
+                        if(web_client_flag_check(w, WEB_CLIENT_FLAG_EXECUTOR))
+                            return;
+
+                        w->response.code = code;
+                    }
                     break;
             }
             break;
@@ -1629,6 +2007,12 @@ void web_client_process_request(struct web_client *w) {
             break;
     }
 
+    web_client_process_request_done(w);
+}
+
+// the response is ready, send its header and prepare to send its data
+void web_client_process_request_done(struct web_client *w) {
+
     // keep track of the time we done processing
     now_realtime_timeval(&w->tv_ready);
 
@@ -1758,6 +2142,83 @@ ssize_t web_client_send_chunk_finalize(struct web_client *w)
 }
 
 #ifdef NETDATA_WITH_ZLIB
+// the compressor has all the input of the response
+static inline int web_client_compression_can_finish(struct web_client *w) {
+    return (w->mode == WEB_CLIENT_MODE_NORMAL && !w->response.generator)
+           || (w->mode == WEB_CLIENT_MODE_FILECOPY && !web_client_has_wait_receive(w) && w->response.data->len == w->response.rlen);
+}
+
+// the compressor has output not received yet, for the input it has been given
+static inline int web_client_compression_pending(struct web_client *w) {
+    if(w->response.zencoding == WEB_CLIENT_ENCODING_GZIP)
+        return w->response.zstream.avail_out == 0;
+
+    // zstd and brotli do not output anything for empty flushes,
+    // so they are called only for more output, or to finish the stream
+    return w->response.zdraining || (!w->response.zfinished && web_client_compression_can_finish(w));
+}
+
+// compress zstream.avail_in bytes from zstream.next_in to zstream.next_out,
+// and update the pointers and the counters of zstream, like deflate() does
+static int web_client_compress(struct web_client *w) {
+    z_stream *zs = &w->response.zstream;
+
+    switch(w->response.zencoding) {
+#ifdef ENABLE_ZSTD
+        case WEB_CLIENT_ENCODING_ZSTD: {
+            ZSTD_inBuffer in = { .src = zs->next_in, .size = zs->avail_in, .pos = 0 };
+            ZSTD_outBuffer out = { .dst = zs->next_out, .size = zs->avail_out, .pos = 0 };
+            size_t remaining;
+
+            do {
+                remaining = ZSTD_compressStream2(w->response.zstd, &out, &in, w->response.zfinish ? ZSTD_e_end : ZSTD_e_flush);
+                if(ZSTD_isError(remaining))
+                    return -1;
+            } while(remaining && out.pos < out.size);
+
+            w->response.zdraining = (remaining != 0);
+            w->response.zfinished = (w->response.zfinish && !remaining);
+
+            zs->next_in += in.pos;
+            zs->avail_in -= (uInt)in.pos;
+            zs->total_in += in.pos;
+            zs->next_out += out.pos;
+            zs->avail_out -= (uInt)out.pos;
+            zs->total_out += out.pos;
+            return 0;
+        }
+#endif
+
+#ifdef ENABLE_BROTLI
+        case WEB_CLIENT_ENCODING_BROTLI: {
+            size_t avail_in = zs->avail_in, avail_out = zs->avail_out;
+            const uint8_t *next_in = zs->next_in;
+            uint8_t *next_out = zs->next_out;
+            BrotliEncoderOperation op = w->response.zfinish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+
+            do {
+                if(!BrotliEncoderCompressStream(w->response.brotli, op, &avail_in, &next_in, &avail_out, &next_out, NULL))
+                    return -1;
+            } while(avail_out && (avail_in || BrotliEncoderHasMoreOutput(w->response.brotli)));
+
+            w->response.zdraining = (avail_in || BrotliEncoderHasMoreOutput(w->response.brotli));
+            w->response.zfinished = BrotliEncoderIsFinished(w->response.brotli);
+
+            zs->total_in += zs->avail_in - avail_in;
+            zs->total_out += zs->avail_out - avail_out;
+            zs->next_in = (Bytef *)next_in;
+            zs->avail_in = (uInt)avail_in;
+            zs->next_out = next_out;
+            zs->avail_out = (uInt)avail_out;
+            return 0;
+        }
+#endif
+
+        default:
+            return (deflate(zs, w->response.zfinish ? Z_FINISH : Z_SYNC_FLUSH) == Z_STREAM_ERROR) ? -1 : 0;
+    }
+}
+
 ssize_t web_client_send_deflate(struct web_client *w)
 {
     ssize_t len = 0, t = 0;
@@ -1768,13 +2229,22 @@ ssize_t web_client_send_deflate(struct web_client *w)
     debug(D_DEFLATE, "%llu: web_client_send_deflate(): w->response.data->len = %zu, w->response.sent = %zu, w->response.zhave = %zu, w->response.zsent = %zu, w->response.zstream.avail_in = %u, w->response.zstream.avail_out = %u, w->response.zstream.total_in = %lu, w->response.zstream.total_out = %lu.",
         w->id, w->response.data->len, w->response.sent, w->response.zhave, w->response.zsent, w->response.zstream.avail_in, w->response.zstream.avail_out, w->response.zstream.total_in, w->response.zstream.total_out);
 
-    if(w->response.data->len - w->response.sent == 0 && w->response.zstream.avail_in == 0 && w->response.zhave == w->response.zsent && w->response.zstream.avail_out != 0) {
+    if(w->response.data->len - w->response.sent == 0 && w->response.zstream.avail_in == 0 && w->response.zhave == w->response.zsent && !web_client_compression_pending(w)) {
         // there is nothing to send
 
         debug(D_WEB_CLIENT, "%llu: Out of output data.", w->id);
 
+        // compress the next part of a streamed response
+        if(w->response.generator) {
+            web_client_generate_next(w);
+            if(unlikely(w->response.generator && !w->response.data->len))
+                return 0;
+
+            goto compress;
+        }
+
         // finalize the chunk
-        if(w->response.sent != 0) {
+        if(w->response.sent != 0 || w->response.zstream.total_out != 0) {
             t = web_client_send_chunk_finalize(w);
             if(t < 0) return t;
         }
@@ -1798,40 +2268,46 @@ ssize_t web_client_send_deflate(struct web_client *w)
         return t;
     }
 
+compress:
     if(w->response.zhave == w->response.zsent) {
         // compress more input data
 
         // close the previous open chunk
-        if(w->response.sent != 0) {
+        if(w->response.sent != 0 || w->response.zstream.total_out != 0) {
             t = web_client_send_chunk_close(w);
             if(t < 0) return t;
         }
 
-        debug(D_DEFLATE, "%llu: Compressing %zu new bytes starting from %zu (and %u left behind).", w->id, (w->response.data->len - w->response.sent), w->response.sent, w->response.zstream.avail_in);
+        // zstd and brotli need the same input and operation, until they have output everything for them
+        if(!w->response.zdraining) {
+            debug(D_DEFLATE, "%llu: Compressing %zu new bytes starting from %zu (and %u left behind).", w->id, (w->response.data->len - w->response.sent), w->response.sent, w->response.zstream.avail_in);
+
+            // give the compressor all the data not passed through the compressor yet
+            if(w->response.data->len > w->response.sent) {
+                w->response.zstream.next_in = (Bytef *)&w->response.data->buffer[w->response.sent - w->response.zstream.avail_in];
+                w->response.zstream.avail_in += (uInt) (w->response.data->len - w->response.sent);
+            }
+
+            // keep track of the bytes passed through the compressor
+            w->response.sent = w->response.data->len;
 
-        // give the compressor all the data not passed through the compressor yet
-        if(w->response.data->len > w->response.sent) {
-            w->response.zstream.next_in = (Bytef *)&w->response.data->buffer[w->response.sent - w->response.zstream.avail_in];
-            w->response.zstream.avail_in += (uInt) (w->response.data->len - w->response.sent);
+            // ask for FINISH if we have all the input
+            if(web_client_compression_can_finish(w)) {
+                w->response.zfinish = 1;
+                debug(D_DEFLATE, "%llu: Requesting Z_FINISH, if possible.", w->id);
+            }
+            else {
+                w->response.zfinish = 0;
+                debug(D_DEFLATE, "%llu: Requesting Z_SYNC_FLUSH.", w->id);
+            }
         }
 
         // reset the compressor output buffer
         w->response.zstream.next_out = w->response.zbuffer;
         w->response.zstream.avail_out = NETDATA_WEB_RESPONSE_ZLIB_CHUNK_SIZE;
 
-        // ask for FINISH if we have all the input
-        int flush = Z_SYNC_FLUSH;
-        if(w->mode == WEB_CLIENT_MODE_NORMAL
-            || (w->mode == WEB_CLIENT_MODE_FILECOPY && !web_client_has_wait_receive(w) && w->response.data->len == w->response.rlen)) {
-            flush = Z_FINISH;
-            debug(D_DEFLATE, "%llu: Requesting Z_FINISH, if possible.", w->id);
-        }
-        else {
-            debug(D_DEFLATE, "%llu: Requesting Z_SYNC_FLUSH.", w->id);
-        }
-
         // compress
-        if(deflate(&w->response.zstream, flush) == Z_STREAM_ERROR) {
+        if(web_client_compress(w) != 0) {
             error("%llu: Compression failed. Closing down client.", w->id);
             web_client_request_done(w);
             return(-1);
@@ -1840,9 +2316,6 @@ ssize_t web_client_send_deflate(struct web_client *w)
         w->response.zhave = NETDATA_WEB_RESPONSE_ZLIB_CHUNK_SIZE - w->response.zstream.avail_out;
         w->response.zsent = 0;
 
-        // keep track of the bytes passed through the compressor
-        w->response.sent = w->response.data->len;
-
         debug(D_DEFLATE, "%llu: Compression produced %zu bytes.", w->id, w->response.zhave);
 
         // open a new chunk
@@ -1887,9 +2360,18 @@ ssize_t web_client_send(struct web_client *w) {
 
         debug(D_WEB_CLIENT, "%llu: Out of output data.", w->id);
 
-        // there can be two cases for this
+        // there can be three cases for this
         // A. we have done everything
         // B. we temporarily have nothing to send, waiting for the buffer to be filled by ifd
+        // C. the next part of a streamed response has to be generated
+
+        if(w->response.generator) {
+            web_client_generate_next(w);
+            if(unlikely(!w->response.data->len))
+                return 0;
+
+            goto send;
+        }
 
         if(w->mode == WEB_CLIENT_MODE_FILECOPY && web_client_has_wait_receive(w) && w->response.rlen && w->response.rlen > w->response.data->len) {
             // we have to wait, more data will come
@@ -1909,6 +2391,7 @@ ssize_t web_client_send(struct web_client *w) {
         return 0;
     }
 
+send:
     bytes = web_client_send_data(w,&w->response.data->buffer[w->response.sent], w->response.data->len - w->response.sent, MSG_DONTWAIT);
     if(likely(bytes > 0)) {
         w->stats_sent_bytes += bytes;
@@ -7,6 +7,13 @@
 
 #ifdef NETDATA_WITH_ZLIB
 extern int web_enable_gzip, web_gzip_level, web_gzip_strategy;
+extern int web_compression_adaptive;
+#ifdef ENABLE_ZSTD
+extern int web_enable_zstd, web_zstd_level;
+#endif /* ENABLE_ZSTD */
+#ifdef ENABLE_BROTLI
+extern int web_enable_brotli, web_brotli_level;
+#endif /* ENABLE_BROTLI */
 #endif /* NETDATA_WITH_ZLIB */
 
 // HTTP_CODES 2XX Success
@@ -14,6 +21,7 @@ extern int web_enable_gzip, web_gzip_level, web_gzip_strategy;
 
 // HTTP_CODES 3XX Redirections
 #define HTTP_RESP_MOVED_PERM 301
+#define HTTP_RESP_NOT_MODIFIED 304
 #define HTTP_RESP_REDIR_TEMP 307
 #define HTTP_RESP_REDIR_PERM 308
 
@@ -26,6 +34,7 @@ extern int web_enable_gzip, web_gzip_level, web_gzip_strategy;
 // HTTP_CODES 5XX Server Errors
 #define HTTP_RESP_INTERNAL_SERVER_ERROR 500
 #define HTTP_RESP_BACKEND_FETCH_FAILED 503
+#define HTTP_RESP_SERVICE_UNAVAILABLE 503
 
 extern int respect_web_browser_do_not_track_policy;
 extern char *web_x_frame_options;
@@ -66,8 +75,26 @@ typedef enum web_client_flags {
     WEB_CLIENT_FLAG_DONT_CLOSE_SOCKET = 1 << 9, // don't close the socket when cleaning up (static-threaded web server)
 
     WEB_CLIENT_CHUNKED_TRANSFER = 1 << 10, // chunked transfer (used with zlib compression)
+
+    WEB_CLIENT_FLAG_EXECUTOR = 1 << 11, // the request is run by the query executor (static-threaded web server)
+
+    WEB_CLIENT_FLAG_PIPELINED = 1 << 12, // the next request has been received with the previous one
+
+    WEB_CLIENT_FLAG_HTTP2_STREAM = 1 << 13, // the request of an HTTP/2 stream, it has no socket (static-threaded web server)
+
+    WEB_CLIENT_FLAG_ACCEPT_GZIP = 1 << 14, // the client accepts gzip compressed responses
+
+    WEB_CLIENT_FLAG_ACCEPT_BROTLI = 1 << 15, // the client accepts brotli compressed responses
 } WEB_CLIENT_FLAGS;
 
+// the Content-Encoding of the compressed responses
+typedef enum web_client_encoding {
+    WEB_CLIENT_ENCODING_NONE = 0,
+    WEB_CLIENT_ENCODING_GZIP,
+    WEB_CLIENT_ENCODING_ZSTD,
+    WEB_CLIENT_ENCODING_BROTLI,
+} WEB_CLIENT_ENCODING;
+
 //#ifdef HAVE_C___ATOMIC
 //#define web_client_flag_check(w, flag) (__atomic_load_n(&((w)->flags), __ATOMIC_SEQ_CST) & flag)
 //#define web_client_flag_set(w, flag)   __atomic_or_fetch(&((w)->flags), flag, __ATOMIC_SEQ_CST)
@@ -116,24 +143,49 @@ typedef enum web_client_flags {
 #define NETDATA_WEB_RESPONSE_INITIAL_SIZE 16384
 #define NETDATA_WEB_REQUEST_RECEIVE_SIZE 16384
 #define NETDATA_WEB_REQUEST_MAX_SIZE 16384
+#define NETDATA_WEB_RESPONSE_STREAM_PART_SIZE 65536
+
+struct web_client;
+
+// A response generated while it is sent, in parts: the generator appends the
+// next part of the response to wb (about NETDATA_WEB_RESPONSE_STREAM_PART_SIZE
+// bytes) and returns 0 when it has appended the last one.
+typedef int (*web_client_generator_t)(struct web_client *w, BUFFER *wb, void *data);
 
 struct response {
     BUFFER *header;        // our response header
     BUFFER *header_output; // internal use
     BUFFER *data;          // our response data buffer
+    BUFFER *data_own;      // the response data buffer of the client, while data is a buffer of the pool
 
     int code; // the HTTP response code
 
     size_t rlen; // if non-zero, the excepted size of ifd (input of firecopy)
     size_t sent; // current data length sent to output
 
+    web_client_generator_t generator;   // set while a streamed response has more parts to generate
+    void *generator_data;
+    void (*generator_free)(void *data);
+    size_t streamed;                    // the bytes of the parts of a streamed response generated so far
+
     int zoutput; // if set to 1, web_client_send() will send compressed data
+    WEB_CLIENT_ENCODING zencoding; // the compressor of zoutput
 #ifdef NETDATA_WITH_ZLIB
     z_stream zstream;                                    // zlib stream for sending compressed output to client
+                                                         // (its buffer pointers and counters are used by all compressors)
     Bytef zbuffer[NETDATA_WEB_RESPONSE_ZLIB_CHUNK_SIZE]; // temporary buffer for storing compressed output
     size_t zsent;                                        // the compressed bytes we have sent to the client
     size_t zhave;                                        // the compressed bytes that we have received from zlib
     unsigned int zinitialized : 1;
+    unsigned int zfinish : 1;                            // the last compression step finishes the stream
+    unsigned int zdraining : 1;                          // zstd and brotli have more output for their last step
+    unsigned int zfinished : 1;                          // zstd and brotli have finished the stream
+#ifdef ENABLE_ZSTD
+    ZSTD_CCtx *zstd;
+#endif /* ENABLE_ZSTD */
+#ifdef ENABLE_BROTLI
+    BrotliEncoderState *brotli;
+#endif /* ENABLE_BROTLI */
 #endif /* NETDATA_WITH_ZLIB */
 };
 
@@ -172,11 +224,19 @@ struct web_client {
     char cookie2[NETDATA_WEB_REQUEST_COOKIE_SIZE + 1];
     char origin[NETDATA_WEB_REQUEST_ORIGIN_HEADER_SIZE + 1];
     char *user_agent;
+    char *if_none_match;   // the ETags of the If-None-Match header, to respond with 304 Not Modified
 
     struct response response;
 
     size_t stats_received_bytes;
     size_t stats_sent_bytes;
+    size_t stats_db_points_read;        // by the queries of the current request
+
+    struct web_api_endpoint *api_endpoint; // the API endpoint of the current request, when api statistics are enabled
+
+    size_t memory_accounted;    // the bytes reported to memory accounting for this client
+
+    BUFFER *pipelined;          // the requests received after the one being served (HTTP/1.1 pipelining)
 
     // cache of web_client allocations
     struct web_client *prev; // maintain a linked list of web clients
@@ -192,23 +252,54 @@ struct web_client {
 #ifdef ENABLE_HTTPS
     struct netdata_ssl ssl;
 #endif
+#ifdef ENABLE_HTTP2
+    struct http2_session *h2;      // the HTTP/2 session of the connection
+    struct http2_stream *h2_stream; // the HTTP/2 stream of the request
+#endif
 };
 
+static inline size_t web_client_memory_size(struct web_client *w) {
+    return sizeof(*w)
+           + sizeof(BUFFER) + w->response.data->size
+           + sizeof(BUFFER) + w->response.header->size
+           + sizeof(BUFFER) + w->response.header_output->size
+           + (w->response.data_own ? sizeof(BUFFER) + w->response.data_own->size : 0)
+           + (w->pipelined ? sizeof(BUFFER) + w->pipelined->size : 0);
+}
+
+// the response buffers grow with the requests, so report the difference since the last call
+static inline void web_client_memory_accounting_update(struct web_client *w) {
+    size_t size = web_client_memory_size(w);
+    if(unlikely(size != w->memory_accounted)) {
+        memory_accounting_resize(MEMORY_ACCOUNTING_WEB, (ssize_t)size - (ssize_t)w->memory_accounted);
+        w->memory_accounted = size;
+    }
+}
+
 extern uid_t web_files_uid(void);
 extern uid_t web_files_gid(void);
 
 extern int web_client_permission_denied(struct web_client *w);
 
 extern ssize_t web_client_send(struct web_client *w);
+extern ssize_t web_client_send_data(struct web_client *w, const void *buf, size_t len, int flags);
 extern ssize_t web_client_receive(struct web_client *w);
 extern ssize_t web_client_read_file(struct web_client *w);
 
 extern void web_client_process_request(struct web_client *w);
+extern void web_client_process_request_done(struct web_client *w);
 extern void web_client_request_done(struct web_client *w);
 
 extern void buffer_data_options2string(BUFFER *wb, uint32_t options);
 
 extern int mysendfile(struct web_client *w, char *filename);
+extern uint8_t contenttype_for_filename(const char *filename);
+
+extern void web_client_disable_deflate(struct web_client *w);
+extern void web_client_reserve_response(struct web_client *w, size_t size);
+extern void web_client_set_thread_cpu_load(int percent);
+extern void web_client_stream_response(struct web_client *w, web_client_generator_t generator, void *data, void (*free_data)(void *data));
+extern int web_client_etag_matches(struct web_client *w, const char *etag);
 
 extern void web_client_build_http_header(struct web_client *w);
 extern char *strip_control_characters(char *url);
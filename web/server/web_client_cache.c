@@ -25,13 +25,18 @@ static void web_client_zero(struct web_client *w) {
     BUFFER *b1 = w->response.data;
     BUFFER *b2 = w->response.header;
     BUFFER *b3 = w->response.header_output;
+    BUFFER *b4 = w->pipelined;
+    BUFFER *b5 = w->response.data_own;
+    size_t memory_accounted = w->memory_accounted;
 
     // empty the buffers
     buffer_flush(b1);
     buffer_flush(b2);
     buffer_flush(b3);
+    if(b4) buffer_flush(b4);
 
     freez(w->user_agent);
+    freez(w->if_none_match);
 
     // zero everything
     memset(w, 0, sizeof(struct web_client));
@@ -40,13 +45,20 @@ static void web_client_zero(struct web_client *w) {
     w->response.data = b1;
     w->response.header = b2;
     w->response.header_output = b3;
+    w->pipelined = b4;
+    w->response.data_own = b5;
+    w->memory_accounted = memory_accounted;
 }
 
 static void web_client_free(struct web_client *w) {
+    memory_accounting_free(MEMORY_ACCOUNTING_WEB, w->memory_accounted);
     buffer_free(w->response.header_output);
     buffer_free(w->response.header);
     buffer_free(w->response.data);
+    buffer_free(w->response.data_own);
+    if(w->pipelined) buffer_free(w->pipelined);
     freez(w->user_agent);
+    freez(w->if_none_match);
 #ifdef ENABLE_HTTPS
     if ((!web_client_check_unix(w)) && ( netdata_srv_ctx )) {
         if (w->ssl.conn) {
@@ -63,6 +75,9 @@ static struct web_client *web_client_alloc(void) {
     w->response.data = buffer_create(NETDATA_WEB_RESPONSE_INITIAL_SIZE);
     w->response.header = buffer_create(NETDATA_WEB_RESPONSE_HEADER_SIZE);
     w->response.header_output = buffer_create(NETDATA_WEB_RESPONSE_HEADER_SIZE);
+
+    w->memory_accounted = web_client_memory_size(w);
+    memory_accounting_alloc(MEMORY_ACCOUNTING_WEB, w->memory_accounted);
     return w;
 }
 
@@ -159,7 +174,7 @@ void web_client_cache_destroy(void) {
     netdata_thread_enable_cancelability();
 }
 
-struct web_client *web_client_get_from_cache_or_allocate() {
+static struct web_client *web_client_cache_get(void) {
 
 #ifdef NETDATA_INTERNAL_CHECKS
     if(unlikely(web_clients_cache.pid == 0))
@@ -209,7 +224,6 @@ struct web_client *web_client_get_from_cache_or_allocate() {
     web_clients_cache.used_count++;
 
     // initialize it
-    w->id = web_client_connected();
     w->mode = WEB_CLIENT_MODE_NORMAL;
 
     netdata_thread_enable_cancelability();
@@ -217,21 +231,19 @@ struct web_client *web_client_get_from_cache_or_allocate() {
     return w;
 }
 
-void web_client_release(struct web_client *w) {
-#ifdef NETDATA_INTERNAL_CHECKS
-    if(unlikely(web_clients_cache.pid != 0 && web_clients_cache.pid != gettid()))
-        error("Oops! wrong thread accessing the cache. Expected %d, found %d", (int)web_clients_cache.pid, (int)gettid());
-
-    if(unlikely(w->running))
-        error("%llu: releasing web client from %s port %s, but it still running.", w->id, w->client_ip, w->client_port);
-#endif
-
-    debug(D_WEB_CLIENT_ACCESS, "%llu: Closing web client from %s port %s.", w->id, w->client_ip, w->client_port);
+struct web_client *web_client_get_from_cache_or_allocate() {
+    struct web_client *w = web_client_cache_get();
+    w->id = web_client_connected();
+    return w;
+}
 
-    web_server_log_connection(w, "DISCONNECTED");
-    web_client_request_done(w);
-    web_client_disconnected();
+struct web_client *web_client_get_from_cache_for_request(void) {
+    struct web_client *w = web_client_cache_get();
+    w->id = web_client_request_id();
+    return w;
+}
 
+static void web_client_cache_put(struct web_client *w) {
     netdata_thread_disable_cancelability();
 
     if(web_server_mode != WEB_SERVER_MODE_STATIC_THREADED) {
@@ -267,3 +279,32 @@ void web_client_release(struct web_client *w) {
     netdata_thread_enable_cancelability();
 }
 
+void web_client_release(struct web_client *w) {
+#ifdef NETDATA_INTERNAL_CHECKS
+    if(unlikely(web_clients_cache.pid != 0 && web_clients_cache.pid != gettid()))
+        error("Oops! wrong thread accessing the cache. Expected %d, found %d", (int)web_clients_cache.pid, (int)gettid());
+
+    if(unlikely(w->running))
+        error("%llu: releasing web client from %s port %s, but it still running.", w->id, w->client_ip, w->client_port);
+#endif
+
+    debug(D_WEB_CLIENT_ACCESS, "%llu: Closing web client from %s port %s.", w->id, w->client_ip, w->client_port);
+
+    web_server_log_connection(w, "DISCONNECTED");
+    web_client_request_done(w);
+    web_client_disconnected();
+
+    web_client_cache_put(w);
+}
+
+void web_client_release_request(struct web_client *w) {
+#ifdef NETDATA_INTERNAL_CHECKS
+    if(unlikely(web_clients_cache.pid != 0 && web_clients_cache.pid != gettid()))
+        error("Oops! wrong thread accessing the cache. Expected %d, found %d", (int)web_clients_cache.pid, (int)gettid());
+#endif
+
+    debug(D_WEB_CLIENT_ACCESS, "%llu: Releasing the web client of a request from %s port %s.", w->id, w->client_ip, w->client_port);
+
+    web_client_request_done(w);
+    web_client_cache_put(w);
+}
@@ -23,6 +23,11 @@ extern __thread struct clients_cache web_clients_cache;
 
 extern void web_client_release(struct web_client *w);
 extern struct web_client *web_client_get_from_cache_or_allocate();
+
+// the web clients of the requests multiplexed on a connection (i.e. HTTP/2 streams),
+// which are not counted or logged as connections
+extern struct web_client *web_client_get_from_cache_for_request(void);
+extern void web_client_release_request(struct web_client *w);
 extern void web_client_cache_destroy(void);
 extern void web_client_cache_verify(int force);
 
@@ -0,0 +1,410 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "web_server.h"
+
+/*
+ * The web server threads parse the requests. When the API command of a
+ * request is one of the executor endpoints, the thread queues it here and
+ * stops polling the socket of the client. An executor thread runs the API
+ * callback, which fills the response of the client, and gives the client
+ * back to the web server thread that queued it, which sends the HTTP header
+ * and the response from its own poll loop.
+ *
+ * The client is owned by the executor while its query runs: if its socket
+ * is closed in the meantime, the web server thread releases it when the
+ * query completes. A web server thread that exits drops its queued queries
+ * and waits for its running ones, since its clients are freed with it.
+ *
+ * The host of a query is found again by its machine guid when the query
+ * starts, since it may have been freed while the query was waiting.
+ *
+ * The queue is FIFO, but a query is skipped while its endpoint runs as many
+ * queries as it is allowed to, so that i.e. badges can be served while data
+ * queries wait. When the queue is full the query is rejected with 503.
+ */
+
+struct web_executor_job {
+    struct web_client *w;
+    char machine_guid[GUID_LEN + 1];
+    uint32_t hash_machine_guid;
+    int (*callback)(RRDHOST *, struct web_client *, char *);
+    char *url;
+
+    WEB_EXECUTOR_ENDPOINT *endpoint;
+    usec_t queued_ut;
+
+    web_executor_done_t done;
+    void *done_data;
+
+    struct web_executor_job *prev;
+    struct web_executor_job *next;
+};
+
+struct web_executor_thread {
+    netdata_thread_t thread;
+    volatile int running;
+    struct web_executor_job *job;       // the job being run, until its client has been given back - under the mutex
+};
+
+static struct web_executor {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t done_cond;           // signaled when a job has been given back
+
+    WEB_EXECUTOR_ENDPOINT *endpoints;
+
+    size_t threads;
+    size_t queue_size;
+    struct web_executor_thread *thread_list;
+    volatile size_t threads_running;
+    volatile int stopping;
+
+    // protected by the mutex
+    struct web_executor_job *queue;     // prev of the first is the last
+    size_t queued;
+    size_t running;
+
+    size_t submitted;
+    size_t completed;
+    size_t rejected;
+} executor = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+// the web server thread submitting queries
+static __thread web_executor_done_t executor_done = NULL;
+static __thread void *executor_done_data = NULL;
+
+WEB_EXECUTOR_ENDPOINT *web_executor_endpoint_add(const char *name) {
+    WEB_EXECUTOR_ENDPOINT *ep = callocz(1, sizeof(WEB_EXECUTOR_ENDPOINT));
+    ep->name = strdupz(name);
+
+    pthread_mutex_lock(&executor.mutex);
+    ep->next = executor.endpoints;
+    executor.endpoints = ep;
+    pthread_mutex_unlock(&executor.mutex);
+
+    return ep;
+}
+
+WEB_EXECUTOR_ENDPOINT *web_executor_endpoints(void) {
+    return executor.endpoints;
+}
+
+void web_executor_register_thread(web_executor_done_t done, void *data) {
+    executor_done = done;
+    executor_done_data = data;
+}
+
+static void web_executor_unlink(struct web_executor_job *job);
+
+// the jobs being run for the web server thread that registered data - the caller has the mutex
+static size_t web_executor_running_for(void *data) {
+    size_t i, count = 0;
+
+    for(i = 0; i < executor.threads ; i++) {
+        struct web_executor_job *job = executor.thread_list[i].job;
+        if(job && job->done_data == data)
+            count++;
+    }
+
+    return count;
+}
+
+void web_executor_unregister_thread(void) {
+    void *data = executor_done_data;
+
+    executor_done = NULL;
+    executor_done_data = NULL;
+
+    if(!data || !executor.thread_list)
+        return;
+
+    pthread_mutex_lock(&executor.mutex);
+
+    struct web_executor_job *job, *next;
+    size_t dropped = 0;
+    for(job = executor.queue; job ; job = next) {
+        next = job->next;
+        if(job->done_data != data)
+            continue;
+
+        web_executor_unlink(job);
+        job->endpoint->queued--;
+        executor.queued--;
+        web_client_flag_clear(job->w, WEB_CLIENT_FLAG_EXECUTOR);
+        freez(job);
+        dropped++;
+    }
+
+    while(web_executor_running_for(data))
+        pthread_cond_wait(&executor.done_cond, &executor.mutex);
+
+    pthread_mutex_unlock(&executor.mutex);
+
+    if(dropped)
+        info("WEB EXECUTOR: dropped %zu queued queries of an exiting web server thread.", dropped);
+}
+
+int web_executor_can_submit(struct web_client *w, RRDHOST *host) {
+    (void)w;
+
+    if(!executor.threads_running || !executor_done || executor.stopping)
+        return 0;
+
+    // archived hosts are created for the request and freed when it returns
+    if(rrdhost_flag_check(host, RRDHOST_FLAG_ARCHIVED))
+        return 0;
+
+    return 1;
+}
+
+// the first job of an endpoint that has room for one more running query
+static struct web_executor_job *web_executor_next_job(void) {
+    struct web_executor_job *job;
+
+    for(job = executor.queue; job ; job = job->next) {
+        if(job->endpoint->running < job->endpoint->max_concurrent)
+            return job;
+    }
+
+    return NULL;
+}
+
+int web_executor_submit(struct web_client *w, WEB_EXECUTOR_ENDPOINT *ep, RRDHOST *host, int (*callback)(RRDHOST *, struct web_client *, char *), char *url) {
+    pthread_mutex_lock(&executor.mutex);
+
+    if(unlikely(executor.queued >= executor.queue_size)) {
+        ep->rejected++;
+        executor.rejected++;
+        pthread_mutex_unlock(&executor.mutex);
+
+        buffer_flush(w->response.data);
+        w->response.data->contenttype = CT_TEXT_PLAIN;
+        buffer_strcat(w->response.data, "Too many queries are waiting to run. Please try again later.");
+        return HTTP_RESP_BACKEND_FETCH_FAILED;
+    }
+
+    struct web_executor_job *job = mallocz(sizeof(struct web_executor_job));
+    job->w = w;
+    strncpyz(job->machine_guid, host->machine_guid, GUID_LEN);
+    job->hash_machine_guid = host->hash_machine_guid;
+    job->callback = callback;
+    job->url = url;
+    job->endpoint = ep;
+    job->queued_ut = now_monotonic_usec();
+    job->done = executor_done;
+    job->done_data = executor_done_data;
+    job->next = NULL;
+
+    if(executor.queue) {
+        job->prev = executor.queue->prev;
+        executor.queue->prev->next = job;
+        executor.queue->prev = job;
+    }
+    else {
+        job->prev = job;
+        executor.queue = job;
+    }
+
+    ep->queued++;
+    ep->submitted++;
+    executor.queued++;
+    executor.submitted++;
+
+    web_client_flag_set(w, WEB_CLIENT_FLAG_EXECUTOR);
+
+    pthread_cond_signal(&executor.cond);
+    pthread_mutex_unlock(&executor.mutex);
+
+    debug(D_WEB_CLIENT, "%llu: Queued API command '%s' to the query executor.", w->id, ep->name);
+    return 0;
+}
+
+static void web_executor_unlink(struct web_executor_job *job) {
+    if(job->next)
+        job->next->prev = job->prev;
+    else
+        executor.queue->prev = job->prev;
+
+    if(job == executor.queue)
+        executor.queue = job->next;
+    else
+        job->prev->next = job->next;
+
+    job->prev = job->next = NULL;
+}
+
+static void web_executor_thread_cleanup(void *ptr) {
+    struct web_executor_thread *t = (struct web_executor_thread *)ptr;
+
+    // cancelled while running a job, its client will not be given back
+    pthread_mutex_lock(&executor.mutex);
+    t->job = NULL;
+    pthread_cond_broadcast(&executor.done_cond);
+    pthread_mutex_unlock(&executor.mutex);
+
+    t->running = 0;
+    __atomic_sub_fetch(&executor.threads_running, 1, __ATOMIC_SEQ_CST);
+}
+
+static void web_executor_thread_unlock(void *ptr) {
+    (void)ptr;
+    pthread_mutex_unlock(&executor.mutex);
+}
+
+static void *web_executor_thread(void *ptr) {
+    struct web_executor_thread *t = (struct web_executor_thread *)ptr;
+    netdata_thread_cleanup_push(web_executor_thread_cleanup, ptr);
+
+    while(!netdata_exit && !executor.stopping) {
+        struct web_executor_job *job;
+
+        pthread_mutex_lock(&executor.mutex);
+        netdata_thread_cleanup_push(web_executor_thread_unlock, NULL);
+
+        while(!(job = web_executor_next_job()) && !netdata_exit && !executor.stopping)
+            pthread_cond_wait(&executor.cond, &executor.mutex);
+
+        if(job) {
+            web_executor_unlink(job);
+            job->endpoint->queued--;
+            job->endpoint->running++;
+            executor.queued--;
+            executor.running++;
+            t->job = job;
+        }
+
+        netdata_thread_cleanup_pop(1);
+
+        if(!job)
+            break;
+
+        usec_t started_ut = now_monotonic_usec();
+        histogram_add(&job->endpoint->wait, started_ut - job->queued_ut);
+
+        struct web_client *w = job->w;
+        RRDHOST *host = rrdhost_find_by_guid(job->machine_guid, job->hash_machine_guid);
+        if(likely(host)) {
+            uint64_t points_read = rrdr_query_thread_points_read();
+            w->response.code = job->callback(host, w, job->url);
+            w->stats_db_points_read += rrdr_query_thread_points_read() - points_read;
+        }
+        else {
+            buffer_flush(w->response.data);
+            w->response.data->contenttype = CT_TEXT_PLAIN;
+            buffer_strcat(w->response.data, "This netdata does not maintain a database for host: ");
+            buffer_strcat_htmlescape(w->response.data, job->machine_guid);
+            w->response.code = HTTP_RESP_NOT_FOUND;
+        }
+
+        histogram_add(&job->endpoint->run, now_monotonic_usec() - started_ut);
+
+        job->done(w, job->done_data);
+
+        pthread_mutex_lock(&executor.mutex);
+        t->job = NULL;
+        job->endpoint->running--;
+        job->endpoint->completed++;
+        executor.running--;
+        executor.completed++;
+
+        // a query of this endpoint may have been waiting for it
+        if(executor.queued)
+            pthread_cond_signal(&executor.cond);
+
+        // and the web server thread of the client may be waiting to exit
+        pthread_cond_broadcast(&executor.done_cond);
+        pthread_mutex_unlock(&executor.mutex);
+
+        freez(job);
+    }
+
+    netdata_thread_cleanup_pop(1);
+    return NULL;
+}
+
+void web_executor_start(void) {
+    long long threads = config_get_number(CONFIG_SECTION_WEB, "query executor threads", (processors > 4) ? 4 : processors);
+    long long queue_size = config_get_number(CONFIG_SECTION_WEB, "query executor queue size", 1000);
+
+    if(threads <= 0) {
+        info("WEB EXECUTOR: disabled, the API queries will run in the web server threads.");
+        return;
+    }
+
+    if(queue_size < 1) queue_size = 1;
+
+    executor.threads = (size_t)threads;
+    executor.queue_size = (size_t)queue_size;
+    executor.stopping = 0;
+
+    WEB_EXECUTOR_ENDPOINT *ep;
+    for(ep = executor.endpoints; ep ; ep = ep->next) {
+        char key[CONFIG_MAX_NAME + 1];
+        snprintfz(key, CONFIG_MAX_NAME, "query executor max concurrent %s", ep->name);
+
+        long long max = config_get_number(CONFIG_SECTION_WEB, key, threads);
+        ep->max_concurrent = (max < 1) ? 1 : (size_t)max;
+    }
+
+    executor.thread_list = callocz(executor.threads, sizeof(struct web_executor_thread));
+
+    size_t i;
+    for(i = 0; i < executor.threads ; i++) {
+        struct web_executor_thread *t = &executor.thread_list[i];
+
+        char tag[NETDATA_THREAD_TAG_MAX + 1];
+        snprintfz(tag, NETDATA_THREAD_TAG_MAX, "WEB_EXECUTOR[%zu]", i + 1);
+
+        t->running = 1;
+        __atomic_add_fetch(&executor.threads_running, 1, __ATOMIC_SEQ_CST);
+        if(netdata_thread_create(&t->thread, tag, NETDATA_THREAD_OPTION_DEFAULT, web_executor_thread, (void *)t)) {
+            error("WEB EXECUTOR: failed to create thread %zu", i + 1);
+            t->running = 0;
+            __atomic_sub_fetch(&executor.threads_running, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    info("WEB EXECUTOR: started %zu threads, with a queue of %zu queries.", executor.threads, executor.queue_size);
+}
+
+void web_executor_stop(void) {
+    if(!executor.thread_list)
+        return;
+
+    pthread_mutex_lock(&executor.mutex);
+    executor.stopping = 1;
+    pthread_cond_broadcast(&executor.cond);
+    pthread_mutex_unlock(&executor.mutex);
+
+    usec_t max = 2 * USEC_PER_SEC, step = 50000;
+    while(__atomic_load_n(&executor.threads_running, __ATOMIC_SEQ_CST) && max > 0) {
+        sleep_usec(step);
+        max -= step;
+    }
+
+    // the threads still running are in long queries
+    if(__atomic_load_n(&executor.threads_running, __ATOMIC_SEQ_CST)) {
+        size_t i;
+        error("WEB EXECUTOR: %zu threads are taking too long to finish, cancelling them.", executor.threads_running);
+        for(i = 0; i < executor.threads ; i++) {
+            if(executor.thread_list[i].running)
+                netdata_thread_cancel(executor.thread_list[i].thread);
+        }
+    }
+}
+
+void web_executor_get_statistics(WEB_EXECUTOR_STATISTICS *stats) {
+    pthread_mutex_lock(&executor.mutex);
+    stats->threads = executor.threads;
+    stats->queue_size = executor.queue_size;
+    stats->queued = executor.queued;
+    stats->running = executor.running;
+    stats->submitted = executor.submitted;
+    stats->completed = executor.completed;
+    stats->rejected = executor.rejected;
+    pthread_mutex_unlock(&executor.mutex);
+}
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_WEB_EXECUTOR_H
+#define NETDATA_WEB_EXECUTOR_H 1
+
+#include "web_client.h"
+
+// ----------------------------------------------------------------------------
+// query executor
+//
+// The API endpoints that may run for long (i.e. /api/v1/data on months of
+// data) are run by a pool of threads, instead of the web server thread that
+// received the request, so that the other clients of that thread are not
+// kept waiting. When the query finishes, the web server thread that
+// submitted it is notified to send the response.
+
+typedef struct web_executor_endpoint {
+    const char *name;
+    size_t max_concurrent;              // the queries of this endpoint that may run at the same time
+
+    // protected by the executor mutex
+    size_t queued;                      // waiting for a thread
+    size_t running;                     // being run by a thread
+
+    size_t submitted;
+    size_t completed;
+    size_t rejected;                    // the queue was full
+
+    HISTOGRAM wait;                     // usec from submission to start
+    HISTOGRAM run;                      // usec running
+    HISTOGRAM wait_charted;             // the state of wait when last charted
+    HISTOGRAM run_charted;              // the state of run when last charted
+
+    struct web_executor_endpoint *next;
+} WEB_EXECUTOR_ENDPOINT;
+
+typedef struct web_executor_statistics {
+    size_t threads;
+    size_t queue_size;
+
+    size_t queued;
+    size_t running;
+
+    size_t submitted;
+    size_t completed;
+    size_t rejected;
+} WEB_EXECUTOR_STATISTICS;
+
+// called by the web server threads with the client that finished its query
+typedef void (*web_executor_done_t)(struct web_client *w, void *data);
+
+// the endpoints are added before the executor is started
+extern WEB_EXECUTOR_ENDPOINT *web_executor_endpoint_add(const char *name);
+extern WEB_EXECUTOR_ENDPOINT *web_executor_endpoints(void);
+
+extern void web_executor_start(void);
+extern void web_executor_stop(void);
+
+// the calling thread can submit queries, completed queries are given to done()
+extern void web_executor_register_thread(web_executor_done_t done, void *data);
+
+// the calling thread is exiting: its queued queries are dropped and its running ones are waited for
+extern void web_executor_unregister_thread(void);
+
+// returns 1 when the query can be run by the executor
+extern int web_executor_can_submit(struct web_client *w, struct rrdhost *host);
+
+// queue the query and set WEB_CLIENT_FLAG_EXECUTOR on the client,
+// or return HTTP_RESP_BACKEND_FETCH_FAILED when the queue is full
+extern int web_executor_submit(struct web_client *w, WEB_EXECUTOR_ENDPOINT *ep, struct rrdhost *host, int (*callback)(struct rrdhost *, struct web_client *, char *), char *url);
+
+extern void web_executor_get_statistics(WEB_EXECUTOR_STATISTICS *stats);
+
+#endif //NETDATA_WEB_EXECUTOR_H
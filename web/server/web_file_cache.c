@@ -0,0 +1,293 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "web_server.h"
+
+/*
+ * The cache is indexed by the filename requested, so a hit costs a lookup
+ * and the copy of the file to the response buffer, instead of an lstat(),
+ * an open() and the reads of the file, and compressing it on every response.
+ *
+ * The files are checked (regular, owned by the web files user and group)
+ * when they are loaded. The files that do not fit in the cache, or cannot be
+ * loaded, are left to mysendfile() to serve from disk, or to respond with the
+ * proper error.
+ */
+
+struct web_file {
+    uint8_t contenttype;
+    time_t mtime;
+
+    char *data;
+    size_t size;
+
+    char *gzip;                         // NULL when the file does not compress
+    size_t gzip_size;
+
+    char *brotli;                       // NULL when the file does not compress
+    size_t brotli_size;
+
+    char etag[50];
+    char etag_gzip[50];
+    char etag_brotli[50];
+};
+
+static struct web_file_cache {
+    int enabled;
+    size_t max_size;
+
+    netdata_rwlock_t rwlock;
+    DICTIONARY *files;
+    size_t size;                        // the bytes of the files in the cache
+} cache = {
+    .enabled = 0,
+    .max_size = 64 * 1024 * 1024,
+    .rwlock = PTHREAD_RWLOCK_INITIALIZER,
+    .files = NULL,
+    .size = 0,
+};
+
+static inline size_t web_file_memory_size(struct web_file *f) {
+    return sizeof(struct web_file) + f->size + f->gzip_size + f->brotli_size;
+}
+
+static void web_file_free(struct web_file *f) {
+    memory_accounting_free(MEMORY_ACCOUNTING_WEB, web_file_memory_size(f));
+    freez(f->brotli);
+    freez(f->gzip);
+    freez(f->data);
+    freez(f);
+}
+
+#ifdef NETDATA_WITH_ZLIB
+// keep a gzip copy of the file, when it is at least 10% smaller
+static void web_file_compress(struct web_file *f) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+
+    // windowbits = 15 + 16 for gzip
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+
+    size_t bound = deflateBound(&zs, (uLong)f->size);
+    char *out = mallocz(bound);
+
+    zs.next_in = (Bytef *)f->data;
+    zs.avail_in = (uInt)f->size;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = (uInt)bound;
+
+    if(deflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out < f->size - f->size / 10) {
+        f->gzip = reallocz(out, zs.total_out);
+        f->gzip_size = zs.total_out;
+    }
+    else
+        freez(out);
+
+    deflateEnd(&zs);
+}
+#endif
+
+#ifdef ENABLE_BROTLI
+// keep a brotli copy of the file, when it is at least 10% smaller
+static void web_file_compress_brotli(struct web_file *f) {
+    size_t size = BrotliEncoderMaxCompressedSize(f->size);
+    if(!size)
+        return;
+
+    char *out = mallocz(size);
+
+    if(BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, f->size, (const uint8_t *)f->data, &size, (uint8_t *)out)
+       && size < f->size - f->size / 10) {
+        f->brotli = reallocz(out, size);
+        f->brotli_size = size;
+    }
+    else
+        freez(out);
+}
+#endif
+
+static struct web_file *web_file_load(const char *filename, size_t max_size) {
+    char path[FILENAME_MAX + 1];
+    snprintfz(path, FILENAME_MAX, "%s/%s", netdata_configured_web_dir, filename);
+
+    struct stat st;
+    if(lstat(path, &st) != 0)
+        return NULL;
+
+    if((st.st_mode & S_IFMT) == S_IFDIR) {
+        snprintfz(path, FILENAME_MAX, "%s/%s/index.html", netdata_configured_web_dir, filename);
+        if(lstat(path, &st) != 0)
+            return NULL;
+    }
+
+    if((st.st_mode & S_IFMT) != S_IFREG || st.st_uid != web_files_uid() || st.st_gid != web_files_gid())
+        return NULL;
+
+    if((size_t)st.st_size > max_size)
+        return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if(fd == -1)
+        return NULL;
+
+    struct web_file *f = callocz(1, sizeof(struct web_file));
+    f->size = (size_t)st.st_size;
+    f->data = mallocz(f->size + 1);
+
+    size_t done = 0;
+    while(done < f->size) {
+        ssize_t bytes = read(fd, &f->data[done], f->size - done);
+        if(bytes <= 0) break;
+        done += bytes;
+    }
+    close(fd);
+
+    if(done != f->size) {
+        freez(f->data);
+        freez(f);
+        return NULL;
+    }
+
+    f->contenttype = contenttype_for_filename(path);
+#ifdef __APPLE__
+    f->mtime = st.st_mtimespec.tv_sec;
+#else
+    f->mtime = st.st_mtim.tv_sec;
+#endif
+
+#ifdef NETDATA_WITH_ZLIB
+    web_file_compress(f);
+#endif
+#ifdef ENABLE_BROTLI
+    web_file_compress_brotli(f);
+#endif
+
+    // a strong ETag, from the contents of the file
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for(i = 0; i < f->size ; i++) {
+        hash ^= (unsigned char)f->data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    snprintfz(f->etag, sizeof(f->etag) - 1, "\"%zx-%016" PRIx64 "\"", f->size, hash);
+    snprintfz(f->etag_gzip, sizeof(f->etag_gzip) - 1, "\"%zx-%016" PRIx64 "-gz\"", f->size, hash);
+    snprintfz(f->etag_brotli, sizeof(f->etag_brotli) - 1, "\"%zx-%016" PRIx64 "-br\"", f->size, hash);
+
+    memory_accounting_alloc(MEMORY_ACCOUNTING_WEB, web_file_memory_size(f));
+    return f;
+}
+
+// called with the cache read locked
+static int web_file_send(struct web_client *w, struct web_file *f) {
+    // prefer brotli, it is smaller
+    int brotli = (f->brotli && web_client_flag_check(w, WEB_CLIENT_FLAG_ACCEPT_BROTLI));
+    int gzip = (!brotli && f->gzip && web_client_flag_check(w, WEB_CLIENT_FLAG_ACCEPT_GZIP));
+    const char *etag = brotli ? f->etag_brotli : gzip ? f->etag_gzip : f->etag;
+
+    // the file is sent as it is, or already compressed
+    web_client_disable_deflate(w);
+
+    buffer_flush(w->response.data);
+    w->response.data->contenttype = f->contenttype;
+    w->response.data->date = f->mtime;
+    buffer_cacheable(w->response.data);
+
+    buffer_sprintf(w->response.header, "ETag: %s\r\n", etag);
+    if(f->gzip || f->brotli)
+        buffer_strcat(w->response.header, "Vary: Accept-Encoding\r\n");
+
+    if(web_client_etag_matches(w, etag))
+        return HTTP_RESP_NOT_MODIFIED;
+
+    const char *data = f->data;
+    size_t size = f->size;
+    if(brotli) {
+        buffer_strcat(w->response.header, "Content-Encoding: br\r\n");
+        data = f->brotli;
+        size = f->brotli_size;
+    }
+    else if(gzip) {
+        buffer_strcat(w->response.header, "Content-Encoding: gzip\r\n");
+        data = f->gzip;
+        size = f->gzip_size;
+    }
+
+    web_client_reserve_response(w, size + 1);
+    memcpy(w->response.data->buffer, data, size);
+    w->response.data->len = size;
+    w->response.data->buffer[size] = '\0';
+
+    return HTTP_RESP_OK;
+}
+
+int web_file_cache_send(struct web_client *w, const char *filename) {
+    if(!cache.enabled)
+        return 0;
+
+    netdata_rwlock_rdlock(&cache.rwlock);
+    struct web_file *f = dictionary_get(cache.files, filename);
+    if(likely(f)) {
+        int code = web_file_send(w, f);
+        netdata_rwlock_unlock(&cache.rwlock);
+        return code;
+    }
+    size_t available = (cache.size < cache.max_size) ? cache.max_size - cache.size : 0;
+    netdata_rwlock_unlock(&cache.rwlock);
+
+    f = web_file_load(filename, available);
+    if(!f)
+        return 0;
+
+    netdata_rwlock_wrlock(&cache.rwlock);
+    struct web_file *t = dictionary_get(cache.files, filename);
+    if(t) {
+        // another thread loaded it meanwhile
+        web_file_free(f);
+        f = t;
+    }
+    else if(cache.size + f->size + f->gzip_size + f->brotli_size > cache.max_size) {
+        netdata_rwlock_unlock(&cache.rwlock);
+        web_file_free(f);
+        return 0;
+    }
+    else {
+        dictionary_set(cache.files, filename, f, sizeof(struct web_file));
+        cache.size += f->size + f->gzip_size + f->brotli_size;
+        debug(D_WEB_CLIENT, "%llu: Cached web file '%s' (%zu bytes, %zu gzipped, %zu brotli).", w->id, filename, f->size, f->gzip_size, f->brotli_size);
+    }
+
+    int code = web_file_send(w, f);
+    netdata_rwlock_unlock(&cache.rwlock);
+    return code;
+}
+
+static int web_file_free_callback(void *entry, void *data) {
+    (void)data;
+    web_file_free((struct web_file *)entry);
+    return 0;
+}
+
+void web_file_cache_invalidate(void) {
+    if(!cache.enabled)
+        return;
+
+    netdata_rwlock_wrlock(&cache.rwlock);
+    dictionary_get_all(cache.files, web_file_free_callback, NULL);
+    dictionary_destroy(cache.files);
+    cache.files = dictionary_create(DICTIONARY_FLAG_SINGLE_THREADED | DICTIONARY_FLAG_VALUE_LINK_DONT_CLONE);
+    cache.size = 0;
+    netdata_rwlock_unlock(&cache.rwlock);
+
+    info("WEB FILES: the cache of the web files has been emptied.");
+}
+
+void web_file_cache_init(void) {
+    cache.enabled = config_get_boolean(CONFIG_SECTION_WEB, "enable web files cache", CONFIG_BOOLEAN_YES);
+
+    long long mb = config_get_number(CONFIG_SECTION_WEB, "web files cache size MB", (long long)(cache.max_size / 1024 / 1024));
+    if(mb < 1) cache.enabled = 0;
+    else cache.max_size = (size_t)mb * 1024 * 1024;
+
+    if(cache.enabled)
+        cache.files = dictionary_create(DICTIONARY_FLAG_SINGLE_THREADED | DICTIONARY_FLAG_VALUE_LINK_DONT_CLONE);
+}
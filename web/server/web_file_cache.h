@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NETDATA_WEB_FILE_CACHE_H
+#define NETDATA_WEB_FILE_CACHE_H 1
+
+#include "web_client.h"
+
+// ----------------------------------------------------------------------------
+// static web files cache
+//
+// The files of the dashboard are read from disk the first time they are
+// requested, with gzip (and brotli) compressed copies for the ones that
+// compress, and are then served from memory with a strong ETag, so that
+// browsers revalidating them get 304 Not Modified. The cache is emptied on
+// SIGHUP.
+
+extern void web_file_cache_init(void);
+
+// returns the HTTP response code, or 0 when the file cannot be served from the cache
+extern int web_file_cache_send(struct web_client *w, const char *filename);
+
+extern void web_file_cache_invalidate(void);
+
+#endif //NETDATA_WEB_FILE_CACHE_H
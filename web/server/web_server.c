@@ -57,12 +57,62 @@ void debug_sockets() {
 	buffer_free(wb);
 }
 
+// The web server threads may have listening sockets of their own, with
+// SO_REUSEPORT, so that the kernel balances the connections among them.
+// They are opened here, before netdata drops its privileges, since the sockets
+// of a SO_REUSEPORT group must belong to the same user.
+// The first thread listens on api_sockets.
+static LISTEN_SOCKETS *api_threads_sockets = NULL;
+static size_t api_threads_sockets_count = 0;
+
+static void api_threads_sockets_setup(void) {
+	if(web_server_mode != WEB_SERVER_MODE_STATIC_THREADED)
+		return;
+
+	if(!config_get_boolean(CONFIG_SECTION_WEB, "listen sockets per thread", CONFIG_BOOLEAN_NO))
+		return;
+
+	size_t threads = (size_t)static_threaded_workers_setup();
+	if(threads < 2)
+		return;
+
+	api_threads_sockets = callocz(threads, sizeof(LISTEN_SOCKETS));
+	api_threads_sockets_count = threads;
+
+	size_t i, opened = 0;
+	for(i = 1; i < threads ; i++)
+		opened += listen_sockets_clone_reuseport(&api_threads_sockets[i], &api_sockets);
+
+	info("LISTENER: opened %zu SO_REUSEPORT listening sockets for %zu web server threads.", opened, threads - 1);
+}
+
+LISTEN_SOCKETS *api_thread_listen_sockets(int thread) {
+	if(thread > 0 && (size_t)thread < api_threads_sockets_count && api_threads_sockets[thread].opened)
+		return &api_threads_sockets[thread];
+
+	return &api_sockets;
+}
+
+void api_listen_sockets_close(void) {
+	size_t i;
+	for(i = 1; i < api_threads_sockets_count ; i++)
+		listen_sockets_close(&api_threads_sockets[i]);
+
+	freez(api_threads_sockets);
+	api_threads_sockets = NULL;
+	api_threads_sockets_count = 0;
+
+	listen_sockets_close(&api_sockets);
+}
+
 void api_listen_sockets_setup(void) {
 	int socks = listen_sockets_setup(&api_sockets);
 
 	if(!socks)
 		fatal("LISTENER: Cannot listen on any API socket. Exiting...");
 
+	api_threads_sockets_setup();
+
 	if(unlikely(debug_flags & D_WEB_CLIENT))
 		debug_sockets();
 
@@ -150,6 +200,7 @@ void web_client_initialize_connection(struct web_client *w) {
     w->origin[0] = '*'; w->origin[1] = '\0';
     w->cookie1[0] = '\0'; w->cookie2[0] = '\0';
     freez(w->user_agent); w->user_agent = NULL;
+    freez(w->if_none_match); w->if_none_match = NULL;
 
     web_client_enable_wait_receive(w);
 
@@ -49,6 +49,8 @@ extern long web_client_streaming_rate_t;
 
 #ifdef WEB_SERVER_INTERNALS
 extern LISTEN_SOCKETS api_sockets;
+extern LISTEN_SOCKETS *api_thread_listen_sockets(int thread);
+extern void api_listen_sockets_close(void);
 extern void web_client_update_acl_matches(struct web_client *w);
 extern void web_server_log_connection(struct web_client *w, const char *msg);
 extern void web_client_initialize_connection(struct web_client *w);
@@ -57,6 +59,10 @@ extern struct web_client *web_client_create_on_listenfd(int listener);
 #include "web_client_cache.h"
 #endif // WEB_SERVER_INTERNALS
 
+#include "web_executor.h"
+#include "http2.h"
+#include "web_file_cache.h"
+#include "web_buffer_pool.h"
 #include "static/static-threaded.h"
 
 #include "daemon/common.h"